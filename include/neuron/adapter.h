@@ -45,6 +45,26 @@ typedef enum {
     NEU_NODE_STAT_MSGS_RECV,  // number of messages received
     NEU_NODE_STAT_AVG_RTT,    // average round trip time (ms)
 
+    // effective socket options, set by the plugins rather than added up
+    NEU_NODE_STAT_SOCK_NODELAY,         // TCP_NODELAY, 0 or 1
+    NEU_NODE_STAT_SOCK_KEEPALIVE_IDLE,  // s, 0 when keepalive is off
+    NEU_NODE_STAT_SOCK_KEEPALIVE_INTVL, // s
+    NEU_NODE_STAT_SOCK_KEEPALIVE_COUNT, // probes
+    NEU_NODE_STAT_SOCK_RCVBUF,          // SO_RCVBUF (bytes)
+    NEU_NODE_STAT_SOCK_SNDBUF,          // SO_SNDBUF (bytes)
+    NEU_NODE_STAT_SOCK_BUSY_POLL,       // SO_BUSY_POLL (us)
+    NEU_NODE_STAT_SOCK_USER_TIMEOUT,    // TCP_USER_TIMEOUT (ms)
+
+    // kinds of counters maintained by the adapter core
+    NEU_NODE_STAT_CTRL_DEPTH,       // control messages waiting
+    NEU_NODE_STAT_CTRL_DEPTH_MAX,   // highest control queue depth
+    NEU_NODE_STAT_CTRL_LATENCY,     // average control queue latency (us)
+    NEU_NODE_STAT_CTRL_LATENCY_MAX, // longest control queue latency (us)
+    NEU_NODE_STAT_BULK_DEPTH,       // bulk data messages waiting
+    NEU_NODE_STAT_BULK_DEPTH_MAX,   // highest bulk data queue depth
+    NEU_NODE_STAT_BULK_LATENCY,     // average bulk data queue latency (us)
+    NEU_NODE_STAT_BULK_LATENCY_MAX, // longest bulk data queue latency (us)
+
     // kinds of counters maintained by the driver core
     NEU_NODE_STAT_TAG_TOT_CNT, // number of tag read including errors
     NEU_NODE_STAT_TAG_ERR_CNT, // number of tag read errors
@@ -55,14 +75,30 @@ typedef enum {
 static inline const char *neu_node_stat_string(neu_node_stat_e s)
 {
     static const char *map[] = {
-        [NEU_NODE_STAT_BYTES_SENT]  = "bytes_sent",
-        [NEU_NODE_STAT_BYTES_RECV]  = "bytes_received",
-        [NEU_NODE_STAT_MSGS_SENT]   = "messages_sent",
-        [NEU_NODE_STAT_MSGS_RECV]   = "messages_received",
-        [NEU_NODE_STAT_AVG_RTT]     = "average_rtt",
-        [NEU_NODE_STAT_TAG_TOT_CNT] = "tag_total_count",
-        [NEU_NODE_STAT_TAG_ERR_CNT] = "tag_error_count",
-        [NEU_NODE_STAT_MAX]         = NULL,
+        [NEU_NODE_STAT_BYTES_SENT]           = "bytes_sent",
+        [NEU_NODE_STAT_BYTES_RECV]           = "bytes_received",
+        [NEU_NODE_STAT_MSGS_SENT]            = "messages_sent",
+        [NEU_NODE_STAT_MSGS_RECV]            = "messages_received",
+        [NEU_NODE_STAT_AVG_RTT]              = "average_rtt",
+        [NEU_NODE_STAT_SOCK_NODELAY]         = "socket_nodelay",
+        [NEU_NODE_STAT_SOCK_KEEPALIVE_IDLE]  = "socket_keepalive_idle",
+        [NEU_NODE_STAT_SOCK_KEEPALIVE_INTVL] = "socket_keepalive_interval",
+        [NEU_NODE_STAT_SOCK_KEEPALIVE_COUNT] = "socket_keepalive_count",
+        [NEU_NODE_STAT_SOCK_RCVBUF]          = "socket_rcvbuf",
+        [NEU_NODE_STAT_SOCK_SNDBUF]          = "socket_sndbuf",
+        [NEU_NODE_STAT_SOCK_BUSY_POLL]       = "socket_busy_poll_us",
+        [NEU_NODE_STAT_SOCK_USER_TIMEOUT]    = "socket_user_timeout_ms",
+        [NEU_NODE_STAT_CTRL_DEPTH]           = "control_queue_depth",
+        [NEU_NODE_STAT_CTRL_DEPTH_MAX]       = "control_queue_depth_max",
+        [NEU_NODE_STAT_CTRL_LATENCY]         = "control_queue_latency_us",
+        [NEU_NODE_STAT_CTRL_LATENCY_MAX]     = "control_queue_latency_max_us",
+        [NEU_NODE_STAT_BULK_DEPTH]           = "bulk_queue_depth",
+        [NEU_NODE_STAT_BULK_DEPTH_MAX]       = "bulk_queue_depth_max",
+        [NEU_NODE_STAT_BULK_LATENCY]         = "bulk_queue_latency_us",
+        [NEU_NODE_STAT_BULK_LATENCY_MAX]     = "bulk_queue_latency_max_us",
+        [NEU_NODE_STAT_TAG_TOT_CNT]          = "tag_total_count",
+        [NEU_NODE_STAT_TAG_ERR_CNT]          = "tag_error_count",
+        [NEU_NODE_STAT_MAX]                  = NULL,
     };
 
     return map[s];
@@ -105,6 +141,9 @@ typedef enum neu_reqresp_type {
     NEU_REQ_NODE_CTL,
     NEU_REQ_GET_NODE_STAT,
     NEU_RESP_GET_NODE_STAT,
+    NEU_REQ_NODE_CAPTURE,
+    NEU_REQ_GET_NODE_CAPTURE,
+    NEU_RESP_GET_NODE_CAPTURE,
 
     NEU_REQ_ADD_GROUP,
     NEU_REQ_DEL_GROUP,
@@ -130,6 +169,11 @@ typedef enum neu_reqresp_type {
     NEU_REQRESP_TRANS_DATA,
     NEU_REQRESP_NODES_STATE,
     NEU_REQRESP_NODE_DELETED,
+
+    NEU_REQRESP_TRANS_DATA_PACKED,
+    NEU_REQ_GET_TAG_DICT,
+    NEU_RESP_GET_TAG_DICT,
+    NEU_RESP_SUBSCRIBE_GROUP,
 } neu_reqresp_type_e;
 
 typedef enum {
@@ -168,6 +212,9 @@ static const char *neu_reqresp_type_string_t[] = {
     [NEU_REQ_NODE_CTL]          = "NEU_REQ_NODE_CTL",
     [NEU_REQ_GET_NODE_STAT]     = "NEU_REQ_GET_NODE_STAT",
     [NEU_RESP_GET_NODE_STAT]    = "NEU_RESP_GET_NODE_STAT",
+    [NEU_REQ_NODE_CAPTURE]      = "NEU_REQ_NODE_CAPTURE",
+    [NEU_REQ_GET_NODE_CAPTURE]  = "NEU_REQ_GET_NODE_CAPTURE",
+    [NEU_RESP_GET_NODE_CAPTURE] = "NEU_RESP_GET_NODE_CAPTURE",
 
     [NEU_REQ_ADD_GROUP]         = "NEU_REQ_ADD_GROUP",
     [NEU_REQ_DEL_GROUP]         = "NEU_REQ_DEL_GROUP",
@@ -193,6 +240,11 @@ static const char *neu_reqresp_type_string_t[] = {
     [NEU_REQRESP_TRANS_DATA]   = "NEU_REQRESP_TRANS_DATA",
     [NEU_REQRESP_NODES_STATE]  = "NEU_REQRESP_NODES_STATE",
     [NEU_REQRESP_NODE_DELETED] = "NEU_REQRESP_NODE_DELETED",
+
+    [NEU_REQRESP_TRANS_DATA_PACKED] = "NEU_REQRESP_TRANS_DATA_PACKED",
+    [NEU_REQ_GET_TAG_DICT]          = "NEU_REQ_GET_TAG_DICT",
+    [NEU_RESP_GET_TAG_DICT]         = "NEU_RESP_GET_TAG_DICT",
+    [NEU_RESP_SUBSCRIBE_GROUP]      = "NEU_RESP_SUBSCRIBE_GROUP",
 };
 
 inline static const char *neu_reqresp_type_string(neu_reqresp_type_e type)
@@ -330,11 +382,26 @@ typedef struct neu_resp_get_tag {
     UT_array *tags; // array neu_datatag_t
 } neu_resp_get_tag_t;
 
+typedef struct {
+    char     app[NEU_NODE_NAME_LEN];
+    char     driver[NEU_NODE_NAME_LEN];
+    char     group[NEU_GROUP_NAME_LEN];
+    uint16_t n_filter;
+    char **  filters; // tag name patterns(fnmatch), all tags if n_filter is 0
+} neu_req_subscribe_t;
+
 typedef struct {
     char app[NEU_NODE_NAME_LEN];
     char driver[NEU_NODE_NAME_LEN];
     char group[NEU_GROUP_NAME_LEN];
-} neu_req_subscribe_t, neu_req_unsubscribe_t;
+} neu_req_unsubscribe_t;
+
+// sent by the driver once it packs the filtered trans data for the app
+typedef struct {
+    char app[NEU_NODE_NAME_LEN];
+    char driver[NEU_NODE_NAME_LEN];
+    char group[NEU_GROUP_NAME_LEN];
+} neu_resp_subscribe_t;
 
 typedef struct neu_req_get_subscribe_group {
     char app[NEU_NODE_NAME_LEN];
@@ -426,6 +493,21 @@ typedef struct neu_resp_get_node_stat {
     uint64_t        data[NEU_NODE_STAT_MAX];
 } neu_resp_get_node_stat_t;
 
+typedef struct neu_req_node_capture {
+    char     node[NEU_NODE_NAME_LEN];
+    bool     enable;
+    uint32_t size; // bytes of the capture ring
+} neu_req_node_capture_t;
+
+typedef struct neu_req_get_node_capture {
+    char node[NEU_NODE_NAME_LEN];
+} neu_req_get_node_capture_t;
+
+typedef struct neu_resp_get_node_capture {
+    uint8_t *data; // pcapng file, freed by the receiver
+    size_t   len;
+} neu_resp_get_node_capture_t;
+
 typedef struct neu_req_update_license {
 } neu_req_update_license_t;
 
@@ -460,12 +542,78 @@ typedef struct {
     neu_resp_tag_value_t tags[];
 } neu_reqresp_trans_data_t;
 
+/**
+ * Packed trans data, every tag is encoded as
+ *   | slot(2) | type(1) | value(n) | timestamp(8, optional) |
+ * The slot indexes the tag name dictionary of the group version. The
+ * NEU_TRANS_DATA_TIMESTAMP bit of type marks the timestamp, the time in ms the
+ * value was read, set when the driver has it. String values carry a 1 byte
+ * length, float and double values carry the precision after the value.
+ */
+#define NEU_TRANS_DATA_TIMESTAMP 0x80
+
+typedef struct {
+    char     driver[NEU_NODE_NAME_LEN];
+    char     group[NEU_GROUP_NAME_LEN];
+    int64_t  version;
+    uint16_t n_tag;
+    uint32_t size;
+    uint8_t  data[];
+} neu_reqresp_trans_data_packed_t;
+
+typedef struct {
+    char driver[NEU_NODE_NAME_LEN];
+    char group[NEU_GROUP_NAME_LEN];
+} neu_req_get_tag_dict_t;
+
+typedef struct {
+    char      driver[NEU_NODE_NAME_LEN];
+    char      group[NEU_GROUP_NAME_LEN];
+    int64_t   version;
+    UT_array *names; // array char *, indexed by tag slot
+} neu_resp_get_tag_dict_t;
+
 typedef struct {
     char node[NEU_NODE_NAME_LEN];
 } neu_reqresp_node_deleted_t;
 
 void *neu_msg_gen(neu_reqresp_head_t *header, void *data);
 
+/**
+ * @brief Pack one tag value into buf.
+ *
+ * @param[in] buf Output buffer, NULL to query the packed size.
+ * @param[in] size Size of buf.
+ * @param[in] slot Tag slot in the group dictionary.
+ * @param[in] value Tag value.
+ * @param[in] timestamp Optional timestamp of the value, could be NULL.
+ * @return The number of bytes packed, -1 when buf is too small.
+ */
+int neu_trans_data_pack(uint8_t *buf, size_t size, uint16_t slot,
+                        neu_dvalue_t *value, int64_t *timestamp);
+/**
+ * @brief Unpack one tag value from buf.
+ *
+ * @param[in] buf Packed tags.
+ * @param[in] size Size of buf.
+ * @param[out] slot Tag slot in the group dictionary.
+ * @param[out] value Tag value.
+ * @param[out] timestamp Timestamp of the value, 0 when it is not packed.
+ * @return The number of bytes unpacked, -1 on malformed data.
+ */
+int neu_trans_data_unpack(uint8_t *buf, size_t size, uint16_t *slot,
+                          neu_dvalue_t *value, int64_t *timestamp);
+/**
+ * @brief Decode all tags of the packed trans data.
+ *
+ * @param[in] packed Packed trans data.
+ * @param[in] names Tag name dictionary of packed->version.
+ * @param[out] data Must have room for packed->n_tag tags.
+ * @return 0 on success, -1 on malformed data or unknown slots.
+ */
+int neu_trans_data_decode(neu_reqresp_trans_data_packed_t *packed,
+                          UT_array *names, neu_reqresp_trans_data_t *data);
+
 inline static void neu_msg_exchange(neu_reqresp_head_t *header)
 {
     char tmp[NEU_NODE_NAME_LEN] = { 0 };
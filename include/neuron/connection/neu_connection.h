@@ -20,7 +20,9 @@
 #ifndef NEURON_CONNECTION_H
 #define NEURON_CONNECTION_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "utils/protocol_buf.h"
@@ -69,9 +71,43 @@ typedef enum neu_conn_tty_flow {
 
 typedef void (*neu_conn_callback)(void *ctx, int fd);
 
+// socket options, 0 keeps the system default
+typedef struct neu_conn_tune {
+    bool     nodelay;            // tcp, disable the nagle algorithm
+    uint16_t keepalive_idle;     // tcp, s, keepalive is on when not 0
+    uint16_t keepalive_interval; // tcp, s
+    uint16_t keepalive_count;    // tcp, probes before the peer is dead
+    uint32_t rcvbuf;             // bytes
+    uint32_t sndbuf;             // bytes
+    uint32_t busy_poll;          // us
+    uint32_t user_timeout;       // tcp, ms, unacknowledged data drops the link
+} neu_conn_tune_t;
+
+// the high bits of a tag tell the member of a shared session
+#define NEU_CONN_TAG_BITS 12
+#define NEU_CONN_TAG_MASK ((1 << NEU_CONN_TAG_BITS) - 1)
+// nodes sharing an endpoint, and sessions to an endpoint
+#define NEU_CONN_POOL_MAX_MEMBER (1 << (16 - NEU_CONN_TAG_BITS))
+#define NEU_CONN_POOL_MAX_SESSION 8
+// requests in flight on a session
+#define NEU_CONN_POOL_MAX_WINDOW 64
+
+/**
+ * How the frames of a pooled session are told apart. Each request carries a
+ * tag taken in the range given by neu_conn_tag_base, which the device echoes
+ * in the response, the modbus tcp transaction id for example.
+ */
+typedef struct neu_conn_framing {
+    // size of the frame at the head of buf, 0 if more bytes are needed, -1 if
+    // the stream is out of sync
+    int (*frame_size)(const uint8_t *buf, size_t len);
+    uint16_t (*frame_tag)(const uint8_t *buf, size_t len);
+} neu_conn_framing_t;
+
 typedef struct neu_conn_param {
     zlog_category_t *log;
     neu_conn_type_e  type;
+    neu_conn_tune_t  tune; // tcp and udp only
 
     union {
         struct {
@@ -81,12 +117,24 @@ typedef struct neu_conn_param {
             int               max_link;
             neu_conn_callback start_listen;
             neu_conn_callback stop_listen;
+            // several listeners on the port, the kernel spreads the clients
+            bool              reuse_port;
         } tcp_server;
 
         struct {
             char *   ip;
             uint16_t port;
             uint16_t timeout; // millisecond
+
+            // with sessions not 0 the requests go through the process wide
+            // connection pool, see neu_conn_tag_base
+            struct {
+                bool     shared;   // with the other nodes of the endpoint
+                uint16_t sessions; // at most NEU_CONN_POOL_MAX_SESSION
+                uint16_t window;   // requests in flight on a session
+                uint16_t timeout;  // ms, a request is not waited for longer
+                const neu_conn_framing_t *framing;
+            } pool;
         } tcp_client;
 
         struct {
@@ -111,6 +159,19 @@ typedef struct neu_conn_param {
 
 typedef struct neu_conn neu_conn_t;
 
+// buffers of one neu_conn_sendv or neu_conn_recvv
+#define NEU_CONN_MAX_IOV 64
+
+typedef struct neu_conn_stat {
+    uint64_t connect_attempts;
+    uint64_t connect_failures;
+    uint64_t connect_latency;     // ms, of the last connect succeeded
+    uint64_t connect_latency_max; // ms
+    // the options the kernel applied to the last socket connected, as
+    // reported by getsockopt, the buffer sizes include the kernel overhead
+    neu_conn_tune_t tune;
+} neu_conn_stat_t;
+
 /**
  * @brief create a new connection.
  *
@@ -150,6 +211,31 @@ void neu_conn_destory(neu_conn_t *conn);
  */
 void neu_conn_disconnect(neu_conn_t *conn);
 
+/**
+ * @brief Get the connect counters and the socket options of the connection.
+ *
+ * @param[in] conn
+ * @param[out] stat
+ */
+void neu_conn_stat(neu_conn_t *conn, neu_conn_stat_t *stat);
+
+/**
+ * @brief Get the range of the tags of the requests sent on a pooled
+ * connection. A node of a shared endpoint owns the tags from the base to base
+ * + mask, the responses are routed to it by the tag. The whole range is owned
+ * by a connection of its own.
+ *
+ * The endpoint is keyed by ip and port, its sessions are connected with the
+ * parameters of the first node joining. A session sends the queued requests
+ * of its nodes in turn, one each, keeping at most the smallest window of them
+ * in flight. A node with several sessions spreads its requests over them.
+ *
+ * @param[in] conn
+ * @param[out] mask
+ * @return The base of the tags.
+ */
+uint16_t neu_conn_tag_base(neu_conn_t *conn, uint16_t *mask);
+
 /**
  * @brief Stop the connection
  *
@@ -195,6 +281,19 @@ int neu_conn_tcp_server_close_client(neu_conn_t *conn, int fd);
  */
 ssize_t neu_conn_send(neu_conn_t *conn, uint8_t *buf, ssize_t len);
 
+/**
+ * @brief Send several buffers in one syscall, a window of pipelined requests
+ * for example. Over tcp the buffers follow each other in the stream, over udp
+ * each buffer is a datagram.
+ *
+ * @param[in] conn
+ * @param[in] iov The buffers, at most NEU_CONN_MAX_IOV.
+ * @param[in] n_iov Number of buffers.
+ * @return The bytes sent as neu_conn_send, or -1 with errno EAGAIN when
+ * nothing could be sent for now and the connection is kept.
+ */
+ssize_t neu_conn_sendv(neu_conn_t *conn, struct iovec *iov, int n_iov);
+
 /**
  * @brief Receive data via connection read.
  *
@@ -206,6 +305,19 @@ ssize_t neu_conn_send(neu_conn_t *conn, uint8_t *buf, ssize_t len);
  */
 ssize_t neu_conn_recv(neu_conn_t *conn, uint8_t *buf, ssize_t len);
 
+/**
+ * @brief Receive several udp datagrams in one syscall, one in each buffer,
+ * only the first one is waited for. A stream is read into the first buffer.
+ *
+ * @param[in] conn
+ * @param[in,out] iov The buffers, at most NEU_CONN_MAX_IOV, the lengths are
+ * set to the sizes received.
+ * @param[in] n_iov Number of buffers.
+ * @return The number of buffers filled, less than or equal to 0 as
+ * neu_conn_recv when nothing is received.
+ */
+int neu_conn_recvv(neu_conn_t *conn, struct iovec *iov, int n_iov);
+
 /**
  * @brief Specify the client to send data.
  *
@@ -55,6 +55,7 @@ typedef enum {
     NEU_ERR_NODE_IS_STOPED         = 2009,
     NEU_ERR_NODE_NAME_TOO_LONG     = 2010,
     NEU_ERR_NODE_NOT_ALLOW_DELETE  = 2011,
+    NEU_ERR_NODE_CAPTURE_NOT_FOUND = 2012,
 
     NEU_ERR_GROUP_ALREADY_SUBSCRIBED = 2101,
     NEU_ERR_GROUP_NOT_SUBSCRIBE      = 2102,
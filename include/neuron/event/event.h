@@ -28,6 +28,20 @@ extern "C" {
 
 typedef struct neu_events neu_events_t;
 
+typedef enum {
+    NEU_EVENT_BACKEND_EPOLL,
+    NEU_EVENT_BACKEND_IO_URING,
+} neu_event_backend_e;
+
+/**
+ * @brief Select the backend of the events created afterwards.
+ * io_uring is the default when neuron is built with NEU_EVENT_URING, epoll is
+ * used when io_uring is not built or not supported by the kernel.
+ *
+ * @param[in] backend
+ */
+void neu_event_set_backend(neu_event_backend_e backend);
+
 /**
  * @brief Creat a new event.
  * When an event is created, a corresponding thread is created, and both
@@ -45,6 +59,21 @@ neu_events_t *neu_event_new(void);
  */
 int neu_event_close(neu_events_t *events);
 
+typedef struct {
+    uint64_t n_poll;    // waits for the events
+    uint64_t n_syscall; // syscalls made by the event thread
+    uint64_t n_event;   // timers and ios handled
+} neu_event_stat_t;
+
+/**
+ * @brief Get the counters of the event thread, they are updated without
+ * locking and only approximate while the thread runs.
+ *
+ * @param[in] events
+ * @param[out] stat
+ */
+void neu_event_stat(neu_events_t *events, neu_event_stat_t *stat);
+
 typedef struct neu_event_timer neu_event_timer_t;
 typedef int (*neu_event_timer_callback)(void *usr_data);
 
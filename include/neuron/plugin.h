@@ -24,6 +24,7 @@
 extern "C" {
 #endif
 
+#include "utils/capture.h"
 #include "utils/utextend.h"
 #include "utils/zlog.h"
 
@@ -47,6 +48,8 @@ typedef struct neu_plugin_common {
     int64_t               timestamp;
 
     zlog_category_t *log;
+    // set by the adapter while the protocol capture is enabled
+    neu_capture_t *capture;
 } neu_plugin_common_t;
 
 typedef struct neu_plugin neu_plugin_t;
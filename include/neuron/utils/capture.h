@@ -0,0 +1,67 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#ifndef _NEU_CAPTURE_H_
+#define _NEU_CAPTURE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NEU_CAPTURE_SIZE_MIN 4096
+#define NEU_CAPTURE_SIZE_DEFAULT (1024 * 1024)
+#define NEU_CAPTURE_SIZE_MAX (64 * 1024 * 1024)
+#define NEU_CAPTURE_SNAPLEN 65535
+// LINKTYPE_USER0, in wireshark map DLT_USER 147 to the protocol dissector
+#define NEU_CAPTURE_LINKTYPE 147
+
+typedef enum {
+    NEU_CAPTURE_RECV = 1,
+    NEU_CAPTURE_SEND = 2,
+} neu_capture_dir_e;
+
+// ring of the raw frames of a node, the oldest frames are overwritten
+typedef struct neu_capture neu_capture_t;
+
+neu_capture_t *neu_capture_new(size_t size);
+void           neu_capture_free(neu_capture_t *capture);
+// drops the captured frames and resizes the ring
+int neu_capture_reset(neu_capture_t *capture, size_t size);
+// safe to call from any thread, frames bigger than the ring are dropped
+void neu_capture_add(neu_capture_t *capture, neu_capture_dir_e dir,
+                     const uint8_t *bytes, size_t n_byte);
+void neu_capture_used(neu_capture_t *capture, size_t *n_frame,
+                      uint64_t *n_drop);
+/**
+ * @brief encode the captured frames, oldest first, as a pcapng file.
+ *
+ * @param[out] data the file, should be freed by the caller.
+ * @param[out] len length of the file.
+ * @return 0 on success, -1 when out of memory.
+ */
+int neu_capture_dump(neu_capture_t *capture, uint8_t **data, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,6 +22,7 @@ config_ **/
 
 #include <inttypes.h>
 
+#include "utils/capture.h"
 #include "utils/zlog.h"
 
 extern zlog_category_t *neuron;
@@ -64,49 +65,46 @@ extern zlog_category_t *neuron;
     zlog((plugin)->common.log, __FILE__, sizeof(__FILE__) - 1, __func__, \
          sizeof(__func__) - 1, __LINE__, ZLOG_LEVEL_DEBUG, __VA_ARGS__)
 
-#define plog_send_protocol(plugin, bytes, n_byte)                            \
-    uint16_t log_protocol_buf_size = n_byte * 5 + 20;                        \
-    char *   log_protocol_buf      = calloc(log_protocol_buf_size, 1);       \
-    int      log_offset            = 0;                                      \
-    uint16_t tmp_n_byte            = n_byte;                                 \
-    log_offset = snprintf(log_protocol_buf, log_protocol_buf_size, ">>(%d)", \
-                          tmp_n_byte);                                       \
-    for (int i = 0; i < n_byte; i++) {                                       \
-        log_offset += snprintf(log_protocol_buf + log_offset,                \
-                               log_protocol_buf_size - log_offset,           \
-                               " 0x%02hhX", (bytes)[i]);                     \
-    }                                                                        \
-    plog_debug(plugin, "%s", log_protocol_buf);                              \
-    free(log_protocol_buf);
+// the frames are only copied while the capture of the node is enabled
+#define plog_send_protocol(plugin, bytes, n_byte) \
+    log_capture((plugin)->common.capture, NEU_CAPTURE_SEND, bytes, n_byte)
 
-#define plog_recv_protocol(plugin, bytes, n_byte)                            \
-    uint16_t log_protocol_buf_size = n_byte * 5 + 20;                        \
-    char *   log_protocol_buf      = calloc(log_protocol_buf_size, 1);       \
-    int      log_offset            = 0;                                      \
-    uint16_t tmp_n_byte            = n_byte;                                 \
-    log_offset = snprintf(log_protocol_buf, log_protocol_buf_size, "<<(%d)", \
-                          tmp_n_byte);                                       \
-    for (int i = 0; i < n_byte; i++) {                                       \
-        log_offset += snprintf(log_protocol_buf + log_offset,                \
-                               log_protocol_buf_size - log_offset,           \
-                               " 0x%02hhX", (bytes)[i]);                     \
-    }                                                                        \
-    plog_debug(plugin, "%s", log_protocol_buf);                              \
-    free(log_protocol_buf);
+#define plog_recv_protocol(plugin, bytes, n_byte) \
+    log_capture((plugin)->common.capture, NEU_CAPTURE_RECV, bytes, n_byte)
 
-#define zlog_recv_protocol(log, bytes, n_byte)                               \
-    uint16_t log_protocol_buf_size = n_byte * 5 + 20;                        \
-    char *   log_protocol_buf      = calloc(log_protocol_buf_size, 1);       \
-    int      log_offset            = 0;                                      \
-    uint16_t tmp_n_byte            = n_byte;                                 \
-    log_offset = snprintf(log_protocol_buf, log_protocol_buf_size, "<<(%d)", \
-                          tmp_n_byte);                                       \
-    for (int i = 0; i < n_byte; i++) {                                       \
-        log_offset += snprintf(log_protocol_buf + log_offset,                \
-                               log_protocol_buf_size - log_offset,           \
-                               " 0x%02hhX", (bytes)[i]);                     \
-    }                                                                        \
-    zlog_debug(log, "%s", log_protocol_buf);                                 \
-    free(log_protocol_buf);
+#define log_capture(capture, dir, bytes, n_byte)                             \
+    do {                                                                     \
+        neu_capture_t *log_capture_ring =                                    \
+            __atomic_load_n(&(capture), __ATOMIC_ACQUIRE);                   \
+        if (log_capture_ring != NULL) {                                      \
+            neu_capture_add(log_capture_ring, dir, bytes, n_byte);           \
+        }                                                                    \
+    } while (0)
+
+#define zlog_recv_protocol(log, bytes, n_byte) \
+    log_protocol(log, "<<", bytes, n_byte)
+
+// the bytes are only formatted when the debug level is enabled
+#define log_protocol(log, dir, bytes, n_byte)                                 \
+    do {                                                                      \
+        if (zlog_level_enabled(log, ZLOG_LEVEL_DEBUG)) {                      \
+            size_t log_protocol_n_byte   = (n_byte);                          \
+            size_t log_protocol_buf_size = log_protocol_n_byte * 5 + 20;      \
+            char * log_protocol_buf      = calloc(log_protocol_buf_size, 1);  \
+            size_t log_offset            = 0;                                 \
+            if (log_protocol_buf == NULL) {                                   \
+                break;                                                        \
+            }                                                                 \
+            log_offset = snprintf(log_protocol_buf, log_protocol_buf_size,    \
+                                  dir "(%zu)", log_protocol_n_byte);          \
+            for (size_t i = 0; i < log_protocol_n_byte; i++) {                \
+                log_offset += snprintf(log_protocol_buf + log_offset,         \
+                                       log_protocol_buf_size - log_offset,    \
+                                       " 0x%02hhX", (bytes)[i]);              \
+            }                                                                 \
+            zlog_debug(log, "%s", log_protocol_buf);                          \
+            free(log_protocol_buf);                                           \
+        }                                                                     \
+    } while (0)
 
 #endif
\ No newline at end of file
@@ -58,11 +58,15 @@ cp default_plugins.json ${package_name}/config/
 cp build/plugins/schema/ekuiper.json \
     build/plugins/schema/mqtt.json \
     build/plugins/schema/modbus-tcp.json \
+    build/plugins/schema/modbus-rtu.json \
+    build/plugins/schema/modbus-tcp-server.json \
     ${package_name}/plugins/schema/
 
 cp build/plugins/libplugin-ekuiper.so \
     build/plugins/libplugin-mqtt.so \
     build/plugins/libplugin-modbus-tcp.so \
+    build/plugins/libplugin-modbus-rtu.so \
+    build/plugins/libplugin-modbus-tcp-server.so \
     ${package_name}/plugins/
 
 tar czf ${package_name}-${arch}.tar.gz ${package_name}/
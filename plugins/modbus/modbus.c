@@ -18,6 +18,7 @@
  **/
 #include <assert.h>
 #include <netinet/in.h>
+#include <string.h>
 
 #include <neuron.h>
 
@@ -149,6 +150,79 @@ int modbus_data_unwrap(neu_protocol_unpack_buf_t *buf,
     return sizeof(struct modbus_data);
 }
 
+uint16_t modbus_crc16(const uint8_t *bytes, uint16_t n_byte)
+{
+    uint16_t crc = 0xffff;
+
+    for (uint16_t i = 0; i < n_byte; i++) {
+        crc ^= bytes[i];
+        for (int k = 0; k < 8; k++) {
+            if (crc & 0x1) {
+                crc = (crc >> 1) ^ 0xa001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+void modbus_crc_wrap(neu_protocol_pack_buf_t *buf)
+{
+    assert(neu_protocol_pack_buf_unused_size(buf) >=
+           sizeof(struct modbus_crc));
+    uint8_t *crc = neu_protocol_pack_buf(buf, sizeof(struct modbus_crc));
+
+    crc[0] = 0;
+    crc[1] = 0;
+}
+
+void modbus_crc_set(neu_protocol_pack_buf_t *buf)
+{
+    uint8_t *bytes  = neu_protocol_pack_buf_get(buf);
+    uint16_t n_byte = neu_protocol_pack_buf_used_size(buf);
+    uint16_t crc    = modbus_crc16(bytes, n_byte - sizeof(struct modbus_crc));
+
+    bytes[n_byte - 2] = crc & 0xff;
+    bytes[n_byte - 1] = crc >> 8;
+}
+
+bool modbus_crc_check(uint8_t *bytes, uint16_t n_byte)
+{
+    uint16_t crc = 0;
+
+    if (n_byte <= sizeof(struct modbus_crc)) {
+        return false;
+    }
+
+    crc = modbus_crc16(bytes, n_byte - sizeof(struct modbus_crc));
+    return bytes[n_byte - 2] == (crc & 0xff) && bytes[n_byte - 1] == crc >> 8;
+}
+
+void modbus_registers_decode(const uint8_t *bytes, uint16_t n_register,
+                             uint16_t *out)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(out, bytes, n_register * sizeof(uint16_t));
+#else
+    uint16_t i = 0;
+
+    for (; i + 4 <= n_register; i += 4) {
+        uint64_t x = 0;
+
+        memcpy(&x, bytes + i * 2, sizeof(x));
+        x = ((x & 0x00ff00ff00ff00ffULL) << 8) |
+            ((x >> 8) & 0x00ff00ff00ff00ffULL);
+        memcpy(out + i, &x, sizeof(x));
+    }
+
+    for (; i < n_register; i++) {
+        out[i] = (uint16_t)(bytes[i * 2] << 8 | bytes[i * 2 + 1]);
+    }
+#endif
+}
+
 const char *modbus_area_to_str(modbus_area_e area)
 {
     switch (area) {
@@ -19,6 +19,10 @@
 #ifndef _NEU_M_PLUGIN_MODBUS_H_
 #define _NEU_M_PLUGIN_MODBUS_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -45,6 +49,31 @@ typedef enum modbus_function {
     MODBUS_WRITE_M_COIL     = 0x0F
 } modbus_function_e;
 
+typedef enum modbus_exception {
+    MODBUS_EXCEPTION_ILLEGAL_FUNCTION = 0x01,
+    MODBUS_EXCEPTION_ILLEGAL_ADDRESS  = 0x02,
+    MODBUS_EXCEPTION_ILLEGAL_VALUE    = 0x03,
+    MODBUS_EXCEPTION_DEVICE_FAILURE   = 0x04,
+    MODBUS_EXCEPTION_GATEWAY_PATH     = 0x0A,
+    MODBUS_EXCEPTION_GATEWAY_TARGET   = 0x0B,
+} modbus_exception_e;
+
+typedef enum modbus_protocol {
+    MODBUS_PROTOCOL_TCP = 1,
+    MODBUS_PROTOCOL_RTU = 2,
+} modbus_protocol_e;
+
+// function code, data and for tcp the unit id
+#define MODBUS_MAX_PDU 253
+// the pdu with the mbap header, or with the slave id and crc
+#define MODBUS_MAX_ADU 260
+// in one read request
+#define MODBUS_MAX_READ_REGISTER 125
+#define MODBUS_MAX_READ_BIT 2000
+// in one write multiple request
+#define MODBUS_MAX_WRITE_REGISTER 123
+#define MODBUS_MAX_WRITE_BIT 1968
+
 typedef enum modbus_area {
     MODBUS_AREA_COIL           = 0,
     MODBUS_AREA_INPUT          = 1,
@@ -92,6 +121,31 @@ void modbus_data_wrap(neu_protocol_pack_buf_t *buf, uint8_t n_byte,
 int  modbus_data_unwrap(neu_protocol_unpack_buf_t *buf,
                         struct modbus_data *       out_data);
 
+struct modbus_crc {
+    uint16_t crc;
+} __attribute__((packed));
+
+// the crc of the rtu frame, low byte first on the wire
+uint16_t modbus_crc16(const uint8_t *bytes, uint16_t n_byte);
+// reserve the crc at the end of the frame, before anything else is wrapped
+void modbus_crc_wrap(neu_protocol_pack_buf_t *buf);
+// fill in the crc reserved, after everything else is wrapped
+void modbus_crc_set(neu_protocol_pack_buf_t *buf);
+// check the crc of a whole frame
+bool modbus_crc_check(uint8_t *bytes, uint16_t n_byte);
+
+/**
+ * The registers of a read response in host order, out holds n_register words.
+ * Four registers are swapped at a time in a 64 bits word, which needs neither
+ * simd intrinsics nor the vectorizer.
+ */
+void modbus_registers_decode(const uint8_t *bytes, uint16_t n_register,
+                             uint16_t *out);
+
 const char *modbus_area_to_str(modbus_area_e area);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,559 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#include <stdlib.h>
+#include <string.h>
+
+#include "modbus_image.h"
+
+#define IMAGE_REGISTER (UINT16_MAX + 1)
+#define IMAGE_BIT (UINT16_MAX + 1)
+
+typedef struct {
+    char          name[NEU_TAG_NAME_LEN];
+    neu_type_e    type;
+    modbus_area_e area;
+    uint16_t      address;
+    uint16_t      n; // registers or coils, 0 when the tag is not mapped
+    bool          seen;
+
+    UT_hash_handle hh;
+} image_tag_t;
+
+typedef struct {
+    char driver[NEU_NODE_NAME_LEN];
+    char group[NEU_GROUP_NAME_LEN];
+} image_group_key_t;
+
+typedef struct {
+    image_group_key_t key;
+    image_tag_t *     tags;
+    bool              seen;
+
+    UT_hash_handle hh;
+} image_group_t;
+
+struct modbus_image {
+    image_group_t *groups;
+    // the next free address
+    uint32_t n_register;
+    uint32_t n_bit;
+
+    // as on the wire, a read is a single copy
+    uint8_t registers[IMAGE_REGISTER * 2];
+    // lsb first, as packed in a read response
+    uint8_t bits[IMAGE_BIT / 8];
+};
+
+static int tag_width(neu_type_e type)
+{
+    switch (type) {
+    case NEU_TYPE_BIT:
+    case NEU_TYPE_BOOL:
+    case NEU_TYPE_INT8:
+    case NEU_TYPE_UINT8:
+    case NEU_TYPE_INT16:
+    case NEU_TYPE_UINT16:
+        return 1;
+    case NEU_TYPE_INT32:
+    case NEU_TYPE_UINT32:
+    case NEU_TYPE_FLOAT:
+        return 2;
+    case NEU_TYPE_INT64:
+    case NEU_TYPE_UINT64:
+    case NEU_TYPE_DOUBLE:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static inline bool tag_is_bit(neu_type_e type)
+{
+    return type == NEU_TYPE_BIT || type == NEU_TYPE_BOOL;
+}
+
+static void bit_set(modbus_image_t *image, uint16_t address, bool on)
+{
+    if (on) {
+        image->bits[address / 8] |= 1 << (address % 8);
+    } else {
+        image->bits[address / 8] &= ~(1 << (address % 8));
+    }
+}
+
+static void tag_clear(modbus_image_t *image, image_tag_t *tag)
+{
+    if (tag->n == 0) {
+        return;
+    }
+    if (tag->area == MODBUS_AREA_COIL) {
+        bit_set(image, tag->address, false);
+    } else {
+        memset(&image->registers[tag->address * 2], 0, tag->n * 2);
+    }
+}
+
+static void group_free(modbus_image_t *image, image_group_t *group)
+{
+    image_tag_t *tag = NULL, *tmp = NULL;
+
+    HASH_ITER(hh, group->tags, tag, tmp)
+    {
+        HASH_DEL(group->tags, tag);
+        tag_clear(image, tag);
+        free(tag);
+    }
+    free(group);
+}
+
+static image_group_t *group_find(modbus_image_t *image, const char *driver,
+                                 const char *group)
+{
+    image_group_t *   find = NULL;
+    image_group_key_t key  = { 0 };
+
+    strncpy(key.driver, driver, sizeof(key.driver) - 1);
+    strncpy(key.group, group, sizeof(key.group) - 1);
+    HASH_FIND(hh, image->groups, &key, sizeof(key), find);
+    return find;
+}
+
+modbus_image_t *modbus_image_new(void)
+{
+    return calloc(1, sizeof(modbus_image_t));
+}
+
+void modbus_image_free(modbus_image_t *image)
+{
+    image_group_t *group = NULL, *tmp = NULL;
+
+    HASH_ITER(hh, image->groups, group, tmp)
+    {
+        HASH_DEL(image->groups, group);
+        group_free(image, group);
+    }
+    free(image);
+}
+
+typedef struct {
+    image_group_t *group;
+    neu_datatag_t *datatag;
+} layout_new_t;
+
+typedef struct {
+    uint32_t address;
+    uint32_t n;
+} layout_span_t;
+
+// the free ranges of an area while the new tags are placed
+typedef struct {
+    layout_span_t *gaps;
+    int            n_gap;
+    uint32_t       top;
+    uint32_t       limit;
+} layout_area_t;
+
+// true when the tag needs an address
+static bool layout_seen(modbus_image_t *image, image_group_t *group,
+                        neu_datatag_t *datatag)
+{
+    image_tag_t *tag   = NULL;
+    int          width = tag_width(datatag->type);
+
+    HASH_FIND_STR(group->tags, datatag->name, tag);
+    // the type is changed, or there was no space left the last time
+    if (tag != NULL &&
+        (tag->type != datatag->type || (tag->n == 0 && width != 0))) {
+        HASH_DEL(group->tags, tag);
+        tag_clear(image, tag);
+        free(tag);
+        tag = NULL;
+    }
+
+    if (tag != NULL) {
+        tag->seen = true;
+        return false;
+    }
+    return true;
+}
+
+static int span_cmp(const void *a, const void *b)
+{
+    const layout_span_t *sa = (const layout_span_t *) a;
+    const layout_span_t *sb = (const layout_span_t *) b;
+
+    return sa->address < sb->address ? -1 : sa->address > sb->address;
+}
+
+static int new_cmp(const void *a, const void *b)
+{
+    const layout_new_t *na = (const layout_new_t *) a;
+    const layout_new_t *nb = (const layout_new_t *) b;
+    int                 rv = 0;
+
+    if ((rv = strcmp(na->group->key.driver, nb->group->key.driver)) != 0 ||
+        (rv = strcmp(na->group->key.group, nb->group->key.group)) != 0) {
+        return rv;
+    }
+    return strcmp(na->datatag->name, nb->datatag->name);
+}
+
+static void area_init(modbus_image_t *image, layout_area_t *area, bool bit,
+                      uint32_t limit)
+{
+    image_group_t *group = NULL, *gtmp = NULL;
+    image_tag_t *  tag = NULL, *ttmp = NULL;
+    layout_span_t *used = NULL;
+    int            n    = 0;
+    uint32_t       next = 0;
+
+    HASH_ITER(hh, image->groups, group, gtmp) { n += HASH_COUNT(group->tags); }
+    used        = calloc(n + 1, sizeof(layout_span_t));
+    area->gaps  = calloc(n + 1, sizeof(layout_span_t));
+    area->n_gap = 0;
+    area->limit = limit;
+
+    n = 0;
+    HASH_ITER(hh, image->groups, group, gtmp)
+    {
+        HASH_ITER(hh, group->tags, tag, ttmp)
+        {
+            if (tag->n != 0 && tag_is_bit(tag->type) == bit) {
+                used[n].address = tag->address;
+                used[n].n       = tag->n;
+                n += 1;
+            }
+        }
+    }
+    qsort(used, n, sizeof(layout_span_t), span_cmp);
+
+    for (int i = 0; i < n; i++) {
+        if (used[i].address > next) {
+            area->gaps[area->n_gap].address = next;
+            area->gaps[area->n_gap].n       = used[i].address - next;
+            area->n_gap += 1;
+        }
+        next = used[i].address + used[i].n;
+    }
+    area->top = next;
+    free(used);
+}
+
+// first fit, -1 when there is no space left
+static int32_t area_alloc(layout_area_t *area, int width)
+{
+    int32_t address = -1;
+
+    for (int i = 0; i < area->n_gap; i++) {
+        if (area->gaps[i].n >= (uint32_t) width) {
+            address = area->gaps[i].address;
+            area->gaps[i].address += width;
+            area->gaps[i].n -= width;
+            return address;
+        }
+    }
+
+    if (area->top + width <= area->limit) {
+        address = area->top;
+        area->top += width;
+    }
+    return address;
+}
+
+static void layout_place(layout_area_t *bits, layout_area_t *registers,
+                         layout_new_t *pending)
+{
+    image_tag_t *tag     = NULL;
+    int          width   = tag_width(pending->datatag->type);
+    int32_t      address = -1;
+
+    // the same tag twice in a group
+    HASH_FIND_STR(pending->group->tags, pending->datatag->name, tag);
+    if (tag != NULL) {
+        return;
+    }
+
+    // the tags which can not be mapped are kept, so that their values are
+    // known to be skipped by modbus_image_update
+    tag = calloc(1, sizeof(image_tag_t));
+    strncpy(tag->name, pending->datatag->name, sizeof(tag->name) - 1);
+    tag->type = pending->datatag->type;
+    tag->seen = true;
+    HASH_ADD_STR(pending->group->tags, name, tag);
+
+    if (width == 0) {
+        return;
+    }
+    if (tag_is_bit(tag->type)) {
+        tag->area = MODBUS_AREA_COIL;
+        address   = area_alloc(bits, width);
+    } else {
+        tag->area = MODBUS_AREA_HOLD_REGISTER;
+        address   = area_alloc(registers, width);
+    }
+    if (address >= 0) {
+        tag->address = address;
+        tag->n       = width;
+    }
+}
+
+void modbus_image_layout(modbus_image_t *image, UT_array *infos)
+{
+    image_group_t *group = NULL, *gtmp = NULL;
+    image_tag_t *  tag = NULL, *ttmp = NULL;
+    layout_new_t * news      = NULL;
+    int            n_new     = 0;
+    layout_area_t  bits      = { 0 };
+    layout_area_t  registers = { 0 };
+    size_t         n_tag     = 0;
+
+    HASH_ITER(hh, image->groups, group, gtmp)
+    {
+        group->seen = false;
+        HASH_ITER(hh, group->tags, tag, ttmp) { tag->seen = false; }
+    }
+
+    utarray_foreach(infos, neu_resp_get_sub_driver_tags_info_t *, info)
+    {
+        n_tag += utarray_len(info->tags);
+    }
+    news = calloc(n_tag + 1, sizeof(layout_new_t));
+
+    utarray_foreach(infos, neu_resp_get_sub_driver_tags_info_t *, info)
+    {
+        group = group_find(image, info->driver, info->group);
+        if (group == NULL) {
+            group = calloc(1, sizeof(image_group_t));
+            strncpy(group->key.driver, info->driver,
+                    sizeof(group->key.driver) - 1);
+            strncpy(group->key.group, info->group,
+                    sizeof(group->key.group) - 1);
+            HASH_ADD(hh, image->groups, key, sizeof(group->key), group);
+        }
+        group->seen = true;
+
+        utarray_foreach(info->tags, neu_datatag_t *, datatag)
+        {
+            if (layout_seen(image, group, datatag)) {
+                news[n_new].group   = group;
+                news[n_new].datatag = datatag;
+                n_new += 1;
+            }
+        }
+    }
+
+    // the space of the deleted tags is freed before the new tags are placed
+    HASH_ITER(hh, image->groups, group, gtmp)
+    {
+        if (!group->seen) {
+            HASH_DEL(image->groups, group);
+            group_free(image, group);
+            continue;
+        }
+
+        HASH_ITER(hh, group->tags, tag, ttmp)
+        {
+            if (!tag->seen) {
+                HASH_DEL(group->tags, tag);
+                tag_clear(image, tag);
+                free(tag);
+            }
+        }
+    }
+
+    // not in the order the groups are subscribed in, so that the same tags
+    // are given the same addresses after a restart
+    qsort(news, n_new, sizeof(layout_new_t), new_cmp);
+    area_init(image, &bits, true, IMAGE_BIT);
+    area_init(image, &registers, false, IMAGE_REGISTER);
+    for (int i = 0; i < n_new; i++) {
+        layout_place(&bits, &registers, &news[i]);
+    }
+
+    image->n_bit      = bits.top;
+    image->n_register = registers.top;
+    free(bits.gaps);
+    free(registers.gaps);
+    free(news);
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v >> 16);
+    put_u16(p + 2, v);
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    put_u32(p, v >> 32);
+    put_u32(p + 4, v);
+}
+
+static void tag_put(modbus_image_t *image, image_tag_t *tag,
+                    const neu_dvalue_t *value)
+{
+    uint8_t *p = &image->registers[tag->address * 2];
+
+    switch (tag->type) {
+    case NEU_TYPE_BIT:
+        bit_set(image, tag->address, value->value.u8 != 0);
+        break;
+    case NEU_TYPE_BOOL:
+        bit_set(image, tag->address, value->value.boolean);
+        break;
+    case NEU_TYPE_INT8:
+        put_u16(p, (uint16_t)(int16_t) value->value.i8);
+        break;
+    case NEU_TYPE_UINT8:
+        put_u16(p, value->value.u8);
+        break;
+    case NEU_TYPE_INT16:
+    case NEU_TYPE_UINT16:
+        put_u16(p, value->value.u16);
+        break;
+    case NEU_TYPE_INT32:
+    case NEU_TYPE_UINT32:
+    case NEU_TYPE_FLOAT:
+        put_u32(p, value->value.u32);
+        break;
+    case NEU_TYPE_INT64:
+    case NEU_TYPE_UINT64:
+    case NEU_TYPE_DOUBLE:
+        put_u64(p, value->value.u64);
+        break;
+    default:
+        break;
+    }
+}
+
+int modbus_image_update(modbus_image_t *                image,
+                        const neu_reqresp_trans_data_t *data)
+{
+    image_group_t *group = group_find(image, data->driver, data->group);
+    image_tag_t *  tag   = NULL;
+    int            ret   = 0;
+
+    if (group == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < data->n_tag; i++) {
+        const neu_resp_tag_value_t *tv = &data->tags[i];
+
+        // the last good value is kept on read errors
+        if (tv->value.type == NEU_TYPE_ERROR) {
+            continue;
+        }
+
+        HASH_FIND_STR(group->tags, tv->tag, tag);
+        if (tag == NULL || tag->type != tv->value.type) {
+            ret = -1;
+            continue;
+        }
+        if (tag->n == 0) {
+            continue;
+        }
+
+        tag_put(image, tag, &tv->value);
+    }
+
+    return ret;
+}
+
+int modbus_image_read(modbus_image_t *image, uint8_t function, uint16_t start,
+                      uint16_t n, uint8_t *bytes)
+{
+    switch (function) {
+    case MODBUS_READ_COIL:
+    case MODBUS_READ_INPUT: {
+        uint16_t n_byte = (n + 7) / 8;
+
+        if (n == 0 || n > MODBUS_MAX_READ_BIT) {
+            return -MODBUS_EXCEPTION_ILLEGAL_VALUE;
+        }
+        if ((uint32_t) start + n > image->n_bit) {
+            return -MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+        }
+
+        if (start % 8 == 0) {
+            memcpy(bytes, &image->bits[start / 8], n_byte);
+        } else {
+            memset(bytes, 0, n_byte);
+            for (uint16_t i = 0; i < n; i++) {
+                uint32_t a = (uint32_t) start + i;
+
+                if (image->bits[a / 8] & (1 << (a % 8))) {
+                    bytes[i / 8] |= 1 << (i % 8);
+                }
+            }
+        }
+        // the bits after n are zero in a response
+        if (n % 8 != 0) {
+            bytes[n_byte - 1] &= (1 << (n % 8)) - 1;
+        }
+        return n_byte;
+    }
+    case MODBUS_READ_HOLD_REG:
+    case MODBUS_READ_INPUT_REG:
+        if (n == 0 || n > MODBUS_MAX_READ_REGISTER) {
+            return -MODBUS_EXCEPTION_ILLEGAL_VALUE;
+        }
+        if ((uint32_t) start + n > image->n_register) {
+            return -MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+        }
+
+        memcpy(bytes, &image->registers[start * 2], n * 2);
+        return n * 2;
+    default:
+        return -MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+    }
+}
+
+int modbus_image_address(modbus_image_t *image, const char *driver,
+                         const char *group, const char *tag,
+                         modbus_area_e *area)
+{
+    image_group_t *g = group_find(image, driver, group);
+    image_tag_t *  t = NULL;
+
+    if (g == NULL) {
+        return -1;
+    }
+
+    HASH_FIND_STR(g->tags, tag, t);
+    if (t == NULL || t->n == 0) {
+        return -1;
+    }
+
+    *area = t->area;
+    return t->address;
+}
+
+void modbus_image_size(modbus_image_t *image, uint32_t *n_register,
+                       uint32_t *n_bit)
+{
+    *n_register = image->n_register;
+    *n_bit      = image->n_bit;
+}
@@ -0,0 +1,86 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#ifndef _NEU_PLUGIN_MODBUS_IMAGE_H_
+#define _NEU_PLUGIN_MODBUS_IMAGE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include <neuron.h>
+
+#include "modbus.h"
+
+/**
+ * The register image served by the modbus-tcp-server plugin.
+ *
+ * Every tag of the subscribed groups is given an address when it is first
+ * seen. Bit and bool tags are mapped to the coils, which are read by both
+ * FC01 and FC02. The numeric tags are mapped to the holding registers, read
+ * by both FC03 and FC04, big-endian with the high word first:
+ *   int8, uint8, int16, uint16: 1 register
+ *   int32, uint32, float:       2 registers
+ *   int64, uint64, double:      4 registers
+ * String and bytes tags are not mapped, nor are the tags for which there is
+ * no space left. A tag keeps its address for as long as it exists. The new
+ * tags of a layout are sorted by driver, group and tag name, then placed in
+ * the first free range that fits, so the space of the deleted tags is reused
+ * and the same tags get the same addresses after a restart.
+ */
+typedef struct modbus_image modbus_image_t;
+
+modbus_image_t *modbus_image_new(void);
+void            modbus_image_free(modbus_image_t *image);
+
+// infos is an array of neu_resp_get_sub_driver_tags_info_t, the groups and
+// tags not in infos are unmapped
+void modbus_image_layout(modbus_image_t *image, UT_array *infos);
+
+// -1 when the group or one of the tags is not in the layout, the known tags
+// are updated anyway. The tags left unmapped by the layout are skipped.
+int modbus_image_update(modbus_image_t *                image,
+                        const neu_reqresp_trans_data_t *data);
+
+/**
+ * Serve a read request from the image.
+ *
+ * @param[in] function One of the four read function codes.
+ * @param[out] bytes The data of the response, MODBUS_MAX_PDU bytes at most.
+ * @return The number of bytes in the response, or the negated modbus
+ * exception code.
+ */
+int modbus_image_read(modbus_image_t *image, uint8_t function, uint16_t start,
+                      uint16_t n, uint8_t *bytes);
+
+// the address of a tag, -1 when it is not mapped
+int modbus_image_address(modbus_image_t *image, const char *driver,
+                         const char *group, const char *tag,
+                         modbus_area_e *area);
+
+// the number of registers and coils in use
+void modbus_image_size(modbus_image_t *image, uint32_t *n_register,
+                       uint32_t *n_bit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,11 +23,12 @@
 #include "modbus_point.h"
 
 struct modbus_sort_ctx {
-    uint16_t start;
-    uint16_t end;
+    uint32_t start;
+    uint32_t end;
 };
 
-static __thread uint16_t modbus_read_max_byte = 255;
+// neu_tag_sort passes no context to tag_sort
+static __thread const modbus_read_limit_t *modbus_read_limit = NULL;
 
 static int  tag_cmp(neu_tag_sort_elem_t *tag1, neu_tag_sort_elem_t *tag2);
 static bool tag_sort(neu_tag_sort_t *sort, void *tag, void *tag_to_be_sorted);
@@ -152,10 +153,12 @@ int modbus_tag_to_point(neu_datatag_t *tag, modbus_point_t *point)
     return ret;
 }
 
-modbus_read_cmd_sort_t *modbus_tag_sort(UT_array *tags, uint16_t max_byte)
+modbus_read_cmd_sort_t *modbus_tag_sort(UT_array *                 tags,
+                                        const modbus_read_limit_t *limit)
 {
-    modbus_read_max_byte          = max_byte;
+    modbus_read_limit             = limit;
     neu_tag_sort_result_t *result = neu_tag_sort(tags, tag_sort, tag_cmp);
+    modbus_read_limit             = NULL;
 
     modbus_read_cmd_sort_t *sort_result =
         calloc(1, sizeof(modbus_read_cmd_sort_t));
@@ -222,11 +225,30 @@ static int tag_cmp(neu_tag_sort_elem_t *tag1, neu_tag_sort_elem_t *tag2)
     return 0;
 }
 
+// [start, end) takes in a hole, or is split by one
+static bool hole_cross(modbus_point_t *t, uint32_t start, uint32_t end)
+{
+    if (modbus_read_limit->holes == NULL) {
+        return false;
+    }
+
+    utarray_foreach(modbus_read_limit->holes, modbus_hole_t *, hole)
+    {
+        if (hole->slave_id == t->slave_id && hole->area == t->area &&
+            hole->start < end && start < hole->end) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static bool tag_sort(neu_tag_sort_t *sort, void *tag, void *tag_to_be_sorted)
 {
     modbus_point_t *        t1  = (modbus_point_t *) tag;
     modbus_point_t *        t2  = (modbus_point_t *) tag_to_be_sorted;
     struct modbus_sort_ctx *ctx = NULL;
+    uint32_t                end = 0;
 
     if (sort->info.context == NULL) {
         sort->info.context = calloc(1, sizeof(struct modbus_sort_ctx));
@@ -246,32 +268,36 @@ static bool tag_sort(neu_tag_sort_t *sort, void *tag, void *tag_to_be_sorted)
         return false;
     }
 
-    if (t2->start_address > ctx->end) {
-        return false;
+    end = ctx->end;
+    if ((uint32_t) t2->start_address + t2->n_register > end) {
+        end = (uint32_t) t2->start_address + t2->n_register;
     }
 
     switch (t1->area) {
     case MODBUS_AREA_COIL:
     case MODBUS_AREA_INPUT:
-        if ((ctx->end - ctx->start) / 8 >= modbus_read_max_byte - 1) {
+        if (t2->start_address > ctx->end + modbus_read_limit->max_gap * 16) {
+            return false;
+        }
+        if (end - ctx->start > modbus_read_limit->max_bit) {
             return false;
         }
         break;
     case MODBUS_AREA_INPUT_REGISTER:
-    case MODBUS_AREA_HOLD_REGISTER: {
-        uint16_t now_bytes = (ctx->end - ctx->start) * 2;
-        uint16_t add_now   = now_bytes + t2->n_register * 2;
-        if (add_now >= modbus_read_max_byte) {
+    case MODBUS_AREA_HOLD_REGISTER:
+        if (t2->start_address > ctx->end + modbus_read_limit->max_gap) {
+            return false;
+        }
+        if (end - ctx->start > modbus_read_limit->max_register) {
             return false;
         }
-
         break;
     }
-    }
 
-    if (t2->start_address + t2->n_register > ctx->end) {
-        ctx->end = t2->start_address + t2->n_register;
+    if (hole_cross(t2, ctx->start, end)) {
+        return false;
     }
 
+    ctx->end = end;
     return true;
 }
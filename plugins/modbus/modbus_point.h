@@ -56,7 +56,26 @@ typedef struct modbus_read_cmd_sort {
     modbus_read_cmd_t *cmd;
 } modbus_read_cmd_sort_t;
 
-modbus_read_cmd_sort_t *modbus_tag_sort(UT_array *tags, uint16_t max_byte);
+// addresses answered with illegal data address, no command reads them along
+// with other addresses, start == end only splits the commands at start
+typedef struct modbus_hole {
+    uint8_t       slave_id;
+    modbus_area_e area;
+    uint16_t      start;
+    uint16_t      end;
+} modbus_hole_t;
+
+typedef struct modbus_read_limit {
+    uint16_t max_register; // registers in one read
+    uint16_t max_bit;      // coils or inputs in one read
+    // unused registers read to merge two commands, 16 bits each for the coils
+    // and inputs
+    uint16_t  max_gap;
+    UT_array *holes; // modbus_hole_t, could be NULL
+} modbus_read_limit_t;
+
+modbus_read_cmd_sort_t *modbus_tag_sort(UT_array *                 tags,
+                                        const modbus_read_limit_t *limit);
 void                    modbus_tag_sort_free(modbus_read_cmd_sort_t *cs);
 
 #ifdef __cplusplus
@@ -16,26 +16,74 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "modbus_point.h"
 #include "modbus_stack.h"
 
 #include "modbus_req.h"
 
+// period of the timer checking the transaction deadlines
+#define MODBUS_TICK_MS 100
+
+static const UT_icd hole_icd = { sizeof(modbus_hole_t), NULL, NULL, NULL };
+
 struct modbus_group_data {
     char *                  group;
     UT_array *              tags;
     modbus_read_cmd_sort_t *cmd_sort;
+
+    neu_plugin_t *plugin;
+    uint16_t      n_work; // queued and in flight
+    uint32_t      sort_gen;
 };
 
 static void plugin_group_free(neu_plugin_group_t *pgp);
-static int  process_protocol_buf(neu_plugin_t *plugin, uint16_t response_size);
+static void cmd_error(neu_plugin_t *plugin, struct modbus_group_data *gd,
+                      uint16_t cmd_idx, int error);
+
+static int  loop_wakeup_cb(enum neu_event_io_type type, int fd, void *usr_data);
+static int  loop_conn_cb(enum neu_event_io_type type, int fd, void *usr_data);
+static int  loop_tick_cb(void *usr_data);
+static void loop_wakeup(neu_plugin_t *plugin);
+static void loop_pump(neu_plugin_t *plugin);
+static void loop_recv(neu_plugin_t *plugin);
+static void loop_fail_inflight(neu_plugin_t *plugin, int error);
+static void work_fail(neu_plugin_t *plugin, modbus_work_t *work, int error);
+static void work_free(modbus_work_t *work);
+static void write_response(neu_plugin_t *plugin, modbus_work_t *work,
+                           int error);
+static void work_queue(neu_plugin_t *plugin, modbus_work_t *work);
+static void work_done(neu_plugin_t *plugin, modbus_work_t *work);
+static modbus_work_t *work_find(neu_plugin_t *plugin, uint16_t seq);
+static void           unit_dequeue(neu_plugin_t *plugin, modbus_unit_t *unit,
+                                   modbus_work_t *work);
+static void           health_fail(neu_plugin_t *plugin, modbus_work_t *work);
+static void           health_ok(neu_plugin_t *plugin, modbus_work_t *work);
+static void hole_learn(neu_plugin_t *plugin, struct modbus_group_data *gd,
+                       uint16_t cmd_idx);
+
+static uint64_t now_us()
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 void modbus_conn_connected(void *data, int fd)
 {
     struct neu_plugin *plugin = (struct neu_plugin *) data;
-    (void) fd;
 
     plugin->common.link_state = NEU_NODE_LINK_STATE_CONNECTED;
+
+    nng_mtx_lock(plugin->conn_mtx);
+    plugin->conn_fd = fd;
+    plugin->conn_gen += 1;
+    nng_mtx_unlock(plugin->conn_mtx);
 }
 
 void modbus_conn_disconnected(void *data, int fd)
@@ -44,6 +92,143 @@ void modbus_conn_disconnected(void *data, int fd)
     (void) fd;
 
     plugin->common.link_state = NEU_NODE_LINK_STATE_DISCONNECTED;
+
+    nng_mtx_lock(plugin->conn_mtx);
+    plugin->conn_fd = -1;
+    plugin->conn_gen += 1;
+    nng_mtx_unlock(plugin->conn_mtx);
+}
+
+int modbus_loop_init(neu_plugin_t *plugin, modbus_protocol_e protocol)
+{
+    neu_event_io_param_t    io    = { 0 };
+    neu_event_timer_param_t timer = {
+        .second      = 0,
+        .millisecond = MODBUS_TICK_MS,
+        .usr_data    = (void *) plugin,
+        .cb          = loop_tick_cb,
+    };
+
+    if (pipe(plugin->wakeup) != 0) {
+        plog_error(plugin, "create wakeup pipe fail");
+        return -1;
+    }
+    fcntl(plugin->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(plugin->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    nng_mtx_alloc(&plugin->mtx);
+    nng_mtx_alloc(&plugin->conn_mtx);
+    nng_cv_alloc(&plugin->closed, plugin->mtx);
+    plugin->conn_fd       = -1;
+    plugin->max_inflight  = 1;
+    plugin->unit_inflight = 1;
+    plugin->protocol      = protocol;
+
+    plugin->limit.max_register = MODBUS_MAX_READ_REGISTER;
+    plugin->limit.max_bit      = MODBUS_MAX_READ_BIT;
+    utarray_new(plugin->limit.holes, &hole_icd);
+    plugin->stack         = modbus_stack_create(
+        (void *) plugin, protocol, modbus_send_msg, modbus_value_handle,
+        modbus_write_resp);
+
+    plugin->events = neu_event_new();
+
+    io.fd             = plugin->wakeup[0];
+    io.usr_data       = (void *) plugin;
+    io.cb             = loop_wakeup_cb;
+    plugin->wakeup_io = neu_event_add_io(plugin->events, io);
+    plugin->tick      = neu_event_add_timer(plugin->events, timer);
+
+    return 0;
+}
+
+void modbus_loop_uninit(neu_plugin_t *plugin)
+{
+    modbus_work_t *work = NULL, *tmp = NULL;
+    modbus_unit_t *unit = NULL, *unit_tmp = NULL;
+
+    // the io and timer are deleted by the events thread itself, no callback
+    // runs after it signals
+    nng_mtx_lock(plugin->mtx);
+    plugin->closing = true;
+    loop_wakeup(plugin);
+    while (plugin->wakeup_io != NULL) {
+        nng_cv_wait(plugin->closed);
+    }
+
+    DL_FOREACH_SAFE(plugin->ready, unit, unit_tmp)
+    {
+        DL_FOREACH_SAFE(unit->queue, work, tmp)
+        {
+            unit_dequeue(plugin, unit, work);
+            work_free(work);
+        }
+    }
+    DL_FOREACH_SAFE(plugin->inflight, work, tmp)
+    {
+        work_done(plugin, work);
+        work_free(work);
+    }
+    nng_mtx_unlock(plugin->mtx);
+
+    neu_event_close(plugin->events);
+    close(plugin->wakeup[0]);
+    close(plugin->wakeup[1]);
+
+    if (plugin->conn != NULL) {
+        neu_conn_destory(plugin->conn);
+    }
+    modbus_stack_destroy(plugin->stack);
+
+    utarray_free(plugin->limit.holes);
+    nng_cv_free(plugin->closed);
+    nng_mtx_free(plugin->conn_mtx);
+    nng_mtx_free(plugin->mtx);
+}
+
+int modbus_read_limit_config(neu_plugin_t *plugin, const char *config)
+{
+    char *          err_param = NULL;
+    neu_json_elem_t gap       = { .name = "max_gap", .t = NEU_JSON_INT };
+    neu_json_elem_t reg       = { .name = "max_register", .t = NEU_JSON_INT };
+    neu_json_elem_t bit       = { .name = "max_bit", .t = NEU_JSON_INT };
+
+    if (neu_parse_param((char *) config, &err_param, 1, &gap) != 0) {
+        free(err_param);
+        gap.v.val_int = 0;
+    }
+    if (neu_parse_param((char *) config, &err_param, 1, &reg) != 0) {
+        free(err_param);
+        reg.v.val_int = MODBUS_MAX_READ_REGISTER;
+    }
+    if (neu_parse_param((char *) config, &err_param, 1, &bit) != 0) {
+        free(err_param);
+        bit.v.val_int = MODBUS_MAX_READ_BIT;
+    }
+
+    if (gap.v.val_int < 0 || gap.v.val_int > MODBUS_MAX_READ_REGISTER ||
+        reg.v.val_int < 1 || reg.v.val_int > MODBUS_MAX_READ_REGISTER ||
+        bit.v.val_int < 1 || bit.v.val_int > MODBUS_MAX_READ_BIT) {
+        plog_warn(plugin,
+                  "config: invalid max_gap %" PRId64 ", max_register %" PRId64
+                  " or max_bit %" PRId64,
+                  gap.v.val_int, reg.v.val_int, bit.v.val_int);
+        return -1;
+    }
+
+    plog_info(plugin,
+              "config: max_gap: %" PRId64 ", max_register: %" PRId64
+              ", max_bit: %" PRId64,
+              gap.v.val_int, reg.v.val_int, bit.v.val_int);
+
+    nng_mtx_lock(plugin->mtx);
+    plugin->limit.max_gap      = gap.v.val_int;
+    plugin->limit.max_register = reg.v.val_int;
+    plugin->limit.max_bit      = bit.v.val_int;
+    plugin->sort_gen += 1;
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
 }
 
 int modbus_send_msg(void *ctx, uint16_t n_byte, uint8_t *bytes)
@@ -52,8 +237,27 @@ int modbus_send_msg(void *ctx, uint16_t n_byte, uint8_t *bytes)
     void (*stat_acc)(neu_adapter_t *, neu_node_stat_e, uint64_t) =
         plugin->common.adapter_callbacks->stat_acc;
 
+    if (plugin->gather) {
+        uint8_t *frame = plugin->send_frames[plugin->n_send];
+
+        memcpy(frame, bytes, n_byte);
+        plugin->send_iov[plugin->n_send].iov_base = frame;
+        plugin->send_iov[plugin->n_send].iov_len  = n_byte;
+        plugin->n_send += 1;
+
+        plog_send_protocol(plugin, bytes, n_byte);
+        return n_byte;
+    }
+
+    // keep the silent interval between the frames on a serial line
+    uint64_t now = now_us();
+    if (now < plugin->bus_idle) {
+        usleep(plugin->bus_idle - now);
+    }
+
     plog_send_protocol(plugin, bytes, n_byte);
     int ret = neu_conn_send(plugin->conn, bytes, n_byte);
+    plugin->bus_idle = now_us() + n_byte * plugin->char_us + plugin->gap_us;
     if (ret > 0) {
         stat_acc(plugin->common.adapter, NEU_NODE_STAT_MSGS_SENT, 1);
         stat_acc(plugin->common.adapter, NEU_NODE_STAT_BYTES_SENT, ret);
@@ -61,10 +265,11 @@ int modbus_send_msg(void *ctx, uint16_t n_byte, uint8_t *bytes)
     return ret;
 }
 
-int modbus_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group,
-                       uint16_t max_byte)
+int modbus_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group)
 {
-    struct modbus_group_data *gd = NULL;
+    struct modbus_group_data *gd     = NULL;
+    uint64_t                  now    = neu_time_ms();
+    uint16_t                  n_dead = 0;
 
     if (group->user_data == NULL) {
         gd = calloc(1, sizeof(struct modbus_group_data));
@@ -82,49 +287,143 @@ int modbus_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group,
             utarray_push_back(gd->tags, &p);
         }
 
-        gd->group    = strdup(group->group_name);
-        gd->cmd_sort = modbus_tag_sort(gd->tags, max_byte);
+        gd->plugin = plugin;
+        gd->group  = strdup(group->group_name);
     } else {
         gd = (struct modbus_group_data *) group->user_data;
     }
-    plugin->plugin_group_data = gd;
+
+    nng_mtx_lock(plugin->mtx);
+    if (gd->n_work > 0) {
+        // the device is slower than the interval, skip this round
+        plog_debug(plugin, "group: %s, %u requests still pending", gd->group,
+                   gd->n_work);
+        nng_mtx_unlock(plugin->mtx);
+        return 0;
+    }
+
+    // nothing refers to the commands with no work left
+    if (gd->cmd_sort == NULL || gd->sort_gen != plugin->sort_gen) {
+        if (gd->cmd_sort != NULL) {
+            modbus_tag_sort_free(gd->cmd_sort);
+        }
+        gd->cmd_sort = modbus_tag_sort(gd->tags, &plugin->limit);
+        gd->sort_gen = plugin->sort_gen;
+        plog_debug(plugin, "group: %s, %u tags in %u read commands",
+                   gd->group, utarray_len(gd->tags), gd->cmd_sort->n_cmd);
+    }
 
     for (uint16_t i = 0; i < gd->cmd_sort->n_cmd; i++) {
-        uint16_t response_size = 0;
-        plugin->cmd_idx        = i;
-        int ret                = modbus_stack_read(
-            plugin->stack, gd->cmd_sort->cmd[i].slave_id,
-            gd->cmd_sort->cmd[i].area, gd->cmd_sort->cmd[i].start_address,
-            gd->cmd_sort->cmd[i].n_register, &response_size);
-        if (ret > 0) {
-            process_protocol_buf(plugin, response_size);
+        modbus_read_cmd_t *cmd = &gd->cmd_sort->cmd[i];
+
+        if (plugin->health[cmd->slave_id][cmd->area].backoff > now) {
+            n_dead += 1;
         }
     }
+    if (n_dead > 0 && n_dead == gd->cmd_sort->n_cmd) {
+        neu_dvalue_t dvalue = { .type      = NEU_TYPE_ERROR,
+                                .value.i32 = NEU_ERR_PLUGIN_READ_FAILURE };
+
+        // every tag of the group at once
+        plugin->common.adapter_callbacks->driver.update(
+            plugin->common.adapter, gd->group, NULL, dvalue);
+        nng_mtx_unlock(plugin->mtx);
+        return 0;
+    }
+
+    for (uint16_t i = 0; i < gd->cmd_sort->n_cmd; i++) {
+        modbus_read_cmd_t *cmd    = &gd->cmd_sort->cmd[i];
+        modbus_health_t *  health = &plugin->health[cmd->slave_id][cmd->area];
+        modbus_work_t *    work   = NULL;
+
+        if (health->backoff > now) {
+            cmd_error(plugin, gd, i, NEU_ERR_PLUGIN_READ_FAILURE);
+            continue;
+        }
+
+        work           = calloc(1, sizeof(modbus_work_t));
+        work->type     = MODBUS_WORK_READ;
+        work->gd       = gd;
+        work->cmd_idx  = i;
+        work->unit     = cmd->slave_id;
+        work->area     = cmd->area;
+        work->deadline = now + plugin->timeout;
+        if (health->n_fail >= MODBUS_HEALTH_FAIL) {
+            // the backoff is over, the other commands to the area wait for
+            // the answer of this one
+            work->probe     = true;
+            health->backoff = work->deadline;
+        }
+        work_queue(plugin, work);
+        gd->n_work += 1;
+    }
+    loop_wakeup(plugin);
+    nng_mtx_unlock(plugin->mtx);
 
     return 0;
 }
 
-int modbus_value_handle(void *ctx, uint8_t slave_id, uint16_t n_byte,
-                        uint8_t *bytes)
+int modbus_value_handle(void *ctx, uint16_t seq, uint8_t slave_id,
+                        uint16_t n_byte, uint8_t *bytes)
 {
-    neu_plugin_t *            plugin = (neu_plugin_t *) ctx;
-    struct modbus_group_data *gd =
-        (struct modbus_group_data *) plugin->plugin_group_data;
-    uint16_t start_address = gd->cmd_sort->cmd[plugin->cmd_idx].start_address;
-    uint16_t n_register    = gd->cmd_sort->cmd[plugin->cmd_idx].n_register;
+    neu_plugin_t *            plugin        = (neu_plugin_t *) ctx;
+    modbus_work_t *           work          = work_find(plugin, seq);
+    struct modbus_group_data *gd            = NULL;
+    uint16_t                  cmd_idx       = 0;
+    uint16_t                  start_address = 0;
+    uint16_t                  n_register    = 0;
+    // the byte count of a response is a single byte
+    uint16_t                  regs[(UINT8_MAX + 1) / 2];
+
+    if (work == NULL) {
+        // already timed out
+        plog_debug(plugin, "drop response of transaction %u", seq);
+        return 0;
+    }
+
+    work_done(plugin, work);
 
     if (bytes == NULL) {
-        neu_dvalue_t dvalue = { 0 };
+        // the gateway got no answer from the slave behind it
+        if (n_byte == MODBUS_EXCEPTION_GATEWAY_PATH ||
+            n_byte == MODBUS_EXCEPTION_GATEWAY_TARGET) {
+            health_fail(plugin, work);
+        } else {
+            health_ok(plugin, work);
+        }
+        if (n_byte == MODBUS_EXCEPTION_ILLEGAL_ADDRESS &&
+            work->type == MODBUS_WORK_READ) {
+            hole_learn(plugin, work->gd, work->cmd_idx);
+        }
+        work_fail(plugin, work,
+                  work->type == MODBUS_WORK_READ
+                      ? NEU_ERR_PLUGIN_READ_FAILURE
+                      : NEU_ERR_PLUGIN_WRITE_FAILURE);
+        work_free(work);
+        return 0;
+    }
 
-        dvalue.type      = NEU_TYPE_ERROR;
-        dvalue.value.i32 = NEU_ERR_PLUGIN_DISCONNECTED;
-        plugin->common.adapter_callbacks->driver.update(
-            plugin->common.adapter, gd->group, NULL, dvalue);
+    health_ok(plugin, work);
+    if (work->type != MODBUS_WORK_READ) {
+        plog_warn(plugin, "transaction %u, unexpected read response", seq);
+        work_fail(plugin, work, NEU_ERR_PLUGIN_PROTOCOL_DECODE_FAILURE);
+        work_free(work);
         return 0;
     }
 
-    utarray_foreach(gd->cmd_sort->cmd[plugin->cmd_idx].tags, modbus_point_t **,
-                    p_tag)
+    gd            = work->gd;
+    cmd_idx       = work->cmd_idx;
+    start_address = gd->cmd_sort->cmd[cmd_idx].start_address;
+    n_register    = gd->cmd_sort->cmd[cmd_idx].n_register;
+    work_free(work);
+
+    // swapped once for the whole response instead of tag by tag
+    if (gd->cmd_sort->cmd[cmd_idx].area == MODBUS_AREA_HOLD_REGISTER ||
+        gd->cmd_sort->cmd[cmd_idx].area == MODBUS_AREA_INPUT_REGISTER) {
+        modbus_registers_decode(bytes, n_byte / 2, regs);
+    }
+
+    utarray_foreach(gd->cmd_sort->cmd[cmd_idx].tags, modbus_point_t **, p_tag)
     {
         neu_dvalue_t dvalue = { 0 };
 
@@ -136,15 +435,32 @@ int modbus_value_handle(void *ctx, uint8_t slave_id, uint16_t n_byte,
         } else {
             switch ((*p_tag)->area) {
             case MODBUS_AREA_HOLD_REGISTER:
-            case MODBUS_AREA_INPUT_REGISTER:
-                if (n_byte >= ((*p_tag)->start_address - start_address) * 2 +
-                        (*p_tag)->n_register * 2) {
-                    memcpy(dvalue.value.bytes,
-                           bytes +
-                               ((*p_tag)->start_address - start_address) * 2,
+            case MODBUS_AREA_INPUT_REGISTER: {
+                uint16_t offset = (*p_tag)->start_address - start_address;
+
+                if (n_byte < (offset + (*p_tag)->n_register) * 2) {
+                    break;
+                }
+
+                switch ((*p_tag)->type) {
+                case NEU_TYPE_UINT16:
+                case NEU_TYPE_INT16:
+                case NEU_TYPE_BIT:
+                    dvalue.value.u16 = regs[offset];
+                    break;
+                case NEU_TYPE_FLOAT:
+                case NEU_TYPE_INT32:
+                case NEU_TYPE_UINT32:
+                    dvalue.value.u32 =
+                        (uint32_t) regs[offset] << 16 | regs[offset + 1];
+                    break;
+                default:
+                    memcpy(dvalue.value.bytes, bytes + offset * 2,
                            (*p_tag)->n_register * 2);
+                    break;
                 }
                 break;
+            }
             case MODBUS_AREA_COIL:
             case MODBUS_AREA_INPUT: {
                 uint16_t offset = (*p_tag)->start_address - start_address;
@@ -159,21 +475,11 @@ int modbus_value_handle(void *ctx, uint8_t slave_id, uint16_t n_byte,
 
             dvalue.type = (*p_tag)->type;
             switch ((*p_tag)->type) {
-            case NEU_TYPE_UINT16:
-            case NEU_TYPE_INT16:
-                dvalue.value.u16 = ntohs(dvalue.value.u16);
-                break;
-            case NEU_TYPE_FLOAT:
-            case NEU_TYPE_INT32:
-            case NEU_TYPE_UINT32:
-                dvalue.value.u32 = ntohl(dvalue.value.u32);
-                break;
             case NEU_TYPE_BIT: {
                 switch ((*p_tag)->area) {
                 case MODBUS_AREA_HOLD_REGISTER:
                 case MODBUS_AREA_INPUT_REGISTER: {
-                    neu_value16_u v16 = { 0 };
-                    v16.value         = htons(*(uint16_t *) dvalue.value.bytes);
+                    neu_value16_u v16 = { .value = dvalue.value.u16 };
                     dvalue.value.u8 =
                         neu_value16_get_bit(v16, (*p_tag)->option.bit.bit);
                     break;
@@ -264,31 +570,82 @@ int modbus_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
         break;
     }
 
-    uint16_t response_size = 0;
-    ret = modbus_stack_write(plugin->stack, req, point.slave_id, point.area,
-                             point.start_address, point.n_register, value.bytes,
-                             n_byte, &response_size);
-    if (ret > 0) {
-        process_protocol_buf(plugin, response_size);
+    modbus_work_t *work = calloc(1, sizeof(modbus_work_t));
+
+    work->type   = MODBUS_WORK_WRITE;
+    work->req    = req;
+    work->point  = point;
+    work->value  = value;
+    work->n_byte = n_byte;
+    work->unit   = point.slave_id;
+    work->area   = point.area;
+
+    nng_mtx_lock(plugin->mtx);
+    modbus_work_t *queue = plugin->units[work->unit].queue;
+    // a write waiting behind the one in flight is sent along with the writes
+    // to the adjacent addresses queued meanwhile
+    if (queue != NULL && modbus_work_merge(queue->prev, work)) {
+        nng_mtx_unlock(plugin->mtx);
+        return 0;
     }
 
+    work->deadline = neu_time_ms() + plugin->timeout;
+    work_queue(plugin, work);
+    loop_wakeup(plugin);
+    nng_mtx_unlock(plugin->mtx);
+
     return 0;
 }
 
-int modbus_write_resp(void *ctx, void *req, int error)
+int modbus_write_resp(void *ctx, uint16_t seq, int error)
 {
-    neu_plugin_t *plugin = (neu_plugin_t *) ctx;
+    neu_plugin_t * plugin = (neu_plugin_t *) ctx;
+    modbus_work_t *work   = work_find(plugin, seq);
 
-    plugin->common.adapter_callbacks->driver.write_response(
-        plugin->common.adapter, req, error);
+    if (work == NULL || work->type != MODBUS_WORK_WRITE) {
+        plog_debug(plugin, "drop write response of transaction %u", seq);
+        return 0;
+    }
+
+    work_done(plugin, work);
+    health_ok(plugin, work);
+
+    write_response(plugin, work, error);
+    work_free(work);
     return 0;
 }
 
 static void plugin_group_free(neu_plugin_group_t *pgp)
 {
     struct modbus_group_data *gd = (struct modbus_group_data *) pgp->user_data;
+    neu_plugin_t *            plugin = gd->plugin;
+    modbus_work_t *           work = NULL, *tmp = NULL;
+    modbus_unit_t *           unit = NULL, *unit_tmp = NULL;
+
+    // a late response of the dropped requests is ignored
+    nng_mtx_lock(plugin->mtx);
+    DL_FOREACH_SAFE(plugin->ready, unit, unit_tmp)
+    {
+        DL_FOREACH_SAFE(unit->queue, work, tmp)
+        {
+            if (work->gd == gd) {
+                unit_dequeue(plugin, unit, work);
+                work_free(work);
+            }
+        }
+    }
+    DL_FOREACH_SAFE(plugin->inflight, work, tmp)
+    {
+        if (work->gd == gd) {
+            work_done(plugin, work);
+            work_free(work);
+        }
+    }
+    nng_mtx_unlock(plugin->mtx);
 
-    modbus_tag_sort_free(gd->cmd_sort);
+    if (gd->cmd_sort != NULL) {
+        modbus_tag_sort_free(gd->cmd_sort);
+    }
 
     utarray_foreach(gd->tags, modbus_point_t **, tag) { free(*tag); }
 
@@ -298,26 +655,614 @@ static void plugin_group_free(neu_plugin_group_t *pgp)
     free(gd);
 }
 
-static int process_protocol_buf(neu_plugin_t *plugin, uint16_t response_size)
+static void cmd_error(neu_plugin_t *plugin, struct modbus_group_data *gd,
+                      uint16_t cmd_idx, int error)
+{
+    utarray_foreach(gd->cmd_sort->cmd[cmd_idx].tags, modbus_point_t **, p_tag)
+    {
+        neu_dvalue_t dvalue = { 0 };
+
+        dvalue.type      = NEU_TYPE_ERROR;
+        dvalue.value.i32 = error;
+        plugin->common.adapter_callbacks->driver.update(
+            plugin->common.adapter, gd->group, (*p_tag)->name, dvalue);
+    }
+}
+
+static void work_fail(neu_plugin_t *plugin, modbus_work_t *work, int error)
+{
+    switch (work->type) {
+    case MODBUS_WORK_READ:
+        cmd_error(plugin, work->gd, work->cmd_idx, error);
+        break;
+    case MODBUS_WORK_WRITE:
+        write_response(plugin, work, error);
+        break;
+    }
+}
+
+static void work_free(modbus_work_t *work)
+{
+    modbus_work_t *merged = NULL, *tmp = NULL;
+
+    if (work->gd != NULL) {
+        work->gd->n_work -= 1;
+    }
+
+    DL_FOREACH_SAFE(work->merged, merged, tmp)
+    {
+        DL_DELETE(work->merged, merged);
+        free(merged);
+    }
+    free(work->batch);
+    free(work);
+}
+
+static void write_response(neu_plugin_t *plugin, modbus_work_t *work,
+                           int error)
+{
+    modbus_work_t *merged = NULL;
+
+    plugin->common.adapter_callbacks->driver.write_response(
+        plugin->common.adapter, work->req, error);
+    DL_FOREACH(work->merged, merged)
+    {
+        plugin->common.adapter_callbacks->driver.write_response(
+            plugin->common.adapter, merged->req, error);
+    }
+}
+
+static void work_queue(neu_plugin_t *plugin, modbus_work_t *work)
+{
+    modbus_unit_t *unit = &plugin->units[work->unit];
+
+    DL_APPEND(unit->queue, work);
+    if (!unit->ready) {
+        unit->ready = true;
+        DL_APPEND(plugin->ready, unit);
+        plugin->n_ready += 1;
+    }
+}
+
+// the work is not in flight any more
+static void work_done(neu_plugin_t *plugin, modbus_work_t *work)
+{
+    DL_DELETE(plugin->inflight, work);
+    plugin->n_inflight -= 1;
+    plugin->units[work->unit].n_inflight -= 1;
+}
+
+static void unit_dequeue(neu_plugin_t *plugin, modbus_unit_t *unit,
+                         modbus_work_t *work)
+{
+    DL_DELETE(unit->queue, work);
+    if (unit->queue == NULL) {
+        unit->ready = false;
+        DL_DELETE(plugin->ready, unit);
+        plugin->n_ready -= 1;
+    }
+}
+
+// the first failures are taken as glitches, then the pause doubles each time
+static void health_fail(neu_plugin_t *plugin, modbus_work_t *work)
+{
+    modbus_health_t *health = &plugin->health[work->unit][work->area];
+    uint64_t         pause  = plugin->timeout;
+
+    if (health->n_fail < UINT16_MAX) {
+        health->n_fail += 1;
+    }
+    if (health->n_fail < MODBUS_HEALTH_FAIL) {
+        return;
+    }
+
+    for (uint16_t i = MODBUS_HEALTH_FAIL;
+         i < health->n_fail && pause < MODBUS_HEALTH_BACKOFF_MAX; i++) {
+        pause *= 2;
+    }
+    if (pause > MODBUS_HEALTH_BACKOFF_MAX) {
+        pause = MODBUS_HEALTH_BACKOFF_MAX;
+    }
+
+    health->backoff = neu_time_ms() + pause;
+    plog_warn(plugin,
+              "slave %u %s failed %u times in a row, skipped for %" PRIu64
+              " ms",
+              work->unit, modbus_area_to_str(work->area), health->n_fail,
+              pause);
+}
+
+static void health_ok(neu_plugin_t *plugin, modbus_work_t *work)
+{
+    modbus_health_t *health = &plugin->health[work->unit][work->area];
+
+    if (health->n_fail >= MODBUS_HEALTH_FAIL) {
+        plog_notice(plugin, "slave %u %s answers again", work->unit,
+                    modbus_area_to_str(work->area));
+    }
+    health->n_fail  = 0;
+    health->backoff = 0;
+}
+
+static bool hole_add(neu_plugin_t *plugin, modbus_hole_t *hole)
+{
+    utarray_foreach(plugin->limit.holes, modbus_hole_t *, h)
+    {
+        if (h->slave_id == hole->slave_id && h->area == hole->area &&
+            h->start == hole->start && h->end == hole->end) {
+            return false;
+        }
+    }
+
+    if (utarray_len(plugin->limit.holes) >= MODBUS_MAX_HOLE) {
+        plog_warn(plugin, "too many illegal address ranges, ignore %u-%u",
+                  hole->start, hole->end);
+        return false;
+    }
+
+    plog_notice(plugin, "slave %u %s, illegal address range %u-%u",
+                hole->slave_id, modbus_area_to_str(hole->area), hole->start,
+                hole->end);
+    utarray_push_back(plugin->limit.holes, hole);
+    return true;
+}
+
+// the device refuses a command, split it around the addresses read for no tag,
+// or in halves if there are none, until the refused tags are read alone
+static void hole_learn(neu_plugin_t *plugin, struct modbus_group_data *gd,
+                       uint16_t cmd_idx)
+{
+    modbus_read_cmd_t *cmd     = &gd->cmd_sort->cmd[cmd_idx];
+    uint16_t           n_tag   = utarray_len(cmd->tags);
+    uint32_t           covered = cmd->start_address;
+    bool               learnt  = false;
+    modbus_hole_t      hole    = {
+        .slave_id = cmd->slave_id,
+        .area     = cmd->area,
+    };
+
+    if (n_tag < 2) {
+        return;
+    }
+
+    // the tags are in address order
+    utarray_foreach(cmd->tags, modbus_point_t **, p_tag)
+    {
+        uint32_t end = (uint32_t)(*p_tag)->start_address + (*p_tag)->n_register;
+
+        if ((*p_tag)->start_address > covered) {
+            hole.start = covered;
+            hole.end   = (*p_tag)->start_address;
+            learnt     = hole_add(plugin, &hole) || learnt;
+        }
+        if (end > covered) {
+            covered = end;
+        }
+    }
+
+    for (uint16_t i = 0; i < n_tag && !learnt; i++) {
+        uint16_t        idx = (n_tag / 2 + i) % n_tag;
+        modbus_point_t *p   = NULL;
+
+        p = *(modbus_point_t **) utarray_eltptr(cmd->tags, idx);
+
+        if (p->start_address > cmd->start_address) {
+            hole.start = p->start_address;
+            hole.end   = p->start_address;
+            learnt     = hole_add(plugin, &hole);
+        }
+    }
+
+    if (learnt) {
+        plugin->sort_gen += 1;
+    }
+}
+
+static modbus_work_t *work_find(neu_plugin_t *plugin, uint16_t seq)
+{
+    modbus_work_t *work = NULL;
+
+    DL_FOREACH(plugin->inflight, work)
+    {
+        if (work->seq == seq) {
+            return work;
+        }
+    }
+
+    return NULL;
+}
+
+static int work_send(neu_plugin_t *plugin, modbus_work_t *work)
+{
+    uint16_t response_size = 0;
+
+    switch (work->type) {
+    case MODBUS_WORK_READ: {
+        modbus_read_cmd_t *cmd = &work->gd->cmd_sort->cmd[work->cmd_idx];
+
+        return modbus_stack_read(plugin->stack, cmd->slave_id, cmd->area,
+                                 cmd->start_address, cmd->n_register,
+                                 &response_size, &work->seq);
+    }
+    case MODBUS_WORK_WRITE:
+        if (work->batch != NULL && work->point.area == MODBUS_AREA_COIL) {
+            uint8_t bits[MODBUS_MAX_WRITE_BIT / 8] = { 0 };
+
+            for (uint16_t i = 0; i < work->point.n_register; i++) {
+                bits[i / 8] |= work->batch[i] << (i % 8);
+            }
+            return modbus_stack_write(
+                plugin->stack, work->point.slave_id, work->point.area,
+                work->point.start_address, work->point.n_register, bits,
+                (work->point.n_register + 7) / 8, &response_size, &work->seq);
+        }
+
+        return modbus_stack_write(
+            plugin->stack, work->point.slave_id, work->point.area,
+            work->point.start_address, work->point.n_register,
+            work->batch != NULL ? work->batch : work->value.bytes,
+            work->n_byte, &response_size, &work->seq);
+    }
+
+    return -1;
+}
+
+static void loop_wakeup(neu_plugin_t *plugin)
+{
+    if (write(plugin->wakeup[1], "", 1) != 1) {
+        // the pipe is full, the events thread is woken up anyway
+    }
+}
+
+// the socket options in effect, reported once connected
+static void loop_stat_tune(neu_plugin_t *plugin)
+{
+    void (*stat_acc)(neu_adapter_t *, neu_node_stat_e, uint64_t) =
+        plugin->common.adapter_callbacks->stat_acc;
+    neu_adapter_t * adapter = plugin->common.adapter;
+    neu_conn_stat_t stat    = { 0 };
+
+    neu_conn_stat(plugin->conn, &stat);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_NODELAY, stat.tune.nodelay);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_KEEPALIVE_IDLE,
+             stat.tune.keepalive_idle);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_KEEPALIVE_INTVL,
+             stat.tune.keepalive_interval);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_KEEPALIVE_COUNT,
+             stat.tune.keepalive_count);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_RCVBUF, stat.tune.rcvbuf);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_SNDBUF, stat.tune.sndbuf);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_BUSY_POLL, stat.tune.busy_poll);
+    stat_acc(adapter, NEU_NODE_STAT_SOCK_USER_TIMEOUT, stat.tune.user_timeout);
+}
+
+// follow the connection changes made by the connection callbacks
+static void loop_sync_conn(neu_plugin_t *plugin)
+{
+    int fd  = 0;
+    int gen = 0;
+
+    nng_mtx_lock(plugin->conn_mtx);
+    fd  = plugin->conn_fd;
+    gen = plugin->conn_gen;
+    nng_mtx_unlock(plugin->conn_mtx);
+
+    if (gen == plugin->conn_io_gen) {
+        return;
+    }
+    plugin->conn_io_gen = gen;
+
+    if (plugin->conn_io != NULL) {
+        neu_event_del_io(plugin->events, plugin->conn_io);
+        plugin->conn_io = NULL;
+    }
+    plugin->recv_head = 0;
+    plugin->recv_len  = 0;
+
+    if (fd >= 0) {
+        neu_event_io_param_t io = {
+            .fd       = fd,
+            .usr_data = (void *) plugin,
+            .cb       = loop_conn_cb,
+        };
+
+        plugin->conn_io = neu_event_add_io(plugin->events, io);
+        if (plugin->protocol == MODBUS_PROTOCOL_TCP) {
+            loop_stat_tune(plugin);
+        }
+        return;
+    }
+
+    // nothing sent on the closed connection will be answered, nor are the
+    // frames kept for it sent
+    plugin->n_send = 0;
+    loop_fail_inflight(plugin, NEU_ERR_PLUGIN_DISCONNECTED);
+}
+
+// the works in flight will not be answered, error 0 fails each of them as a
+// read or write failure
+static void loop_fail_inflight(neu_plugin_t *plugin, int error)
+{
+    modbus_work_t *work = NULL, *tmp = NULL;
+
+    DL_FOREACH_SAFE(plugin->inflight, work, tmp)
+    {
+        int e = error;
+
+        if (e == 0) {
+            e = work->type == MODBUS_WORK_READ ? NEU_ERR_PLUGIN_READ_FAILURE
+                                               : NEU_ERR_PLUGIN_WRITE_FAILURE;
+        }
+        work_done(plugin, work);
+        work_fail(plugin, work, e);
+        work_free(work);
+    }
+}
+
+static void loop_expire(neu_plugin_t *plugin, uint64_t now)
+{
+    modbus_work_t *work = NULL, *tmp = NULL;
+    modbus_unit_t *unit = NULL, *unit_tmp = NULL;
+
+    DL_FOREACH_SAFE(plugin->inflight, work, tmp)
+    {
+        if (work->deadline <= now) {
+            plog_warn(plugin, "transaction %u timeout", work->seq);
+            if (plugin->protocol == MODBUS_PROTOCOL_RTU) {
+                // whatever received belongs to the request timed out
+                plugin->recv_head = 0;
+                plugin->recv_len  = 0;
+            }
+            work_done(plugin, work);
+            health_fail(plugin, work);
+            work_fail(plugin, work,
+                      work->type == MODBUS_WORK_READ
+                          ? NEU_ERR_PLUGIN_READ_FAILURE
+                          : NEU_ERR_PLUGIN_WRITE_FAILURE);
+            work_free(work);
+        }
+    }
+
+    // never sent, either the device is unreachable or the window is kept
+    // full by a slow device, the requests to an area skipped meanwhile fail
+    // at once instead of holding their group until the deadline
+    DL_FOREACH_SAFE(plugin->ready, unit, unit_tmp)
+    {
+        DL_FOREACH_SAFE(unit->queue, work, tmp)
+        {
+            modbus_health_t *health =
+                &plugin->health[work->unit][work->area];
+
+            if (work->deadline <= now ||
+                (health->backoff > now && !work->probe)) {
+                int error = NEU_ERR_PLUGIN_DISCONNECTED;
+
+                if (plugin->common.link_state ==
+                    NEU_NODE_LINK_STATE_CONNECTED) {
+                    error = work->type == MODBUS_WORK_READ
+                        ? NEU_ERR_PLUGIN_READ_FAILURE
+                        : NEU_ERR_PLUGIN_WRITE_FAILURE;
+                }
+
+                unit_dequeue(plugin, unit, work);
+                work_fail(plugin, work, error);
+                work_free(work);
+            }
+        }
+    }
+}
+
+// send the requests gathered in one pump, the frames already in flight are
+// failed by the disconnection if they could not all be sent, they are kept
+// for the next pump if the connection is only busy. The sessions of a pooled
+// conn are shared, so only the works of this node are failed then
+static void loop_flush(neu_plugin_t *plugin)
 {
-    uint8_t *                 recv_buf = calloc(response_size, 1);
-    neu_protocol_unpack_buf_t pbuf     = { 0 };
-    ssize_t                   ret      = 0;
     void (*stat_acc)(neu_adapter_t *, neu_node_stat_e, uint64_t) =
         plugin->common.adapter_callbacks->stat_acc;
+    ssize_t len = 0;
+    ssize_t ret = 0;
+
+    plugin->gather = false;
+    if (plugin->n_send == 0) {
+        return;
+    }
 
-    ret = neu_conn_recv(plugin->conn, recv_buf, response_size);
+    for (uint16_t i = 0; i < plugin->n_send; i++) {
+        len += plugin->send_iov[i].iov_len;
+    }
 
+    ret = neu_conn_sendv(plugin->conn, plugin->send_iov, plugin->n_send);
+    if (ret < 0 && errno == EAGAIN) {
+        plog_debug(plugin, "send %u requests again later", plugin->n_send);
+        return;
+    }
     if (ret > 0) {
-        stat_acc(plugin->common.adapter, NEU_NODE_STAT_BYTES_RECV, ret);
-        neu_protocol_unpack_buf_init(&pbuf, recv_buf, ret);
-        plog_recv_protocol(plugin, recv_buf, ret);
-        ret = modbus_stack_recv(plugin->stack, &pbuf);
-        if (ret > 0) {
+        stat_acc(plugin->common.adapter, NEU_NODE_STAT_MSGS_SENT,
+                 plugin->n_send);
+        stat_acc(plugin->common.adapter, NEU_NODE_STAT_BYTES_SENT, ret);
+    }
+    if (ret != len) {
+        plog_warn(plugin, "send %u requests, %zd of %zd bytes sent",
+                  plugin->n_send, ret, len);
+        if (plugin->pooled) {
+            loop_fail_inflight(plugin, 0);
+        } else {
+            neu_conn_disconnect(plugin->conn);
+        }
+    }
+
+    plugin->n_send = 0;
+}
+
+static void loop_pump(neu_plugin_t *plugin)
+{
+    uint16_t n_skip = 0;
+
+    loop_sync_conn(plugin);
+    loop_expire(plugin, neu_time_ms());
+
+    // only gather on an established connection, the first request connects
+    plugin->gather =
+        plugin->protocol == MODBUS_PROTOCOL_TCP && plugin->conn_io != NULL;
+
+    // round robin over the units, stop when every unit is passed over
+    while (plugin->ready != NULL && n_skip < plugin->n_ready &&
+           plugin->n_inflight < plugin->max_inflight &&
+           plugin->n_send < MODBUS_MAX_INFLIGHT) {
+        modbus_unit_t *unit = plugin->ready;
+        modbus_work_t *work = unit->queue;
+
+        DL_DELETE(plugin->ready, unit);
+        DL_APPEND(plugin->ready, unit);
+        if (unit->n_inflight >= plugin->unit_inflight) {
+            n_skip += 1;
+            continue;
+        }
+
+        // not connected yet, try again on the next tick
+        if (work_send(plugin, work) <= 0) {
+            break;
+        }
+
+        n_skip = 0;
+        unit_dequeue(plugin, unit, work);
+        DL_APPEND(plugin->inflight, work);
+        plugin->n_inflight += 1;
+        unit->n_inflight += 1;
+    }
+    loop_flush(plugin);
+
+    // sending connects or disconnects
+    loop_sync_conn(plugin);
+}
+
+// parse the complete frames received
+static void loop_recv(neu_plugin_t *plugin)
+{
+    neu_protocol_unpack_buf_t pbuf = { 0 };
+    ssize_t                   ret  = 0;
+    void (*stat_acc)(neu_adapter_t *, neu_node_stat_e, uint64_t) =
+        plugin->common.adapter_callbacks->stat_acc;
+
+    if (sizeof(plugin->recv_buf) - plugin->recv_len < MODBUS_MAX_ADU) {
+        memmove(plugin->recv_buf, plugin->recv_buf + plugin->recv_head,
+                plugin->recv_len - plugin->recv_head);
+        plugin->recv_len -= plugin->recv_head;
+        plugin->recv_head = 0;
+    }
+
+    ret = neu_conn_recv(plugin->conn, plugin->recv_buf + plugin->recv_len,
+                        sizeof(plugin->recv_buf) - plugin->recv_len);
+    if (ret <= 0) {
+        return;
+    }
+    stat_acc(plugin->common.adapter, NEU_NODE_STAT_BYTES_RECV, ret);
+    plugin->recv_len += ret;
+    plugin->bus_idle = now_us() + plugin->gap_us;
+
+    // a read may end in the middle of a frame or carry several of them
+    while (plugin->recv_len > plugin->recv_head) {
+        uint8_t *frame = plugin->recv_buf + plugin->recv_head;
+        uint16_t n     = plugin->recv_len - plugin->recv_head;
+        int      len   = modbus_stack_frame_size(plugin->stack, frame, n);
+
+        if (len < 0) {
+            plog_warn(plugin, "invalid frame, drop %u bytes", n);
+            plugin->recv_head = 0;
+            plugin->recv_len  = 0;
+            // out of sync with the stream, start over on a new connection,
+            // the serial line resyncs at the next silent interval. The pool
+            // checks the framing of the shared sessions itself
+            if (plugin->pooled) {
+                loop_fail_inflight(plugin, 0);
+            } else if (plugin->protocol == MODBUS_PROTOCOL_TCP) {
+                neu_conn_disconnect(plugin->conn);
+            }
+            return;
+        }
+
+        if (len == 0 || n < len) {
+            break;
+        }
+
+        plog_recv_protocol(plugin, frame, len);
+        neu_protocol_unpack_buf_init(&pbuf, frame, len);
+        if (modbus_stack_recv(plugin->stack, &pbuf) > 0) {
             stat_acc(plugin->common.adapter, NEU_NODE_STAT_MSGS_RECV, 1);
+        } else {
+            plog_warn(plugin, "drop frame of %d bytes, decode failure", len);
         }
+        plugin->recv_head += len;
     }
 
-    free(recv_buf);
-    return ret;
-}
\ No newline at end of file
+    if (plugin->recv_head == plugin->recv_len) {
+        plugin->recv_head = 0;
+        plugin->recv_len  = 0;
+    }
+}
+
+static int loop_conn_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    neu_plugin_t *plugin = (neu_plugin_t *) usr_data;
+    (void) fd;
+
+    nng_mtx_lock(plugin->mtx);
+    switch (type) {
+    case NEU_EVENT_IO_READ:
+        loop_recv(plugin);
+        break;
+    case NEU_EVENT_IO_CLOSED:
+    case NEU_EVENT_IO_HUP:
+        plog_warn(plugin, "connection closed by the device");
+        neu_conn_disconnect(plugin->conn);
+        break;
+    }
+    loop_pump(plugin);
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
+}
+
+static int loop_wakeup_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    neu_plugin_t *plugin = (neu_plugin_t *) usr_data;
+    char          c      = 0;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    while (read(fd, &c, 1) == 1) {
+    }
+
+    nng_mtx_lock(plugin->mtx);
+    if (plugin->closing) {
+        if (plugin->conn_io != NULL) {
+            neu_event_del_io(plugin->events, plugin->conn_io);
+            plugin->conn_io = NULL;
+        }
+        neu_event_del_timer(plugin->events, plugin->tick);
+        neu_event_del_io(plugin->events, plugin->wakeup_io);
+        plugin->wakeup_io = NULL;
+        nng_cv_wake(plugin->closed);
+    } else {
+        loop_pump(plugin);
+    }
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
+}
+
+static int loop_tick_cb(void *usr_data)
+{
+    neu_plugin_t *plugin = (neu_plugin_t *) usr_data;
+
+    nng_mtx_lock(plugin->mtx);
+    if (plugin->ready != NULL || plugin->inflight != NULL) {
+        loop_pump(plugin);
+    }
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
+}
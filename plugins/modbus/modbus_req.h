@@ -16,37 +16,173 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
+
 #ifndef _NEU_M_PLUGIN_MODBUS_REQ_H_
 #define _NEU_M_PLUGIN_MODBUS_REQ_H_
 
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include <nng/nng.h>
+#include <nng/supplemental/util/platform.h>
+
 #include <neuron.h>
 
+#include "modbus_point.h"
 #include "modbus_stack.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODBUS_MAX_INFLIGHT 16
+#define MODBUS_RECV_BUF (MODBUS_MAX_INFLIGHT * MODBUS_MAX_ADU)
+#define MODBUS_MAX_UNIT 256
+// failures in a row before an area of a slave is skipped
+#define MODBUS_HEALTH_FAIL 2
+// longest pause of an area not answering, in ms
+#define MODBUS_HEALTH_BACKOFF_MAX 60000
+// address ranges learnt to be refused by the device
+#define MODBUS_MAX_HOLE 256
+
+typedef enum modbus_work_type {
+    MODBUS_WORK_READ,
+    MODBUS_WORK_WRITE,
+} modbus_work_type_e;
+
+// a request waiting to be sent, or sent and waiting for its response
+typedef struct modbus_work {
+    modbus_work_type_e type;
+
+    struct modbus_group_data *gd; // read
+    uint16_t                  cmd_idx;
+
+    void *         req; // write
+    modbus_point_t point;
+    neu_value_u    value;
+    uint8_t        n_byte;
+
+    // the writes queued right behind an adjacent write are merged into it,
+    // point then covers all of them, batch holds 2 bytes of each register or
+    // 1 byte of each coil
+    struct modbus_work *merged;
+    uint8_t *           batch;
+
+    uint8_t       unit;
+    modbus_area_e area;
+    bool          probe; // sent to see if a skipped area answers again
+    uint16_t      seq;
+    uint64_t      deadline;
+
+    struct modbus_work *prev;
+    struct modbus_work *next;
+} modbus_work_t;
+
+// the requests to one unit id, behind a gateway each unit id is a slave of its
+// own that may be slow or dead without the others being affected
+typedef struct modbus_unit {
+    modbus_work_t *queue;
+    uint16_t       n_inflight;
+
+    bool                ready; // in the ready ring, the queue is not empty
+    struct modbus_unit *prev;
+    struct modbus_unit *next;
+} modbus_unit_t;
+
+// an area of a slave not answering is skipped by the group timer until the
+// backoff, then a single request probes it
+typedef struct modbus_health {
+    uint16_t n_fail;  // timeouts in a row
+    uint64_t backoff; // ms
+} modbus_health_t;
+
 struct neu_plugin {
     neu_plugin_common_t common;
 
-    neu_conn_t *    conn;
-    modbus_stack_t *stack;
+    modbus_protocol_e protocol;
+    neu_conn_t *      conn;
+    modbus_stack_t *  stack;
+    // the sessions of the conn may be shared with other nodes
+    bool pooled;
+
+    // serial line timing in microseconds, 0 for tcp
+    uint32_t char_us;
+    uint32_t gap_us;
+    uint64_t bus_idle; // no frame is sent before it
+
+    // the requests are sent and the responses are handled on the events
+    // thread only, the group timer and the write request just queue the work
+    nng_mtx *          mtx;
+    neu_events_t *     events;
+    neu_event_timer_t *tick;
+    neu_event_io_t *   wakeup_io;
+    int                wakeup[2];
+    neu_event_io_t *   conn_io;
+    int                conn_io_gen;
+    bool               closing;
+    nng_cv *           closed;
+
+    uint16_t       timeout;
+    uint16_t       max_inflight;
+    uint16_t       n_inflight;
+    modbus_work_t *inflight;
+
+    // the units are served in turn, one request each, a unit is skipped while
+    // it has unit_inflight requests in flight
+    modbus_unit_t  units[MODBUS_MAX_UNIT];
+    modbus_unit_t *ready;
+    uint16_t       n_ready;
+    uint16_t       unit_inflight;
+
+    // by slave id and area
+    modbus_health_t health[MODBUS_MAX_UNIT][MODBUS_AREA_HOLD_REGISTER + 1];
 
-    void *   plugin_group_data;
-    uint16_t cmd_idx;
+    // the read commands of a group are sorted again when sort_gen changes
+    modbus_read_limit_t limit;
+    uint32_t            sort_gen;
 
-    neu_event_io_t *tcp_server_io;
-    int             client_fd;
-    neu_events_t *  events;
+    // the frames are parsed in place from recv_head to recv_len, the bytes
+    // left are moved to the front only when there is no room for another adu
+    uint8_t  recv_buf[MODBUS_RECV_BUF];
+    uint16_t recv_head;
+    uint16_t recv_len;
+
+    // over tcp the requests of one pump are gathered and sent by one writev
+    bool         gather;
+    uint8_t      send_frames[MODBUS_MAX_INFLIGHT][MODBUS_MAX_ADU];
+    struct iovec send_iov[MODBUS_MAX_INFLIGHT];
+    uint16_t     n_send;
+
+    // set by the connection callbacks
+    nng_mtx *conn_mtx;
+    int      conn_fd;
+    int      conn_gen;
 };
 
 void modbus_conn_connected(void *data, int fd);
 void modbus_conn_disconnected(void *data, int fd);
 
-int modbus_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group,
-                       uint16_t max_byte);
+// the stack is created and destroyed along with the loop, so is the conn
+int  modbus_loop_init(neu_plugin_t *plugin, modbus_protocol_e protocol);
+void modbus_loop_uninit(neu_plugin_t *plugin);
+
+// the optional max_gap, max_register and max_bit settings
+int modbus_read_limit_config(neu_plugin_t *plugin, const char *config);
+
+int modbus_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group);
 int modbus_send_msg(void *ctx, uint16_t n_byte, uint8_t *bytes);
-int modbus_value_handle(void *ctx, uint8_t slave_id, uint16_t n_byte,
-                        uint8_t *bytes);
+int modbus_value_handle(void *ctx, uint16_t seq, uint8_t slave_id,
+                        uint16_t n_byte, uint8_t *bytes);
 int modbus_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
                  neu_value_u value);
-int modbus_write_resp(void *ctx, void *req, int error);
+int modbus_write_resp(void *ctx, uint16_t seq, int error);
+
+// merge next into work when they write to adjacent or overlapping addresses,
+// the later value wins on the overlapping ones
+bool modbus_work_merge(modbus_work_t *work, modbus_work_t *next);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
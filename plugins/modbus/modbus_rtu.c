@@ -0,0 +1,256 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#include <stdlib.h>
+
+#include "neuron.h"
+
+#include "modbus_point.h"
+#include "modbus_req.h"
+#include "modbus_stack.h"
+
+static neu_plugin_t *driver_open(void);
+static int           driver_close(neu_plugin_t *plugin);
+static int           driver_init(neu_plugin_t *plugin);
+static int           driver_uninit(neu_plugin_t *plugin);
+static int           driver_start(neu_plugin_t *plugin);
+static int           driver_stop(neu_plugin_t *plugin);
+static int           driver_config(neu_plugin_t *plugin, const char *config);
+static int driver_request(neu_plugin_t *plugin, neu_reqresp_head_t *head,
+                          void *data);
+
+static int driver_validate_tag(neu_plugin_t *plugin, neu_datatag_t *tag);
+static int driver_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group);
+static int driver_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
+                        neu_value_u value);
+
+static const neu_plugin_intf_funs_t plugin_intf_funs = {
+    .open    = driver_open,
+    .close   = driver_close,
+    .init    = driver_init,
+    .uninit  = driver_uninit,
+    .start   = driver_start,
+    .stop    = driver_stop,
+    .setting = driver_config,
+    .request = driver_request,
+
+    .driver.validate_tag = driver_validate_tag,
+    .driver.group_timer  = driver_group_timer,
+    .driver.write_tag    = driver_write,
+};
+
+const neu_plugin_module_t neu_plugin_module = {
+    .version      = NEURON_PLUGIN_VER_1_0,
+    .module_name  = "modbus-rtu",
+    .module_descr = "The modbus-rtu plugin is used for devices connected using "
+                    "the modbus protocol rtu mode over a serial line.",
+    .intf_funs = &plugin_intf_funs,
+    .kind      = NEU_PLUGIN_KIND_SYSTEM,
+    .type      = NEU_NA_TYPE_DRIVER,
+    .single    = false,
+};
+
+static neu_plugin_t *driver_open(void)
+{
+    neu_plugin_t *plugin = calloc(1, sizeof(neu_plugin_t));
+
+    neu_plugin_common_init(&plugin->common);
+
+    return plugin;
+}
+
+static int driver_close(neu_plugin_t *plugin)
+{
+    free(plugin);
+
+    return 0;
+}
+
+static int driver_init(neu_plugin_t *plugin)
+{
+    return modbus_loop_init(plugin, MODBUS_PROTOCOL_RTU);
+}
+
+static int driver_uninit(neu_plugin_t *plugin)
+{
+    modbus_loop_uninit(plugin);
+
+    plog_info(plugin, "node: modbus uninit ok");
+
+    return 0;
+}
+
+static int driver_start(neu_plugin_t *plugin)
+{
+    neu_conn_start(plugin->conn);
+    return 0;
+}
+
+static int driver_stop(neu_plugin_t *plugin)
+{
+    neu_conn_stop(plugin->conn);
+    return 0;
+}
+
+static int tty_baud(int64_t baud, neu_conn_tty_baud_e *out)
+{
+    switch (baud) {
+    case 115200:
+        *out = NEU_CONN_TTY_BAUD_115200;
+        return 0;
+    case 57600:
+        *out = NEU_CONN_TTY_BAUD_57600;
+        return 0;
+    case 38400:
+        *out = NEU_CONN_TTY_BAUD_38400;
+        return 0;
+    case 19200:
+        *out = NEU_CONN_TTY_BAUD_19200;
+        return 0;
+    case 9600:
+        *out = NEU_CONN_TTY_BAUD_9600;
+        return 0;
+    case 4800:
+        *out = NEU_CONN_TTY_BAUD_4800;
+        return 0;
+    case 2400:
+        *out = NEU_CONN_TTY_BAUD_2400;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static int driver_config(neu_plugin_t *plugin, const char *config)
+{
+    int              ret       = 0;
+    char *           err_param = NULL;
+    neu_json_elem_t  device    = { .name = "device", .t = NEU_JSON_STR };
+    neu_json_elem_t  baud      = { .name = "baud", .t = NEU_JSON_INT };
+    neu_json_elem_t  data      = { .name = "data", .t = NEU_JSON_INT };
+    neu_json_elem_t  parity    = { .name = "parity", .t = NEU_JSON_INT };
+    neu_json_elem_t  stop      = { .name = "stop", .t = NEU_JSON_INT };
+    neu_json_elem_t  timeout   = { .name = "timeout", .t = NEU_JSON_INT };
+    neu_conn_param_t param     = { 0 };
+    uint32_t         n_bit     = 0;
+
+    ret = neu_parse_param((char *) config, &err_param, 6, &device, &baud,
+                          &data, &parity, &stop, &timeout);
+
+    if (ret != 0) {
+        plog_warn(plugin, "config: %s, decode error: %s", (char *) config,
+                  err_param);
+        free(err_param);
+        free(device.v.val_str);
+        return -1;
+    }
+
+    if (tty_baud(baud.v.val_int, &param.params.tty_client.baud) != 0 ||
+        data.v.val_int < 5 || data.v.val_int > 8 || parity.v.val_int < 0 ||
+        parity.v.val_int > NEU_CONN_TTY_PARITY_SPACE || stop.v.val_int < 1 ||
+        stop.v.val_int > 2) {
+        plog_warn(plugin, "config: %s, invalid serial setting",
+                  (char *) config);
+        free(device.v.val_str);
+        return -1;
+    }
+
+    if (modbus_read_limit_config(plugin, config) != 0) {
+        free(device.v.val_str);
+        return -1;
+    }
+
+    param.log                       = plugin->common.log;
+    param.type                      = NEU_CONN_TTY_CLIENT;
+    param.params.tty_client.device  = device.v.val_str;
+    param.params.tty_client.data    = data.v.val_int - 5;
+    param.params.tty_client.parity  = parity.v.val_int;
+    param.params.tty_client.stop    = stop.v.val_int - 1;
+    param.params.tty_client.flow    = NEU_CONN_TTYP_FLOW_DISABLE;
+    param.params.tty_client.timeout = timeout.v.val_int;
+
+    plog_info(plugin,
+              "config: device: %s, baud: %" PRId64 ", data: %" PRId64
+              ", parity: %" PRId64 ", stop: %" PRId64 ", timeout: %" PRId64,
+              device.v.val_str, baud.v.val_int, data.v.val_int,
+              parity.v.val_int, stop.v.val_int, timeout.v.val_int);
+
+    // start bit, data bits, parity bit and stop bits of a character, the
+    // frames are separated by 3.5 characters of silence, fixed to 1.75ms
+    // above 19200 bps
+    n_bit = 1 + data.v.val_int + (parity.v.val_int > 0 ? 1 : 0) +
+        stop.v.val_int;
+
+    // the conn is replaced by the reconfig, the events thread uses it under
+    // mtx
+    nng_mtx_lock(plugin->mtx);
+    plugin->timeout = timeout.v.val_int;
+    plugin->char_us = n_bit * 1000000 / baud.v.val_int;
+    plugin->gap_us  = baud.v.val_int > 19200 ? 1750 : plugin->char_us * 7 / 2;
+
+    plugin->common.link_state = NEU_NODE_LINK_STATE_DISCONNECTED;
+    if (plugin->conn != NULL) {
+        plugin->conn = neu_conn_reconfig(plugin->conn, &param);
+    } else {
+        plugin->conn =
+            neu_conn_new(&param, (void *) plugin, modbus_conn_connected,
+                         modbus_conn_disconnected);
+    }
+    nng_mtx_unlock(plugin->mtx);
+
+    free(device.v.val_str);
+    return 0;
+}
+
+static int driver_request(neu_plugin_t *plugin, neu_reqresp_head_t *head,
+                          void *data)
+{
+    (void) plugin;
+    (void) head;
+    (void) data;
+    return 0;
+}
+
+static int driver_validate_tag(neu_plugin_t *plugin, neu_datatag_t *tag)
+{
+    modbus_point_t point = { 0 };
+
+    int ret = modbus_tag_to_point(tag, &point);
+    if (ret == 0) {
+        plog_debug(
+            plugin,
+            "validate tag success, name: %s, address: %s, type: %d, slave id: "
+            "%d, start address: %d, n register: %d, area: %s",
+            tag->name, tag->address, tag->type, point.slave_id,
+            point.start_address, point.n_register,
+            modbus_area_to_str(point.area));
+    }
+
+    return ret;
+}
+
+static int driver_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group)
+{
+    return modbus_group_timer(plugin, group);
+}
+
+static int driver_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
+                        neu_value_u value)
+{
+    return modbus_write(plugin, req, tag, value);
+}
\ No newline at end of file
@@ -0,0 +1,711 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <nng/nng.h>
+#include <nng/supplemental/util/platform.h>
+
+#include "neuron.h"
+
+#include "modbus.h"
+#include "modbus_image.h"
+
+// requests pipelined by a client are answered together
+#define SERVER_RECV_BUF (MODBUS_MAX_ADU * 4)
+// mbap header and unit id
+#define SERVER_MBAP 7
+// least interval between two layout requests, in ms
+#define SERVER_LAYOUT_INTERVAL 1000
+
+typedef struct server_client {
+    neu_plugin_t *  plugin;
+    int             fd;
+    neu_event_io_t *io;
+
+    uint8_t  buf[SERVER_RECV_BUF];
+    uint16_t len;
+
+    struct server_client *prev;
+    struct server_client *next;
+} server_client_t;
+
+struct neu_plugin {
+    neu_plugin_common_t common;
+
+    neu_conn_t *conn;
+
+    // the listening socket and the clients are only touched by the events
+    // thread, the others ask it through the wakeup pipe and wait for sync_gen
+    neu_events_t *   events;
+    neu_event_io_t * wakeup_io;
+    int              wakeup[2];
+    neu_event_io_t * listen_io;
+    int              listen_io_fd;
+    server_client_t *clients;
+    int              n_client;
+
+    nng_mtx *mtx;
+    nng_cv * synced;
+    int      listen_fd; // set by the conn callbacks
+    bool     running;
+    bool     detach; // drop the clients, the conn is reconfigured
+    bool     closing;
+    uint32_t req_gen;
+    uint32_t sync_gen;
+
+    // written by the adapter thread, read by the events thread
+    nng_mtx *       image_mtx;
+    modbus_image_t *image;
+
+    // adapter thread only
+    uint64_t layout_time;
+};
+
+static neu_plugin_t *server_open(void);
+static int           server_close(neu_plugin_t *plugin);
+static int           server_init(neu_plugin_t *plugin);
+static int           server_uninit(neu_plugin_t *plugin);
+static int           server_start(neu_plugin_t *plugin);
+static int           server_stop(neu_plugin_t *plugin);
+static int           server_config(neu_plugin_t *plugin, const char *config);
+static int server_request(neu_plugin_t *plugin, neu_reqresp_head_t *head,
+                          void *data);
+
+static int  loop_wakeup_cb(enum neu_event_io_type type, int fd,
+                           void *usr_data);
+static int  loop_accept_cb(enum neu_event_io_type type, int fd,
+                           void *usr_data);
+static int  loop_client_cb(enum neu_event_io_type type, int fd,
+                           void *usr_data);
+static void loop_wakeup(neu_plugin_t *plugin);
+static void loop_sync(neu_plugin_t *plugin);
+
+static const neu_plugin_intf_funs_t plugin_intf_funs = {
+    .open    = server_open,
+    .close   = server_close,
+    .init    = server_init,
+    .uninit  = server_uninit,
+    .start   = server_start,
+    .stop    = server_stop,
+    .setting = server_config,
+    .request = server_request,
+};
+
+const neu_plugin_module_t neu_plugin_module = {
+    .version      = NEURON_PLUGIN_VER_1_0,
+    .module_name  = "modbus-tcp-server",
+    .module_descr = "The modbus-tcp-server plugin serves the tags of the "
+                    "subscribed groups to modbus tcp clients.",
+    .intf_funs = &plugin_intf_funs,
+    .kind      = NEU_PLUGIN_KIND_SYSTEM,
+    .type      = NEU_NA_TYPE_APP,
+    .display   = true,
+    .single    = false,
+};
+
+static neu_plugin_t *server_open(void)
+{
+    neu_plugin_t *plugin = calloc(1, sizeof(neu_plugin_t));
+
+    neu_plugin_common_init(&plugin->common);
+
+    return plugin;
+}
+
+static int server_close(neu_plugin_t *plugin)
+{
+    free(plugin);
+
+    return 0;
+}
+
+static int server_init(neu_plugin_t *plugin)
+{
+    neu_event_io_param_t io = { 0 };
+
+    if (pipe(plugin->wakeup) != 0) {
+        plog_error(plugin, "create wakeup pipe fail");
+        return -1;
+    }
+    fcntl(plugin->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(plugin->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    nng_mtx_alloc(&plugin->mtx);
+    nng_mtx_alloc(&plugin->image_mtx);
+    nng_cv_alloc(&plugin->synced, plugin->mtx);
+    plugin->listen_fd    = -1;
+    plugin->listen_io_fd = -1;
+    plugin->image        = modbus_image_new();
+
+    plugin->events = neu_event_new();
+
+    io.fd             = plugin->wakeup[0];
+    io.usr_data       = (void *) plugin;
+    io.cb             = loop_wakeup_cb;
+    plugin->wakeup_io = neu_event_add_io(plugin->events, io);
+
+    plog_info(plugin, "node: modbus server init ok");
+    return 0;
+}
+
+static int server_uninit(neu_plugin_t *plugin)
+{
+    // the io are deleted by the events thread itself, no callback runs after
+    // it signals
+    nng_mtx_lock(plugin->mtx);
+    plugin->closing = true;
+    loop_wakeup(plugin);
+    while (plugin->wakeup_io != NULL) {
+        nng_cv_wait(plugin->synced);
+    }
+    nng_mtx_unlock(plugin->mtx);
+
+    if (plugin->conn != NULL) {
+        neu_conn_destory(plugin->conn);
+    }
+
+    neu_event_close(plugin->events);
+    close(plugin->wakeup[0]);
+    close(plugin->wakeup[1]);
+
+    modbus_image_free(plugin->image);
+    nng_cv_free(plugin->synced);
+    nng_mtx_free(plugin->image_mtx);
+    nng_mtx_free(plugin->mtx);
+
+    plog_info(plugin, "node: modbus server uninit ok");
+    return 0;
+}
+
+static void layout_request(neu_plugin_t *plugin)
+{
+    neu_reqresp_head_t            header = { 0 };
+    neu_req_get_sub_driver_tags_t cmd    = { 0 };
+    uint64_t                      now    = neu_time_ms();
+
+    // the tags could be mapped by the response on the way
+    if (now - plugin->layout_time < SERVER_LAYOUT_INTERVAL) {
+        return;
+    }
+
+    header.type = NEU_REQ_GET_SUB_DRIVER_TAGS;
+    strcpy(cmd.app, plugin->common.name);
+    if (neu_plugin_op(plugin, header, &cmd) == 0) {
+        plugin->layout_time = now;
+    }
+}
+
+static void layout_update(neu_plugin_t *                  plugin,
+                          neu_resp_get_sub_driver_tags_t *resp)
+{
+    uint32_t      n_register = 0;
+    uint32_t      n_bit      = 0;
+    modbus_area_e area       = MODBUS_AREA_HOLD_REGISTER;
+    int           address    = 0;
+
+    nng_mtx_lock(plugin->image_mtx);
+    modbus_image_layout(plugin->image, resp->infos);
+    modbus_image_size(plugin->image, &n_register, &n_bit);
+    nng_mtx_unlock(plugin->image_mtx);
+
+    // the image is only changed by this thread
+    utarray_foreach(resp->infos, neu_resp_get_sub_driver_tags_info_t *, info)
+    {
+        utarray_foreach(info->tags, neu_datatag_t *, tag)
+        {
+            address = modbus_image_address(plugin->image, info->driver,
+                                           info->group, tag->name, &area);
+            if (address < 0) {
+                plog_debug(plugin, "layout: %s/%s/%s not mapped",
+                           info->driver, info->group, tag->name);
+            } else {
+                plog_debug(plugin, "layout: %s/%s/%s -> %s %d", info->driver,
+                           info->group, tag->name, modbus_area_to_str(area),
+                           address);
+            }
+        }
+        utarray_free(info->tags);
+    }
+    utarray_free(resp->infos);
+
+    plog_notice(plugin, "layout: %" PRIu32 " registers, %" PRIu32 " coils",
+                n_register, n_bit);
+}
+
+static void server_listen_start(void *data, int fd)
+{
+    neu_plugin_t *plugin = (neu_plugin_t *) data;
+
+    nng_mtx_lock(plugin->mtx);
+    plugin->listen_fd = fd;
+    loop_wakeup(plugin);
+    nng_mtx_unlock(plugin->mtx);
+}
+
+static void server_listen_stop(void *data, int fd)
+{
+    neu_plugin_t *plugin = (neu_plugin_t *) data;
+
+    (void) fd;
+
+    nng_mtx_lock(plugin->mtx);
+    plugin->listen_fd = -1;
+    nng_mtx_unlock(plugin->mtx);
+}
+
+// the clients are counted by the events thread, the conn callbacks are also
+// triggered for the listening socket
+static void server_client_connected(void *data, int fd)
+{
+    (void) data;
+    (void) fd;
+}
+
+static void server_client_disconnected(void *data, int fd)
+{
+    (void) data;
+    (void) fd;
+}
+
+static int server_start(neu_plugin_t *plugin)
+{
+    nng_mtx_lock(plugin->mtx);
+    plugin->running = true;
+    loop_wakeup(plugin);
+    nng_mtx_unlock(plugin->mtx);
+
+    layout_request(plugin);
+    return 0;
+}
+
+static int server_stop(neu_plugin_t *plugin)
+{
+    nng_mtx_lock(plugin->mtx);
+    plugin->running = false;
+    loop_sync(plugin);
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
+}
+
+static int server_config(neu_plugin_t *plugin, const char *config)
+{
+    int              ret       = 0;
+    char *           err_param = NULL;
+    neu_json_elem_t  port      = { .name = "port", .t = NEU_JSON_INT };
+    neu_json_elem_t  host      = { .name = "host", .t = NEU_JSON_STR };
+    neu_json_elem_t  max_link  = { .name = "max_link", .t = NEU_JSON_INT };
+    neu_conn_param_t param     = { 0 };
+    neu_conn_t *     conn      = NULL;
+
+    ret = neu_parse_param((char *) config, &err_param, 2, &port, &host);
+    if (ret != 0) {
+        plog_warn(plugin, "config: %s, decode error: %s", (char *) config,
+                  err_param);
+        free(err_param);
+        free(host.v.val_str);
+        return -1;
+    }
+
+    // optional
+    ret = neu_parse_param((char *) config, &err_param, 1, &max_link);
+    if (ret != 0) {
+        free(err_param);
+        max_link.v.val_int = 256;
+    }
+    if (max_link.v.val_int < 1 || max_link.v.val_int > 1024) {
+        plog_warn(plugin, "config: invalid max_link %" PRId64,
+                  max_link.v.val_int);
+        free(host.v.val_str);
+        return -1;
+    }
+
+    // non-blocking, a request is answered as soon as it is complete
+    param.log                            = plugin->common.log;
+    param.type                           = NEU_CONN_TCP_SERVER;
+    param.params.tcp_server.ip           = host.v.val_str;
+    param.params.tcp_server.port         = port.v.val_int;
+    param.params.tcp_server.timeout      = 0;
+    param.params.tcp_server.max_link     = max_link.v.val_int;
+    param.params.tcp_server.start_listen = server_listen_start;
+    param.params.tcp_server.stop_listen  = server_listen_stop;
+
+    plog_info(plugin,
+              "config: host: %s, port: %" PRId64 ", max_link: %" PRId64,
+              host.v.val_str, port.v.val_int, max_link.v.val_int);
+
+    // the clients of the old socket are closed before it is
+    nng_mtx_lock(plugin->mtx);
+    plugin->detach = true;
+    loop_sync(plugin);
+    conn = plugin->conn;
+    nng_mtx_unlock(plugin->mtx);
+
+    if (conn != NULL) {
+        conn = neu_conn_reconfig(conn, &param);
+    } else {
+        conn = neu_conn_new(&param, (void *) plugin, server_client_connected,
+                            server_client_disconnected);
+    }
+
+    nng_mtx_lock(plugin->mtx);
+    plugin->conn   = conn;
+    plugin->detach = false;
+    loop_wakeup(plugin);
+    nng_mtx_unlock(plugin->mtx);
+
+    free(host.v.val_str);
+    return 0;
+}
+
+static int server_request(neu_plugin_t *plugin, neu_reqresp_head_t *head,
+                          void *data)
+{
+    switch (head->type) {
+    case NEU_REQRESP_TRANS_DATA: {
+        neu_reqresp_trans_data_t *trans = (neu_reqresp_trans_data_t *) data;
+        int                       ret   = 0;
+
+        nng_mtx_lock(plugin->image_mtx);
+        ret = modbus_image_update(plugin->image, trans);
+        nng_mtx_unlock(plugin->image_mtx);
+
+        // a group subscribed, or tags added since the last layout
+        if (ret != 0) {
+            layout_request(plugin);
+        }
+        break;
+    }
+    case NEU_RESP_GET_SUB_DRIVER_TAGS:
+        layout_update(plugin, (neu_resp_get_sub_driver_tags_t *) data);
+        break;
+    case NEU_RESP_ERROR: {
+        neu_resp_error_t *error = (neu_resp_error_t *) data;
+        plog_debug(plugin, "receive resp errcode: %d", error->error);
+        break;
+    }
+    default:
+        plog_debug(plugin, "unsupported request type: %d", head->type);
+        break;
+    }
+
+    return 0;
+}
+
+// plugin->mtx locked
+static void loop_wakeup(neu_plugin_t *plugin)
+{
+    plugin->req_gen += 1;
+    if (write(plugin->wakeup[1], "", 1) != 1) {
+        // the pipe is full, a wakeup is pending anyway
+    }
+}
+
+// plugin->mtx locked, returns once the events thread has seen the state
+static void loop_sync(neu_plugin_t *plugin)
+{
+    uint32_t gen = 0;
+
+    loop_wakeup(plugin);
+    gen = plugin->req_gen;
+    while (plugin->sync_gen != gen && plugin->wakeup_io != NULL) {
+        nng_cv_wait(plugin->synced);
+    }
+}
+
+static void link_state_update(neu_plugin_t *plugin)
+{
+    nng_mtx_lock(plugin->mtx);
+    plugin->common.link_state = plugin->n_client > 0
+        ? NEU_NODE_LINK_STATE_CONNECTED
+        : NEU_NODE_LINK_STATE_DISCONNECTED;
+    nng_mtx_unlock(plugin->mtx);
+}
+
+static void client_close(neu_plugin_t *plugin, server_client_t *client)
+{
+    neu_event_del_io(plugin->events, client->io);
+    neu_conn_tcp_server_close_client(plugin->conn, client->fd);
+    DL_DELETE(plugin->clients, client);
+    free(client);
+
+    plugin->n_client -= 1;
+    link_state_update(plugin);
+}
+
+static void loop_detach(neu_plugin_t *plugin)
+{
+    server_client_t *client = NULL, *tmp = NULL;
+
+    DL_FOREACH_SAFE(plugin->clients, client, tmp)
+    {
+        client_close(plugin, client);
+    }
+
+    if (plugin->listen_io != NULL) {
+        neu_event_del_io(plugin->events, plugin->listen_io);
+        plugin->listen_io    = NULL;
+        plugin->listen_io_fd = -1;
+    }
+}
+
+static int loop_wakeup_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    neu_plugin_t *plugin    = (neu_plugin_t *) usr_data;
+    char          c         = 0;
+    bool          closing   = false;
+    bool          serve     = false;
+    int           listen_fd = -1;
+    uint32_t      gen       = 0;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    while (read(fd, &c, 1) == 1) {
+    }
+
+    nng_mtx_lock(plugin->mtx);
+    closing   = plugin->closing;
+    serve     = plugin->running && !plugin->detach && plugin->conn != NULL;
+    listen_fd = plugin->listen_fd;
+    gen       = plugin->req_gen;
+    nng_mtx_unlock(plugin->mtx);
+
+    if (closing || !serve || listen_fd != plugin->listen_io_fd) {
+        loop_detach(plugin);
+    }
+
+    if (!closing && serve && listen_fd >= 0 && plugin->listen_io == NULL) {
+        neu_event_io_param_t io = {
+            .fd       = listen_fd,
+            .usr_data = (void *) plugin,
+            .cb       = loop_accept_cb,
+        };
+
+        plugin->listen_io    = neu_event_add_io(plugin->events, io);
+        plugin->listen_io_fd = listen_fd;
+    }
+
+    nng_mtx_lock(plugin->mtx);
+    if (closing) {
+        neu_event_del_io(plugin->events, plugin->wakeup_io);
+        plugin->wakeup_io = NULL;
+    }
+    plugin->sync_gen = gen;
+    nng_cv_wake(plugin->synced);
+    nng_mtx_unlock(plugin->mtx);
+
+    return 0;
+}
+
+static int loop_accept_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    neu_plugin_t *       plugin = (neu_plugin_t *) usr_data;
+    server_client_t *    client = NULL;
+    int                  one    = 1;
+    int                  cfd    = -1;
+    neu_event_io_param_t io     = { 0 };
+
+    (void) fd;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    // rejected by the conn when there are max_link clients
+    cfd = neu_conn_tcp_server_accept(plugin->conn);
+    if (cfd < 0) {
+        return 0;
+    }
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    client         = calloc(1, sizeof(server_client_t));
+    client->plugin = plugin;
+    client->fd     = cfd;
+
+    io.fd       = cfd;
+    io.usr_data = (void *) client;
+    io.cb       = loop_client_cb;
+    client->io  = neu_event_add_io(plugin->events, io);
+    DL_APPEND(plugin->clients, client);
+
+    plugin->n_client += 1;
+    link_state_update(plugin);
+    return 0;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t) p[0] << 8 | p[1];
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+// answer one request, returns the size of the response written to out
+static uint16_t serve(neu_plugin_t *plugin, const uint8_t *req,
+                      uint16_t n_req, uint8_t *out)
+{
+    uint8_t  function = req[SERVER_MBAP];
+    int      ret      = -MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+    uint16_t n_pdu    = 0;
+
+    // the mbap header and the unit id are echoed
+    memcpy(out, req, SERVER_MBAP);
+
+    switch (function) {
+    case MODBUS_READ_COIL:
+    case MODBUS_READ_INPUT:
+    case MODBUS_READ_HOLD_REG:
+    case MODBUS_READ_INPUT_REG:
+        if (n_req != SERVER_MBAP + 5) {
+            ret = -MODBUS_EXCEPTION_ILLEGAL_VALUE;
+            break;
+        }
+
+        nng_mtx_lock(plugin->image_mtx);
+        ret = modbus_image_read(plugin->image, function,
+                                get_u16(&req[SERVER_MBAP + 1]),
+                                get_u16(&req[SERVER_MBAP + 3]),
+                                &out[SERVER_MBAP + 2]);
+        nng_mtx_unlock(plugin->image_mtx);
+        break;
+    default:
+        break;
+    }
+
+    if (ret < 0) {
+        out[SERVER_MBAP]     = function | 0x80;
+        out[SERVER_MBAP + 1] = -ret;
+        n_pdu                = 2;
+    } else {
+        out[SERVER_MBAP]     = function;
+        out[SERVER_MBAP + 1] = ret;
+        n_pdu                = 2 + ret;
+    }
+
+    // the unit id is counted in the length
+    put_u16(&out[4], 1 + n_pdu);
+    return SERVER_MBAP + n_pdu;
+}
+
+static int client_flush(neu_plugin_t *plugin, server_client_t *client,
+                        uint8_t *out, uint16_t n_out)
+{
+    ssize_t ret = 0;
+
+    if (n_out == 0) {
+        return 0;
+    }
+
+    plog_send_protocol(plugin, out, n_out);
+    ret = neu_conn_tcp_server_send(plugin->conn, client->fd, out, n_out);
+    // a client not reading its responses is not waited for
+    if (ret != n_out) {
+        plog_warn(plugin, "client fd: %d, send %" PRIu16 " bytes fail",
+                  client->fd, n_out);
+        return -1;
+    }
+
+    plugin->common.adapter_callbacks->stat_acc(
+        plugin->common.adapter, NEU_NODE_STAT_BYTES_SENT, ret);
+    return 0;
+}
+
+static int loop_client_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    server_client_t *client = (server_client_t *) usr_data;
+    neu_plugin_t *   plugin = client->plugin;
+    uint8_t          out[SERVER_RECV_BUF];
+    uint16_t         n_out = 0;
+    uint16_t         head  = 0;
+    ssize_t          ret   = 0;
+    void (*stat_acc)(neu_adapter_t *, neu_node_stat_e, uint64_t) =
+        plugin->common.adapter_callbacks->stat_acc;
+
+    if (type != NEU_EVENT_IO_READ) {
+        client_close(plugin, client);
+        return 0;
+    }
+
+    ret = neu_conn_tcp_server_recv(plugin->conn, fd, client->buf + client->len,
+                                   sizeof(client->buf) - client->len);
+    if (ret <= 0) {
+        client_close(plugin, client);
+        return 0;
+    }
+    stat_acc(plugin->common.adapter, NEU_NODE_STAT_BYTES_RECV, ret);
+    client->len += ret;
+
+    // the frames are parsed in place, only a partial one is moved, the
+    // responses are sent together
+    while (client->len - head >= SERVER_MBAP) {
+        const uint8_t *req   = &client->buf[head];
+        uint16_t       n_req = 6 + get_u16(&req[4]);
+
+        if (n_req < SERVER_MBAP + 1 || n_req > MODBUS_MAX_ADU) {
+            plog_warn(plugin, "client fd: %d, invalid frame length: %" PRIu16,
+                      fd, n_req);
+            client_close(plugin, client);
+            return 0;
+        }
+        if (client->len - head < n_req) {
+            break;
+        }
+
+        plog_recv_protocol(plugin, req, n_req);
+        stat_acc(plugin->common.adapter, NEU_NODE_STAT_MSGS_RECV, 1);
+
+        if (sizeof(out) - n_out < MODBUS_MAX_ADU) {
+            if (client_flush(plugin, client, out, n_out) != 0) {
+                client_close(plugin, client);
+                return 0;
+            }
+            n_out = 0;
+        }
+
+        // the protocol id of modbus is 0, other frames are dropped
+        if (get_u16(&req[2]) == 0) {
+            n_out += serve(plugin, req, n_req, &out[n_out]);
+            stat_acc(plugin->common.adapter, NEU_NODE_STAT_MSGS_SENT, 1);
+        }
+        head += n_req;
+    }
+
+    if (head > 0) {
+        memmove(client->buf, &client->buf[head], client->len - head);
+        client->len -= head;
+    }
+
+    if (client_flush(plugin, client, out, n_out) != 0) {
+        client_close(plugin, client);
+    }
+
+    return 0;
+}
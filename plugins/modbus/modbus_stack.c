@@ -17,6 +17,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
 #include <assert.h>
+#include <netinet/in.h>
 
 #include <neuron.h>
 
@@ -24,23 +25,43 @@
 
 struct modbus_stack {
     void *                  ctx;
+    modbus_protocol_e       protocol;
     modbus_stack_send       send_fn;
     modbus_stack_value      value_fn;
     modbus_stack_write_resp write_resp;
 
+    // the transaction ids are taken in base to base + mask
     uint16_t seq;
+    uint16_t seq_base;
+    uint16_t seq_mask;
+
+    // an rtu frame has no transaction id, the response is matched against
+    // the one request on the bus, a late answer to an expired request is
+    // dropped when it does not match
+    struct {
+        bool     pending;
+        uint16_t seq;
+        uint8_t  slave_id;
+        uint8_t  function;
+        uint16_t n_byte;        // of the read response
+        uint16_t start_address; // echoed by the write response
+        uint16_t n_reg;         // or the value of a single write
+    } rtu;
 };
 
-modbus_stack_t *modbus_stack_create(void *ctx, modbus_stack_send send_fn,
+modbus_stack_t *modbus_stack_create(void *ctx, modbus_protocol_e protocol,
+                                    modbus_stack_send       send_fn,
                                     modbus_stack_value      value_fn,
                                     modbus_stack_write_resp write_resp)
 {
     modbus_stack_t *stack = calloc(1, sizeof(modbus_stack_t));
 
     stack->ctx        = ctx;
+    stack->protocol   = protocol;
     stack->send_fn    = send_fn;
     stack->value_fn   = value_fn;
     stack->write_resp = write_resp;
+    stack->seq_mask   = UINT16_MAX;
 
     return stack;
 }
@@ -50,15 +71,133 @@ void modbus_stack_destroy(modbus_stack_t *stack)
     free(stack);
 }
 
+void modbus_stack_seq_range(modbus_stack_t *stack, uint16_t base,
+                            uint16_t mask)
+{
+    stack->seq_base = base;
+    stack->seq_mask = mask;
+}
+
+static uint16_t stack_seq(modbus_stack_t *stack, uint16_t n)
+{
+    return stack->seq_base | (n & stack->seq_mask);
+}
+
+int modbus_tcp_frame_size(const uint8_t *bytes, size_t n_byte)
+{
+    const struct modbus_header *header = (const struct modbus_header *) bytes;
+
+    if (n_byte < sizeof(struct modbus_header)) {
+        return 0;
+    }
+    if (header->protocol != 0 ||
+        ntohs(header->len) < sizeof(struct modbus_code) ||
+        ntohs(header->len) > MODBUS_MAX_PDU + 1) {
+        return -1;
+    }
+
+    return sizeof(struct modbus_header) + ntohs(header->len);
+}
+
+uint16_t modbus_tcp_frame_seq(const uint8_t *bytes, size_t n_byte)
+{
+    (void) n_byte;
+    return ntohs(((const struct modbus_header *) bytes)->seq);
+}
+
+int modbus_stack_frame_size(modbus_stack_t *stack, uint8_t *bytes,
+                            uint16_t n_byte)
+{
+    switch (stack->protocol) {
+    case MODBUS_PROTOCOL_TCP:
+        return modbus_tcp_frame_size(bytes, n_byte);
+    case MODBUS_PROTOCOL_RTU: {
+        struct modbus_code *code = (struct modbus_code *) bytes;
+
+        // the rtu frame has no length, it is told by the function code
+        if (n_byte < sizeof(struct modbus_code) + 1) {
+            return 0;
+        }
+        if (code->function & 0x80) {
+            return sizeof(struct modbus_code) + 1 + sizeof(struct modbus_crc);
+        }
+
+        switch (code->function) {
+        case MODBUS_READ_COIL:
+        case MODBUS_READ_INPUT:
+        case MODBUS_READ_HOLD_REG:
+        case MODBUS_READ_INPUT_REG:
+            return sizeof(struct modbus_code) + sizeof(struct modbus_data) +
+                bytes[sizeof(struct modbus_code)] + sizeof(struct modbus_crc);
+        case MODBUS_WRITE_S_COIL:
+        case MODBUS_WRITE_S_HOLD_REG:
+        case MODBUS_WRITE_M_HOLD_REG:
+        case MODBUS_WRITE_M_COIL:
+            return sizeof(struct modbus_code) + sizeof(struct modbus_address) +
+                sizeof(struct modbus_crc);
+        default:
+            return -1;
+        }
+    }
+    }
+
+    return -1;
+}
+
+static void modbus_frame_wrap(modbus_stack_t *         stack,
+                              neu_protocol_pack_buf_t *pbuf, uint16_t seq,
+                              uint16_t *response_size)
+{
+    switch (stack->protocol) {
+    case MODBUS_PROTOCOL_TCP:
+        modbus_header_wrap(pbuf, seq);
+        *response_size += sizeof(struct modbus_header);
+        break;
+    case MODBUS_PROTOCOL_RTU:
+        modbus_crc_set(pbuf);
+        *response_size += sizeof(struct modbus_crc);
+        break;
+    }
+}
+
+static void rtu_request(modbus_stack_t *stack, uint16_t seq, uint8_t slave_id,
+                        uint8_t function, uint16_t start_address,
+                        uint16_t n_reg, uint16_t n_byte)
+{
+    stack->rtu.pending       = true;
+    stack->rtu.seq           = seq;
+    stack->rtu.slave_id      = slave_id;
+    stack->rtu.function      = function;
+    stack->rtu.start_address = start_address;
+    stack->rtu.n_reg         = n_reg;
+    stack->rtu.n_byte        = n_byte;
+}
+
+static bool rtu_match(modbus_stack_t *stack, struct modbus_code *code)
+{
+    return stack->rtu.pending && code->slave_id == stack->rtu.slave_id &&
+        (code->function & 0x7f) == stack->rtu.function;
+}
+
 int modbus_stack_recv(modbus_stack_t *stack, neu_protocol_unpack_buf_t *buf)
 {
     struct modbus_header header = { 0 };
     struct modbus_code   code   = { 0 };
     int                  ret    = 0;
 
-    ret = modbus_header_unwrap(buf, &header);
-    if (ret <= 0) {
-        return ret;
+    switch (stack->protocol) {
+    case MODBUS_PROTOCOL_TCP:
+        ret = modbus_header_unwrap(buf, &header);
+        if (ret <= 0) {
+            return ret;
+        }
+        break;
+    case MODBUS_PROTOCOL_RTU:
+        if (!modbus_crc_check(buf->base, buf->size)) {
+            return -1;
+        }
+        header.seq = stack->rtu.seq;
+        break;
     }
 
     ret = modbus_code_unwrap(buf, &code);
@@ -66,6 +205,22 @@ int modbus_stack_recv(modbus_stack_t *stack, neu_protocol_unpack_buf_t *buf)
         return ret;
     }
 
+    if (stack->protocol == MODBUS_PROTOCOL_RTU && !rtu_match(stack, &code)) {
+        return -1;
+    }
+
+    if (code.function & 0x80) {
+        uint8_t *exception = neu_protocol_unpack_buf(buf, sizeof(uint8_t));
+        if (exception == NULL) {
+            return 0;
+        }
+
+        stack->rtu.pending = false;
+        stack->value_fn(stack->ctx, header.seq, code.slave_id, *exception,
+                        NULL);
+        return neu_protocol_unpack_buf_used_size(buf);
+    }
+
     switch (code.function) {
     case MODBUS_READ_COIL:
     case MODBUS_READ_INPUT:
@@ -77,20 +232,37 @@ int modbus_stack_recv(modbus_stack_t *stack, neu_protocol_unpack_buf_t *buf)
         if (ret <= 0) {
             return ret;
         }
+        if (stack->protocol == MODBUS_PROTOCOL_RTU &&
+            data.n_byte != stack->rtu.n_byte) {
+            return -1;
+        }
 
-        bytes = neu_protocol_unpack_buf(buf, data.n_byte);
-        stack->value_fn(stack->ctx, code.slave_id, data.n_byte, bytes);
+        bytes              = neu_protocol_unpack_buf(buf, data.n_byte);
+        stack->rtu.pending = false;
+        stack->value_fn(stack->ctx, header.seq, code.slave_id, data.n_byte,
+                        bytes);
 
         break;
     }
     case MODBUS_WRITE_S_COIL:
+    case MODBUS_WRITE_S_HOLD_REG:
     case MODBUS_WRITE_M_HOLD_REG:
     case MODBUS_WRITE_M_COIL: {
         struct modbus_address address = { 0 };
         ret                           = modbus_address_unwrap(buf, &address);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (stack->protocol == MODBUS_PROTOCOL_RTU &&
+            (address.start_address != stack->rtu.start_address ||
+             address.n_reg != stack->rtu.n_reg)) {
+            return -1;
+        }
+
+        stack->rtu.pending = false;
+        stack->write_resp(stack->ctx, header.seq, NEU_ERR_SUCCESS);
         break;
     }
-    case MODBUS_WRITE_S_HOLD_REG:
     default:
         break;
     }
@@ -100,91 +272,105 @@ int modbus_stack_recv(modbus_stack_t *stack, neu_protocol_unpack_buf_t *buf)
 
 int modbus_stack_read(modbus_stack_t *stack, uint8_t slave_id,
                       enum modbus_area area, uint16_t start_address,
-                      uint16_t n_reg, uint16_t *response_size)
+                      uint16_t n_reg, uint16_t *response_size, uint16_t *seq)
 {
-    static __thread uint8_t                 buf[16] = { 0 };
-    static __thread neu_protocol_pack_buf_t pbuf    = { 0 };
-    int                                     ret     = 0;
+    static __thread uint8_t                 buf[16]  = { 0 };
+    static __thread neu_protocol_pack_buf_t pbuf     = { 0 };
+    int                                     ret      = 0;
+    uint8_t                                 function = 0;
+    uint16_t                                n_byte   = 0;
 
     neu_protocol_pack_buf_init(&pbuf, buf, sizeof(buf));
 
+    if (stack->protocol == MODBUS_PROTOCOL_RTU) {
+        modbus_crc_wrap(&pbuf);
+    }
     modbus_address_wrap(&pbuf, start_address, n_reg);
 
     switch (area) {
     case MODBUS_AREA_COIL:
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_READ_COIL);
-        *response_size += n_reg / 8 + ((n_reg % 8) > 0 ? 1 : 0);
+        function = MODBUS_READ_COIL;
+        n_byte   = n_reg / 8 + ((n_reg % 8) > 0 ? 1 : 0);
         break;
     case MODBUS_AREA_INPUT:
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_READ_INPUT);
-        *response_size += n_reg / 8 + ((n_reg % 8) > 0 ? 1 : 0);
+        function = MODBUS_READ_INPUT;
+        n_byte   = n_reg / 8 + ((n_reg % 8) > 0 ? 1 : 0);
         break;
     case MODBUS_AREA_INPUT_REGISTER:
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_READ_INPUT_REG);
-        *response_size += n_reg * 2;
+        function = MODBUS_READ_INPUT_REG;
+        n_byte   = n_reg * 2;
         break;
     case MODBUS_AREA_HOLD_REGISTER:
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_READ_HOLD_REG);
-        *response_size += n_reg * 2;
+        function = MODBUS_READ_HOLD_REG;
+        n_byte   = n_reg * 2;
         break;
     }
+    modbus_code_wrap(&pbuf, slave_id, function);
 
+    *response_size += n_byte;
     *response_size += sizeof(struct modbus_code);
     *response_size += sizeof(struct modbus_data);
 
-    modbus_header_wrap(&pbuf, stack->seq++);
-    *response_size += sizeof(struct modbus_header);
+    *seq = stack_seq(stack, stack->seq++);
+    modbus_frame_wrap(stack, &pbuf, *seq, response_size);
+    if (stack->protocol == MODBUS_PROTOCOL_RTU) {
+        rtu_request(stack, *seq, slave_id, function, start_address, n_reg,
+                    n_byte);
+    }
 
     ret = stack->send_fn(stack->ctx, neu_protocol_pack_buf_used_size(&pbuf),
                          neu_protocol_pack_buf_get(&pbuf));
-    if (ret <= 0) {
-        stack->value_fn(stack->ctx, 0, 0, NULL);
-    }
     return ret;
 }
 
-int modbus_stack_write(modbus_stack_t *stack, void *req, uint8_t slave_id,
+int modbus_stack_write(modbus_stack_t *stack, uint8_t slave_id,
                        enum modbus_area area, uint16_t start_address,
                        uint16_t n_reg, uint8_t *bytes, uint8_t n_byte,
-                       uint16_t *response_size)
+                       uint16_t *response_size, uint16_t *seq)
 {
-    uint8_t *               buf  = calloc(256, 1);
-    neu_protocol_pack_buf_t pbuf = { 0 };
-    int                     ret  = 0;
+    uint8_t                 buf[MODBUS_MAX_ADU] = { 0 };
+    neu_protocol_pack_buf_t pbuf                = { 0 };
+    int                     ret                 = 0;
+    uint8_t                 function            = 0;
 
-    neu_protocol_pack_buf_init(&pbuf, buf, 256);
+    neu_protocol_pack_buf_init(&pbuf, buf, sizeof(buf));
+
+    if (stack->protocol == MODBUS_PROTOCOL_RTU) {
+        modbus_crc_wrap(&pbuf);
+    }
 
     switch (area) {
     case MODBUS_AREA_COIL:
-        if (*bytes > 0) {
-            modbus_address_wrap(&pbuf, start_address, 0xff00);
+        if (n_reg > 1) {
+            modbus_data_wrap(&pbuf, n_byte, bytes);
+            function = MODBUS_WRITE_M_COIL;
         } else {
-            modbus_address_wrap(&pbuf, start_address, 0);
+            // the single coil is written and echoed as 0xff00 or 0
+            n_reg    = *bytes > 0 ? 0xff00 : 0;
+            function = MODBUS_WRITE_S_COIL;
         }
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_WRITE_S_COIL);
         break;
     case MODBUS_AREA_HOLD_REGISTER:
         modbus_data_wrap(&pbuf, n_byte, bytes);
-        modbus_address_wrap(&pbuf, start_address, n_reg);
-        modbus_code_wrap(&pbuf, slave_id, MODBUS_WRITE_M_HOLD_REG);
+        function = MODBUS_WRITE_M_HOLD_REG;
         break;
     default:
         assert(false);
         break;
     }
+    modbus_address_wrap(&pbuf, start_address, n_reg);
+    modbus_code_wrap(&pbuf, slave_id, function);
+
     *response_size += sizeof(struct modbus_code);
     *response_size += sizeof(struct modbus_address);
 
-    modbus_header_wrap(&pbuf, stack->seq++);
-    *response_size += sizeof(struct modbus_header);
+    *seq = stack_seq(stack, stack->seq++);
+    modbus_frame_wrap(stack, &pbuf, *seq, response_size);
+    if (stack->protocol == MODBUS_PROTOCOL_RTU) {
+        rtu_request(stack, *seq, slave_id, function, start_address, n_reg, 0);
+    }
 
     ret = stack->send_fn(stack->ctx, neu_protocol_pack_buf_used_size(&pbuf),
                          neu_protocol_pack_buf_get(&pbuf));
-    if (ret > 0) {
-        stack->write_resp(stack->ctx, req, NEU_ERR_SUCCESS);
-    } else {
-        stack->write_resp(stack->ctx, req, NEU_ERR_PLUGIN_DISCONNECTED);
-    }
-    free(buf);
     return ret;
 }
\ No newline at end of file
@@ -25,26 +25,55 @@
 
 #include "modbus.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct modbus_stack modbus_stack_t;
 
 typedef int (*modbus_stack_send)(void *ctx, uint16_t n_byte, uint8_t *bytes);
-typedef int (*modbus_stack_value)(void *ctx, uint8_t slave_id, uint16_t n_byte,
-                                  uint8_t *bytes);
-typedef int (*modbus_stack_write_resp)(void *ctx, void *req, int error);
+// bytes is NULL when the device answers the request seq with an exception,
+// n_byte is then the exception code
+typedef int (*modbus_stack_value)(void *ctx, uint16_t seq, uint8_t slave_id,
+                                  uint16_t n_byte, uint8_t *bytes);
+typedef int (*modbus_stack_write_resp)(void *ctx, uint16_t seq, int error);
 
-modbus_stack_t *modbus_stack_create(void *ctx, modbus_stack_send send_fn,
+modbus_stack_t *modbus_stack_create(void *ctx, modbus_protocol_e protocol,
+                                    modbus_stack_send       send_fn,
                                     modbus_stack_value      value_fn,
                                     modbus_stack_write_resp write_resp);
 void            modbus_stack_destroy(modbus_stack_t *stack);
 
+// a node sharing its connection only owns a range of the transaction ids
+void modbus_stack_seq_range(modbus_stack_t *stack, uint16_t base,
+                            uint16_t mask);
+
+/**
+ * Size of the first frame in bytes, 0 if more bytes are needed to tell, -1 if
+ * the bytes are not a modbus frame.
+ */
+int modbus_stack_frame_size(modbus_stack_t *stack, uint8_t *bytes,
+                            uint16_t n_byte);
+
+// the frames of a modbus tcp stream without a stack, for the connection pool
+int      modbus_tcp_frame_size(const uint8_t *bytes, size_t n_byte);
+uint16_t modbus_tcp_frame_seq(const uint8_t *bytes, size_t n_byte);
+
 int modbus_stack_recv(modbus_stack_t *stack, neu_protocol_unpack_buf_t *buf);
 
+// the transaction id of the request is returned in seq
 int modbus_stack_read(modbus_stack_t *stack, uint8_t slave_id,
                       enum modbus_area area, uint16_t start_address,
-                      uint16_t n_reg, uint16_t *response_size);
-int modbus_stack_write(modbus_stack_t *stack, void *req, uint8_t slave_id,
+                      uint16_t n_reg, uint16_t *response_size, uint16_t *seq);
+// write_resp is called when the device confirms the write, bytes are packed
+// bits when more than one coil is written
+int modbus_stack_write(modbus_stack_t *stack, uint8_t slave_id,
                        enum modbus_area area, uint16_t start_address,
                        uint16_t n_reg, uint8_t *bytes, uint8_t n_byte,
-                       uint16_t *response_size);
+                       uint16_t *response_size, uint16_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
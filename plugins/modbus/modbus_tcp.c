@@ -39,6 +39,12 @@ static int driver_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group);
 static int driver_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
                         neu_value_u value);
 
+// the responses on a pooled connection are routed by the transaction id
+static const neu_conn_framing_t tcp_framing = {
+    .frame_size = modbus_tcp_frame_size,
+    .frame_tag  = modbus_tcp_frame_seq,
+};
+
 static const neu_plugin_intf_funs_t plugin_intf_funs = {
     .open    = driver_open,
     .close   = driver_close,
@@ -83,24 +89,12 @@ static int driver_close(neu_plugin_t *plugin)
 
 static int driver_init(neu_plugin_t *plugin)
 {
-    plugin->events = neu_event_new();
-    plugin->stack  = modbus_stack_create((void *) plugin, modbus_send_msg,
-                                        modbus_value_handle, modbus_write_resp);
-
-    return 0;
+    return modbus_loop_init(plugin, MODBUS_PROTOCOL_TCP);
 }
 
 static int driver_uninit(neu_plugin_t *plugin)
 {
-    if (plugin->conn != NULL) {
-        neu_conn_destory(plugin->conn);
-    }
-
-    if (plugin->stack) {
-        modbus_stack_destroy(plugin->stack);
-    }
-
-    neu_event_close(plugin->events);
+    modbus_loop_uninit(plugin);
 
     plog_info(plugin, "node: modbus uninit ok");
 
@@ -119,6 +113,60 @@ static int driver_stop(neu_plugin_t *plugin)
     return 0;
 }
 
+// the optional socket options, 0 keeps the system default
+static int tune_config(neu_plugin_t *plugin, const char *config,
+                       neu_conn_tune_t *tune)
+{
+    char *          err_param = NULL;
+    neu_json_elem_t nodelay   = { .name = "tcp_nodelay", .t = NEU_JSON_BOOL };
+    neu_json_elem_t elems[]   = {
+        { .name = "keepalive_idle", .t = NEU_JSON_INT },
+        { .name = "keepalive_interval", .t = NEU_JSON_INT },
+        { .name = "keepalive_count", .t = NEU_JSON_INT },
+        { .name = "rcvbuf", .t = NEU_JSON_INT },
+        { .name = "sndbuf", .t = NEU_JSON_INT },
+        { .name = "busy_poll", .t = NEU_JSON_INT },
+        { .name = "user_timeout", .t = NEU_JSON_INT },
+    };
+    const int64_t max[] = { 32767, 32767, 127, 16777216, 16777216, 1000000,
+                            3600000 };
+
+    // the requests are small, nagle would hold them back
+    if (neu_parse_param((char *) config, &err_param, 1, &nodelay) != 0) {
+        free(err_param);
+        nodelay.v.val_bool = true;
+    }
+
+    for (size_t i = 0; i < NEU_JSON_ELEM_SIZE(elems); i++) {
+        if (neu_parse_param((char *) config, &err_param, 1, &elems[i]) != 0) {
+            free(err_param);
+            elems[i].v.val_int = 0;
+        }
+        if (elems[i].v.val_int < 0 || elems[i].v.val_int > max[i]) {
+            plog_warn(plugin, "config: invalid %s %" PRId64, elems[i].name,
+                      elems[i].v.val_int);
+            return -1;
+        }
+    }
+
+    tune->nodelay            = nodelay.v.val_bool;
+    tune->keepalive_idle     = elems[0].v.val_int;
+    tune->keepalive_interval = elems[1].v.val_int;
+    tune->keepalive_count    = elems[2].v.val_int;
+    tune->rcvbuf             = elems[3].v.val_int;
+    tune->sndbuf             = elems[4].v.val_int;
+    tune->busy_poll          = elems[5].v.val_int;
+    tune->user_timeout       = elems[6].v.val_int;
+
+    plog_info(plugin,
+              "config: tcp_nodelay: %d, keepalive: %u/%u/%u, rcvbuf: %u, "
+              "sndbuf: %u, busy_poll: %u, user_timeout: %u",
+              tune->nodelay, tune->keepalive_idle, tune->keepalive_interval,
+              tune->keepalive_count, tune->rcvbuf, tune->sndbuf,
+              tune->busy_poll, tune->user_timeout);
+    return 0;
+}
+
 static int driver_config(neu_plugin_t *plugin, const char *config)
 {
     int              ret       = 0;
@@ -126,7 +174,13 @@ static int driver_config(neu_plugin_t *plugin, const char *config)
     neu_json_elem_t  port      = { .name = "port", .t = NEU_JSON_INT };
     neu_json_elem_t  timeout   = { .name = "timeout", .t = NEU_JSON_INT };
     neu_json_elem_t  host      = { .name = "host", .t = NEU_JSON_STR };
+    neu_json_elem_t  inflight  = { .name = "max_inflight", .t = NEU_JSON_INT };
+    neu_json_elem_t  gateway   = { .name = "gateway", .t = NEU_JSON_BOOL };
+    neu_json_elem_t  shared    = { .name = "shared", .t = NEU_JSON_BOOL };
+    neu_json_elem_t  sessions  = { .name = "sessions", .t = NEU_JSON_INT };
     neu_conn_param_t param     = { 0 };
+    uint16_t         seq_base  = 0;
+    uint16_t         seq_mask  = 0;
 
     ret =
         neu_parse_param((char *) config, &err_param, 3, &port, &host, &timeout);
@@ -139,15 +193,83 @@ static int driver_config(neu_plugin_t *plugin, const char *config)
         return -1;
     }
 
+    // optional, most devices only serve one request at a time
+    ret = neu_parse_param((char *) config, &err_param, 1, &inflight);
+    if (ret != 0) {
+        free(err_param);
+        inflight.v.val_int = 1;
+    }
+    if (inflight.v.val_int < 1 || inflight.v.val_int > MODBUS_MAX_INFLIGHT) {
+        plog_warn(plugin, "config: invalid max_inflight %" PRId64,
+                  inflight.v.val_int);
+        free(host.v.val_str);
+        return -1;
+    }
+
+    // optional, a tcp to rtu gateway passes one request at a time to each of
+    // the slaves behind it
+    ret = neu_parse_param((char *) config, &err_param, 1, &gateway);
+    if (ret != 0) {
+        free(err_param);
+        gateway.v.val_bool = false;
+    }
+
+    // optional, the nodes of a device with a small connection limit share
+    // the sessions to it, a device that allows it is served by several
+    ret = neu_parse_param((char *) config, &err_param, 1, &shared);
+    if (ret != 0) {
+        free(err_param);
+        shared.v.val_bool = false;
+    }
+    ret = neu_parse_param((char *) config, &err_param, 1, &sessions);
+    if (ret != 0) {
+        free(err_param);
+        sessions.v.val_int = 1;
+    }
+    if (sessions.v.val_int < 1 ||
+        sessions.v.val_int > NEU_CONN_POOL_MAX_SESSION) {
+        plog_warn(plugin, "config: invalid sessions %" PRId64,
+                  sessions.v.val_int);
+        free(host.v.val_str);
+        return -1;
+    }
+
+    if (modbus_read_limit_config(plugin, config) != 0 ||
+        tune_config(plugin, config, &param.tune) != 0) {
+        free(host.v.val_str);
+        return -1;
+    }
+
+    // non-blocking, the timeout applies to each transaction
     param.log                       = plugin->common.log;
     param.type                      = NEU_CONN_TCP_CLIENT;
     param.params.tcp_client.ip      = host.v.val_str;
     param.params.tcp_client.port    = port.v.val_int;
-    param.params.tcp_client.timeout = timeout.v.val_int;
-
-    plog_info(plugin, "config: host: %s, port: %" PRId64 ", timeout: %" PRId64,
-              host.v.val_str, port.v.val_int, timeout.v.val_int);
+    param.params.tcp_client.timeout = 0;
+    if (shared.v.val_bool || sessions.v.val_int > 1) {
+        param.params.tcp_client.pool.shared   = shared.v.val_bool;
+        param.params.tcp_client.pool.sessions = sessions.v.val_int;
+        param.params.tcp_client.pool.window   = inflight.v.val_int;
+        param.params.tcp_client.pool.timeout  = timeout.v.val_int;
+        param.params.tcp_client.pool.framing  = &tcp_framing;
+    }
 
+    plog_info(plugin,
+              "config: host: %s, port: %" PRId64 ", timeout: %" PRId64
+              ", max_inflight: %" PRId64 ", gateway: %d, shared: %d, "
+              "sessions: %" PRId64,
+              host.v.val_str, port.v.val_int, timeout.v.val_int,
+              inflight.v.val_int, gateway.v.val_bool, shared.v.val_bool,
+              sessions.v.val_int);
+
+    // a pooled conn is replaced by the reconfig, the events thread uses it
+    // under mtx
+    nng_mtx_lock(plugin->mtx);
+    plugin->timeout       = timeout.v.val_int;
+    plugin->max_inflight  = inflight.v.val_int;
+    plugin->unit_inflight = gateway.v.val_bool ? 1 : inflight.v.val_int;
+
+    plugin->pooled            = param.params.tcp_client.pool.sessions > 0;
     plugin->common.link_state = NEU_NODE_LINK_STATE_DISCONNECTED;
     if (plugin->conn != NULL) {
         plugin->conn = neu_conn_reconfig(plugin->conn, &param);
@@ -156,6 +278,9 @@ static int driver_config(neu_plugin_t *plugin, const char *config)
             neu_conn_new(&param, (void *) plugin, modbus_conn_connected,
                          modbus_conn_disconnected);
     }
+    seq_base = neu_conn_tag_base(plugin->conn, &seq_mask);
+    modbus_stack_seq_range(plugin->stack, seq_base, seq_mask);
+    nng_mtx_unlock(plugin->mtx);
 
     free(host.v.val_str);
     return 0;
@@ -190,7 +315,7 @@ static int driver_validate_tag(neu_plugin_t *plugin, neu_datatag_t *tag)
 
 static int driver_group_timer(neu_plugin_t *plugin, neu_plugin_group_t *group)
 {
-    return modbus_group_timer(plugin, group, 0xfa);
+    return modbus_group_timer(plugin, group);
 }
 
 static int driver_write(neu_plugin_t *plugin, void *req, neu_datatag_t *tag,
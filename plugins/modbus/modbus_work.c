@@ -0,0 +1,98 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "modbus_req.h"
+
+// bytes of each register or coil written
+static uint8_t write_unit_size(modbus_work_t *work)
+{
+    switch (work->point.area) {
+    case MODBUS_AREA_COIL:
+        return 1;
+    case MODBUS_AREA_HOLD_REGISTER:
+        // a single byte is written for a bit of a register
+        if (work->n_byte == work->point.n_register * 2) {
+            return 2;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+bool modbus_work_merge(modbus_work_t *work, modbus_work_t *next)
+{
+    uint8_t  size    = write_unit_size(next);
+    uint32_t start   = work->point.start_address;
+    uint32_t end     = start + work->point.n_register;
+    uint32_t n_start = next->point.start_address;
+    uint32_t n_end   = n_start + next->point.n_register;
+    uint32_t max     = MODBUS_MAX_WRITE_REGISTER;
+
+    if (size == 1) {
+        max = MODBUS_MAX_WRITE_BIT;
+    }
+
+    if (work->type != MODBUS_WORK_WRITE || size == 0 ||
+        write_unit_size(work) != size || work->point.area != next->point.area ||
+        n_start > end || n_end < start) {
+        return false;
+    }
+    if ((n_end > end ? n_end : end) - (n_start < start ? n_start : start) >
+        max) {
+        return false;
+    }
+
+    if (work->batch == NULL) {
+        work->batch = calloc(MODBUS_MAX_WRITE_BIT, 1);
+        if (size == 1) {
+            work->batch[0] = work->value.bytes[0] > 0 ? 1 : 0;
+        } else {
+            memcpy(work->batch, work->value.bytes, work->n_byte);
+        }
+    }
+
+    if (n_start < start) {
+        memmove(work->batch + (start - n_start) * size, work->batch,
+                (end - start) * size);
+        memset(work->batch, 0, (start - n_start) * size);
+        start = n_start;
+    }
+    if (n_end > end) {
+        end = n_end;
+    }
+
+    if (size == 1) {
+        work->batch[n_start - start] = next->value.bytes[0] > 0 ? 1 : 0;
+    } else {
+        memcpy(work->batch + (n_start - start) * size, next->value.bytes,
+               next->n_byte);
+    }
+
+    work->point.start_address = start;
+    work->point.n_register    = end - start;
+    if (size == 2) {
+        work->n_byte = (end - start) * size;
+    }
+    DL_APPEND(work->merged, next);
+    return true;
+}
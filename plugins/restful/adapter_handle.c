@@ -19,6 +19,8 @@
 
 #include <stdlib.h>
 
+#include <nng/supplemental/http/http.h>
+
 #include "parser/neu_json_node.h"
 #include "plugin.h"
 #include "utils/log.h"
@@ -268,6 +270,99 @@ void handle_get_node_stat_resp(nng_aio *aio, neu_resp_get_node_stat_t *stat)
     free(result);
 }
 
+void handle_node_capture(nng_aio *aio)
+{
+    neu_plugin_t *plugin = neu_rest_get_plugin();
+
+    REST_PROCESS_HTTP_REQUEST_VALIDATE_JWT(
+        aio, neu_json_node_capture_req_t, neu_json_decode_node_capture_req, {
+            if (req->size < 0 || req->size > NEU_CAPTURE_SIZE_MAX) {
+                NEU_JSON_RESPONSE_ERROR(NEU_ERR_PARAM_IS_WRONG, {
+                    http_response(aio, NEU_ERR_PARAM_IS_WRONG, result_error);
+                });
+            } else {
+                int                    ret    = 0;
+                neu_reqresp_head_t     header = { 0 };
+                neu_req_node_capture_t cmd    = { 0 };
+
+                header.ctx  = aio;
+                header.type = NEU_REQ_NODE_CAPTURE;
+                strcpy(cmd.node, req->node);
+                cmd.enable = req->enable;
+                cmd.size   = (uint32_t) req->size;
+
+                ret = neu_plugin_op(plugin, header, &cmd);
+                if (ret != 0) {
+                    NEU_JSON_RESPONSE_ERROR(NEU_ERR_IS_BUSY, {
+                        http_response(aio, NEU_ERR_IS_BUSY, result_error);
+                    });
+                }
+            }
+        })
+}
+
+void handle_get_node_capture(nng_aio *aio)
+{
+    neu_plugin_t *             plugin = neu_rest_get_plugin();
+    char                       node_name[NEU_NODE_NAME_LEN] = { 0 };
+    int                        ret                          = 0;
+    neu_reqresp_head_t         header                       = { 0 };
+    neu_req_get_node_capture_t cmd                          = { 0 };
+
+    VALIDATE_JWT(aio);
+
+    header.ctx = aio;
+
+    if (http_get_param_str(aio, "node", node_name, sizeof(node_name)) <= 0) {
+        NEU_JSON_RESPONSE_ERROR(NEU_ERR_PARAM_IS_WRONG, {
+            http_response(aio, NEU_ERR_PARAM_IS_WRONG, result_error);
+        });
+        return;
+    } else {
+        header.type = NEU_REQ_GET_NODE_CAPTURE;
+        strcpy(cmd.node, node_name);
+    }
+
+    ret = neu_plugin_op(plugin, header, &cmd);
+    if (ret != 0) {
+        NEU_JSON_RESPONSE_ERROR(NEU_ERR_IS_BUSY, {
+            http_response(aio, NEU_ERR_IS_BUSY, result_error);
+        });
+    }
+}
+
+void handle_get_node_capture_resp(nng_aio *                    aio,
+                                  neu_resp_get_node_capture_t *capture)
+{
+    int           rv  = 0;
+    nng_http_res *res = NULL;
+
+    if (((rv = nng_http_res_alloc(&res)) != 0) ||
+        ((rv = nng_http_res_set_status(res, NNG_HTTP_STATUS_OK)) != 0) ||
+        ((rv = nng_http_res_set_header(res, "Content-Type",
+                                       "application/octet-stream")) != 0) ||
+        ((rv = nng_http_res_set_header(
+              res, "Content-Disposition",
+              "attachment; filename=capture.pcapng")) != 0) ||
+        ((rv = nng_http_res_set_header(res, "Access-Control-Allow-Origin",
+                                       "*")) != 0) ||
+        ((rv = nng_http_res_set_header(res, "Access-Control-Allow-Methods",
+                                       "POST,GET,PUT,DELETE,OPTIONS")) != 0) ||
+        ((rv = nng_http_res_set_header(res, "Access-Control-Allow-Headers",
+                                       "*")) != 0) ||
+        ((rv = nng_http_res_copy_data(res, capture->data, capture->len)) !=
+         0)) {
+        nng_http_res_free(res);
+        free(capture->data);
+        nng_aio_finish(aio, rv);
+        return;
+    }
+
+    free(capture->data);
+    nng_aio_set_output(aio, 0, res);
+    nng_aio_finish(aio, 0);
+}
+
 void handle_get_node_state(nng_aio *aio)
 {
     neu_plugin_t *           plugin = neu_rest_get_plugin();
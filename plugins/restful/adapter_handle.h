@@ -37,6 +37,10 @@ void handle_node_ctl(nng_aio *aio);
 void handle_get_node_stat(nng_aio *aio);
 void handle_get_node_state(nng_aio *aio);
 void handle_get_node_stat_resp(nng_aio *aio, neu_resp_get_node_stat_t *stat);
+void handle_node_capture(nng_aio *aio);
+void handle_get_node_capture(nng_aio *aio);
+void handle_get_node_capture_resp(nng_aio *                    aio,
+                                  neu_resp_get_node_capture_t *capture);
 void handle_get_node_state_resp(nng_aio *aio, neu_resp_get_node_state_t *state);
 void handle_get_nodes_state_resp(nng_aio *                   aio,
                                  neu_resp_get_nodes_state_t *states);
@@ -208,8 +208,20 @@ void handle_grp_subscribe(nng_aio *aio)
             strcpy(cmd.app, req->app);
             strcpy(cmd.driver, req->driver);
             strcpy(cmd.group, req->group);
+            cmd.n_filter = req->n_tag;
+            if (req->n_tag > 0) {
+                cmd.filters = calloc(req->n_tag, sizeof(char *));
+                for (int i = 0; i < req->n_tag; i++) {
+                    cmd.filters[i] = strdup(req->tags[i]);
+                }
+            }
             ret = neu_plugin_op(plugin, header, &cmd);
             if (ret != 0) {
+                // the filters are only owned by the receiver once sent
+                for (int i = 0; i < cmd.n_filter; i++) {
+                    free(cmd.filters[i]);
+                }
+                free(cmd.filters);
                 NEU_JSON_RESPONSE_ERROR(NEU_ERR_IS_BUSY, {
                     http_response(aio, NEU_ERR_IS_BUSY, result_error);
                 });
@@ -95,6 +95,9 @@ struct neu_rest_handler cors_handler[] = {
     {
         .url = "/api/v2/node/state",
     },
+    {
+        .url = "/api/v2/node/capture",
+    },
     {
         .url = "/api/v2/log",
     },
@@ -287,6 +290,18 @@ struct neu_rest_handler api_handlers[] = {
         .url           = "/api/v2/node/state",
         .value.handler = handle_get_node_state,
     },
+    {
+        .method        = NEU_REST_METHOD_POST,
+        .type          = NEU_REST_HANDLER_FUNCTION,
+        .url           = "/api/v2/node/capture",
+        .value.handler = handle_node_capture,
+    },
+    {
+        .method        = NEU_REST_METHOD_GET,
+        .type          = NEU_REST_HANDLER_FUNCTION,
+        .url           = "/api/v2/node/capture",
+        .value.handler = handle_get_node_capture,
+    },
     {
         .method        = NEU_REST_METHOD_GET,
         .type          = NEU_REST_HANDLER_FUNCTION,
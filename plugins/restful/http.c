@@ -323,6 +323,7 @@ int http_response(nng_aio *aio, neu_err_code_e code, char *content)
     case NEU_ERR_FILE_NOT_EXIST:
     case NEU_ERR_LIBRARY_NOT_FOUND:
     case NEU_ERR_NODE_NOT_EXIST:
+    case NEU_ERR_NODE_CAPTURE_NOT_FOUND:
     case NEU_ERR_TAG_NOT_EXIST:
     case NEU_ERR_LICENSE_NOT_FOUND:
     case NEU_ERR_GROUP_NOT_EXIST:
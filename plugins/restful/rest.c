@@ -305,6 +305,10 @@ static int dashb_plugin_request(neu_plugin_t *      plugin,
         handle_get_node_stat_resp(header->ctx,
                                   (neu_resp_get_node_stat_t *) data);
         break;
+    case NEU_RESP_GET_NODE_CAPTURE:
+        handle_get_node_capture_resp(header->ctx,
+                                     (neu_resp_get_node_capture_t *) data);
+        break;
     case NEU_RESP_GET_NODE_STATE:
         handle_get_node_state_resp(header->ctx,
                                    (neu_resp_get_node_state_t *) data);
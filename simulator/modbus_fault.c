@@ -0,0 +1,307 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "modbus_fault.h"
+
+typedef enum {
+    LATENCY_FIXED,
+    LATENCY_UNIFORM,
+    LATENCY_NORMAL,
+    LATENCY_EXP,
+} latency_e;
+
+struct fault_conf {
+    latency_e latency;
+    double    a; // us
+    double    b; // us
+
+    double  drop;
+    double  truncate;
+    double  exception;
+    uint8_t exception_code;
+    double  reset;
+};
+
+static struct fault_conf confs[256];
+
+static __thread unsigned int seed = 0;
+
+static double random_unit(void)
+{
+    if (seed == 0) {
+        seed = (unsigned int) time(NULL) ^ (unsigned int) pthread_self();
+    }
+
+    return rand_r(&seed) / ((double) RAND_MAX + 1);
+}
+
+static int parse_units(char *units, bool set[256])
+{
+    char *save = NULL;
+
+    if (strcmp(units, "all") == 0) {
+        for (int i = 0; i < 256; i++) {
+            set[i] = true;
+        }
+        return 0;
+    }
+
+    for (char *r = strtok_r(units, ",", &save); r != NULL;
+         r = strtok_r(NULL, ",", &save)) {
+        int start = 0;
+        int end   = 0;
+
+        switch (sscanf(r, "%d-%d", &start, &end)) {
+        case 1:
+            end = start;
+            break;
+        case 2:
+            break;
+        default:
+            return -1;
+        }
+
+        if (start < 0 || end > 255 || start > end) {
+            return -1;
+        }
+        for (int i = start; i <= end; i++) {
+            set[i] = true;
+        }
+    }
+
+    return 0;
+}
+
+static int parse_latency(const char *v, struct fault_conf *conf)
+{
+    if (sscanf(v, "fixed:%lf", &conf->a) == 1) {
+        conf->latency = LATENCY_FIXED;
+    } else if (sscanf(v, "uniform:%lf:%lf", &conf->a, &conf->b) == 2 &&
+               conf->a <= conf->b) {
+        conf->latency = LATENCY_UNIFORM;
+    } else if (sscanf(v, "normal:%lf:%lf", &conf->a, &conf->b) == 2) {
+        conf->latency = LATENCY_NORMAL;
+    } else if (sscanf(v, "exp:%lf", &conf->a) == 1) {
+        conf->latency = LATENCY_EXP;
+    } else {
+        return -1;
+    }
+
+    return conf->a < 0 || conf->b < 0 ? -1 : 0;
+}
+
+static int parse_probability(const char *v, double *p)
+{
+    if (sscanf(v, "%lf", p) != 1 || *p < 0 || *p > 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int modbus_fault_parse(const char *spec)
+{
+    char *            dup      = strdup(spec);
+    char *            save     = NULL;
+    char *            token    = strtok_r(dup, " \t\r\n", &save);
+    bool              set[256] = { 0 };
+    struct fault_conf conf     = { 0 };
+    enum {
+        F_LATENCY   = 1 << 0,
+        F_DROP      = 1 << 1,
+        F_TRUNCATE  = 1 << 2,
+        F_EXCEPTION = 1 << 3,
+        F_RESET     = 1 << 4,
+    } given = 0;
+
+    if (token == NULL || parse_units(token, set) != 0) {
+        goto error;
+    }
+
+    conf.exception_code = 4;
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        char *v = strchr(token, '=');
+        int   n = 0;
+
+        if (v == NULL) {
+            goto error;
+        }
+        *v++ = '\0';
+
+        if (strcmp(token, "latency") == 0) {
+            n = parse_latency(v, &conf);
+            given |= F_LATENCY;
+        } else if (strcmp(token, "drop") == 0) {
+            n = parse_probability(v, &conf.drop);
+            given |= F_DROP;
+        } else if (strcmp(token, "truncate") == 0) {
+            n = parse_probability(v, &conf.truncate);
+            given |= F_TRUNCATE;
+        } else if (strcmp(token, "exception") == 0) {
+            int code = 4;
+
+            if (sscanf(v, "%lf:%d", &conf.exception, &code) < 1 ||
+                conf.exception < 0 || conf.exception > 1 || code < 1 ||
+                code > 0xff) {
+                n = -1;
+            }
+            conf.exception_code = code;
+            given |= F_EXCEPTION;
+        } else if (strcmp(token, "reset") == 0) {
+            n = parse_probability(v, &conf.reset);
+            given |= F_RESET;
+        } else {
+            n = -1;
+        }
+
+        if (n != 0) {
+            goto error;
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        if (!set[i]) {
+            continue;
+        }
+        if (given & F_LATENCY) {
+            confs[i].latency = conf.latency;
+            confs[i].a       = conf.a;
+            confs[i].b       = conf.b;
+        }
+        if (given & F_DROP) {
+            confs[i].drop = conf.drop;
+        }
+        if (given & F_TRUNCATE) {
+            confs[i].truncate = conf.truncate;
+        }
+        if (given & F_EXCEPTION) {
+            confs[i].exception      = conf.exception;
+            confs[i].exception_code = conf.exception_code;
+        }
+        if (given & F_RESET) {
+            confs[i].reset = conf.reset;
+        }
+    }
+
+    free(dup);
+    return 0;
+
+error:
+    printf("invalid fault spec: %s\n", spec);
+    free(dup);
+    return -1;
+}
+
+int modbus_fault_load(const char *path)
+{
+    char  line[1024] = { 0 };
+    int   ret        = 0;
+    FILE *f          = fopen(path, "r");
+
+    if (f == NULL) {
+        printf("open %s fail\n", path);
+        return -1;
+    }
+
+    while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+        char *p = line + strspn(line, " \t");
+
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+        ret = modbus_fault_parse(p);
+    }
+
+    fclose(f);
+    return ret;
+}
+
+static uint32_t latency(const struct fault_conf *conf)
+{
+    double us = 0;
+
+    switch (conf->latency) {
+    case LATENCY_FIXED:
+        us = conf->a;
+        break;
+    case LATENCY_UNIFORM:
+        us = conf->a + (conf->b - conf->a) * random_unit();
+        break;
+    case LATENCY_NORMAL: {
+        // box-muller, 1 - u is never 0
+        double u = 1 - random_unit();
+        double v = random_unit();
+
+        us = conf->a + conf->b * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+        break;
+    }
+    case LATENCY_EXP:
+        us = -conf->a * log(1 - random_unit());
+        break;
+    }
+
+    return us < 0 ? 0 : (uint32_t) us;
+}
+
+modbus_fault_e modbus_fault_pick(uint8_t unit, uint32_t *delay_us,
+                                 uint8_t *exception)
+{
+    const struct fault_conf *conf = &confs[unit];
+    double                   r    = 0;
+
+    *delay_us = latency(conf);
+    if (conf->drop == 0 && conf->truncate == 0 && conf->exception == 0 &&
+        conf->reset == 0) {
+        return MODBUS_FAULT_NONE;
+    }
+
+    r = random_unit();
+    if (r < conf->drop) {
+        return MODBUS_FAULT_DROP;
+    }
+    r -= conf->drop;
+    if (r < conf->truncate) {
+        return MODBUS_FAULT_TRUNCATE;
+    }
+    r -= conf->truncate;
+    if (r < conf->exception) {
+        *exception = conf->exception_code;
+        return MODBUS_FAULT_EXCEPTION;
+    }
+    r -= conf->exception;
+    if (r < conf->reset) {
+        return MODBUS_FAULT_RESET;
+    }
+
+    return MODBUS_FAULT_NONE;
+}
+
+int modbus_fault_truncate(int len)
+{
+    if (len <= 1) {
+        return 0;
+    }
+    return 1 + (int) (random_unit() * (len - 1));
+}
@@ -0,0 +1,53 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#ifndef SIMULATOR_MODBUS_FAULT_H
+#define SIMULATOR_MODBUS_FAULT_H
+
+#include <stdint.h>
+
+/**
+ * Latency and faults of the simulated units, set up before serving. One spec
+ * is a unit list followed by the options, e.g.
+ *   1-10,20 latency=uniform:1000:5000 drop=0.01 exception=0.01:4
+ *   all latency=normal:2000:500 truncate=0.001 reset=0.0001
+ * latency (us) is fixed:US, uniform:MIN:MAX, normal:MEAN:STDDEV or exp:MEAN.
+ * drop, truncate, exception and reset are probabilities of each request,
+ * exception takes the exception code after the probability, 4 by default.
+ * The options given override the ones of the earlier specs.
+ */
+typedef enum modbus_fault {
+    MODBUS_FAULT_NONE,
+    MODBUS_FAULT_DROP,      // no response
+    MODBUS_FAULT_TRUNCATE,  // the first part of the response
+    MODBUS_FAULT_EXCEPTION, // an exception response instead
+    MODBUS_FAULT_RESET,     // the connection is reset
+} modbus_fault_e;
+
+int modbus_fault_parse(const char *spec);
+
+// one spec per line, blank lines and lines starting with # are skipped
+int modbus_fault_load(const char *path);
+
+modbus_fault_e modbus_fault_pick(uint8_t unit, uint32_t *delay_us,
+                                 uint8_t *exception);
+
+// a random length in [1, len)
+int modbus_fault_truncate(int len);
+
+#endif
@@ -0,0 +1,364 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "modbus_gen.h"
+#include "modbus_s.h"
+
+typedef enum {
+    GEN_COUNTER,
+    GEN_SINE,
+    GEN_WALK,
+    GEN_STEP,
+} gen_e;
+
+struct gen {
+    bool            units[256];
+    modbus_s_area_e area;
+    uint16_t        start;
+    uint16_t        end;
+
+    gen_e    kind;
+    int64_t  interval; // ms
+    double   ratio;
+    int32_t  step;
+    int32_t  min;
+    int32_t  max;
+    int64_t  period; // ms
+    uint64_t t;      // ms since started
+
+    unsigned int       seed;
+    neu_event_timer_t *timer;
+
+    struct gen *next;
+};
+
+static struct gen *gens = NULL;
+
+static double random_unit(struct gen *gen)
+{
+    return rand_r(&gen->seed) / ((double) RAND_MAX + 1);
+}
+
+static int parse_units(char *units, bool set[256])
+{
+    char *save = NULL;
+
+    if (strcmp(units, "all") == 0) {
+        for (int i = 0; i < 256; i++) {
+            set[i] = true;
+        }
+        return 0;
+    }
+
+    for (char *r = strtok_r(units, ",", &save); r != NULL;
+         r = strtok_r(NULL, ",", &save)) {
+        int start = 0;
+        int end   = 0;
+
+        switch (sscanf(r, "%d-%d", &start, &end)) {
+        case 1:
+            end = start;
+            break;
+        case 2:
+            break;
+        default:
+            return -1;
+        }
+
+        if (start < 0 || end > 255 || start > end) {
+            return -1;
+        }
+        for (int i = start; i <= end; i++) {
+            set[i] = true;
+        }
+    }
+
+    return 0;
+}
+
+static int parse_area(const char *v, struct gen *gen)
+{
+    static const struct {
+        const char *    name;
+        modbus_s_area_e area;
+    } areas[] = {
+        { "coil", MODBUS_S_COIL },
+        { "input", MODBUS_S_INPUT },
+        { "input_register", MODBUS_S_INPUT_REGISTER },
+        { "hold", MODBUS_S_HOLD_REGISTER },
+    };
+    const char *sep   = strchr(v, ':');
+    int         start = 0;
+    int         end   = 0;
+
+    if (sep == NULL || sscanf(sep + 1, "%d-%d", &start, &end) != 2 ||
+        start < 0 || end > 65535 || start > end) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(areas) / sizeof(areas[0]); i++) {
+        if (strlen(areas[i].name) == (size_t)(sep - v) &&
+            strncmp(areas[i].name, v, sep - v) == 0) {
+            gen->area  = areas[i].area;
+            gen->start = start;
+            gen->end   = end;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int parse_kind(const char *v, struct gen *gen)
+{
+    if (strcmp(v, "counter") == 0) {
+        gen->kind = GEN_COUNTER;
+    } else if (strcmp(v, "sine") == 0) {
+        gen->kind = GEN_SINE;
+    } else if (strcmp(v, "walk") == 0) {
+        gen->kind = GEN_WALK;
+    } else if (strcmp(v, "step") == 0) {
+        gen->kind = GEN_STEP;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_option(char *token, struct gen *gen)
+{
+    char *  v = strchr(token, '=');
+    int64_t n = 0;
+
+    if (v == NULL) {
+        return -1;
+    }
+    *v++ = '\0';
+
+    if (strcmp(token, "ratio") == 0) {
+        if (sscanf(v, "%lf", &gen->ratio) != 1 || gen->ratio < 0 ||
+            gen->ratio > 1) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (sscanf(v, "%" SCNd64, &n) != 1) {
+        return -1;
+    }
+
+    if (strcmp(token, "interval") == 0 && n > 0) {
+        gen->interval = n;
+    } else if (strcmp(token, "period") == 0 && n > 0) {
+        gen->period = n;
+    } else if (strcmp(token, "step") == 0 && n > 0 && n <= 65535) {
+        gen->step = n;
+    } else if (strcmp(token, "min") == 0 && n >= 0 && n <= 65535) {
+        gen->min = n;
+    } else if (strcmp(token, "max") == 0 && n >= 0 && n <= 65535) {
+        gen->max = n;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+int modbus_gen_parse(const char *spec)
+{
+    char *      dup   = strdup(spec);
+    char *      save  = NULL;
+    char *      token = strtok_r(dup, " \t\r\n", &save);
+    struct gen *gen   = calloc(1, sizeof(struct gen));
+
+    gen->interval = 1000;
+    gen->ratio    = 1;
+    gen->step     = 1;
+    gen->min      = 0;
+    gen->max      = 65535;
+    gen->period   = 10000;
+
+    if (token == NULL || parse_units(token, gen->units) != 0) {
+        goto error;
+    }
+
+    token = strtok_r(NULL, " \t\r\n", &save);
+    if (token == NULL || parse_area(token, gen) != 0) {
+        goto error;
+    }
+
+    token = strtok_r(NULL, " \t\r\n", &save);
+    if (token == NULL || parse_kind(token, gen) != 0) {
+        goto error;
+    }
+
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (parse_option(token, gen) != 0) {
+            goto error;
+        }
+    }
+
+    if (gen->min >= gen->max) {
+        goto error;
+    }
+
+    LL_APPEND(gens, gen);
+    free(dup);
+    return 0;
+
+error:
+    printf("invalid generator spec: %s\n", spec);
+    free(gen);
+    free(dup);
+    return -1;
+}
+
+int modbus_gen_load(const char *path)
+{
+    char  line[1024] = { 0 };
+    int   ret        = 0;
+    FILE *f          = fopen(path, "r");
+
+    if (f == NULL) {
+        printf("open %s fail\n", path);
+        return -1;
+    }
+
+    while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+        char *p = line + strspn(line, " \t");
+
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+        ret = modbus_gen_parse(p);
+    }
+
+    fclose(f);
+    return ret;
+}
+
+static void update(void *ctx, uint16_t address, uint16_t *value)
+{
+    struct gen *gen = (struct gen *) ctx;
+    int32_t     v   = *value;
+
+    if (gen->ratio < 1 && random_unit(gen) >= gen->ratio) {
+        return;
+    }
+
+    if (gen->area == MODBUS_S_COIL || gen->area == MODBUS_S_INPUT) {
+        *value = !*value;
+        return;
+    }
+
+    switch (gen->kind) {
+    case GEN_COUNTER:
+        v += gen->step;
+        if (v > gen->max || v < gen->min) {
+            v = gen->min;
+        }
+        break;
+    case GEN_WALK: {
+        int32_t d = 1 + (int32_t)(random_unit(gen) * gen->step);
+
+        if (random_unit(gen) < 0.5) {
+            d = -d;
+        }
+        // turn back at the bounds
+        if (v + d > gen->max || v + d < gen->min) {
+            d = -d;
+        }
+        v += d;
+        if (v > gen->max || v < gen->min) {
+            v = gen->min;
+        }
+        break;
+    }
+    case GEN_SINE: {
+        // the registers of the range are spread over one period
+        double phase = 2 * M_PI *
+            ((double) gen->t / gen->period +
+             (double) (address - gen->start) / (gen->end - gen->start + 1));
+
+        v = gen->min + (gen->max - gen->min) * (1 + sin(phase)) / 2;
+        break;
+    }
+    case GEN_STEP:
+        v = (gen->t / gen->period) % 2 == 0 ? gen->min : gen->max;
+        break;
+    }
+
+    *value = (uint16_t) v;
+}
+
+static int gen_timer(void *usr_data)
+{
+    struct gen *gen = (struct gen *) usr_data;
+
+    gen->t += gen->interval;
+    for (int unit = 0; unit < 256; unit++) {
+        if (gen->units[unit]) {
+            modbus_s_update(unit, gen->area, gen->start, gen->end, update,
+                            gen);
+        }
+    }
+
+    return 0;
+}
+
+void modbus_gen_start(neu_events_t *events)
+{
+    struct gen *gen = NULL;
+
+    LL_FOREACH(gens, gen)
+    {
+        neu_event_timer_param_t param = {
+            .second      = gen->interval / 1000,
+            .millisecond = gen->interval % 1000,
+            .usr_data    = (void *) gen,
+            .cb          = gen_timer,
+        };
+
+        gen->seed  = (unsigned int) time(NULL) ^ (unsigned int) (uintptr_t) gen;
+        gen->t     = 0;
+        gen->timer = neu_event_add_timer(events, param);
+    }
+}
+
+void modbus_gen_stop(neu_events_t *events)
+{
+    struct gen *gen = NULL;
+
+    LL_FOREACH(gens, gen)
+    {
+        if (gen->timer != NULL) {
+            neu_event_del_timer(events, gen->timer);
+            gen->timer = NULL;
+        }
+    }
+}
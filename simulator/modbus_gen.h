@@ -0,0 +1,48 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+#ifndef SIMULATOR_MODBUS_GEN_H
+#define SIMULATOR_MODBUS_GEN_H
+
+#include <neuron.h>
+
+/**
+ * Registers changing on a timer, to feed the change detection of the driver.
+ * One spec is a unit list, an area with an address range, a generator and
+ * the options, e.g.
+ *   1-10 hold:0-999 counter ratio=0.1 interval=100
+ *   all input_register:0-99 sine min=0 max=1000 period=10000
+ *   1 coil:0-15 walk ratio=0.01
+ * area is coil, input, input_register or hold.
+ * counter adds step, walk adds a random value in [-step, step] except 0,
+ * both within [min, max]. sine and step (a square wave) go between min and
+ * max with the period (ms).
+ * interval (ms, 1000 by default) is the time between two updates, ratio (1 by
+ * default) the part of the registers changed by each update.
+ * The bits are flipped whatever the generator is.
+ */
+int modbus_gen_parse(const char *spec);
+
+// one spec per line, blank lines and lines starting with # are skipped
+int modbus_gen_load(const char *path);
+
+// the generators are run by timers of the events
+void modbus_gen_start(neu_events_t *events);
+void modbus_gen_stop(neu_events_t *events);
+
+#endif
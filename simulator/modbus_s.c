@@ -20,6 +20,7 @@
 #include <memory.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stdlib.h>
 
 #include <neuron.h>
 
@@ -28,16 +29,22 @@
 #include "modbus_s.h"
 
 struct modbus_register {
+    // serializes the writers, the readers retry when seq changed under them
     pthread_mutex_t mutex;
+    uint32_t        seq;
     neu_value8_u    input[65536];
     neu_value16_u   input_register[65536];
     neu_value8_u    coil[65536];
     neu_value16_u   hold_register[65536];
 };
 
-static struct modbus_register rtu_registers[3];
-static struct modbus_register tcp_registers[3];
+// allocated on the first request to a unit, both the tcp and the rtu mode
+// serve the same registers
+static struct modbus_register *registers[MODBUS_S_MAX_UNIT + 1];
+static pthread_mutex_t         registers_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static uint8_t modbus_check(uint8_t function, struct modbus_address *address,
+                            struct modbus_data *data);
 static int  modbus_read(struct modbus_register *reg, uint8_t function,
                         struct modbus_address *address, uint8_t *value);
 static void modbus_write(struct modbus_register *reg, uint8_t function,
@@ -46,19 +53,124 @@ static void modbus_write(struct modbus_register *reg, uint8_t function,
 
 void modbus_s_init()
 {
-    for (int i = 0; i < 3; i++) {
+    pthread_mutex_lock(&registers_mutex);
+    for (int i = 0; i <= MODBUS_S_MAX_UNIT; i++) {
+        if (registers[i] != NULL) {
+            pthread_mutex_destroy(&registers[i]->mutex);
+            free(registers[i]);
+            registers[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&registers_mutex);
+}
+
+static struct modbus_register *modbus_unit(uint8_t slave_id)
+{
+    struct modbus_register *reg = NULL;
+
+    if (slave_id < 1 || slave_id > MODBUS_S_MAX_UNIT) {
+        return NULL;
+    }
+
+    reg = __atomic_load_n(&registers[slave_id], __ATOMIC_ACQUIRE);
+    if (reg != NULL) {
+        return reg;
+    }
+
+    pthread_mutex_lock(&registers_mutex);
+    reg = registers[slave_id];
+    if (reg == NULL) {
+        reg = calloc(1, sizeof(struct modbus_register));
         for (int k = 0; k < 65536; k += 2) {
-            rtu_registers[i].input[k].value = 1;
-            tcp_registers[i].input[k].value = 1;
+            reg->input[k].value = 1;
         }
         for (int k = 0; k < 65536; k++) {
-            rtu_registers[i].input_register[k].value = k;
-            tcp_registers[i].input_register[k].value = k;
+            reg->input_register[k].value = k;
         }
+        pthread_mutex_init(&reg->mutex, NULL);
+        __atomic_store_n(&registers[slave_id], reg, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registers_mutex);
+
+    return reg;
+}
+
+static void write_begin(struct modbus_register *reg)
+{
+    pthread_mutex_lock(&reg->mutex);
+    __atomic_store_n(&reg->seq, reg->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(struct modbus_register *reg)
+{
+    __atomic_store_n(&reg->seq, reg->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&reg->mutex);
+}
+
+void modbus_s_exception(uint8_t *res, int *res_len, bool tcp, uint8_t code)
+{
+    if (tcp) {
+        struct modbus_header *header = (struct modbus_header *) res;
+
+        res[sizeof(struct modbus_header) + 1] |= 0x80;
+        res[sizeof(struct modbus_header) + 2] = code;
+
+        header->len = htons(sizeof(struct modbus_code) + 1);
+        *res_len =
+            sizeof(struct modbus_header) + sizeof(struct modbus_code) + 1;
+    } else {
+        uint16_t sum = 0;
+
+        res[1] |= 0x80;
+        res[2]   = code;
+        sum      = modbus_crc16(res, 3);
+        res[3]   = sum & 0xff;
+        res[4]   = sum >> 8;
+        *res_len = 5;
+    }
+}
+
+void modbus_s_update(uint8_t unit, modbus_s_area_e area, uint16_t start,
+                     uint16_t end, modbus_s_update_fn fn, void *ctx)
+{
+    struct modbus_register *reg = NULL;
+
+    if (unit > MODBUS_S_MAX_UNIT) {
+        return;
+    }
 
-        pthread_mutex_init(&rtu_registers[i].mutex, NULL);
-        pthread_mutex_init(&tcp_registers[i].mutex, NULL);
+    pthread_mutex_lock(&registers_mutex);
+    reg = registers[unit];
+    pthread_mutex_unlock(&registers_mutex);
+    if (reg == NULL) {
+        return;
     }
+
+    write_begin(reg);
+    for (uint32_t i = start; i <= end; i++) {
+        uint16_t value = 0;
+
+        switch (area) {
+        case MODBUS_S_COIL:
+            value = reg->coil[i].value;
+            fn(ctx, i, &value);
+            reg->coil[i].value = value & 1;
+            break;
+        case MODBUS_S_INPUT:
+            value = reg->input[i].value;
+            fn(ctx, i, &value);
+            reg->input[i].value = value & 1;
+            break;
+        case MODBUS_S_INPUT_REGISTER:
+            fn(ctx, i, &reg->input_register[i].value);
+            break;
+        case MODBUS_S_HOLD_REGISTER:
+            fn(ctx, i, &reg->hold_register[i].value);
+            break;
+        }
+    }
+    write_end(reg);
 }
 
 ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
@@ -77,11 +189,15 @@ ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     uint8_t *              res_value   = (uint8_t *) &res_data[1];
     uint16_t *             crc         = NULL;
 
+    struct modbus_register *reg       = NULL;
+    uint8_t                 exception = 0;
+
     if (req_len < sizeof(struct modbus_code)) {
         return 0;
     }
 
-    if (code->slave_id != 1 && code->slave_id != 2 && code->slave_id != 3) {
+    reg = modbus_unit(code->slave_id);
+    if (reg == NULL) {
         return -1;
     }
 
@@ -113,18 +229,26 @@ ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
         }
         use_len += sizeof(struct modbus_data) + data->n_byte + 2;
         break;
+    default:
+        use_len = req_len;
+        break;
     }
 
     memcpy(res, req, sizeof(struct modbus_code));
     *res_len = sizeof(struct modbus_code);
 
+    exception = modbus_check(code->function, address, data);
+    if (exception != 0) {
+        modbus_s_exception(res, res_len, false, exception);
+        return use_len;
+    }
+
     switch (code->function) {
     case MODBUS_READ_COIL:
     case MODBUS_READ_INPUT:
     case MODBUS_READ_HOLD_REG:
     case MODBUS_READ_INPUT_REG:
-        len = modbus_read(&tcp_registers[code->slave_id - 1], code->function,
-                          address, res_value);
+        len = modbus_read(reg, code->function, address, res_value);
         *res_len += sizeof(struct modbus_data);
         *res_len += len;
 
@@ -135,8 +259,7 @@ ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     case MODBUS_WRITE_S_COIL:
     case MODBUS_WRITE_M_COIL:
     case MODBUS_WRITE_M_HOLD_REG:
-        modbus_write(&tcp_registers[code->slave_id - 1], code->function,
-                     address, data, value);
+        modbus_write(reg, code->function, address, data, value);
         *res_address = *address;
 
         *res_len += sizeof(struct modbus_address);
@@ -147,7 +270,9 @@ ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
         return -1;
     }
 
-    *crc = 0x1001;
+    uint16_t sum = modbus_crc16(res, *res_len);
+    ((uint8_t *) crc)[0] = sum & 0xff;
+    ((uint8_t *) crc)[1] = sum >> 8;
     *res_len += 2;
 
     assert(res_mlen >= *res_len);
@@ -171,10 +296,18 @@ ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     struct modbus_data *   res_data    = (struct modbus_data *) &res_code[1];
     uint8_t *              res_value   = (uint8_t *) &res_data[1];
 
+    struct modbus_register *reg       = NULL;
+    uint8_t                 exception = 0;
+
     if (req_len < sizeof(struct modbus_header)) {
         return 0;
     }
 
+    // the unit id and a pdu, a longer frame would never fit the buffer
+    if (ntohs(header->len) > MODBUS_MAX_PDU + 1) {
+        return -1;
+    }
+
     if (req_len < sizeof(struct modbus_header) + ntohs(header->len)) {
         return 0;
     }
@@ -183,7 +316,7 @@ ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
         return -1;
     }
 
-    if (code->slave_id != 1 && code->slave_id != 2 && code->slave_id != 3) {
+    if (ntohs(header->len) < sizeof(struct modbus_code)) {
         return -1;
     }
 
@@ -191,17 +324,30 @@ ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     *res_len        = sizeof(struct modbus_header) + sizeof(struct modbus_code);
     res_header->len = sizeof(struct modbus_code);
 
+    // answered as a gateway without a slave behind
+    reg = modbus_unit(code->slave_id);
+    if (reg == NULL) {
+        modbus_s_exception(res, res_len, true,
+                           MODBUS_EXCEPTION_GATEWAY_TARGET);
+        return sizeof(struct modbus_header) + ntohs(header->len);
+    }
+
+    exception = modbus_check(code->function, address, data);
+    if (exception != 0) {
+        modbus_s_exception(res, res_len, true, exception);
+        return sizeof(struct modbus_header) + ntohs(header->len);
+    }
+
     switch (code->function) {
     case MODBUS_READ_COIL:
     case MODBUS_READ_INPUT:
     case MODBUS_READ_HOLD_REG:
     case MODBUS_READ_INPUT_REG:
-        nlog_info("read register: slave: %d, function: %d, address: %d, n "
-                  "register: %d\n",
-                  code->slave_id, code->function, ntohs(address->start_address),
-                  ntohs(address->n_reg));
-        len = modbus_read(&tcp_registers[code->slave_id - 1], code->function,
-                          address, res_value);
+        nlog_debug("read register: slave: %d, function: %d, address: %d, n "
+                   "register: %d\n",
+                   code->slave_id, code->function,
+                   ntohs(address->start_address), ntohs(address->n_reg));
+        len = modbus_read(reg, code->function, address, res_value);
         *res_len += sizeof(struct modbus_data);
         *res_len += len;
 
@@ -211,13 +357,12 @@ ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     case MODBUS_WRITE_S_COIL:
     case MODBUS_WRITE_M_COIL:
     case MODBUS_WRITE_M_HOLD_REG:
-        nlog_info(
+        nlog_debug(
             "write register: slave: %d, function: %d, address: %d, n: %d, "
             "nbyte: %d\n",
             code->slave_id, code->function, ntohs(address->start_address),
             ntohs(address->n_reg), data->n_byte);
-        modbus_write(&tcp_registers[code->slave_id - 1], code->function,
-                     address, data, value);
+        modbus_write(reg, code->function, address, data, value);
         *res_address = *address;
 
         *res_len += sizeof(struct modbus_address);
@@ -234,53 +379,83 @@ ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
     return sizeof(struct modbus_header) + ntohs(header->len);
 }
 
-static int modbus_read(struct modbus_register *reg, uint8_t function,
-                       struct modbus_address *address, uint8_t *value)
+// the exception answered instead, 0 if the request is served
+static uint8_t modbus_check(uint8_t function, struct modbus_address *address,
+                            struct modbus_data *data)
 {
-    int len = 0;
+    uint32_t start = ntohs(address->start_address);
+    uint32_t n     = ntohs(address->n_reg);
 
-    pthread_mutex_lock(&reg->mutex);
     switch (function) {
     case MODBUS_READ_COIL:
     case MODBUS_READ_INPUT:
-        len = ntohs(address->n_reg) / 8;
-        if (ntohs(address->n_reg) % 8 != 0) {
-            len += 1;
+        if (n < 1 || n > MODBUS_MAX_READ_BIT) {
+            return MODBUS_EXCEPTION_ILLEGAL_VALUE;
+        }
+        break;
+    case MODBUS_READ_HOLD_REG:
+    case MODBUS_READ_INPUT_REG:
+        if (n < 1 || n > MODBUS_MAX_READ_REGISTER) {
+            return MODBUS_EXCEPTION_ILLEGAL_VALUE;
         }
+        break;
+    case MODBUS_WRITE_S_COIL:
+        n = 1;
+        break;
+    case MODBUS_WRITE_M_COIL:
+        if (n < 1 || n > MODBUS_MAX_WRITE_BIT || data->n_byte != (n + 7) / 8) {
+            return MODBUS_EXCEPTION_ILLEGAL_VALUE;
+        }
+        break;
+    case MODBUS_WRITE_M_HOLD_REG:
+        if (n < 1 || n > MODBUS_MAX_WRITE_REGISTER || data->n_byte != n * 2) {
+            return MODBUS_EXCEPTION_ILLEGAL_VALUE;
+        }
+        break;
+    default:
+        return MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+    }
 
-        for (int i = 0; i < ntohs(address->n_reg); i++) {
+    if (start + n > 65536) {
+        return MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+    }
+
+    return 0;
+}
+
+static int read_value(struct modbus_register *reg, uint8_t function,
+                      struct modbus_address *address, uint8_t *value)
+{
+    uint16_t start = ntohs(address->start_address);
+    uint16_t n     = ntohs(address->n_reg);
+    int      len   = 0;
+
+    switch (function) {
+    case MODBUS_READ_COIL:
+    case MODBUS_READ_INPUT:
+        len = (n + 7) / 8;
+        memset(value, 0, len);
+
+        for (int i = 0; i < n; i++) {
             if (function == MODBUS_READ_COIL) {
-                value[i / 8] |=
-                    reg->coil[ntohs(address->start_address) + i].value
-                    << (i % 8);
+                value[i / 8] |= reg->coil[start + i].value << (i % 8);
             } else {
-                value[i / 8] |=
-                    reg->input[ntohs(address->start_address) + i].value
-                    << (i % 8);
+                value[i / 8] |= reg->input[start + i].value << (i % 8);
             }
-
-            nlog_info("read coil/input: %d, i: %d\n", value[i / 8], i);
         }
 
         break;
     case MODBUS_READ_HOLD_REG:
     case MODBUS_READ_INPUT_REG: {
-        len = ntohs(address->n_reg) * 2;
-
         uint16_t *byte = (uint16_t *) value;
 
-        for (int i = 0; i < ntohs(address->n_reg); i++) {
+        len = n * 2;
+        for (int i = 0; i < n; i++) {
             if (function == MODBUS_READ_HOLD_REG) {
-                byte[i] =
-                    htons(reg->hold_register[ntohs(address->start_address) + i]
-                              .value);
+                byte[i] = htons(reg->hold_register[start + i].value);
             } else {
-                byte[i] =
-                    htons(reg->input_register[ntohs(address->start_address) + i]
-                              .value);
+                byte[i] = htons(reg->input_register[start + i].value);
             }
-
-            nlog_info("read hold/input register: %X, i:%d\n", byte[i], i);
         }
 
         break;
@@ -290,14 +465,36 @@ static int modbus_read(struct modbus_register *reg, uint8_t function,
         assert(1 != 0);
     }
 
-    pthread_mutex_unlock(&reg->mutex);
     return len;
 }
+
+// the workers read without blocking each other nor the writers
+static int modbus_read(struct modbus_register *reg, uint8_t function,
+                       struct modbus_address *address, uint8_t *value)
+{
+    uint32_t seq = 0;
+    int      len = 0;
+
+    do {
+        seq = __atomic_load_n(&reg->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+
+        len = read_value(reg, function, address, value);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&reg->seq, __ATOMIC_RELAXED) != seq);
+
+    nlog_debug("read function: %d, address: %d, n: %d, len: %d\n", function,
+               ntohs(address->start_address), ntohs(address->n_reg), len);
+    return len;
+}
+
 static void modbus_write(struct modbus_register *reg, uint8_t function,
                          struct modbus_address *address,
                          struct modbus_data *data, uint8_t *value)
 {
-    pthread_mutex_lock(&reg->mutex);
+    write_begin(reg);
     switch (function) {
     case MODBUS_WRITE_S_COIL:
         if (address->n_reg > 0) {
@@ -308,9 +505,9 @@ static void modbus_write(struct modbus_register *reg, uint8_t function,
         break;
     case MODBUS_WRITE_M_COIL:
         for (int i = 0; i < ntohs(address->n_reg); i++) {
-            uint8_t x = (value[ntohs(address->n_reg) / 8] >> (i % 8)) & 0x1;
+            uint8_t x = (value[i / 8] >> (i % 8)) & 0x1;
 
-            nlog_info("write coil byte: %d, %d\n", x, i);
+            nlog_debug("write coil byte: %d, %d\n", x, i);
             if (x > 0) {
                 reg->coil[ntohs(address->start_address) + i].value = 1;
             } else {
@@ -331,7 +528,7 @@ static void modbus_write(struct modbus_register *reg, uint8_t function,
                 reg->hold_register[ntohs(address->start_address) + i / 2]
                     .value |= value[i];
             }
-            nlog_info("write hold register address: %d, byte: %X\n",
+            nlog_debug("write hold register address: %d, byte: %X\n",
                       ntohs(address->start_address) + i / 2,
                       reg->hold_register[ntohs(address->start_address) + i / 2]
                           .value);
@@ -341,5 +538,5 @@ static void modbus_write(struct modbus_register *reg, uint8_t function,
     default:
         assert(1 != 0);
     }
-    pthread_mutex_unlock(&reg->mutex);
+    write_end(reg);
 }
@@ -19,11 +19,35 @@
 #ifndef SIMULATOR_MODBUS_S_H
 #define SIMULATOR_MODBUS_S_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+// the unit ids answered, the others get a gateway target exception over tcp
+#define MODBUS_S_MAX_UNIT 247
+
+// drop the registers written, every unit starts again from the initial values
 void modbus_s_init();
 
+// turn the response built in res into an exception response
+void modbus_s_exception(uint8_t *res, int *res_len, bool tcp, uint8_t code);
+
+typedef enum modbus_s_area {
+    MODBUS_S_COIL,
+    MODBUS_S_INPUT,
+    MODBUS_S_INPUT_REGISTER,
+    MODBUS_S_HOLD_REGISTER,
+} modbus_s_area_e;
+
+// bits are passed as 0 or 1
+typedef void (*modbus_s_update_fn)(void *ctx, uint16_t address,
+                                   uint16_t *value);
+
+// update [start, end] of an area with the unit locked, the units not served
+// yet are skipped
+void modbus_s_update(uint8_t unit, modbus_s_area_e area, uint16_t start,
+                     uint16_t end, modbus_s_update_fn fn, void *ctx);
+
 ssize_t modbus_s_rtu_req(uint8_t *req, uint16_t req_len, uint8_t *res,
                          int res_mlen, int *res_len);
 ssize_t modbus_s_tcp_req(uint8_t *req, uint16_t req_len, uint8_t *res,
@@ -16,21 +16,36 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // posix_openpt
+#endif
+
+#include <fcntl.h>
+#include <getopt.h>
 #include <memory.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
 #include <neuron.h>
 
+#include "plugins/modbus/modbus.h"
+
+#include "modbus_fault.h"
+#include "modbus_gen.h"
 #include "modbus_s.h"
 
-zlog_category_t *neuron           = NULL;
-neu_events_t *   events           = NULL;
-neu_event_io_t * tcp_server_event = NULL;
-neu_conn_t *     conn             = NULL;
+#define MAX_WORKER 64
+
+zlog_category_t *neuron = NULL;
+
+struct worker;
 
 static void start_listen(void *data, int fd);
 static void stop_listen(void *data, int fd);
@@ -38,68 +53,426 @@ static void connected(void *data, int fd);
 static void disconnected(void *data, int fd);
 static int  new_client(enum neu_event_io_type type, int fd, void *usr_data);
 static int  recv_msg(enum neu_event_io_type type, int fd, void *usr_data);
+static int  pty_msg(enum neu_event_io_type type, int fd, void *usr_data);
+static int  due_msg(enum neu_event_io_type type, int fd, void *usr_data);
+static int  start_pty(struct worker *worker);
 static bool mode_tcp = true;
 
-struct client_event {
-    neu_event_io_t *client;
-    int             fd;
-};
-
-struct client_event c_events[10] = { 0 };
-
 struct cycle_buf {
     uint16_t len;
     uint8_t  buf[4096];
 };
 
-static int add_client(int fd, neu_event_io_t *client)
+struct client {
+    struct worker *  worker;
+    int              fd;
+    neu_event_io_t * io;
+    struct cycle_buf buf;
+    bool             pty;
+
+    // the responses delayed are sent in the order of the requests
+    uint64_t last_due;
+    int      n_pending;
+
+    struct client *prev;
+    struct client *next;
+};
+
+// a response waiting for its latency
+struct pending {
+    struct client *client;
+    uint64_t       due;      // us
+    uint64_t       received; // us
+    uint32_t       delay;    // us, injected
+    int            len;
+    uint8_t        res[MODBUS_MAX_ADU];
+
+    struct pending *prev;
+    struct pending *next;
+};
+
+// one event loop serving a share of the clients
+struct worker {
+    neu_events_t *  events;
+    neu_conn_t *    conn;
+    neu_event_io_t *listen_io;
+    struct client * clients;
+    struct pending *pendings; // sorted by due
+    int             due_fd;
+
+    // written by the worker, read by the reporter
+    uint32_t n_client;
+    uint64_t n_request;
+    uint64_t n_response;
+    uint64_t latency_sum; // us, without the latency injected
+    uint64_t latency_max; // us
+};
+
+static struct worker *workers  = NULL;
+static int            n_worker = 1;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(void)
+{
+    printf("./modbus_simulator rtu/tcp port [-w workers] [-m max_link] "
+           "[-r report_second] [-c fault_file] [-u fault_spec]... "
+           "[-G gen_file] [-g gen_spec]...\n");
+    printf("./modbus_simulator rtu pty [-r report_second] [-c fault_file] "
+           "[-u fault_spec]... [-G gen_file] [-g gen_spec]...\n");
+    printf("  workers: event loops sharing the port, 1 by default\n");
+    printf("  max_link: clients of each worker, 1024 by default\n");
+    printf("  report_second: requests and latency report, 0 disables\n");
+    printf("  fault_spec: \"1-10,20 latency=uniform:1000:5000 drop=0.01 "
+           "truncate=0.01 exception=0.01:4 reset=0.001\"\n");
+    printf("  latency: fixed:US, uniform:MIN:MAX, normal:MEAN:STDDEV, "
+           "exp:MEAN\n");
+    printf("  gen_spec: \"1-10 hold:0-999 counter|sine|walk|step ratio=0.1 "
+           "interval=100 step=1 min=0 max=1000 period=10000\"\n");
+    printf("  area: coil, input, input_register, hold\n");
+}
+
+static void stat_response(struct worker *worker, uint64_t received,
+                          uint32_t delay)
 {
-    for (uint32_t i = 0; i < sizeof(c_events) / sizeof(struct client_event);
-         i++) {
-        if (c_events[i].fd == 0) {
-            c_events[i].client = client;
-            c_events[i].fd     = fd;
+    uint64_t now     = now_us();
+    uint64_t latency = now - received > delay ? now - received - delay : 0;
+
+    __atomic_fetch_add(&worker->n_response, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&worker->latency_sum, latency, __ATOMIC_RELAXED);
+    if (latency > __atomic_load_n(&worker->latency_max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&worker->latency_max, latency, __ATOMIC_RELAXED);
+    }
+}
 
-            return 0;
+static void due_arm(struct worker *worker)
+{
+    struct itimerspec value = { 0 };
+
+    // a zero value disarms the timer
+    if (worker->pendings != NULL) {
+        value.it_value.tv_sec  = worker->pendings->due / 1000000;
+        value.it_value.tv_nsec = worker->pendings->due % 1000000 * 1000 + 1;
+    }
+    timerfd_settime(worker->due_fd, TFD_TIMER_ABSTIME, &value, NULL);
+}
+
+static void client_send(struct client *client, uint8_t *res, int len)
+{
+    if (client->pty) {
+        if (write(client->fd, res, len) != len) {
+            printf("write pty fail\n");
         }
+    } else {
+        neu_conn_tcp_server_send(client->worker->conn, client->fd, res, len);
+    }
+}
+
+static void client_close(struct client *client, bool reset)
+{
+    struct worker * worker = client->worker;
+    struct pending *p = NULL, *tmp = NULL;
+
+    if (client->n_pending > 0) {
+        DL_FOREACH_SAFE(worker->pendings, p, tmp)
+        {
+            if (p->client == client) {
+                DL_DELETE(worker->pendings, p);
+                free(p);
+            }
+        }
+        due_arm(worker);
+    }
+
+    if (reset) {
+        // closed with a rst instead of a fin
+        struct linger l = { .l_onoff = 1, .l_linger = 0 };
+        setsockopt(client->fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+    }
+
+    neu_event_del_io(worker->events, client->io);
+    neu_conn_tcp_server_close_client(worker->conn, client->fd);
+    DL_DELETE(worker->clients, client);
+    __atomic_fetch_sub(&worker->n_client, 1, __ATOMIC_RELAXED);
+    free(client);
+}
+
+static void client_respond(struct client *client, uint8_t *res, int len,
+                           uint64_t received, uint32_t delay_us)
+{
+    struct worker * worker = client->worker;
+    uint64_t        now    = now_us();
+    uint64_t        due    = now + delay_us;
+    struct pending *p      = NULL;
+    struct pending *at     = NULL;
+
+    if (due < client->last_due) {
+        due = client->last_due;
+    }
+    client->last_due = due;
+
+    if (due <= now && client->n_pending == 0) {
+        client_send(client, res, len);
+        stat_response(worker, received, delay_us);
+        return;
     }
 
-    return -1;
+    p           = calloc(1, sizeof(struct pending));
+    p->client   = client;
+    p->due      = due;
+    p->received = received;
+    p->delay    = delay_us;
+    p->len      = len;
+    memcpy(p->res, res, len);
+    client->n_pending += 1;
+
+    // most of the responses are due after the ones already waiting
+    if (worker->pendings != NULL) {
+        for (at = worker->pendings->prev;
+             at != worker->pendings && at->due > due; at = at->prev) {
+        }
+    }
+    if (at == NULL || (at == worker->pendings && at->due > due)) {
+        DL_PREPEND(worker->pendings, p);
+        due_arm(worker);
+    } else {
+        DL_APPEND_ELEM(worker->pendings, at, p);
+    }
 }
 
-static neu_event_io_t *del_client(int fd)
+// serve the requests received, returns -1 when the client is closed
+static int client_process(struct client *client)
 {
-    for (uint32_t i = 0; i < sizeof(c_events) / sizeof(struct client_event);
-         i++) {
-        if (c_events[i].fd == fd) {
-            c_events[i].fd = 0;
-            return c_events[i].client;
+    struct cycle_buf *buf      = &client->buf;
+    uint64_t          received = now_us();
+
+    while (buf->len > 0) {
+        uint8_t        res[MODBUS_MAX_ADU] = { 0 };
+        int            res_len             = 0;
+        ssize_t        len                 = 0;
+        uint8_t        unit                = 0;
+        uint8_t        exception           = 0;
+        uint32_t       delay               = 0;
+        modbus_fault_e fault               = MODBUS_FAULT_NONE;
+
+        if (mode_tcp) {
+            len = modbus_s_tcp_req(buf->buf, buf->len, res, sizeof(res),
+                                   &res_len);
+            unit = buf->buf[sizeof(struct modbus_header)];
+        } else {
+            len = modbus_s_rtu_req(buf->buf, buf->len, res, sizeof(res),
+                                   &res_len);
+            unit = buf->buf[0];
+        }
+
+        if (len == 0) {
+            // recv part modbus msg, continue wait msg
+            break;
+        }
+        if (len < 0) {
+            if (client->pty) {
+                // not for the slaves simulated, wait for the next frame
+                buf->len = 0;
+                break;
+            }
+
+            printf("recv msg parse fail, close client: %d\n", client->fd);
+            client_close(client, false);
+            return -1;
+        }
+
+        memmove(buf->buf, buf->buf + len, buf->len - len);
+        buf->len -= len;
+        __atomic_fetch_add(&client->worker->n_request, 1, __ATOMIC_RELAXED);
+
+        fault = modbus_fault_pick(unit, &delay, &exception);
+        switch (fault) {
+        case MODBUS_FAULT_NONE:
+            break;
+        case MODBUS_FAULT_DROP:
+            continue;
+        case MODBUS_FAULT_TRUNCATE:
+            res_len = modbus_fault_truncate(res_len);
+            break;
+        case MODBUS_FAULT_EXCEPTION:
+            modbus_s_exception(res, &res_len, mode_tcp, exception);
+            break;
+        case MODBUS_FAULT_RESET:
+            if (client->pty) {
+                continue;
+            }
+            client_close(client, true);
+            return -1;
         }
+
+        client_respond(client, res, res_len, received, delay);
     }
 
-    return NULL;
+    return 0;
 }
 
 static void sig_handler(int sig)
 {
+    struct client *client = NULL, *tmp = NULL;
+
     (void) sig;
-    for (uint32_t i = 0; i < sizeof(c_events) / sizeof(struct client_event);
-         i++) {
-        if (c_events[i].fd > 0) {
-            neu_event_del_io(events, c_events[i].client);
+    modbus_gen_stop(workers[0].events);
+    for (int i = 0; i < n_worker; i++) {
+        DL_FOREACH_SAFE(workers[i].clients, client, tmp)
+        {
+            neu_event_del_io(workers[i].events, client->io);
         }
     }
 
     nlog_warn("recv sig: %d\n", sig);
-    neu_conn_destory(conn);
-    neu_event_close(events);
+    for (int i = 0; i < n_worker; i++) {
+        if (workers[i].conn != NULL) {
+            neu_conn_destory(workers[i].conn);
+        }
+        neu_event_close(workers[i].events);
+    }
     exit(0);
 }
 
+static int parse_options(int argc, char *argv[], int *max_link, int *report)
+{
+    int opt = 0;
+
+    // the mode and the port are positional
+    optind = 3;
+    while ((opt = getopt(argc, argv, "w:m:r:c:u:G:g:")) != -1) {
+        switch (opt) {
+        case 'w':
+            n_worker = atoi(optarg);
+            if (n_worker < 1 || n_worker > MAX_WORKER) {
+                return -1;
+            }
+            break;
+        case 'm':
+            *max_link = atoi(optarg);
+            if (*max_link < 1) {
+                return -1;
+            }
+            break;
+        case 'r':
+            *report = atoi(optarg);
+            if (*report < 0) {
+                return -1;
+            }
+            break;
+        case 'c':
+            if (modbus_fault_load(optarg) != 0) {
+                return -1;
+            }
+            break;
+        case 'u':
+            if (modbus_fault_parse(optarg) != 0) {
+                return -1;
+            }
+            break;
+        case 'G':
+            if (modbus_gen_load(optarg) != 0) {
+                return -1;
+            }
+            break;
+        case 'g':
+            if (modbus_gen_parse(optarg) != 0) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void workers_init(void)
+{
+    workers = calloc(n_worker, sizeof(struct worker));
+
+    for (int i = 0; i < n_worker; i++) {
+        struct worker *      worker = &workers[i];
+        neu_event_io_param_t io     = {
+            .usr_data = (void *) worker,
+            .cb       = due_msg,
+        };
+
+        worker->events = neu_event_new();
+        worker->due_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        io.fd          = worker->due_fd;
+        neu_event_add_io(worker->events, io);
+    }
+
+    modbus_gen_start(workers[0].events);
+}
+
+// requests per second and the latency added by the simulator itself, a
+// latency growing with the load means the simulator is the bottleneck
+static void report(int second)
+{
+    uint64_t last_request  = 0;
+    uint64_t last_response = 0;
+    uint64_t last_latency  = 0;
+
+    while (1) {
+        uint64_t n_request   = 0;
+        uint64_t n_response  = 0;
+        uint64_t latency     = 0;
+        uint64_t latency_max = 0;
+        uint32_t n_client    = 0;
+
+        sleep(second > 0 ? second : 10);
+        if (second == 0) {
+            continue;
+        }
+
+        for (int i = 0; i < n_worker; i++) {
+            uint64_t max = __atomic_exchange_n(&workers[i].latency_max, 0,
+                                               __ATOMIC_RELAXED);
+
+            n_client += __atomic_load_n(&workers[i].n_client, __ATOMIC_RELAXED);
+            n_request +=
+                __atomic_load_n(&workers[i].n_request, __ATOMIC_RELAXED);
+            n_response +=
+                __atomic_load_n(&workers[i].n_response, __ATOMIC_RELAXED);
+            latency +=
+                __atomic_load_n(&workers[i].latency_sum, __ATOMIC_RELAXED);
+            if (max > latency_max) {
+                latency_max = max;
+            }
+        }
+
+        printf("workers: %d, clients: %u, rps: %" PRIu64
+               ", latency avg: %" PRIu64 " us, max: %" PRIu64 " us\n",
+               n_worker, n_client, (n_request - last_request) / second,
+               n_response > last_response
+                   ? (latency - last_latency) / (n_response - last_response)
+                   : 0,
+               latency_max);
+        fflush(stdout);
+
+        last_request  = n_request;
+        last_response = n_response;
+        last_latency  = latency;
+    }
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3) {
-        printf("./modbus_simulator rtu/tcp port\n");
+    int           max_link = 1024;
+    int           second   = 10;
+    struct rlimit nofile   = { 0 };
+
+    if (argc < 3) {
+        usage();
         return -1;
     }
 
@@ -108,16 +481,49 @@ int main(int argc, char *argv[])
     } else if (strncmp(argv[1], "rtu", strlen("rtu")) == 0) {
         mode_tcp = false;
     } else {
-        printf("./modbus_simulator rtu/tcp port\n");
+        usage();
+        return -1;
+    }
+
+    if (parse_options(argc, argv, &max_link, &second) != 0) {
+        usage();
         return -1;
     }
 
+    modbus_s_init();
+
+    if (!mode_tcp && strcmp(argv[2], "pty") == 0) {
+        // one serial line
+        n_worker = 1;
+
+        zlog_init("./config/dev.conf");
+        neuron = zlog_get_category("neuron");
+        workers_init();
+
+        signal(SIGINT, sig_handler);
+        signal(SIGTERM, sig_handler);
+        signal(SIGABRT, sig_handler);
+
+        if (start_pty(&workers[0]) != 0) {
+            return -1;
+        }
+
+        report(second);
+    }
+
     int port = atoi(argv[2]);
     if (port <= 1024) {
         printf("port <= 1024\n");
         return -1;
     }
 
+    // thousands of clients
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 &&
+        nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
     zlog_init("./config/dev.conf");
     neuron = zlog_get_category("neuron");
 
@@ -127,43 +533,44 @@ int main(int argc, char *argv[])
         .params.tcp_server.ip           = "0.0.0.0",
         .params.tcp_server.port         = (uint16_t) port,
         .params.tcp_server.timeout      = 0,
-        .params.tcp_server.max_link     = 10,
+        .params.tcp_server.max_link     = max_link,
         .params.tcp_server.start_listen = start_listen,
         .params.tcp_server.stop_listen  = stop_listen,
+        .params.tcp_server.reuse_port   = n_worker > 1,
     };
 
-    events = neu_event_new();
-    conn   = neu_conn_new(&param, NULL, connected, disconnected);
+    workers_init();
+    for (int i = 0; i < n_worker; i++) {
+        workers[i].conn =
+            neu_conn_new(&param, &workers[i], connected, disconnected);
+    }
 
     signal(SIGINT, sig_handler);
     signal(SIGTERM, sig_handler);
     signal(SIGABRT, sig_handler);
 
-    while (1) {
-        sleep(10);
-    }
-
+    report(second);
     return 0;
 }
 
 static void start_listen(void *data, int fd)
 {
+    struct worker *      worker   = (struct worker *) data;
     neu_event_io_param_t io_event = {
         .fd       = fd,
         .usr_data = data,
         .cb       = new_client,
     };
 
-    tcp_server_event = neu_event_add_io(events, io_event);
+    worker->listen_io = neu_event_add_io(worker->events, io_event);
     nlog_info("start listen....\n");
 }
 
 static void stop_listen(void *data, int fd)
 {
-    (void) data;
-    (void) fd;
+    struct worker *worker = (struct worker *) data;
 
-    neu_event_del_io(events, tcp_server_event);
+    neu_event_del_io(worker->events, worker->listen_io);
     nlog_info("stop listen....fd: %d\n", fd);
 }
 
@@ -184,20 +591,26 @@ static void disconnected(void *data, int fd)
 
 static int new_client(enum neu_event_io_type type, int fd, void *usr_data)
 {
+    struct worker *worker = (struct worker *) usr_data;
+
+    (void) fd;
+
     switch (type) {
     case NEU_EVENT_IO_READ: {
-        int client_fd = neu_conn_tcp_server_accept(conn);
+        int client_fd = neu_conn_tcp_server_accept(worker->conn);
         if (client_fd > 0) {
-            struct cycle_buf *   buf = calloc(1, sizeof(struct cycle_buf));
-            neu_event_io_param_t io  = {
+            struct client *      client = calloc(1, sizeof(struct client));
+            neu_event_io_param_t io     = {
                 .fd       = client_fd,
-                .usr_data = (void *) buf,
+                .usr_data = (void *) client,
                 .cb       = recv_msg,
             };
 
-            neu_event_io_t *client = neu_event_add_io(events, io);
-
-            add_client(fd, client);
+            client->worker = worker;
+            client->fd     = client_fd;
+            client->io     = neu_event_add_io(worker->events, io);
+            DL_APPEND(worker->clients, client);
+            __atomic_fetch_add(&worker->n_client, 1, __ATOMIC_RELAXED);
             nlog_info("accept new client: fd: %d\n", client_fd);
         }
 
@@ -206,10 +619,7 @@ static int new_client(enum neu_event_io_type type, int fd, void *usr_data)
 
     case NEU_EVENT_IO_CLOSED:
     case NEU_EVENT_IO_HUP: {
-        neu_event_del_io(events, tcp_server_event);
-
-        free(usr_data);
-        close(fd);
+        neu_event_del_io(worker->events, worker->listen_io);
         break;
     }
     }
@@ -218,60 +628,103 @@ static int new_client(enum neu_event_io_type type, int fd, void *usr_data)
 
 static int recv_msg(enum neu_event_io_type type, int fd, void *usr_data)
 {
-    struct cycle_buf *buf = (struct cycle_buf *) usr_data;
+    struct client *   client = (struct client *) usr_data;
+    struct cycle_buf *buf    = &client->buf;
+
     switch (type) {
     case NEU_EVENT_IO_READ: {
-        ssize_t len        = 0;
-        uint8_t res[60000] = { 0 };
-        int     res_len    = 0;
-
-        len = neu_conn_tcp_server_recv(conn, fd, buf->buf + buf->len,
-                                       sizeof(buf->buf) - buf->len);
-        if (len > 0) {
-            buf->len += len;
-        }
-        if (mode_tcp) {
-            len = modbus_s_tcp_req(buf->buf, buf->len, res, sizeof(res),
-                                   &res_len);
-        } else {
-            len = modbus_s_rtu_req(buf->buf, buf->len, res, sizeof(res),
-                                   &res_len);
+        ssize_t len =
+            neu_conn_tcp_server_recv(client->worker->conn, fd,
+                                     buf->buf + buf->len,
+                                     sizeof(buf->buf) - buf->len);
+        if (len <= 0) {
+            client_close(client, false);
+            break;
         }
 
-        if (len == -1) {
-            neu_event_io_t *io = del_client(fd);
+        buf->len += len;
+        client_process(client);
+        break;
+    }
+    case NEU_EVENT_IO_CLOSED:
+    case NEU_EVENT_IO_HUP:
+        client_close(client, false);
+        break;
+    }
 
-            if (io != NULL) {
-                neu_event_del_io(events, io);
-            }
+    return 0;
+}
 
-            free(usr_data);
-            neu_conn_tcp_server_close_client(conn, fd);
-            printf("recv msg parse fail, close client: %d\n", fd);
-        } else if (len > 0) {
-            memmove(buf->buf, buf->buf + len, buf->len - len);
-            buf->len -= len;
+static int due_msg(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    struct worker * worker = (struct worker *) usr_data;
+    uint64_t        expire = 0;
+    uint64_t        now    = now_us();
+    struct pending *p      = NULL;
 
-            neu_conn_tcp_server_send(conn, fd, res, res_len);
-        } else {
-            printf("recv part modbus msg, continue wait msg\n");
-        }
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
 
-        break;
+    if (read(fd, &expire, sizeof(expire)) != sizeof(expire)) {
+        // rearmed before it fired
     }
-    case NEU_EVENT_IO_CLOSED:
-    case NEU_EVENT_IO_HUP: {
-        neu_event_io_t *io = del_client(fd);
 
-        if (io != NULL) {
-            neu_event_del_io(events, io);
-        }
+    while ((p = worker->pendings) != NULL && p->due <= now) {
+        DL_DELETE(worker->pendings, p);
+        p->client->n_pending -= 1;
+        client_send(p->client, p->res, p->len);
+        stat_response(worker, p->received, p->delay);
+        free(p);
+    }
 
-        free(usr_data);
-        neu_conn_tcp_server_close_client(conn, fd);
-        break;
+    due_arm(worker);
+    return 0;
+}
+
+// a serial line without hardware, the modbus-rtu node uses the device printed
+static int start_pty(struct worker *worker)
+{
+    struct client *      client = calloc(1, sizeof(struct client));
+    neu_event_io_param_t io     = {
+        .usr_data = (void *) client,
+        .cb       = pty_msg,
+    };
+
+    io.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (io.fd < 0 || grantpt(io.fd) != 0 || unlockpt(io.fd) != 0) {
+        printf("open pty fail\n");
+        free(client);
+        return -1;
+    }
+
+    client->worker = worker;
+    client->fd     = io.fd;
+    client->pty    = true;
+    client->io     = neu_event_add_io(worker->events, io);
+    DL_APPEND(worker->clients, client);
+    printf("pty: %s\n", ptsname(io.fd));
+    fflush(stdout);
+    return 0;
+}
+
+static int pty_msg(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    struct client *   client = (struct client *) usr_data;
+    struct cycle_buf *buf    = &client->buf;
+    ssize_t           len    = 0;
+
+    if (type != NEU_EVENT_IO_READ) {
+        // no one has the slave side open
+        usleep(100 * 1000);
+        return 0;
     }
+
+    len = read(fd, buf->buf + buf->len, sizeof(buf->buf) - buf->len);
+    if (len > 0) {
+        buf->len += len;
     }
 
+    client_process(client);
     return 0;
-}
\ No newline at end of file
+}
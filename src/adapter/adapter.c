@@ -41,6 +41,7 @@
 #include "storage.h"
 
 static int  adapter_loop(enum neu_event_io_type type, int fd, void *usr_data);
+static void adapter_dispatch(void *usr_data, nng_msg *msg);
 static int  adapter_command(neu_adapter_t *adapter, neu_reqresp_head_t header,
                             void *data);
 static int  adapter_response(neu_adapter_t *adapter, neu_reqresp_head_t *header,
@@ -50,6 +51,46 @@ static void adapter_stat_acc(neu_adapter_t *adapter, neu_node_stat_e s,
 inline static void reply(neu_adapter_t *adapter, neu_reqresp_head_t *header,
                          void *data);
 static int         update_timestamp(void *usr_data);
+static void        trans_data_packed(neu_adapter_t *     adapter,
+                                     neu_reqresp_head_t *header);
+static void        trans_data_decode(neu_adapter_t *     adapter,
+                                     neu_reqresp_head_t *header,
+                                     UT_array *          names);
+static void        tag_dict_update(neu_adapter_t *          adapter,
+                                   neu_resp_get_tag_dict_t *dict);
+static void        tag_dict_free(neu_adapter_t *adapter);
+static int         adapter_capture(neu_adapter_t *adapter, bool enable,
+                                   uint32_t size);
+
+typedef struct tag_dict_key {
+    char driver[NEU_NODE_NAME_LEN];
+    char group[NEU_GROUP_NAME_LEN];
+} tag_dict_key_t;
+
+// a report waiting for the dictionary of its version
+typedef struct tag_dict_pending {
+    neu_reqresp_head_t *header;
+
+    struct tag_dict_pending *prev;
+    struct tag_dict_pending *next;
+} tag_dict_pending_t;
+
+// reports kept per group while its dictionary is fetched
+#define TAG_DICT_MAX_PENDING 16
+
+typedef struct tag_dict {
+    tag_dict_key_t key;
+
+    int64_t   version;
+    int64_t   requested;
+    int64_t   requested_at;
+    UT_array *names;
+
+    tag_dict_pending_t *pending;
+    uint16_t            n_pending;
+
+    UT_hash_handle hh;
+} tag_dict_t;
 
 static const adapter_callbacks_t callback_funs = {
     .command  = adapter_command,
@@ -136,6 +177,8 @@ neu_adapter_t *neu_adapter_create(neu_adapter_info_t *info)
     param.usr_data = (void *) adapter;
     param.cb       = adapter_loop;
 
+    adapter->lanes = neu_msg_lanes_new(adapter->sock, adapter->events,
+                                       adapter_dispatch, adapter);
     adapter->nng_io = neu_event_add_io(adapter->events, param);
     rv = nng_dial(adapter->sock, neu_manager_get_url(), &adapter->dialer, 0);
     assert(rv == 0);
@@ -198,8 +241,26 @@ static void adapter_stat_acc(neu_adapter_t *adapter, neu_node_stat_e s,
         adapter->stat.avg_rtt = adapter->stat.avg_rtt * (1 - a) + n * a;
         break;
     }
+    case NEU_NODE_STAT_SOCK_NODELAY:
+    case NEU_NODE_STAT_SOCK_KEEPALIVE_IDLE:
+    case NEU_NODE_STAT_SOCK_KEEPALIVE_INTVL:
+    case NEU_NODE_STAT_SOCK_KEEPALIVE_COUNT:
+    case NEU_NODE_STAT_SOCK_RCVBUF:
+    case NEU_NODE_STAT_SOCK_SNDBUF:
+    case NEU_NODE_STAT_SOCK_BUSY_POLL:
+    case NEU_NODE_STAT_SOCK_USER_TIMEOUT:
+        adapter->stat.data[s] = n;
+        break;
 
     // these are maintained by neuron core
+    case NEU_NODE_STAT_CTRL_DEPTH:
+    case NEU_NODE_STAT_CTRL_DEPTH_MAX:
+    case NEU_NODE_STAT_CTRL_LATENCY:
+    case NEU_NODE_STAT_CTRL_LATENCY_MAX:
+    case NEU_NODE_STAT_BULK_DEPTH:
+    case NEU_NODE_STAT_BULK_DEPTH_MAX:
+    case NEU_NODE_STAT_BULK_LATENCY:
+    case NEU_NODE_STAT_BULK_LATENCY_MAX:
     case NEU_NODE_STAT_TAG_TOT_CNT:
     case NEU_NODE_STAT_TAG_ERR_CNT:
     default:
@@ -244,6 +305,8 @@ static int adapter_command(neu_adapter_t *adapter, neu_reqresp_head_t header,
     }
     case NEU_REQ_NODE_CTL:
     case NEU_REQ_GET_NODE_STAT:
+    case NEU_REQ_NODE_CAPTURE:
+    case NEU_REQ_GET_NODE_CAPTURE:
     case NEU_REQ_GET_NODE_STATE:
     case NEU_REQ_GET_NODE_SETTING:
     case NEU_REQ_NODE_SETTING: {
@@ -298,9 +361,7 @@ static int adapter_response(neu_adapter_t *adapter, neu_reqresp_head_t *header,
 
 static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
 {
-    neu_adapter_t *     adapter = (neu_adapter_t *) usr_data;
-    nng_msg *           msg     = NULL;
-    neu_reqresp_head_t *header  = NULL;
+    neu_adapter_t *adapter = (neu_adapter_t *) usr_data;
 
     if (type != NEU_EVENT_IO_READ) {
         nlog_warn("adapter: %s recv close, exit loop, fd: %d", adapter->name,
@@ -308,8 +369,15 @@ static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
         return 0;
     }
 
-    nng_recvmsg(adapter->sock, &msg, 0);
-    header = (neu_reqresp_head_t *) nng_msg_body(msg);
+    neu_msg_lanes_run(adapter->lanes);
+    return 0;
+}
+
+static void adapter_dispatch(void *usr_data, nng_msg *msg)
+{
+    neu_adapter_t *     adapter = (neu_adapter_t *) usr_data;
+    neu_reqresp_head_t *header  = (neu_reqresp_head_t *) nng_msg_body(msg);
+
     if (header->type == NEU_REQRESP_NODES_STATE) {
         nlog_debug("adapter(%s) recv msg from: %s, type: %s", adapter->name,
                    header->sender, neu_reqresp_type_string(header->type));
@@ -324,6 +392,7 @@ static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
     case NEU_RESP_GET_SUB_DRIVER_TAGS:
     case NEU_REQ_UPDATE_LICENSE:
     case NEU_RESP_GET_NODE_STAT:
+    case NEU_RESP_GET_NODE_CAPTURE:
     case NEU_RESP_GET_NODE_STATE:
     case NEU_RESP_GET_NODES_STATE:
     case NEU_RESP_GET_NODE_SETTING:
@@ -373,6 +442,69 @@ static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
 
         break;
     }
+    case NEU_REQRESP_TRANS_DATA_PACKED:
+        trans_data_packed(adapter, header);
+        break;
+    case NEU_RESP_GET_TAG_DICT:
+        tag_dict_update(adapter, (neu_resp_get_tag_dict_t *) &header[1]);
+        break;
+    case NEU_REQ_GET_TAG_DICT: {
+        neu_req_get_tag_dict_t *cmd  = (neu_req_get_tag_dict_t *) &header[1];
+        neu_resp_get_tag_dict_t resp = { 0 };
+
+        if (adapter->module->type == NEU_NA_TYPE_DRIVER &&
+            neu_adapter_driver_get_tag_dict((neu_adapter_driver_t *) adapter,
+                                            cmd->group, &resp.version,
+                                            &resp.names) == NEU_ERR_SUCCESS) {
+            strcpy(resp.driver, cmd->driver);
+            strcpy(resp.group, cmd->group);
+            header->type = NEU_RESP_GET_TAG_DICT;
+            neu_msg_exchange(header);
+            reply(adapter, header, &resp);
+        }
+        break;
+    }
+    case NEU_REQ_SUBSCRIBE_GROUP: {
+        // sent by the manager once the subscription is accepted, a filtered
+        // one is confirmed so that the manager stops forwarding the full
+        // trans data to the app
+        neu_req_subscribe_t *cmd = (neu_req_subscribe_t *) &header[1];
+
+        if (adapter->module->type == NEU_NA_TYPE_DRIVER) {
+            uint16_t n_filter = cmd->n_filter;
+            int      ret      = neu_adapter_driver_subscribe(
+                (neu_adapter_driver_t *) adapter, cmd);
+
+            if (ret == NEU_ERR_SUCCESS && n_filter > 0) {
+                neu_resp_subscribe_t resp = { 0 };
+
+                strcpy(resp.app, cmd->app);
+                strcpy(resp.driver, cmd->driver);
+                strcpy(resp.group, cmd->group);
+                header->type = NEU_RESP_SUBSCRIBE_GROUP;
+                neu_msg_exchange(header);
+                reply(adapter, header, &resp);
+            } else if (ret != NEU_ERR_SUCCESS) {
+                nlog_warn("%s subscribe %s-%s fail, error: %d", cmd->app,
+                          cmd->driver, cmd->group, ret);
+            }
+        } else {
+            for (int i = 0; i < cmd->n_filter; i++) {
+                free(cmd->filters[i]);
+            }
+            free(cmd->filters);
+        }
+        break;
+    }
+    case NEU_REQ_UNSUBSCRIBE_GROUP: {
+        neu_req_unsubscribe_t *cmd = (neu_req_unsubscribe_t *) &header[1];
+
+        if (adapter->module->type == NEU_NA_TYPE_DRIVER) {
+            neu_adapter_driver_unsubscribe((neu_adapter_driver_t *) adapter,
+                                           cmd->app, cmd->group);
+        }
+        break;
+    }
     case NEU_REQ_NODE_SETTING: {
         neu_req_node_setting_t *cmd   = (neu_req_node_setting_t *) &header[1];
         neu_resp_error_t        error = { 0 };
@@ -410,11 +542,43 @@ static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
 
         resp.type = neu_adapter_get_type(adapter);
         memcpy(resp.data, adapter->stat.data, sizeof(resp.data));
+        neu_msg_lanes_node_stat(adapter->lanes, resp.data);
         header->type = NEU_RESP_GET_NODE_STAT;
         neu_msg_exchange(header);
         reply(adapter, header, &resp);
         break;
     }
+    case NEU_REQ_NODE_CAPTURE: {
+        neu_req_node_capture_t *cmd   = (neu_req_node_capture_t *) &header[1];
+        neu_resp_error_t        error = { 0 };
+
+        error.error  = adapter_capture(adapter, cmd->enable, cmd->size);
+        header->type = NEU_RESP_ERROR;
+        neu_msg_exchange(header);
+        reply(adapter, header, &error);
+        break;
+    }
+    case NEU_REQ_GET_NODE_CAPTURE: {
+        neu_resp_get_node_capture_t resp  = { 0 };
+        neu_resp_error_t            error = { 0 };
+
+        neu_msg_exchange(header);
+        if (adapter->capture == NULL) {
+            error.error = NEU_ERR_NODE_CAPTURE_NOT_FOUND;
+        } else if (neu_capture_dump(adapter->capture, &resp.data,
+                                    &resp.len) != 0) {
+            error.error = NEU_ERR_EINTERNAL;
+        }
+
+        if (error.error != NEU_ERR_SUCCESS) {
+            header->type = NEU_RESP_ERROR;
+            reply(adapter, header, &error);
+        } else {
+            header->type = NEU_RESP_GET_NODE_CAPTURE;
+            reply(adapter, header, &resp);
+        }
+        break;
+    }
     case NEU_REQ_GET_NODE_STATE: {
         neu_resp_get_node_state_t resp = { 0 };
 
@@ -687,8 +851,6 @@ static int adapter_loop(enum neu_event_io_type type, int fd, void *usr_data)
         break;
     }
     nng_msg_free(msg);
-
-    return 0;
 }
 
 void neu_adapter_destroy(neu_adapter_t *adapter)
@@ -706,7 +868,12 @@ void neu_adapter_destroy(neu_adapter_t *adapter)
         free(adapter->setting);
     }
 
+    neu_msg_lanes_free(adapter->lanes);
     neu_event_close(adapter->events);
+    tag_dict_free(adapter);
+    if (adapter->capture != NULL) {
+        neu_capture_free(adapter->capture);
+    }
     free(adapter);
 }
 
@@ -718,6 +885,8 @@ int neu_adapter_uninit(neu_adapter_t *adapter)
     adapter->module->intf_funs->uninit(adapter->plugin);
 
     neu_event_del_io(adapter->events, adapter->nng_io);
+    // drop the messages queued for the plugin
+    neu_msg_lanes_close(adapter->lanes);
 
     if (adapter->module->type == NEU_NA_TYPE_DRIVER) {
         neu_adapter_driver_destroy((neu_adapter_driver_t *) adapter);
@@ -845,6 +1014,37 @@ neu_node_state_t neu_adapter_get_state(neu_adapter_t *adapter)
     return state;
 }
 
+// the plugin only pays a pointer check while the capture is disabled
+static int adapter_capture(neu_adapter_t *adapter, bool enable, uint32_t size)
+{
+    neu_plugin_common_t *common = neu_plugin_to_plugin_common(adapter->plugin);
+
+    if (!enable) {
+        __atomic_store_n(&common->capture, NULL, __ATOMIC_RELEASE);
+        nlog_notice("adapter(%s) stop protocol capture", adapter->name);
+        return NEU_ERR_SUCCESS;
+    }
+
+    if (size == 0) {
+        size = NEU_CAPTURE_SIZE_DEFAULT;
+    }
+
+    // the plugin may still hold the ring, it is only freed with the adapter
+    if (adapter->capture == NULL) {
+        adapter->capture = neu_capture_new(size);
+        if (adapter->capture == NULL) {
+            return NEU_ERR_EINTERNAL;
+        }
+    } else if (neu_capture_reset(adapter->capture, size) != 0) {
+        return NEU_ERR_EINTERNAL;
+    }
+
+    __atomic_store_n(&common->capture, adapter->capture, __ATOMIC_RELEASE);
+    nlog_notice("adapter(%s) start protocol capture, size: %" PRIu32,
+                adapter->name, size);
+    return NEU_ERR_SUCCESS;
+}
+
 int neu_adapter_validate_tag(neu_adapter_t *adapter, neu_datatag_t *tag)
 {
     const neu_plugin_intf_funs_t *intf_funs = adapter->module->intf_funs;
@@ -874,6 +1074,167 @@ inline static void reply(neu_adapter_t *adapter, neu_reqresp_head_t *header,
     nng_sendmsg(adapter->sock, msg, 0);
 }
 
+static void trans_data_packed(neu_adapter_t *     adapter,
+                              neu_reqresp_head_t *header)
+{
+    neu_reqresp_trans_data_packed_t *packed =
+        (neu_reqresp_trans_data_packed_t *) &header[1];
+    tag_dict_t *        dict    = NULL;
+    tag_dict_key_t      key     = { 0 };
+    tag_dict_pending_t *pending = NULL;
+    size_t              size    = 0;
+
+    strcpy(key.driver, packed->driver);
+    strcpy(key.group, packed->group);
+    HASH_FIND(hh, adapter->dicts, &key, sizeof(tag_dict_key_t), dict);
+
+    if (dict == NULL) {
+        dict      = calloc(1, sizeof(tag_dict_t));
+        dict->key = key;
+        HASH_ADD(hh, adapter->dicts, key, sizeof(tag_dict_key_t), dict);
+    }
+
+    if (dict->names == NULL || dict->version != packed->version) {
+        // fetch the dictionary once per group version, the data reported
+        // before it arrives is decoded along with it
+        if (dict->requested != packed->version ||
+            adapter->timestamp - dict->requested_at > 3000) {
+            neu_reqresp_head_t     h   = { .type = NEU_REQ_GET_TAG_DICT };
+            neu_req_get_tag_dict_t cmd = { 0 };
+            nng_msg *              msg = NULL;
+
+            strcpy(h.sender, adapter->name);
+            strcpy(h.receiver, packed->driver);
+            strcpy(cmd.driver, packed->driver);
+            strcpy(cmd.group, packed->group);
+
+            msg = neu_msg_gen(&h, &cmd);
+            if (nng_sendmsg(adapter->sock, msg, 0) == 0) {
+                dict->requested    = packed->version;
+                dict->requested_at = adapter->timestamp;
+            } else {
+                nng_msg_free(msg);
+            }
+        }
+
+        // the oldest report goes when the dictionary does not come
+        if (dict->n_pending >= TAG_DICT_MAX_PENDING) {
+            pending = dict->pending;
+            DL_DELETE(dict->pending, pending);
+            dict->n_pending -= 1;
+            free(pending->header);
+            free(pending);
+            nlog_warn("adapter(%s) drop the oldest trans data of %s-%s "
+                      "waiting for the tag dict",
+                      adapter->name, packed->driver, packed->group);
+        }
+
+        size = sizeof(neu_reqresp_head_t) +
+            sizeof(neu_reqresp_trans_data_packed_t) + packed->size;
+        pending         = calloc(1, sizeof(tag_dict_pending_t));
+        pending->header = malloc(size);
+        memcpy(pending->header, header, size);
+        DL_APPEND(dict->pending, pending);
+        dict->n_pending += 1;
+        return;
+    }
+
+    trans_data_decode(adapter, header, dict->names);
+}
+
+static void trans_data_decode(neu_adapter_t *     adapter,
+                              neu_reqresp_head_t *header, UT_array *names)
+{
+    neu_reqresp_trans_data_packed_t *packed =
+        (neu_reqresp_trans_data_packed_t *) &header[1];
+    neu_reqresp_trans_data_t *data = calloc(
+        1,
+        sizeof(neu_reqresp_trans_data_t) +
+            packed->n_tag * sizeof(neu_resp_tag_value_t));
+
+    if (neu_trans_data_decode(packed, names, data) == 0) {
+        neu_reqresp_head_t h = *header;
+
+        h.type = NEU_REQRESP_TRANS_DATA;
+        adapter->module->intf_funs->request(adapter->plugin, &h, data);
+    } else {
+        nlog_warn("adapter(%s) malformed trans data of %s-%s", adapter->name,
+                  packed->driver, packed->group);
+    }
+
+    free(data);
+}
+
+static void tag_dict_update(neu_adapter_t *          adapter,
+                            neu_resp_get_tag_dict_t *resp)
+{
+    tag_dict_t *        dict    = NULL;
+    tag_dict_key_t      key     = { 0 };
+    tag_dict_pending_t *pending = NULL, *tmp = NULL;
+
+    strcpy(key.driver, resp->driver);
+    strcpy(key.group, resp->group);
+    HASH_FIND(hh, adapter->dicts, &key, sizeof(tag_dict_key_t), dict);
+
+    if (dict == NULL) {
+        dict      = calloc(1, sizeof(tag_dict_t));
+        dict->key = key;
+        HASH_ADD(hh, adapter->dicts, key, sizeof(tag_dict_key_t), dict);
+    }
+
+    if (dict->names != NULL) {
+        utarray_free(dict->names);
+    }
+
+    dict->version = resp->version;
+    dict->names   = resp->names;
+
+    // in the order reported, the reports of another version can not be
+    // decoded any more
+    DL_FOREACH_SAFE(dict->pending, pending, tmp)
+    {
+        neu_reqresp_trans_data_packed_t *packed =
+            (neu_reqresp_trans_data_packed_t *) &pending->header[1];
+
+        if (packed->version == dict->version) {
+            trans_data_decode(adapter, pending->header, dict->names);
+        } else if (packed->version < dict->version) {
+            nlog_warn("adapter(%s) drop trans data of %s-%s, no tag dict of "
+                      "version: %" PRId64,
+                      adapter->name, packed->driver, packed->group,
+                      packed->version);
+        } else {
+            continue;
+        }
+
+        DL_DELETE(dict->pending, pending);
+        dict->n_pending -= 1;
+        free(pending->header);
+        free(pending);
+    }
+}
+
+static void tag_dict_free(neu_adapter_t *adapter)
+{
+    tag_dict_t *        el      = NULL, *tmp = NULL;
+    tag_dict_pending_t *pending = NULL, *pending_tmp = NULL;
+
+    HASH_ITER(hh, adapter->dicts, el, tmp)
+    {
+        HASH_DEL(adapter->dicts, el);
+        DL_FOREACH_SAFE(el->pending, pending, pending_tmp)
+        {
+            DL_DELETE(el->pending, pending);
+            free(pending->header);
+            free(pending);
+        }
+        if (el->names != NULL) {
+            utarray_free(el->names);
+        }
+        free(el);
+    }
+}
+
 static int update_timestamp(void *usr_data)
 {
     neu_adapter_t *adapter   = (neu_adapter_t *) usr_data;
@@ -968,6 +1329,9 @@ void *neu_msg_gen(neu_reqresp_head_t *header, void *data)
     case NEU_REQ_UNSUBSCRIBE_GROUP:
         data_size = sizeof(neu_req_unsubscribe_t);
         break;
+    case NEU_RESP_SUBSCRIBE_GROUP:
+        data_size = sizeof(neu_resp_subscribe_t);
+        break;
     case NEU_REQ_GET_SUBSCRIBE_GROUP:
     case NEU_REQ_GET_SUB_DRIVER_TAGS:
         data_size = sizeof(neu_req_get_subscribe_group_t);
@@ -999,6 +1363,15 @@ void *neu_msg_gen(neu_reqresp_head_t *header, void *data)
     case NEU_RESP_GET_NODE_STAT:
         data_size = sizeof(neu_resp_get_node_stat_t);
         break;
+    case NEU_REQ_NODE_CAPTURE:
+        data_size = sizeof(neu_req_node_capture_t);
+        break;
+    case NEU_REQ_GET_NODE_CAPTURE:
+        data_size = sizeof(neu_req_get_node_capture_t);
+        break;
+    case NEU_RESP_GET_NODE_CAPTURE:
+        data_size = sizeof(neu_resp_get_node_capture_t);
+        break;
     case NEU_RESP_GET_NODE_STATE:
         data_size = sizeof(neu_resp_get_node_state_t);
         break;
@@ -1033,6 +1406,18 @@ void *neu_msg_gen(neu_reqresp_head_t *header, void *data)
     case NEU_RESP_GET_DRIVER_GROUP:
         data_size = sizeof(neu_resp_get_driver_group_t);
         break;
+    case NEU_REQRESP_TRANS_DATA_PACKED: {
+        neu_reqresp_trans_data_packed_t *packed =
+            (neu_reqresp_trans_data_packed_t *) data;
+        data_size = sizeof(neu_reqresp_trans_data_packed_t) + packed->size;
+        break;
+    }
+    case NEU_REQ_GET_TAG_DICT:
+        data_size = sizeof(neu_req_get_tag_dict_t);
+        break;
+    case NEU_RESP_GET_TAG_DICT:
+        data_size = sizeof(neu_resp_get_tag_dict_t);
+        break;
     default:
         assert(false);
         break;
@@ -1043,4 +1428,4 @@ void *neu_msg_gen(neu_reqresp_head_t *header, void *data)
     memcpy(body, header, sizeof(neu_reqresp_head_t));
     memcpy((uint8_t *) body + sizeof(neu_reqresp_head_t), data, data_size);
     return msg;
-}
\ No newline at end of file
+}
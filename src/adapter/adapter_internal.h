@@ -29,6 +29,7 @@
 
 #include "adapter_info.h"
 #include "core/manager.h"
+#include "core/msg_lane.h"
 
 struct neu_adapter {
     char *name;
@@ -52,6 +53,13 @@ struct neu_adapter {
     neu_event_io_t *   nng_io;
     neu_event_timer_t *timer;
     int                recv_fd;
+    neu_msg_lanes_t *  lanes;
+
+    // tag name dictionaries of the subscribed groups
+    struct tag_dict *dicts;
+
+    // protocol capture, kept after it is disabled so it can be downloaded
+    neu_capture_t *capture;
 
     // statistics counters
     union {
@@ -61,6 +69,12 @@ struct neu_adapter {
             uint64_t msgs_sent;   // number of messages sent
             uint64_t msgs_recv;   // number of messages received
             uint64_t avg_rtt;     // average round trip time in milliseconds
+            // effective socket options, see neu_conn_stat
+            uint64_t sock[NEU_NODE_STAT_CTRL_DEPTH -
+                          NEU_NODE_STAT_SOCK_NODELAY];
+            // kept by the message lanes, see neu_msg_lanes_node_stat
+            uint64_t lanes[NEU_NODE_STAT_TAG_TOT_CNT -
+                           NEU_NODE_STAT_CTRL_DEPTH];
             uint64_t tag_tot_cnt; // number of tag read including errors
             uint64_t tag_err_cnt; // number of tag read errors
         };
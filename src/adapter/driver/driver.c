@@ -17,6 +17,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
 #include <assert.h>
+#include <fnmatch.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 
@@ -36,6 +37,20 @@
 #include "errcodes.h"
 #include "tag.h"
 
+typedef struct sub_app {
+    char app[NEU_NODE_NAME_LEN];
+
+    uint16_t n_filter;
+    char **  filters;
+
+    // one bit per read tag slot, compiled against the group timestamp
+    int64_t  timestamp;
+    uint16_t n_slot;
+    uint8_t *bitmap;
+
+    struct sub_app *next;
+} sub_app_t;
+
 typedef struct group {
     char *name;
 
@@ -48,6 +63,8 @@ typedef struct group {
     neu_plugin_group_t    grp;
     neu_adapter_driver_t *driver;
 
+    sub_app_t *apps;
+
     UT_hash_handle hh;
 } group_t;
 
@@ -67,11 +84,14 @@ static void read_group(int64_t timestamp, int64_t timeout,
                        UT_array *tags, neu_resp_tag_value_t *datas);
 static int  read_report_group(int64_t timestamp, int64_t timeout,
                               neu_driver_cache_t *cache, const char *group,
-                              UT_array *tags, neu_resp_tag_value_t *datas);
+                              UT_array *tags, neu_resp_tag_value_t *datas,
+                              uint16_t *slots, int64_t *timestamps);
 static void update(neu_adapter_t *adapter, const char *group, const char *tag,
                    neu_dvalue_t value);
 static void write_response(neu_adapter_t *adapter, void *r, neu_error error);
 static group_t *find_group(neu_adapter_driver_t *driver, const char *name);
+static void     sub_app_free(sub_app_t *app);
+static void     sub_apps_free(group_t *group);
 
 static void write_response(neu_adapter_t *adapter, void *r, neu_error error)
 {
@@ -168,6 +188,7 @@ int neu_adapter_driver_uninit(neu_adapter_driver_t *driver)
         free(el->grp.group_name);
         free(el->name);
         utarray_free(el->grp.tags);
+        sub_apps_free(el);
 
         neu_group_destroy(el->group);
         free(el);
@@ -445,6 +466,7 @@ int neu_adapter_driver_del_group(neu_adapter_driver_t *driver, const char *name)
         }
 
         utarray_free(find->grp.tags);
+        sub_apps_free(find);
         neu_group_destroy(find->group);
         free(find);
 
@@ -464,6 +486,112 @@ static group_t *find_group(neu_adapter_driver_t *driver, const char *name)
 
     return find;
 }
+
+int neu_adapter_driver_subscribe(neu_adapter_driver_t *driver,
+                                 neu_req_subscribe_t * cmd)
+{
+    group_t *  group = find_group(driver, cmd->group);
+    sub_app_t *app   = NULL;
+
+    if (group == NULL) {
+        for (int i = 0; i < cmd->n_filter; i++) {
+            free(cmd->filters[i]);
+        }
+        free(cmd->filters);
+        return NEU_ERR_GROUP_NOT_EXIST;
+    }
+
+    LL_FOREACH(group->apps, app)
+    {
+        if (strcmp(app->app, cmd->app) == 0) {
+            LL_DELETE(group->apps, app);
+            sub_app_free(app);
+            break;
+        }
+    }
+
+    app = calloc(1, sizeof(sub_app_t));
+    strcpy(app->app, cmd->app);
+    app->n_filter = cmd->n_filter;
+    app->filters  = cmd->filters;
+    LL_APPEND(group->apps, app);
+
+    nlog_notice("app: %s subscribe %s-%s with %d tag filters", cmd->app,
+                driver->adapter.name, cmd->group, cmd->n_filter);
+    return NEU_ERR_SUCCESS;
+}
+
+int neu_adapter_driver_unsubscribe(neu_adapter_driver_t *driver,
+                                   const char *app_name, const char *group_name)
+{
+    group_t *  group = find_group(driver, group_name);
+    sub_app_t *app = NULL, *tmp = NULL;
+
+    if (group == NULL) {
+        return NEU_ERR_GROUP_NOT_EXIST;
+    }
+
+    LL_FOREACH_SAFE(group->apps, app, tmp)
+    {
+        if (strcmp(app->app, app_name) == 0) {
+            LL_DELETE(group->apps, app);
+            sub_app_free(app);
+            return NEU_ERR_SUCCESS;
+        }
+    }
+
+    return NEU_ERR_GROUP_NOT_SUBSCRIBE;
+}
+
+static void sub_app_free(sub_app_t *app)
+{
+    for (int i = 0; i < app->n_filter; i++) {
+        free(app->filters[i]);
+    }
+    free(app->filters);
+    free(app->bitmap);
+    free(app);
+}
+
+static void sub_apps_free(group_t *group)
+{
+    sub_app_t *app = NULL, *tmp = NULL;
+
+    LL_FOREACH_SAFE(group->apps, app, tmp)
+    {
+        LL_DELETE(group->apps, app);
+        sub_app_free(app);
+    }
+}
+
+static void sub_app_compile(sub_app_t *app, neu_group_t *group, UT_array *tags)
+{
+    if (app->bitmap != NULL && !neu_group_is_change(group, app->timestamp)) {
+        return;
+    }
+
+    free(app->bitmap);
+    app->timestamp = neu_group_get_timestamp(group);
+    app->n_slot    = utarray_len(tags);
+    app->bitmap    = calloc(app->n_slot / 8 + 1, sizeof(uint8_t));
+
+    utarray_foreach(tags, neu_datatag_t *, tag)
+    {
+        uint16_t slot = utarray_eltidx(tags, tag);
+
+        for (int i = 0; i < app->n_filter; i++) {
+            if (fnmatch(app->filters[i], tag->name, 0) == 0) {
+                app->bitmap[slot / 8] |= 1 << (slot % 8);
+                break;
+            }
+        }
+    }
+}
+
+static inline bool sub_app_test(sub_app_t *app, uint16_t slot)
+{
+    return slot < app->n_slot && (app->bitmap[slot / 8] & (1 << (slot % 8)));
+}
 int neu_adapter_driver_group_exist(neu_adapter_driver_t *driver,
                                    const char *          name)
 {
@@ -661,39 +789,128 @@ UT_array *neu_adapter_driver_get_read_tag(neu_adapter_driver_t *driver,
     return tags;
 }
 
+int neu_adapter_driver_get_tag_dict(neu_adapter_driver_t *driver,
+                                    const char *group, int64_t *version,
+                                    UT_array **names)
+{
+    group_t * find = NULL;
+    UT_array *tags = NULL;
+
+    HASH_FIND_STR(driver->groups, group, find);
+    if (find == NULL) {
+        return NEU_ERR_GROUP_NOT_EXIST;
+    }
+
+    // slots follow the order of the read tags, same as report_callback
+    tags     = neu_group_get_read_tag(find->group);
+    *version = neu_group_get_timestamp(find->group);
+
+    utarray_new(*names, &ut_str_icd);
+    utarray_foreach(tags, neu_datatag_t *, tag)
+    {
+        utarray_push_back(*names, &tag->name);
+    }
+
+    utarray_free(tags);
+    return NEU_ERR_SUCCESS;
+}
+
+static void report_packed(group_t *group, sub_app_t *app, int64_t version,
+                          neu_resp_tag_value_t *tags, uint16_t *slots,
+                          int64_t *timestamps, uint16_t n_tag)
+{
+    neu_reqresp_head_t               header = { 0 };
+    neu_reqresp_trans_data_packed_t *packed = NULL;
+    uint32_t                         size   = 0;
+    uint32_t                         offset = 0;
+
+    header.type = NEU_REQRESP_TRANS_DATA_PACKED;
+    if (app != NULL) {
+        // the manager routes it to this app only
+        strcpy(header.receiver, app->app);
+    }
+
+    for (uint16_t i = 0; i < n_tag; i++) {
+        if (app == NULL || sub_app_test(app, slots[i])) {
+            size += neu_trans_data_pack(NULL, 0, slots[i], &tags[i].value,
+                                        timestamps[i] != 0 ? &timestamps[i]
+                                                           : NULL);
+        }
+    }
+
+    if (size == 0) {
+        return;
+    }
+
+    packed = calloc(1, sizeof(neu_reqresp_trans_data_packed_t) + size);
+    strcpy(packed->driver, group->driver->adapter.name);
+    strcpy(packed->group, group->name);
+    packed->version = version;
+    packed->size    = size;
+
+    for (uint16_t i = 0; i < n_tag; i++) {
+        if (app == NULL || sub_app_test(app, slots[i])) {
+            offset += neu_trans_data_pack(
+                packed->data + offset, size - offset, slots[i], &tags[i].value,
+                timestamps[i] != 0 ? &timestamps[i] : NULL);
+            packed->n_tag += 1;
+        }
+    }
+
+    group->driver->adapter.cb_funs.response(&group->driver->adapter, &header,
+                                            packed);
+    free(packed);
+}
+
 static int report_callback(void *usr_data)
 {
-    group_t *                group  = (group_t *) usr_data;
-    neu_reqresp_head_t       header = { 0 };
-    neu_node_running_state_e state  = group->driver->adapter.state;
+    group_t *                group   = (group_t *) usr_data;
+    neu_node_running_state_e state   = group->driver->adapter.state;
+    sub_app_t *              app     = NULL;
+    bool                     full    = group->apps == NULL;
+    int64_t                  version = 0;
+    uint16_t                 n_tag   = 0;
     if (state != NEU_NODE_RUNNING_STATE_RUNNING) {
         return 0;
     }
 
-    header.type = NEU_REQRESP_TRANS_DATA;
+    LL_FOREACH(group->apps, app) { full |= app->n_filter == 0; }
 
     UT_array *tags =
         neu_adapter_driver_get_read_tag(group->driver, group->name);
+    neu_resp_tag_value_t *datas =
+        calloc(utarray_len(tags) + 1, sizeof(neu_resp_tag_value_t));
+    uint16_t *slots      = calloc(utarray_len(tags) + 1, sizeof(uint16_t));
+    int64_t * timestamps = calloc(utarray_len(tags) + 1, sizeof(int64_t));
+
+    version = neu_group_get_timestamp(group->group);
+    n_tag   = read_report_group(group->driver->adapter.timestamp,
+                              neu_group_get_interval(group->group) *
+                                  NEU_DRIVER_TAG_CACHE_EXPIRE_TIME,
+                              group->driver->cache, group->name, tags, datas,
+                              slots, timestamps);
+
+    if (n_tag > 0) {
+        if (full) {
+            report_packed(group, NULL, version, datas, slots, timestamps,
+                          n_tag);
+        }
 
-    neu_reqresp_trans_data_t *data =
-        calloc(1,
-               sizeof(neu_reqresp_trans_data_t) +
-                   utarray_len(tags) * sizeof(neu_resp_tag_value_t));
-
-    strcpy(data->driver, group->driver->adapter.name);
-    strcpy(data->group, group->name);
-    data->n_tag = read_report_group(group->driver->adapter.timestamp,
-                                    neu_group_get_interval(group->group) *
-                                        NEU_DRIVER_TAG_CACHE_EXPIRE_TIME,
-                                    group->driver->cache, group->name, tags,
-                                    (neu_resp_tag_value_t *) &data[1]);
-
-    if (data->n_tag > 0) {
-        group->driver->adapter.cb_funs.response(&group->driver->adapter,
-                                                &header, data);
+        // pack only the requested tags for each filtered app
+        LL_FOREACH(group->apps, app)
+        {
+            if (app->n_filter > 0) {
+                sub_app_compile(app, group->group, tags);
+                report_packed(group, app, version, datas, slots, timestamps,
+                              n_tag);
+            }
+        }
     }
+
     utarray_free(tags);
-    free(data);
+    free(timestamps);
+    free(slots);
+    free(datas);
     return 0;
 }
 
@@ -770,7 +987,8 @@ static int read_callback(void *usr_data)
 
 static int read_report_group(int64_t timestamp, int64_t timeout,
                              neu_driver_cache_t *cache, const char *group,
-                             UT_array *tags, neu_resp_tag_value_t *datas)
+                             UT_array *tags, neu_resp_tag_value_t *datas,
+                             uint16_t *slots, int64_t *timestamps)
 {
     int index = 0;
 
@@ -778,6 +996,10 @@ static int read_report_group(int64_t timestamp, int64_t timeout,
     {
         neu_driver_cache_value_t value = { 0 };
 
+        if (slots != NULL) {
+            slots[index] = utarray_eltidx(tags, tag);
+        }
+
         if (neu_tag_attribute_test(tag, NEU_ATTRIBUTE_SUBSCRIBE)) {
             if (neu_driver_cache_get_changed(cache, group, tag->name, &value) !=
                 0) {
@@ -789,11 +1011,18 @@ static int read_report_group(int64_t timestamp, int64_t timeout,
                 strcpy(datas[index].tag, tag->name);
                 datas[index].value.type      = NEU_TYPE_ERROR;
                 datas[index].value.value.i32 = NEU_ERR_PLUGIN_TAG_NOT_READY;
+                if (timestamps != NULL) {
+                    timestamps[index] = 0;
+                }
                 index += 1;
                 continue;
             }
         }
         strcpy(datas[index].tag, tag->name);
+        // when the value was read, not when it is reported
+        if (timestamps != NULL) {
+            timestamps[index] = value.timestamp;
+        }
 
         if (value.value.type == NEU_TYPE_ERROR) {
             datas[index].value = value.value;
@@ -46,6 +46,12 @@ int neu_adapter_driver_group_exist(neu_adapter_driver_t *driver,
                                    const char *          name);
 UT_array *neu_adapter_driver_get_group(neu_adapter_driver_t *driver);
 
+// takes the ownership of cmd->filters
+int neu_adapter_driver_subscribe(neu_adapter_driver_t *driver,
+                                 neu_req_subscribe_t * cmd);
+int neu_adapter_driver_unsubscribe(neu_adapter_driver_t *driver,
+                                   const char *app, const char *group);
+
 int  neu_adapter_driver_add_tag(neu_adapter_driver_t *driver, const char *group,
                                 neu_datatag_t *tag);
 int  neu_adapter_driver_del_tag(neu_adapter_driver_t *driver, const char *group,
@@ -58,6 +64,9 @@ void neu_adapter_driver_get_value_tag(neu_adapter_driver_t *driver,
                                       const char *group, UT_array **tags);
 UT_array *neu_adapter_driver_get_read_tag(neu_adapter_driver_t *driver,
                                           const char *          group);
+int       neu_adapter_driver_get_tag_dict(neu_adapter_driver_t *driver,
+                                          const char *group, int64_t *version,
+                                          UT_array **names);
 uint16_t  neu_adapter_driver_tag_size(neu_adapter_driver_t *driver);
 void      neu_adapter_driver_set_all_tag_size(neu_adapter_driver_t *driver,
                                               uint32_t              size);
@@ -132,6 +132,7 @@ int adapter_load_group_and_tag(neu_persister_t *     persister,
                                neu_adapter_driver_t *driver)
 {
     UT_array *     group_infos = NULL;
+    UT_array *     tag_infos   = NULL;
     neu_adapter_t *adapter     = (neu_adapter_t *) driver;
 
     int rv = neu_persister_load_groups(persister, adapter->name, &group_infos);
@@ -142,23 +143,22 @@ int adapter_load_group_and_tag(neu_persister_t *     persister,
 
     utarray_foreach(group_infos, neu_persist_group_info_t *, p)
     {
-        UT_array *tags = NULL;
         neu_adapter_driver_add_group(driver, p->name, p->interval);
+    }
+    utarray_free(group_infos);
 
-        rv = neu_persister_load_tags(persister, adapter->name, p->name, &tags);
-        if (0 != rv) {
-            nlog_warn("load %s:%s tags fail", adapter->name, p->name);
-            continue;
-        }
-
-        utarray_foreach(tags, neu_datatag_t *, tag)
-        {
-            neu_adapter_driver_add_tag(driver, p->name, tag);
-        }
+    // the tags of all the groups in one query instead of one per group
+    rv = neu_persister_load_driver_tags(persister, adapter->name, &tag_infos);
+    if (0 != rv) {
+        nlog_warn("load %s tags fail", adapter->name);
+        return rv;
+    }
 
-        utarray_free(tags);
+    utarray_foreach(tag_infos, neu_persist_tag_info_t *, info)
+    {
+        neu_adapter_driver_add_tag(driver, info->group_name, &info->tag);
     }
 
-    utarray_free(group_infos);
+    utarray_free(tag_infos);
     return rv;
 }
\ No newline at end of file
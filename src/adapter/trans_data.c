@@ -0,0 +1,194 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#include <string.h>
+
+#include "adapter.h"
+
+static int value_size(neu_type_e type)
+{
+    switch (type) {
+    case NEU_TYPE_INT8:
+    case NEU_TYPE_UINT8:
+    case NEU_TYPE_BIT:
+    case NEU_TYPE_BOOL:
+        return 1;
+    case NEU_TYPE_INT16:
+    case NEU_TYPE_UINT16:
+        return 2;
+    case NEU_TYPE_INT32:
+    case NEU_TYPE_UINT32:
+    case NEU_TYPE_ERROR:
+        return 4;
+    case NEU_TYPE_FLOAT:
+        return 4 + 1;
+    case NEU_TYPE_INT64:
+    case NEU_TYPE_UINT64:
+        return 8;
+    case NEU_TYPE_DOUBLE:
+        return 8 + 1;
+    case NEU_TYPE_BYTES:
+        return NEU_VALUE_SIZE;
+    case NEU_TYPE_STRING:
+    default:
+        return -1;
+    }
+}
+
+int neu_trans_data_pack(uint8_t *buf, size_t size, uint16_t slot,
+                        neu_dvalue_t *value, int64_t *timestamp)
+{
+    int     n_value = value_size(value->type);
+    uint8_t n_str   = 0;
+    uint8_t type    = value->type;
+    int     n       = 0;
+
+    if (value->type == NEU_TYPE_STRING) {
+        n_str   = strnlen(value->value.str, NEU_VALUE_SIZE - 1);
+        n_value = 1 + n_str;
+    }
+
+    if (n_value < 0) {
+        return -1;
+    }
+
+    n = sizeof(uint16_t) + sizeof(uint8_t) + n_value +
+        (timestamp != NULL ? sizeof(int64_t) : 0);
+    if (buf == NULL) {
+        return n;
+    }
+    if ((size_t) n > size) {
+        return -1;
+    }
+
+    if (timestamp != NULL) {
+        type |= NEU_TRANS_DATA_TIMESTAMP;
+    }
+
+    memcpy(buf, &slot, sizeof(uint16_t));
+    buf += sizeof(uint16_t);
+    *buf++ = type;
+
+    switch (value->type) {
+    case NEU_TYPE_STRING:
+        *buf++ = n_str;
+        memcpy(buf, value->value.str, n_str);
+        buf += n_str;
+        break;
+    case NEU_TYPE_FLOAT:
+    case NEU_TYPE_DOUBLE:
+        memcpy(buf, &value->value, n_value - 1);
+        buf += n_value - 1;
+        *buf++ = value->precision;
+        break;
+    default:
+        memcpy(buf, &value->value, n_value);
+        buf += n_value;
+        break;
+    }
+
+    if (timestamp != NULL) {
+        memcpy(buf, timestamp, sizeof(int64_t));
+    }
+
+    return n;
+}
+
+int neu_trans_data_unpack(uint8_t *buf, size_t size, uint16_t *slot,
+                          neu_dvalue_t *value, int64_t *timestamp)
+{
+    uint8_t *start   = buf;
+    int      n_value = 0;
+    uint8_t  type    = 0;
+
+    if (size < sizeof(uint16_t) + sizeof(uint8_t)) {
+        return -1;
+    }
+
+    memcpy(slot, buf, sizeof(uint16_t));
+    buf += sizeof(uint16_t);
+    type = *buf++;
+    size -= sizeof(uint16_t) + sizeof(uint8_t);
+
+    memset(value, 0, sizeof(neu_dvalue_t));
+    value->type = type & ~NEU_TRANS_DATA_TIMESTAMP;
+
+    if (value->type == NEU_TYPE_STRING) {
+        // the string is terminated in value, as packed
+        if (size < 1 || size < (size_t) 1 + buf[0] ||
+            buf[0] >= NEU_VALUE_SIZE) {
+            return -1;
+        }
+        n_value = 1 + buf[0];
+        memcpy(value->value.str, buf + 1, buf[0]);
+    } else {
+        n_value = value_size(value->type);
+        if (n_value < 0 || size < (size_t) n_value) {
+            return -1;
+        }
+
+        if (value->type == NEU_TYPE_FLOAT || value->type == NEU_TYPE_DOUBLE) {
+            memcpy(&value->value, buf, n_value - 1);
+            value->precision = buf[n_value - 1];
+        } else {
+            memcpy(&value->value, buf, n_value);
+        }
+    }
+    buf += n_value;
+    size -= n_value;
+
+    *timestamp = 0;
+    if (type & NEU_TRANS_DATA_TIMESTAMP) {
+        if (size < sizeof(int64_t)) {
+            return -1;
+        }
+        memcpy(timestamp, buf, sizeof(int64_t));
+        buf += sizeof(int64_t);
+    }
+
+    return buf - start;
+}
+
+int neu_trans_data_decode(neu_reqresp_trans_data_packed_t *packed,
+                          UT_array *names, neu_reqresp_trans_data_t *data)
+{
+    uint32_t offset = 0;
+
+    strcpy(data->driver, packed->driver);
+    strcpy(data->group, packed->group);
+    data->n_tag = 0;
+
+    for (uint16_t i = 0; i < packed->n_tag; i++) {
+        uint16_t slot      = 0;
+        int64_t  timestamp = 0;
+        int      n         = neu_trans_data_unpack(
+            packed->data + offset, packed->size - offset, &slot,
+            &data->tags[i].value, &timestamp);
+
+        if (n < 0 || slot >= utarray_len(names)) {
+            return -1;
+        }
+
+        strcpy(data->tags[i].tag, *(char **) utarray_eltptr(names, slot));
+        data->n_tag += 1;
+        offset += n;
+    }
+
+    return 0;
+}
@@ -71,6 +71,7 @@ const char *usage_text =
 "    --disable_auth       disable http api auth\n"
 "    --config_dir <DIR>   directory from which neuron reads configuration\n"
 "    --plugin_dir <DIR>   directory from which neuron loads plugin lib files\n"
+"    --event <BACKEND>    event backend, epoll or io_uring\n"
 "\n";
 // clang-format on
 
@@ -144,6 +145,7 @@ void neu_cli_args_init(neu_cli_args_t *args, int argc, char *argv[])
         { "disable_auth", no_argument, NULL, 'a' },
         { "config_dir", required_argument, NULL, 'c' },
         { "plugin_dir", required_argument, NULL, 'p' },
+        { "event", required_argument, NULL, 'e' },
         { NULL, 0, NULL, 0 },
     };
 
@@ -189,6 +191,17 @@ void neu_cli_args_init(neu_cli_args_t *args, int argc, char *argv[])
         case 'p':
             plugin_dir = strdup(optarg);
             break;
+        case 'e':
+            if (0 != strcmp(optarg, "epoll") &&
+                0 != strcmp(optarg, "io_uring")) {
+                fprintf(stderr, "%s: option '--event' invalid backend: `%s`\n",
+                        argv[0], optarg);
+                ret = 1;
+                goto quit;
+            }
+            free(args->event_backend);
+            STRDUP(args->event_backend, optarg);
+            break;
         case '?':
         default:
             usage();
@@ -252,5 +265,6 @@ void neu_cli_args_fini(neu_cli_args_t *args)
         free(args->log_init_file);
         free(args->config_dir);
         free(args->plugin_dir);
+        free(args->event_backend);
     }
 }
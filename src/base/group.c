@@ -250,6 +250,11 @@ bool neu_group_is_change(neu_group_t *group, int64_t timestamp)
     return change;
 }
 
+int64_t neu_group_get_timestamp(neu_group_t *group)
+{
+    return group->timestamp;
+}
+
 static void update_timestamp(neu_group_t *group)
 {
     struct timeval tv = { 0 };
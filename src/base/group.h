@@ -46,5 +46,6 @@ typedef void (*neu_group_change_fn)(void *arg, int64_t timestamp,
                                     UT_array *tags, uint32_t interval);
 void neu_group_change_test(neu_group_t *group, int64_t timestamp, void *arg,
                            neu_group_change_fn fn);
-bool neu_group_is_change(neu_group_t *group, int64_t timestamp);
+bool    neu_group_is_change(neu_group_t *group, int64_t timestamp);
+int64_t neu_group_get_timestamp(neu_group_t *group);
 #endif
\ No newline at end of file
@@ -0,0 +1,901 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event/event.h"
+#include "utils/log.h"
+#include "utils/uthash.h"
+#include "utils/utlist.h"
+
+#include "conn_pool.h"
+
+// period of the timer expiring the requests
+#define POOL_TICK_MS 100
+// when the member gives none, ms
+#define POOL_TIMEOUT 3000
+// requests queued by a member on a session, responses waiting for a member
+#define POOL_MAX_QUEUE 64
+#define POOL_MAX_INBOX 64
+#define POOL_RECV_BUF 4096
+
+typedef struct conn_frame {
+    uint16_t tag;
+    uint16_t len;
+    uint64_t deadline; // ms
+
+    struct conn_frame *prev;
+    struct conn_frame *next;
+    uint8_t            bytes[];
+} conn_frame_t;
+
+typedef struct conn_endpoint conn_endpoint_t;
+
+typedef struct conn_session {
+    conn_endpoint_t *ep;
+    uint16_t         index;
+    neu_conn_t *     conn;
+
+    // the members, their queues and the window are guarded by mtx, the events
+    // thread holds it in its callbacks. Lock order: mtx, member mtx.
+    pthread_mutex_t mtx;
+    conn_member_t * members[NEU_CONN_POOL_MAX_MEMBER];
+    conn_frame_t *  queue[NEU_CONN_POOL_MAX_MEMBER];
+    uint16_t        n_queued[NEU_CONN_POOL_MAX_MEMBER];
+    uint16_t        n_member;
+    uint16_t        turn; // the slot served first by the next send
+    uint16_t        window;
+
+    // the tags sent and not answered yet
+    struct {
+        uint16_t tag;
+        uint64_t deadline; // ms
+    } inflight[NEU_CONN_POOL_MAX_WINDOW];
+    uint16_t n_inflight;
+
+    neu_events_t *     events;
+    neu_event_timer_t *tick;
+    neu_event_io_t *   wakeup_io;
+    int                wakeup[2];
+    neu_event_io_t *   conn_io;
+    int                conn_io_gen;
+    bool               up;
+    bool               closing;
+    pthread_cond_t     closed;
+
+    // set by the connection callbacks
+    pthread_mutex_t conn_mtx;
+    int             conn_fd;
+    int             conn_gen;
+
+    uint8_t  buf[POOL_RECV_BUF];
+    uint16_t buf_len;
+} conn_session_t;
+
+struct conn_member {
+    conn_endpoint_t * ep;
+    uint16_t          slot;
+    void *            data;
+    neu_conn_callback connected;
+    neu_conn_callback disconnected;
+    uint16_t          window;
+    uint16_t          timeout;
+
+    conn_session_t *sessions[NEU_CONN_POOL_MAX_SESSION];
+    uint16_t        n_session;
+
+    // the responses routed to the member, notify[0] is readable while there
+    // are some
+    pthread_mutex_t mtx;
+    conn_frame_t *  inbox;
+    uint16_t        n_inbox;
+    uint16_t        n_up; // sessions connected
+    uint16_t        next; // the session tried first by the next send
+    bool            stopped;
+    int             notify[2];
+};
+
+struct conn_endpoint {
+    char             key[96];
+    neu_conn_param_t param; // of the first member
+    conn_member_t *  members[NEU_CONN_POOL_MAX_MEMBER];
+    uint16_t         n_member;
+    conn_session_t * sessions[NEU_CONN_POOL_MAX_SESSION];
+
+    UT_hash_handle hh;
+};
+
+// guards the endpoints, the members and the sessions joining and leaving
+static struct {
+    pthread_mutex_t  mtx;
+    conn_endpoint_t *endpoints;
+} pool = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static int session_wakeup_cb(enum neu_event_io_type type, int fd,
+                             void *usr_data);
+static int session_conn_cb(enum neu_event_io_type type, int fd,
+                           void *usr_data);
+static int session_tick_cb(void *usr_data);
+
+static uint64_t now_ms()
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void notify(int fd)
+{
+    if (write(fd, "", 1) != 1) {
+        // the pipe is full, the reader is woken up anyway
+    }
+}
+
+static void drain(int fd)
+{
+    char c = 0;
+
+    while (read(fd, &c, 1) == 1) {
+    }
+}
+
+static void frames_free(conn_frame_t **frames)
+{
+    conn_frame_t *frame = NULL, *tmp = NULL;
+
+    DL_FOREACH_SAFE(*frames, frame, tmp)
+    {
+        DL_DELETE(*frames, frame);
+        free(frame);
+    }
+}
+
+static void session_connected(void *data, int fd)
+{
+    conn_session_t *s = (conn_session_t *) data;
+
+    pthread_mutex_lock(&s->conn_mtx);
+    s->conn_fd = fd;
+    s->conn_gen += 1;
+    pthread_mutex_unlock(&s->conn_mtx);
+    notify(s->wakeup[1]);
+}
+
+static void session_disconnected(void *data, int fd)
+{
+    (void) fd;
+    session_connected(data, -1);
+}
+
+static conn_session_t *session_new(conn_endpoint_t *ep, uint16_t index)
+{
+    conn_session_t *        s     = calloc(1, sizeof(conn_session_t));
+    neu_event_io_param_t    io    = { 0 };
+    neu_event_timer_param_t timer = {
+        .second      = 0,
+        .millisecond = POOL_TICK_MS,
+        .usr_data    = (void *) s,
+        .cb          = session_tick_cb,
+    };
+
+    if (pipe(s->wakeup) != 0) {
+        zlog_error(ep->param.log, "pool %s create wakeup pipe fail", ep->key);
+        free(s);
+        return NULL;
+    }
+    fcntl(s->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(s->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    s->ep      = ep;
+    s->index   = index;
+    s->conn_fd = -1;
+    s->window  = NEU_CONN_POOL_MAX_WINDOW;
+    pthread_mutex_init(&s->mtx, NULL);
+    pthread_mutex_init(&s->conn_mtx, NULL);
+    pthread_cond_init(&s->closed, NULL);
+
+    s->conn = neu_conn_new(&ep->param, (void *) s, session_connected,
+                           session_disconnected);
+    s->events = neu_event_new();
+
+    io.fd        = s->wakeup[0];
+    io.usr_data  = (void *) s;
+    io.cb        = session_wakeup_cb;
+    s->wakeup_io = neu_event_add_io(s->events, io);
+    s->tick      = neu_event_add_timer(s->events, timer);
+
+    zlog_notice(ep->param.log, "pool %s, session %u open", ep->key, index);
+    return s;
+}
+
+static void session_free(conn_session_t *s)
+{
+    // the ios and the timer are deleted by the events thread itself
+    pthread_mutex_lock(&s->mtx);
+    s->closing = true;
+    notify(s->wakeup[1]);
+    while (s->wakeup_io != NULL) {
+        pthread_cond_wait(&s->closed, &s->mtx);
+    }
+    pthread_mutex_unlock(&s->mtx);
+
+    neu_event_close(s->events);
+    neu_conn_destory(s->conn);
+    zlog_notice(s->ep->param.log, "pool %s, session %u closed", s->ep->key,
+                s->index);
+
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        frames_free(&s->queue[i]);
+    }
+    close(s->wakeup[0]);
+    close(s->wakeup[1]);
+    pthread_cond_destroy(&s->closed);
+    pthread_mutex_destroy(&s->conn_mtx);
+    pthread_mutex_destroy(&s->mtx);
+    free(s);
+}
+
+// with s->mtx held, the smallest window of the members
+static void session_window(conn_session_t *s)
+{
+    s->window = NEU_CONN_POOL_MAX_WINDOW;
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        if (s->members[i] != NULL && s->members[i]->window < s->window) {
+            s->window = s->members[i]->window;
+        }
+    }
+}
+
+static void member_up(conn_member_t *m)
+{
+    pthread_mutex_lock(&m->mtx);
+    m->n_up += 1;
+    m->connected(m->data, m->notify[0]);
+    pthread_mutex_unlock(&m->mtx);
+}
+
+// the requests sent on the session are lost, the member is told even if its
+// other sessions are still up
+static void member_down(conn_member_t *m)
+{
+    pthread_mutex_lock(&m->mtx);
+    m->n_up -= 1;
+    m->disconnected(m->data, -1);
+    if (m->n_up > 0) {
+        m->connected(m->data, m->notify[0]);
+    }
+    pthread_mutex_unlock(&m->mtx);
+}
+
+static void session_attach(conn_session_t *s, conn_member_t *m)
+{
+    pthread_mutex_lock(&s->mtx);
+    s->members[m->slot] = m;
+    s->n_member += 1;
+    session_window(s);
+    if (s->up) {
+        member_up(m);
+    }
+    pthread_mutex_unlock(&s->mtx);
+}
+
+static void session_detach(conn_session_t *s, conn_member_t *m)
+{
+    pthread_mutex_lock(&s->mtx);
+    s->members[m->slot] = NULL;
+    s->n_member -= 1;
+    frames_free(&s->queue[m->slot]);
+    s->n_queued[m->slot] = 0;
+    session_window(s);
+    if (s->up) {
+        pthread_mutex_lock(&m->mtx);
+        m->n_up -= 1;
+        pthread_mutex_unlock(&m->mtx);
+    }
+    pthread_mutex_unlock(&s->mtx);
+}
+
+// follow the connection changes made by the connection callbacks
+static void session_sync(conn_session_t *s)
+{
+    bool was_up = s->up;
+    int  fd     = 0;
+    int  gen    = 0;
+
+    pthread_mutex_lock(&s->conn_mtx);
+    fd  = s->conn_fd;
+    gen = s->conn_gen;
+    pthread_mutex_unlock(&s->conn_mtx);
+
+    if (gen == s->conn_io_gen) {
+        return;
+    }
+    s->conn_io_gen = gen;
+
+    if (s->conn_io != NULL) {
+        neu_event_del_io(s->events, s->conn_io);
+        s->conn_io = NULL;
+    }
+    s->buf_len    = 0;
+    s->n_inflight = 0;
+    s->up         = fd >= 0;
+
+    if (s->up) {
+        neu_event_io_param_t io = {
+            .fd       = fd,
+            .usr_data = (void *) s,
+            .cb       = session_conn_cb,
+        };
+
+        s->conn_io = neu_event_add_io(s->events, io);
+    }
+
+    // a reconnect in between is a disconnect as well
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        if (s->members[i] == NULL) {
+            continue;
+        }
+        if (was_up) {
+            member_down(s->members[i]);
+        }
+        if (s->up) {
+            member_up(s->members[i]);
+        }
+    }
+}
+
+// the members wait for their requests on their own, the pool just stops
+// counting the ones not answered in time
+static void session_expire(conn_session_t *s, uint64_t now)
+{
+    conn_frame_t *frame = NULL, *tmp = NULL;
+
+    for (uint16_t i = 0; i < s->n_inflight;) {
+        if (s->inflight[i].deadline <= now) {
+            s->n_inflight -= 1;
+            s->inflight[i] = s->inflight[s->n_inflight];
+        } else {
+            i++;
+        }
+    }
+
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        DL_FOREACH_SAFE(s->queue[i], frame, tmp)
+        {
+            if (frame->deadline <= now) {
+                DL_DELETE(s->queue[i], frame);
+                s->n_queued[i] -= 1;
+                free(frame);
+            }
+        }
+    }
+}
+
+// send the queued requests of the members in turn, one each, while the window
+// is not full
+static void session_send(conn_session_t *s)
+{
+    conn_frame_t *cursor[NEU_CONN_POOL_MAX_MEMBER];
+    conn_frame_t *picked[NEU_CONN_MAX_IOV];
+    uint16_t      slots[NEU_CONN_MAX_IOV];
+    struct iovec  iov[NEU_CONN_MAX_IOV];
+    uint16_t      slot   = s->turn;
+    uint16_t      n_idle = 0;
+    int           n      = 0;
+    ssize_t       len    = 0;
+    ssize_t       ret    = 0;
+
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        cursor[i] = s->queue[i];
+    }
+
+    while (n < NEU_CONN_MAX_IOV && s->n_inflight + n < s->window &&
+           n_idle < NEU_CONN_POOL_MAX_MEMBER) {
+        conn_frame_t *frame = cursor[slot];
+
+        if (frame == NULL) {
+            n_idle += 1;
+        } else {
+            n_idle          = 0;
+            cursor[slot]    = frame->next;
+            picked[n]       = frame;
+            slots[n]        = slot;
+            iov[n].iov_base = frame->bytes;
+            iov[n].iov_len  = frame->len;
+            len += frame->len;
+            n += 1;
+        }
+        slot = (slot + 1) % NEU_CONN_POOL_MAX_MEMBER;
+    }
+
+    if (n == 0) {
+        return;
+    }
+
+    // not connected yet, the requests wait for the next try
+    ret = neu_conn_sendv(s->conn, iov, n);
+    if (ret <= 0) {
+        return;
+    }
+    s->turn = slot;
+
+    if (ret != len) {
+        zlog_warn(s->ep->param.log,
+                  "pool %s, session %u, %zd of %zd bytes sent", s->ep->key,
+                  s->index, ret, len);
+        neu_conn_disconnect(s->conn);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (ret == len) {
+            s->inflight[s->n_inflight].tag      = picked[i]->tag;
+            s->inflight[s->n_inflight].deadline = picked[i]->deadline;
+            s->n_inflight += 1;
+        }
+        DL_DELETE(s->queue[slots[i]], picked[i]);
+        s->n_queued[slots[i]] -= 1;
+        free(picked[i]);
+    }
+}
+
+// the member is told by the high bits of the tag
+static void session_route(conn_session_t *s, uint8_t *bytes, uint16_t len)
+{
+    const neu_conn_framing_t *framing =
+        s->ep->param.params.tcp_client.pool.framing;
+    uint16_t       tag   = framing->frame_tag(bytes, len);
+    conn_member_t *m     = s->members[tag >> NEU_CONN_TAG_BITS];
+    conn_frame_t * frame = NULL;
+
+    for (uint16_t i = 0; i < s->n_inflight; i++) {
+        if (s->inflight[i].tag == tag) {
+            s->n_inflight -= 1;
+            s->inflight[i] = s->inflight[s->n_inflight];
+            break;
+        }
+    }
+
+    if (m == NULL) {
+        zlog_debug(s->ep->param.log, "pool %s, drop response of tag %u",
+                   s->ep->key, tag);
+        return;
+    }
+
+    pthread_mutex_lock(&m->mtx);
+    if (m->n_inbox >= POOL_MAX_INBOX) {
+        zlog_warn(s->ep->param.log, "pool %s, slot %u inbox full", s->ep->key,
+                  m->slot);
+    } else {
+        frame      = calloc(1, sizeof(conn_frame_t) + len);
+        frame->tag = tag;
+        frame->len = len;
+        memcpy(frame->bytes, bytes, len);
+        DL_APPEND(m->inbox, frame);
+        m->n_inbox += 1;
+        notify(m->notify[1]);
+    }
+    pthread_mutex_unlock(&m->mtx);
+}
+
+static void session_recv(conn_session_t *s)
+{
+    const neu_conn_framing_t *framing =
+        s->ep->param.params.tcp_client.pool.framing;
+    uint16_t head = 0;
+    ssize_t  ret  = 0;
+
+    ret = neu_conn_recv(s->conn, s->buf + s->buf_len,
+                        sizeof(s->buf) - s->buf_len);
+    if (ret <= 0) {
+        return;
+    }
+    s->buf_len += ret;
+
+    // a read may end in the middle of a frame or carry several of them
+    while (s->buf_len > head) {
+        int size = framing->frame_size(s->buf + head, s->buf_len - head);
+
+        if (size < 0 || size > (int) sizeof(s->buf)) {
+            zlog_warn(s->ep->param.log,
+                      "pool %s, session %u, invalid frame, drop %u bytes",
+                      s->ep->key, s->index, s->buf_len - head);
+            s->buf_len = 0;
+            neu_conn_disconnect(s->conn);
+            return;
+        }
+        if (size == 0 || s->buf_len - head < size) {
+            break;
+        }
+
+        session_route(s, s->buf + head, size);
+        head += size;
+    }
+
+    memmove(s->buf, s->buf + head, s->buf_len - head);
+    s->buf_len -= head;
+}
+
+static void session_run(conn_session_t *s)
+{
+    session_sync(s);
+    session_send(s);
+    // sending connects or disconnects
+    session_sync(s);
+}
+
+static int session_conn_cb(enum neu_event_io_type type, int fd,
+                           void *usr_data)
+{
+    conn_session_t *s = (conn_session_t *) usr_data;
+    (void) fd;
+
+    pthread_mutex_lock(&s->mtx);
+    switch (type) {
+    case NEU_EVENT_IO_READ:
+        session_recv(s);
+        break;
+    case NEU_EVENT_IO_CLOSED:
+    case NEU_EVENT_IO_HUP:
+        zlog_warn(s->ep->param.log, "pool %s, session %u closed by the device",
+                  s->ep->key, s->index);
+        neu_conn_disconnect(s->conn);
+        break;
+    }
+    session_run(s);
+    pthread_mutex_unlock(&s->mtx);
+
+    return 0;
+}
+
+static int session_tick_cb(void *usr_data)
+{
+    conn_session_t *s = (conn_session_t *) usr_data;
+
+    pthread_mutex_lock(&s->mtx);
+    if (!s->closing) {
+        session_expire(s, now_ms());
+        session_run(s);
+    }
+    pthread_mutex_unlock(&s->mtx);
+
+    return 0;
+}
+
+static int session_wakeup_cb(enum neu_event_io_type type, int fd,
+                             void *usr_data)
+{
+    conn_session_t *s = (conn_session_t *) usr_data;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    drain(fd);
+
+    pthread_mutex_lock(&s->mtx);
+    if (s->closing) {
+        if (s->conn_io != NULL) {
+            neu_event_del_io(s->events, s->conn_io);
+            s->conn_io = NULL;
+        }
+        neu_event_del_timer(s->events, s->tick);
+        neu_event_del_io(s->events, s->wakeup_io);
+        s->wakeup_io = NULL;
+        pthread_cond_signal(&s->closed);
+    } else {
+        session_run(s);
+    }
+    pthread_mutex_unlock(&s->mtx);
+
+    return 0;
+}
+
+conn_member_t *conn_pool_join(neu_conn_param_t *param, void *data,
+                              neu_conn_callback connected,
+                              neu_conn_callback disconnected)
+{
+    conn_endpoint_t *ep        = NULL;
+    conn_member_t *  m         = NULL;
+    char             key[96]   = { 0 };
+    uint16_t         n_session = param->params.tcp_client.pool.sessions;
+    int              slot      = -1;
+
+    // a member not sharing has an endpoint of its own
+    if (param->params.tcp_client.pool.shared) {
+        snprintf(key, sizeof(key), "%s:%u", param->params.tcp_client.ip,
+                 param->params.tcp_client.port);
+    } else {
+        snprintf(key, sizeof(key), "%s:%u/%p", param->params.tcp_client.ip,
+                 param->params.tcp_client.port, data);
+    }
+
+    pthread_mutex_lock(&pool.mtx);
+    HASH_FIND_STR(pool.endpoints, key, ep);
+    if (ep == NULL) {
+        ep = calloc(1, sizeof(conn_endpoint_t));
+        strcpy(ep->key, key);
+        // the sessions are plain connections, non-blocking
+        ep->param                      = *param;
+        ep->param.params.tcp_client.ip = strdup(param->params.tcp_client.ip);
+        ep->param.params.tcp_client.timeout       = 0;
+        ep->param.params.tcp_client.pool.sessions = 0;
+        HASH_ADD_STR(pool.endpoints, key, ep);
+    }
+
+    for (int i = 0; i < NEU_CONN_POOL_MAX_MEMBER; i++) {
+        if (ep->members[i] == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&pool.mtx);
+        zlog_warn(param->log, "pool %s, no room for another member", key);
+        return NULL;
+    }
+
+    m = calloc(1, sizeof(conn_member_t));
+    if (pipe(m->notify) != 0) {
+        pthread_mutex_unlock(&pool.mtx);
+        zlog_error(param->log, "pool %s, create notify pipe fail", key);
+        free(m);
+        return NULL;
+    }
+    fcntl(m->notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(m->notify[1], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&m->mtx, NULL);
+
+    m->ep           = ep;
+    m->slot         = slot;
+    m->data         = data;
+    m->connected    = connected;
+    m->disconnected = disconnected;
+    m->window       = param->params.tcp_client.pool.window;
+    m->timeout      = param->params.tcp_client.pool.timeout;
+    if (m->window < 1 || m->window > NEU_CONN_POOL_MAX_WINDOW) {
+        m->window = m->window < 1 ? 1 : NEU_CONN_POOL_MAX_WINDOW;
+    }
+    if (m->timeout == 0) {
+        m->timeout = POOL_TIMEOUT;
+    }
+    if (n_session > NEU_CONN_POOL_MAX_SESSION) {
+        n_session = NEU_CONN_POOL_MAX_SESSION;
+    }
+
+    ep->members[slot] = m;
+    ep->n_member += 1;
+
+    for (uint16_t i = 0; i < n_session; i++) {
+        if (ep->sessions[i] == NULL) {
+            ep->sessions[i] = session_new(ep, i);
+        }
+        if (ep->sessions[i] == NULL) {
+            break;
+        }
+        session_attach(ep->sessions[i], m);
+        m->sessions[m->n_session++] = ep->sessions[i];
+    }
+    pthread_mutex_unlock(&pool.mtx);
+
+    if (m->n_session == 0) {
+        conn_pool_leave(m);
+        return NULL;
+    }
+
+    zlog_notice(param->log, "pool %s, member in slot %u, %u sessions", key,
+                slot, m->n_session);
+    return m;
+}
+
+void conn_pool_leave(conn_member_t *m)
+{
+    conn_endpoint_t *ep = m->ep;
+
+    pthread_mutex_lock(&pool.mtx);
+    for (uint16_t i = 0; i < m->n_session; i++) {
+        conn_session_t *s = m->sessions[i];
+
+        session_detach(s, m);
+        if (s->n_member == 0) {
+            ep->sessions[s->index] = NULL;
+            session_free(s);
+        }
+    }
+
+    ep->members[m->slot] = NULL;
+    ep->n_member -= 1;
+    if (ep->n_member == 0) {
+        HASH_DEL(pool.endpoints, ep);
+        free(ep->param.params.tcp_client.ip);
+        free(ep);
+    }
+    pthread_mutex_unlock(&pool.mtx);
+
+    frames_free(&m->inbox);
+    close(m->notify[0]);
+    close(m->notify[1]);
+    pthread_mutex_destroy(&m->mtx);
+    free(m);
+}
+
+void conn_pool_start(conn_member_t *m)
+{
+    pthread_mutex_lock(&m->mtx);
+    m->stopped = false;
+    pthread_mutex_unlock(&m->mtx);
+
+    for (uint16_t i = 0; i < m->n_session; i++) {
+        neu_conn_start(m->sessions[i]->conn);
+    }
+}
+
+// a session is stopped along with the last member running on it
+void conn_pool_stop(conn_member_t *m)
+{
+    pthread_mutex_lock(&m->mtx);
+    m->stopped = true;
+    pthread_mutex_unlock(&m->mtx);
+
+    for (uint16_t i = 0; i < m->n_session; i++) {
+        conn_session_t *s       = m->sessions[i];
+        bool            running = false;
+
+        pthread_mutex_lock(&s->mtx);
+        frames_free(&s->queue[m->slot]);
+        s->n_queued[m->slot] = 0;
+        for (int j = 0; j < NEU_CONN_POOL_MAX_MEMBER; j++) {
+            if (s->members[j] != NULL) {
+                pthread_mutex_lock(&s->members[j]->mtx);
+                running = running || !s->members[j]->stopped;
+                pthread_mutex_unlock(&s->members[j]->mtx);
+            }
+        }
+        pthread_mutex_unlock(&s->mtx);
+
+        if (!running) {
+            neu_conn_stop(s->conn);
+        }
+    }
+}
+
+void conn_pool_disconnect(conn_member_t *m)
+{
+    for (uint16_t i = 0; i < m->n_session; i++) {
+        neu_conn_disconnect(m->sessions[i]->conn);
+    }
+}
+
+// the counters of all the sessions of the member, the socket options are
+// the same on each of them
+void conn_pool_stat(conn_member_t *m, neu_conn_stat_t *stat)
+{
+    neu_conn_stat(m->sessions[0]->conn, stat);
+
+    for (uint16_t i = 1; i < m->n_session; i++) {
+        neu_conn_stat_t s = { 0 };
+
+        neu_conn_stat(m->sessions[i]->conn, &s);
+        stat->connect_attempts += s.connect_attempts;
+        stat->connect_failures += s.connect_failures;
+        if (s.connect_latency > stat->connect_latency) {
+            stat->connect_latency = s.connect_latency;
+        }
+        if (s.connect_latency_max > stat->connect_latency_max) {
+            stat->connect_latency_max = s.connect_latency_max;
+        }
+    }
+}
+
+uint16_t conn_pool_tag_base(conn_member_t *m, uint16_t *mask)
+{
+    *mask = NEU_CONN_TAG_MASK;
+    return m->slot << NEU_CONN_TAG_BITS;
+}
+
+ssize_t conn_pool_sendv(conn_member_t *m, struct iovec *iov, int n_iov)
+{
+    const neu_conn_framing_t *framing =
+        m->ep->param.params.tcp_client.pool.framing;
+    conn_session_t *s        = NULL;
+    uint64_t        deadline = now_ms() + m->timeout;
+    uint16_t        next     = 0;
+    ssize_t         len      = 0;
+
+    pthread_mutex_lock(&m->mtx);
+    if (m->stopped) {
+        pthread_mutex_unlock(&m->mtx);
+        return -1;
+    }
+    next    = m->next;
+    m->next = (m->next + 1) % m->n_session;
+    pthread_mutex_unlock(&m->mtx);
+
+    // the sessions in turn, skipping the ones not connected
+    for (uint16_t i = 0; i < m->n_session; i++) {
+        s = m->sessions[(next + i) % m->n_session];
+        pthread_mutex_lock(&s->mtx);
+        if (s->up) {
+            break;
+        }
+        pthread_mutex_unlock(&s->mtx);
+        s = NULL;
+    }
+    if (s == NULL) {
+        s = m->sessions[next];
+        pthread_mutex_lock(&s->mtx);
+    }
+
+    // only this member is backed up, the session is kept for the others
+    if (s->n_queued[m->slot] + n_iov > POOL_MAX_QUEUE) {
+        pthread_mutex_unlock(&s->mtx);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (int i = 0; i < n_iov; i++) {
+        conn_frame_t *frame = calloc(1, sizeof(conn_frame_t) + iov[i].iov_len);
+
+        frame->len      = iov[i].iov_len;
+        frame->deadline = deadline;
+        memcpy(frame->bytes, iov[i].iov_base, iov[i].iov_len);
+        frame->tag = framing->frame_tag(frame->bytes, frame->len);
+        DL_APPEND(s->queue[m->slot], frame);
+        s->n_queued[m->slot] += 1;
+        len += frame->len;
+    }
+    pthread_mutex_unlock(&s->mtx);
+
+    notify(s->wakeup[1]);
+    return len;
+}
+
+ssize_t conn_pool_recv(conn_member_t *m, uint8_t *buf, ssize_t len)
+{
+    conn_frame_t *frame = NULL, *tmp = NULL;
+    ssize_t       n     = 0;
+
+    pthread_mutex_lock(&m->mtx);
+    drain(m->notify[0]);
+    DL_FOREACH_SAFE(m->inbox, frame, tmp)
+    {
+        if (n + frame->len > len) {
+            break;
+        }
+        memcpy(buf + n, frame->bytes, frame->len);
+        n += frame->len;
+        DL_DELETE(m->inbox, frame);
+        m->n_inbox -= 1;
+        free(frame);
+    }
+    // the rest is for the next call
+    if (m->inbox != NULL) {
+        notify(m->notify[1]);
+    }
+    pthread_mutex_unlock(&m->mtx);
+
+    return n;
+}
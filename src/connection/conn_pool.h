@@ -0,0 +1,54 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#ifndef _NEU_CONN_POOL_H_
+#define _NEU_CONN_POOL_H_
+
+#include "connection/neu_connection.h"
+
+/**
+ * The process wide pool of the tcp client sessions, keyed by endpoint. A
+ * pooled neu_conn_t is a member of an endpoint, its calls are forwarded here.
+ * The fd given to the member callbacks is readable when responses are routed
+ * to the member.
+ */
+typedef struct conn_member conn_member_t;
+
+// NULL if the endpoint has no room left for another member
+conn_member_t *conn_pool_join(neu_conn_param_t *param, void *data,
+                              neu_conn_callback connected,
+                              neu_conn_callback disconnected);
+void           conn_pool_leave(conn_member_t *member);
+
+void conn_pool_start(conn_member_t *member);
+void conn_pool_stop(conn_member_t *member);
+// drop the sessions of the member, the other members sharing them included
+void conn_pool_disconnect(conn_member_t *member);
+// summed over the sessions of the member
+void conn_pool_stat(conn_member_t *member, neu_conn_stat_t *stat);
+
+uint16_t conn_pool_tag_base(conn_member_t *member, uint16_t *mask);
+
+// the buffers are queued whole, or not at all and -1 with errno EAGAIN when
+// the queue of the member is full
+ssize_t conn_pool_sendv(conn_member_t *member, struct iovec *iov, int n_iov);
+// whole frames only
+ssize_t conn_pool_recv(conn_member_t *member, uint8_t *buf, ssize_t len);
+
+#endif
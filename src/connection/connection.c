@@ -17,14 +17,24 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
 
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sendmmsg, recvmmsg
+#endif
+
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
 
 #include <fcntl.h>
 #include <termios.h>
@@ -33,6 +43,14 @@
 
 #include "connection/neu_connection.h"
 
+#include "conn_pool.h"
+
+// the connect timeout of a non-blocking tcp client
+#define CONN_CONNECT_TIMEOUT 5000 // ms
+// the attempts failing in a row are spaced by a doubling backoff
+#define CONN_BACKOFF_MIN 100   // ms
+#define CONN_BACKOFF_MAX 10000 // ms
+
 struct tcp_client {
     int                fd;
     struct sockaddr_in client;
@@ -44,15 +62,42 @@ struct neu_conn {
     bool             is_connected;
     bool             stop;
 
+    // a pooled tcp client, only data and the callbacks are set besides
+    conn_member_t *member;
+
     neu_conn_callback connected;
     neu_conn_callback disconnected;
     bool              callback_trigger;
 
+    // mtx guards the state (fd, connect, disconnect, parameters), send_mtx
+    // and recv_mtx serialize the senders and the receivers. The blocking send
+    // and recv are done without mtx, a sender and a receiver make progress at
+    // the same time. Lock order: send_mtx, recv_mtx, mtx.
     pthread_mutex_t mtx;
+    pthread_mutex_t send_mtx;
+    pthread_mutex_t recv_mtx;
 
     int  fd;
     bool block;
 
+    // the fd of the send or recv in progress, -1 if none. Closing one of them
+    // is left to the side using it, after a shutdown woke it up, so that the
+    // fd number is not reused under a blocked send or recv.
+    int  send_fd;
+    int  recv_fd;
+    bool send_close;
+    bool recv_close;
+    // conn->buf is only touched by the receivers
+    bool buf_reset;
+
+    // a tcp client connects without blocking, send and recv complete the
+    // connect, and fail fast until next_connect after a failure
+    bool            connecting;
+    uint64_t        connect_start; // ms
+    uint64_t        next_connect;  // ms
+    uint64_t        backoff;       // ms
+    neu_conn_stat_t stat;
+
     struct {
         struct tcp_client *clients;
         int                n_client;
@@ -72,17 +117,57 @@ static void conn_tcp_server_listen(neu_conn_t *conn);
 static void conn_tcp_server_stop(neu_conn_t *conn);
 
 static void conn_connect(neu_conn_t *conn);
+static void conn_connect_check(neu_conn_t *conn);
+static void conn_connect_done(neu_conn_t *conn);
+static void conn_connect_fail(neu_conn_t *conn);
+static void conn_tune(neu_conn_t *conn, int fd);
+static void conn_tune_get(neu_conn_t *conn, int fd);
 static void conn_disconnect(neu_conn_t *conn);
 
 static void conn_free_param(neu_conn_t *conn);
 static void conn_init_param(neu_conn_t *conn, neu_conn_param_t *param);
 
+static void    conn_close_fd(neu_conn_t *conn, int fd);
+static void    conn_io_end(int *fd, bool *close_fd, int other_fd);
+static void    conn_buf_sync(neu_conn_t *conn);
+static void    conn_connect_wait(neu_conn_t *conn, int *fd, bool *close_fd,
+                                 int *other_fd);
+static ssize_t conn_recv(neu_conn_t *conn, uint8_t *buf, ssize_t len);
+static ssize_t conn_tcp_server_recv(neu_conn_t *conn, int fd, uint8_t *buf,
+                                    ssize_t len);
+
+static uint64_t now_ms()
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool conn_pooled(neu_conn_param_t *param)
+{
+    return param->type == NEU_CONN_TCP_CLIENT &&
+        param->params.tcp_client.pool.sessions > 0;
+}
+
 neu_conn_t *neu_conn_new(neu_conn_param_t *param, void *data,
                          neu_conn_callback connected,
                          neu_conn_callback disconnected)
 {
     neu_conn_t *conn = calloc(1, sizeof(neu_conn_t));
 
+    if (conn_pooled(param)) {
+        conn->member = conn_pool_join(param, data, connected, disconnected);
+        if (conn->member != NULL) {
+            conn->data         = data;
+            conn->connected    = connected;
+            conn->disconnected = disconnected;
+            return conn;
+        }
+        zlog_warn(param->log, "%s:%d connect outside of the pool",
+                  param->params.tcp_client.ip, param->params.tcp_client.port);
+    }
+
     conn_init_param(conn, param);
     conn->is_connected     = false;
     conn->callback_trigger = false;
@@ -94,16 +179,25 @@ neu_conn_t *neu_conn_new(neu_conn_param_t *param, void *data,
     conn->buf      = calloc(conn->buf_size, 1);
     conn->offset   = 0;
     conn->stop     = false;
+    conn->send_fd  = -1;
+    conn->recv_fd  = -1;
 
     conn_tcp_server_listen(conn);
 
     pthread_mutex_init(&conn->mtx, NULL);
+    pthread_mutex_init(&conn->send_mtx, NULL);
+    pthread_mutex_init(&conn->recv_mtx, NULL);
 
     return conn;
 }
 
 void neu_conn_stop(neu_conn_t *conn)
 {
+    if (conn->member != NULL) {
+        conn_pool_stop(conn->member);
+        return;
+    }
+
     pthread_mutex_lock(&conn->mtx);
     conn->stop = true;
     conn_disconnect(conn);
@@ -112,6 +206,11 @@ void neu_conn_stop(neu_conn_t *conn)
 
 void neu_conn_start(neu_conn_t *conn)
 {
+    if (conn->member != NULL) {
+        conn_pool_start(conn->member);
+        return;
+    }
+
     pthread_mutex_lock(&conn->mtx);
     conn->stop = false;
     pthread_mutex_unlock(&conn->mtx);
@@ -119,8 +218,24 @@ void neu_conn_start(neu_conn_t *conn)
 
 neu_conn_t *neu_conn_reconfig(neu_conn_t *conn, neu_conn_param_t *param)
 {
+    // another endpoint, or in or out of the pool
+    if (conn->member != NULL || conn_pooled(param)) {
+        void *            data         = conn->data;
+        neu_conn_callback connected    = conn->connected;
+        neu_conn_callback disconnected = conn->disconnected;
+
+        neu_conn_destory(conn);
+        return neu_conn_new(param, data, connected, disconnected);
+    }
+
+    // wake up the send and recv in progress before waiting for them
+    pthread_mutex_lock(&conn->mtx);
+    conn_disconnect(conn);
+    pthread_mutex_unlock(&conn->mtx);
+
+    pthread_mutex_lock(&conn->send_mtx);
+    pthread_mutex_lock(&conn->recv_mtx);
     pthread_mutex_lock(&conn->mtx);
-    (void) param;
 
     conn_disconnect(conn);
     conn_free_param(conn);
@@ -129,22 +244,43 @@ neu_conn_t *neu_conn_reconfig(neu_conn_t *conn, neu_conn_param_t *param)
     conn_init_param(conn, param);
     conn_tcp_server_listen(conn);
 
+    // a new device is tried at once
+    conn->backoff      = 0;
+    conn->next_connect = 0;
+
     pthread_mutex_unlock(&conn->mtx);
+    pthread_mutex_unlock(&conn->recv_mtx);
+    pthread_mutex_unlock(&conn->send_mtx);
 
     return conn;
 }
 
 void neu_conn_destory(neu_conn_t *conn)
 {
-    pthread_mutex_lock(&conn->mtx);
+    if (conn->member != NULL) {
+        conn_pool_leave(conn->member);
+        free(conn);
+        return;
+    }
 
+    pthread_mutex_lock(&conn->mtx);
     conn_tcp_server_stop(conn);
     conn_disconnect(conn);
+    pthread_mutex_unlock(&conn->mtx);
+
+    pthread_mutex_lock(&conn->send_mtx);
+    pthread_mutex_lock(&conn->recv_mtx);
+    pthread_mutex_lock(&conn->mtx);
+
     conn_free_param(conn);
 
     pthread_mutex_unlock(&conn->mtx);
+    pthread_mutex_unlock(&conn->recv_mtx);
+    pthread_mutex_unlock(&conn->send_mtx);
 
     pthread_mutex_destroy(&conn->mtx);
+    pthread_mutex_destroy(&conn->send_mtx);
+    pthread_mutex_destroy(&conn->recv_mtx);
 
     free(conn->buf);
     free(conn);
@@ -190,6 +326,8 @@ int neu_conn_tcp_server_accept(neu_conn_t *conn)
         setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
     }
 
+    conn_tune(conn, fd);
+    conn_tune_get(conn, fd);
     conn_tcp_server_add_client(conn, fd, client);
 
     conn->is_connected = true;
@@ -226,16 +364,24 @@ ssize_t neu_conn_tcp_server_send(neu_conn_t *conn, int fd, uint8_t *buf,
 {
     ssize_t ret = 0;
 
+    pthread_mutex_lock(&conn->send_mtx);
     pthread_mutex_lock(&conn->mtx);
     if (conn->stop) {
         pthread_mutex_unlock(&conn->mtx);
+        pthread_mutex_unlock(&conn->send_mtx);
         return ret;
     }
 
     conn_tcp_server_listen(conn);
+    conn->send_fd = fd;
+    pthread_mutex_unlock(&conn->mtx);
+
     ret = send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
 
+    pthread_mutex_lock(&conn->mtx);
+    conn_io_end(&conn->send_fd, &conn->send_close, conn->recv_fd);
     pthread_mutex_unlock(&conn->mtx);
+    pthread_mutex_unlock(&conn->send_mtx);
 
     return ret;
 }
@@ -245,11 +391,25 @@ ssize_t neu_conn_tcp_server_recv(neu_conn_t *conn, int fd, uint8_t *buf,
 {
     ssize_t ret = 0;
 
+    pthread_mutex_lock(&conn->recv_mtx);
+    ret = conn_tcp_server_recv(conn, fd, buf, len);
+    pthread_mutex_unlock(&conn->recv_mtx);
+
+    return ret;
+}
+
+static ssize_t conn_tcp_server_recv(neu_conn_t *conn, int fd, uint8_t *buf,
+                                    ssize_t len)
+{
+    ssize_t ret = 0;
+
     pthread_mutex_lock(&conn->mtx);
     if (conn->stop) {
         pthread_mutex_unlock(&conn->mtx);
         return ret;
     }
+    conn->recv_fd = fd;
+    pthread_mutex_unlock(&conn->mtx);
 
     if (conn->block) {
         ret = recv(fd, buf, len, MSG_WAITALL);
@@ -257,50 +417,56 @@ ssize_t neu_conn_tcp_server_recv(neu_conn_t *conn, int fd, uint8_t *buf,
         ret = recv(fd, buf, len, 0);
     }
 
+    pthread_mutex_lock(&conn->mtx);
+    conn_io_end(&conn->recv_fd, &conn->recv_close, conn->send_fd);
     pthread_mutex_unlock(&conn->mtx);
 
     return ret;
 }
 
-ssize_t neu_conn_send(neu_conn_t *conn, uint8_t *buf, ssize_t len)
+// with send_mtx held, returns the fd to send on, -1 if there is none
+static int conn_send_begin(neu_conn_t *conn)
 {
-    ssize_t ret = 0;
+    int fd = -1;
 
     pthread_mutex_lock(&conn->mtx);
     if (conn->stop) {
         pthread_mutex_unlock(&conn->mtx);
-        return ret;
+        return -1;
     }
 
-    if (!conn->is_connected) {
+    if (!conn->is_connected && !conn->connecting &&
+        now_ms() >= conn->next_connect) {
         conn_connect(conn);
     }
 
+    conn_connect_wait(conn, &conn->send_fd, &conn->send_close,
+                      &conn->recv_fd);
     if (conn->is_connected) {
-        switch (conn->param.type) {
-        case NEU_CONN_TCP_SERVER:
-            assert(false);
-            break;
-        case NEU_CONN_TCP_CLIENT:
-        case NEU_CONN_UDP:
-            if (conn->block) {
-                ret = send(conn->fd, buf, len, MSG_NOSIGNAL);
-            } else {
-                ret = send(conn->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
-            }
-            break;
-        case NEU_CONN_TTY_CLIENT:
-            ret = write(conn->fd, buf, len);
-            break;
-        }
-        if (ret != len) {
-            zlog_error(conn->param.log,
-                       "conn fd: %d, send buf len: %zd, ret: %zd, "
-                       "errno: %s(%d)",
-                       conn->fd, len, ret, strerror(errno), errno);
-        }
+        fd            = conn->fd;
+        conn->send_fd = fd;
+    }
+    pthread_mutex_unlock(&conn->mtx);
 
-        if (ret == -1 && errno != EAGAIN) {
+    return fd;
+}
+
+static void conn_send_end(neu_conn_t *conn, int fd, ssize_t ret, ssize_t len,
+                          int err)
+{
+    pthread_mutex_lock(&conn->mtx);
+    conn_io_end(&conn->send_fd, &conn->send_close, conn->recv_fd);
+
+    if (ret != len) {
+        zlog_error(conn->param.log,
+                   "conn fd: %d, send buf len: %zd, ret: %zd, "
+                   "errno: %s(%d)",
+                   fd, len, ret, strerror(err), err);
+    }
+
+    // the connection could have been closed and opened again meanwhile
+    if (fd == conn->fd) {
+        if (ret == -1 && err != EAGAIN) {
             conn_disconnect(conn);
         }
 
@@ -311,6 +477,114 @@ ssize_t neu_conn_send(neu_conn_t *conn, uint8_t *buf, ssize_t len)
     }
 
     pthread_mutex_unlock(&conn->mtx);
+}
+
+ssize_t neu_conn_send(neu_conn_t *conn, uint8_t *buf, ssize_t len)
+{
+    ssize_t ret = 0;
+    int     fd  = 0;
+
+    if (conn->member != NULL) {
+        struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+        return conn_pool_sendv(conn->member, &iov, 1);
+    }
+
+    pthread_mutex_lock(&conn->send_mtx);
+    fd = conn_send_begin(conn);
+    if (fd < 0) {
+        pthread_mutex_unlock(&conn->send_mtx);
+        return ret;
+    }
+
+    switch (conn->param.type) {
+    case NEU_CONN_TCP_SERVER:
+        assert(false);
+        break;
+    case NEU_CONN_TCP_CLIENT:
+    case NEU_CONN_UDP:
+        if (conn->block) {
+            ret = send(fd, buf, len, MSG_NOSIGNAL);
+        } else {
+            ret = send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        break;
+    case NEU_CONN_TTY_CLIENT:
+        ret = write(fd, buf, len);
+        break;
+    }
+
+    conn_send_end(conn, fd, ret, len, errno);
+    pthread_mutex_unlock(&conn->send_mtx);
+
+    return ret;
+}
+
+ssize_t neu_conn_sendv(neu_conn_t *conn, struct iovec *iov, int n_iov)
+{
+    ssize_t ret   = 0;
+    ssize_t len   = 0;
+    int     fd    = 0;
+    int     flags = conn->block ? MSG_NOSIGNAL : MSG_NOSIGNAL | MSG_DONTWAIT;
+
+    if (n_iov < 1 || n_iov > NEU_CONN_MAX_IOV) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (conn->member != NULL) {
+        return conn_pool_sendv(conn->member, iov, n_iov);
+    }
+
+    for (int i = 0; i < n_iov; i++) {
+        len += iov[i].iov_len;
+    }
+
+    pthread_mutex_lock(&conn->send_mtx);
+    fd = conn_send_begin(conn);
+    if (fd < 0) {
+        pthread_mutex_unlock(&conn->send_mtx);
+        return ret;
+    }
+
+    switch (conn->param.type) {
+    case NEU_CONN_TCP_SERVER:
+        assert(false);
+        break;
+    case NEU_CONN_TCP_CLIENT: {
+        struct msghdr msg = {
+            .msg_iov    = iov,
+            .msg_iovlen = n_iov,
+        };
+
+        ret = sendmsg(fd, &msg, flags);
+        break;
+    }
+    case NEU_CONN_UDP: {
+        struct mmsghdr msgs[NEU_CONN_MAX_IOV] = { 0 };
+        int            n                      = 0;
+
+        for (int i = 0; i < n_iov; i++) {
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        n = sendmmsg(fd, msgs, n_iov, flags);
+        for (int i = 0; i < n; i++) {
+            ret += msgs[i].msg_len;
+        }
+        if (n < 0) {
+            ret = -1;
+        }
+        break;
+    }
+    case NEU_CONN_TTY_CLIENT:
+        ret = writev(fd, iov, n_iov);
+        break;
+    }
+
+    conn_send_end(conn, fd, ret, len, errno);
+    pthread_mutex_unlock(&conn->send_mtx);
 
     return ret;
 }
@@ -319,9 +593,92 @@ ssize_t neu_conn_recv(neu_conn_t *conn, uint8_t *buf, ssize_t len)
 {
     ssize_t ret = 0;
 
+    if (conn->member != NULL) {
+        return conn_pool_recv(conn->member, buf, len);
+    }
+
+    pthread_mutex_lock(&conn->recv_mtx);
+    ret = conn_recv(conn, buf, len);
+    pthread_mutex_unlock(&conn->recv_mtx);
+
+    return ret;
+}
+
+// with recv_mtx held, returns the fd to recv on, or -1 and the value to
+// return in ret
+static int conn_recv_begin(neu_conn_t *conn, ssize_t *ret)
+{
+    int fd = 0;
+
     pthread_mutex_lock(&conn->mtx);
     if (conn->stop) {
         pthread_mutex_unlock(&conn->mtx);
+        *ret = 0;
+        return -1;
+    }
+
+    conn_connect_wait(conn, &conn->recv_fd, &conn->recv_close,
+                      &conn->send_fd);
+    if (conn->connecting) {
+        pthread_mutex_unlock(&conn->mtx);
+        errno = EAGAIN;
+        *ret  = -1;
+        return -1;
+    }
+    // backing off before the next connect, conn->fd is not a socket
+    if (!conn->is_connected) {
+        pthread_mutex_unlock(&conn->mtx);
+        errno = ENOTCONN;
+        *ret  = -1;
+        return -1;
+    }
+
+    fd            = conn->fd;
+    conn->recv_fd = fd;
+    pthread_mutex_unlock(&conn->mtx);
+
+    return fd;
+}
+
+static void conn_recv_end(neu_conn_t *conn, int fd, ssize_t ret, ssize_t len,
+                          int err)
+{
+    pthread_mutex_lock(&conn->mtx);
+    conn_io_end(&conn->recv_fd, &conn->recv_close, conn->send_fd);
+
+    if (ret == -1 && !conn->block && (err == EAGAIN || err == EWOULDBLOCK)) {
+        // nothing to read yet
+        pthread_mutex_unlock(&conn->mtx);
+        return;
+    }
+
+    if (ret <= 0) {
+        zlog_error(conn->param.log,
+                   "conn fd: %d, recv buf len %zd, ret: %zd, errno: %s(%d)",
+                   fd, len, ret, strerror(err), err);
+    }
+
+    // the connection could have been closed and opened again meanwhile
+    if (fd == conn->fd) {
+        if (err == EPIPE || ret <= 0) {
+            conn_disconnect(conn);
+        }
+
+        if (ret > 0 && conn->callback_trigger == false) {
+            conn->connected(conn->data, conn->fd);
+            conn->callback_trigger = true;
+        }
+    }
+
+    pthread_mutex_unlock(&conn->mtx);
+}
+
+static ssize_t conn_recv(neu_conn_t *conn, uint8_t *buf, ssize_t len)
+{
+    ssize_t ret = 0;
+    int     fd  = conn_recv_begin(conn, &ret);
+
+    if (fd < 0) {
         return ret;
     }
 
@@ -332,45 +689,107 @@ ssize_t neu_conn_recv(neu_conn_t *conn, uint8_t *buf, ssize_t len)
         break;
     case NEU_CONN_TCP_CLIENT:
         if (conn->block) {
-            ret = recv(conn->fd, buf, len, MSG_WAITALL);
+            ret = recv(fd, buf, len, MSG_WAITALL);
         } else {
-            ret = recv(conn->fd, buf, len, 0);
+            ret = recv(fd, buf, len, 0);
         }
         break;
     case NEU_CONN_UDP:
-        ret = recv(conn->fd, buf, len, 0);
+        ret = recv(fd, buf, len, 0);
         break;
     case NEU_CONN_TTY_CLIENT:
-        ret = read(conn->fd, buf, len);
+        ret = read(fd, buf, len);
         break;
     }
-    if (ret <= 0) {
-        zlog_error(conn->param.log,
-                   "conn fd: %d, recv buf len %zd, ret: %zd, errno: %s(%d)",
-                   conn->fd, len, ret, strerror(errno), errno);
+
+    conn_recv_end(conn, fd, ret, len, errno);
+    return ret;
+}
+
+int neu_conn_recvv(neu_conn_t *conn, struct iovec *iov, int n_iov)
+{
+    struct mmsghdr msgs[NEU_CONN_MAX_IOV] = { 0 };
+    ssize_t        ret                    = 0;
+    ssize_t        len                    = 0;
+    int            fd                     = 0;
+    int            n                      = 0;
+
+    if (n_iov < 1 || n_iov > NEU_CONN_MAX_IOV) {
+        errno = EINVAL;
+        return -1;
     }
 
-    if (errno == EPIPE || ret <= 0) {
-        conn_disconnect(conn);
+    // a stream is read into the first buffer only
+    if (conn->param.type != NEU_CONN_UDP) {
+        ret = neu_conn_recv(conn, iov[0].iov_base, iov[0].iov_len);
+        if (ret > 0) {
+            iov[0].iov_len = ret;
+            return 1;
+        }
+        return ret;
     }
 
-    if (ret > 0 && conn->callback_trigger == false) {
-        conn->connected(conn->data, conn->fd);
-        conn->callback_trigger = true;
+    for (int i = 0; i < n_iov; i++) {
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        len += iov[i].iov_len;
     }
 
-    pthread_mutex_unlock(&conn->mtx);
+    pthread_mutex_lock(&conn->recv_mtx);
+    fd = conn_recv_begin(conn, &ret);
+    if (fd < 0) {
+        pthread_mutex_unlock(&conn->recv_mtx);
+        return ret;
+    }
 
-    return ret;
+    // only the first datagram is waited for
+    n = recvmmsg(fd, msgs, n_iov, conn->block ? MSG_WAITFORONE : MSG_DONTWAIT,
+                 NULL);
+    ret = n;
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_len = msgs[i].msg_len;
+    }
+
+    conn_recv_end(conn, fd, ret, len, errno);
+    pthread_mutex_unlock(&conn->recv_mtx);
+
+    return n;
 }
 
 void neu_conn_disconnect(neu_conn_t *conn)
 {
+    if (conn->member != NULL) {
+        conn_pool_disconnect(conn->member);
+        return;
+    }
+
     pthread_mutex_lock(&conn->mtx);
     conn_disconnect(conn);
     pthread_mutex_unlock(&conn->mtx);
 }
 
+void neu_conn_stat(neu_conn_t *conn, neu_conn_stat_t *stat)
+{
+    if (conn->member != NULL) {
+        conn_pool_stat(conn->member, stat);
+        return;
+    }
+
+    pthread_mutex_lock(&conn->mtx);
+    *stat = conn->stat;
+    pthread_mutex_unlock(&conn->mtx);
+}
+
+uint16_t neu_conn_tag_base(neu_conn_t *conn, uint16_t *mask)
+{
+    if (conn->member != NULL) {
+        return conn_pool_tag_base(conn->member, mask);
+    }
+
+    *mask = UINT16_MAX;
+    return 0;
+}
+
 static void conn_free_param(neu_conn_t *conn)
 {
     switch (conn->param.type) {
@@ -396,6 +815,7 @@ static void conn_init_param(neu_conn_t *conn, neu_conn_param_t *param)
 {
     conn->param.type = param->type;
     conn->param.log  = param->log;
+    conn->param.tune = param->tune;
 
     switch (param->type) {
     case NEU_CONN_TCP_SERVER:
@@ -409,6 +829,8 @@ static void conn_init_param(neu_conn_t *conn, neu_conn_param_t *param)
             param->params.tcp_server.start_listen;
         conn->param.params.tcp_server.stop_listen =
             param->params.tcp_server.stop_listen;
+        conn->param.params.tcp_server.reuse_port =
+            param->params.tcp_server.reuse_port;
         conn->tcp_server.clients = calloc(
             conn->param.params.tcp_server.max_link, sizeof(struct tcp_client));
         if (conn->param.params.tcp_server.timeout > 0) {
@@ -459,6 +881,11 @@ static void conn_tcp_server_listen(neu_conn_t *conn)
             .sin_addr.s_addr = inet_addr(conn->param.params.tcp_server.ip),
         };
 
+        if (conn->param.params.tcp_server.reuse_port) {
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+
         ret = bind(fd, (struct sockaddr *) &local, sizeof(local));
         if (ret != 0) {
             close(fd);
@@ -468,7 +895,8 @@ static void conn_tcp_server_listen(neu_conn_t *conn)
             return;
         }
 
-        ret = listen(fd, 1);
+        // clients reconnecting all at once are not refused
+        ret = listen(fd, conn->param.params.tcp_server.max_link);
         if (ret != 0) {
             close(fd);
             zlog_error(conn->param.log, "tcp bind %s:%d fail, errno: %s",
@@ -499,7 +927,7 @@ static void conn_tcp_server_stop(neu_conn_t *conn)
 
         for (int i = 0; i < conn->param.params.tcp_server.max_link; i++) {
             if (conn->tcp_server.clients[i].fd > 0) {
-                close(conn->tcp_server.clients[i].fd);
+                conn_close_fd(conn, conn->tcp_server.clients[i].fd);
                 conn->tcp_server.clients[i].fd = 0;
             }
         }
@@ -522,25 +950,19 @@ static void conn_connect(neu_conn_t *conn)
     case NEU_CONN_TCP_SERVER:
         break;
     case NEU_CONN_TCP_CLIENT: {
-        if (conn->block) {
-            struct timeval tv = {
-                .tv_sec = conn->param.params.tcp_client.timeout / 1000,
-                .tv_usec =
-                    (conn->param.params.tcp_client.timeout % 1000) * 1000,
-            };
-
-            fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-        } else {
-            fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
-        }
         struct sockaddr_in remote = {
             .sin_family      = AF_INET,
             .sin_port        = htons(conn->param.params.tcp_client.port),
             .sin_addr.s_addr = inet_addr(conn->param.params.tcp_client.ip),
         };
 
+        // completed by conn_connect_check, the blocking mode is set then
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+        // the buffer sizes are set before connect to take part in the window
+        conn_tune(conn, fd);
+        conn->stat.connect_attempts += 1;
+        conn->connect_start = now_ms();
+
         ret = connect(fd, (struct sockaddr *) &remote,
                       sizeof(struct sockaddr_in));
         if (ret != 0 && errno != EINPROGRESS) {
@@ -550,13 +972,15 @@ static void conn_connect(neu_conn_t *conn)
                        conn->param.params.tcp_client.port, strerror(errno),
                        errno);
             conn->is_connected = false;
+            conn_connect_fail(conn);
             return;
+        }
+
+        conn->fd = fd;
+        if (ret == 0) {
+            conn_connect_done(conn);
         } else {
-            zlog_info(conn->param.log, "connect %s:%d success",
-                      conn->param.params.tcp_client.ip,
-                      conn->param.params.tcp_client.port);
-            conn->is_connected = true;
-            conn->fd           = fd;
+            conn->connecting = true;
         }
         break;
     }
@@ -576,6 +1000,7 @@ static void conn_connect(neu_conn_t *conn)
         int so_broadcast = 1;
         setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &so_broadcast,
                    sizeof(so_broadcast));
+        conn_tune(conn, fd);
         struct sockaddr_in local = {
             .sin_family      = AF_INET,
             .sin_port        = htons(conn->param.params.udp.src_port),
@@ -589,6 +1014,7 @@ static void conn_connect(neu_conn_t *conn)
                        conn->param.params.udp.src_ip,
                        conn->param.params.udp.src_port, strerror(errno), errno);
             conn->is_connected = false;
+            conn_connect_fail(conn);
             return;
         }
 
@@ -605,6 +1031,7 @@ static void conn_connect(neu_conn_t *conn)
                        conn->param.params.udp.dst_ip,
                        conn->param.params.udp.dst_port, strerror(errno), errno);
             conn->is_connected = false;
+            conn_connect_fail(conn);
             return;
         } else {
             zlog_info(conn->param.log, "connect %s:%d success",
@@ -612,6 +1039,7 @@ static void conn_connect(neu_conn_t *conn)
                       conn->param.params.udp.dst_port);
             conn->is_connected = true;
             conn->fd           = fd;
+            conn_tune_get(conn, fd);
         }
         break;
     }
@@ -623,6 +1051,7 @@ static void conn_connect(neu_conn_t *conn)
             zlog_error(conn->param.log, "open %s error: %s(%d)",
                        conn->param.params.tty_client.device, strerror(errno),
                        errno);
+            conn_connect_fail(conn);
             return;
         }
 
@@ -748,13 +1177,120 @@ static void conn_connect(neu_conn_t *conn)
     }
 }
 
+static uint64_t conn_connect_timeout(neu_conn_t *conn)
+{
+    return conn->param.params.tcp_client.timeout > 0
+        ? conn->param.params.tcp_client.timeout
+        : CONN_CONNECT_TIMEOUT;
+}
+
+// with mtx held, mtx is released while a blocking send or recv waits for the
+// connect in progress
+static void conn_connect_wait(neu_conn_t *conn, int *fd, bool *close_fd,
+                              int *other_fd)
+{
+    if (conn->connecting && conn->block) {
+        struct pollfd pfd  = { .fd = conn->fd, .events = POLLOUT };
+        uint64_t      used = now_ms() - conn->connect_start;
+
+        if (used < conn_connect_timeout(conn)) {
+            *fd = conn->fd;
+            pthread_mutex_unlock(&conn->mtx);
+            poll(&pfd, 1, conn_connect_timeout(conn) - used);
+            pthread_mutex_lock(&conn->mtx);
+            conn_io_end(fd, close_fd, *other_fd);
+        }
+    }
+
+    if (conn->connecting) {
+        conn_connect_check(conn);
+    }
+}
+
+static void conn_connect_check(neu_conn_t *conn)
+{
+    struct pollfd pfd = { .fd = conn->fd, .events = POLLOUT };
+    int           err = 0;
+    socklen_t     len = sizeof(err);
+
+    if (poll(&pfd, 1, 0) == 0) {
+        if (now_ms() - conn->connect_start < conn_connect_timeout(conn)) {
+            return;
+        }
+        err = ETIMEDOUT;
+    } else if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+        err = errno;
+    }
+
+    if (err == 0) {
+        conn_connect_done(conn);
+        return;
+    }
+
+    zlog_error(conn->param.log, "connect %s:%d error: %s(%d)",
+               conn->param.params.tcp_client.ip,
+               conn->param.params.tcp_client.port, strerror(err), err);
+    conn_close_fd(conn, conn->fd);
+    conn->fd         = 0;
+    conn->connecting = false;
+    conn_connect_fail(conn);
+}
+
+static void conn_connect_done(neu_conn_t *conn)
+{
+    uint64_t latency = now_ms() - conn->connect_start;
+
+    if (conn->block) {
+        struct timeval tv = {
+            .tv_sec  = conn->param.params.tcp_client.timeout / 1000,
+            .tv_usec = (conn->param.params.tcp_client.timeout % 1000) * 1000,
+        };
+
+        fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) & ~O_NONBLOCK);
+        setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    conn->connecting   = false;
+    conn->is_connected = true;
+    conn->backoff      = 0;
+    conn_tune_get(conn, conn->fd);
+
+    conn->stat.connect_latency = latency;
+    if (latency > conn->stat.connect_latency_max) {
+        conn->stat.connect_latency_max = latency;
+    }
+
+    zlog_info(conn->param.log, "connect %s:%d success, %" PRIu64 " ms",
+              conn->param.params.tcp_client.ip,
+              conn->param.params.tcp_client.port, latency);
+}
+
+static void conn_connect_fail(neu_conn_t *conn)
+{
+    conn->stat.connect_failures += 1;
+
+    if (conn->backoff == 0) {
+        conn->backoff = CONN_BACKOFF_MIN;
+    } else if (conn->backoff * 2 <= CONN_BACKOFF_MAX) {
+        conn->backoff *= 2;
+    } else {
+        conn->backoff = CONN_BACKOFF_MAX;
+    }
+
+    // half of the backoff is random, the connections to a device restarted
+    // do not all come back at once
+    conn->next_connect =
+        now_ms() + conn->backoff / 2 + rand() % (conn->backoff / 2 + 1);
+}
+
 static void conn_disconnect(neu_conn_t *conn)
 {
     switch (conn->param.type) {
     case NEU_CONN_TCP_SERVER:
         for (int i = 0; i < conn->param.params.tcp_server.max_link; i++) {
             if (conn->tcp_server.clients[i].fd > 0) {
-                close(conn->tcp_server.clients[i].fd);
+                conn_close_fd(conn, conn->tcp_server.clients[i].fd);
                 conn->tcp_server.clients[i].fd = 0;
             }
         }
@@ -763,19 +1299,60 @@ static void conn_disconnect(neu_conn_t *conn)
     case NEU_CONN_UDP:
     case NEU_CONN_TTY_CLIENT:
         if (conn->fd > 0) {
-            close(conn->fd);
+            conn_close_fd(conn, conn->fd);
             conn->fd = 0;
         }
         break;
     }
 
     conn->is_connected = false;
+    conn->connecting   = false;
     if (conn->callback_trigger == true) {
         conn->disconnected(conn->data, conn->fd);
         conn->callback_trigger = false;
     }
-    conn->offset = 0;
-    memset(conn->buf, 0, conn->buf_size);
+    conn->buf_reset = true;
+}
+
+static void conn_close_fd(neu_conn_t *conn, int fd)
+{
+    if (fd != conn->send_fd && fd != conn->recv_fd) {
+        close(fd);
+        return;
+    }
+
+    // the blocked send or recv returns at once, and closes the fd
+    shutdown(fd, SHUT_RDWR);
+    if (fd == conn->send_fd) {
+        conn->send_close = true;
+    }
+    if (fd == conn->recv_fd) {
+        conn->recv_close = true;
+    }
+}
+
+// with mtx held, after the send or recv on *fd returned
+static void conn_io_end(int *fd, bool *close_fd, int other_fd)
+{
+    // when the other side uses the fd too, it is closed by the other side
+    if (*close_fd && *fd != other_fd) {
+        close(*fd);
+    }
+
+    *close_fd = false;
+    *fd       = -1;
+}
+
+// with recv_mtx held, drop the bytes of a previous connection
+static void conn_buf_sync(neu_conn_t *conn)
+{
+    pthread_mutex_lock(&conn->mtx);
+    if (conn->buf_reset) {
+        conn->buf_reset = false;
+        conn->offset    = 0;
+        memset(conn->buf, 0, conn->buf_size);
+    }
+    pthread_mutex_unlock(&conn->mtx);
 }
 
 static void conn_tcp_server_add_client(neu_conn_t *conn, int fd,
@@ -798,7 +1375,7 @@ static void conn_tcp_server_del_client(neu_conn_t *conn, int fd)
 {
     for (int i = 0; i < conn->param.params.tcp_server.max_link; i++) {
         if (conn->tcp_server.clients[i].fd == fd) {
-            close(fd);
+            conn_close_fd(conn, fd);
             conn->tcp_server.clients[i].fd = 0;
             conn->tcp_server.n_client -= 1;
             return;
@@ -811,8 +1388,11 @@ static void conn_tcp_server_del_client(neu_conn_t *conn, int fd)
 void neu_conn_stream_consume(neu_conn_t *conn, void *context,
                              neu_conn_stream_consume_fn fn)
 {
-    ssize_t ret = neu_conn_recv(conn, conn->buf + conn->offset,
-                                conn->buf_size - conn->offset);
+    pthread_mutex_lock(&conn->recv_mtx);
+    conn_buf_sync(conn);
+
+    ssize_t ret = conn_recv(conn, conn->buf + conn->offset,
+                            conn->buf_size - conn->offset);
     if (ret > 0) {
         zlog_recv_protocol(conn->param.log, conn->buf + conn->offset, ret);
         conn->offset += ret;
@@ -839,13 +1419,18 @@ void neu_conn_stream_consume(neu_conn_t *conn, void *context,
                     conn->offset);
         }
     }
+
+    pthread_mutex_unlock(&conn->recv_mtx);
 }
 
 void neu_conn_stream_tcp_server_consume(neu_conn_t *conn, int fd, void *context,
                                         neu_conn_stream_consume_fn fn)
 {
-    ssize_t ret = neu_conn_tcp_server_recv(conn, fd, conn->buf + conn->offset,
-                                           conn->buf_size - conn->offset);
+    pthread_mutex_lock(&conn->recv_mtx);
+    conn_buf_sync(conn);
+
+    ssize_t ret = conn_tcp_server_recv(conn, fd, conn->buf + conn->offset,
+                                       conn->buf_size - conn->offset);
     if (ret > 0) {
         conn->offset += ret;
         neu_protocol_unpack_buf_t protocol_buf = { 0 };
@@ -869,14 +1454,21 @@ void neu_conn_stream_tcp_server_consume(neu_conn_t *conn, int fd, void *context,
                     conn->offset);
         }
     }
+
+    pthread_mutex_unlock(&conn->recv_mtx);
 }
 
 int neu_conn_wait_msg(neu_conn_t *conn, void *context, uint16_t n_byte,
                       neu_conn_process_msg fn)
 {
-    ssize_t                   ret  = neu_conn_recv(conn, conn->buf, n_byte);
+    ssize_t                   ret  = 0;
     neu_protocol_unpack_buf_t pbuf = { 0 };
-    conn->offset                   = 0;
+
+    pthread_mutex_lock(&conn->recv_mtx);
+    conn_buf_sync(conn);
+
+    ret          = conn_recv(conn, conn->buf, n_byte);
+    conn->offset = 0;
 
     while (ret > 0) {
         zlog_recv_protocol(conn->param.log, conn->buf + conn->offset, ret);
@@ -885,21 +1477,28 @@ int neu_conn_wait_msg(neu_conn_t *conn, void *context, uint16_t n_byte,
         neu_buf_result_t result = fn(context, &pbuf);
         if (result.need > 0) {
             assert(result.need <= conn->buf_size - conn->offset);
-            ret = neu_conn_recv(conn, conn->buf + conn->offset, result.need);
+            ret = conn_recv(conn, conn->buf + conn->offset, result.need);
         } else {
-            return result.used;
+            ret = result.used;
+            break;
         }
     }
 
+    pthread_mutex_unlock(&conn->recv_mtx);
     return ret;
 }
 
 int neu_conn_tcp_server_wait_msg(neu_conn_t *conn, int fd, void *context,
                                  uint16_t n_byte, neu_conn_process_msg fn)
 {
-    ssize_t ret = neu_conn_tcp_server_recv(conn, fd, conn->buf, n_byte);
+    ssize_t                   ret  = 0;
     neu_protocol_unpack_buf_t pbuf = { 0 };
-    conn->offset                   = 0;
+
+    pthread_mutex_lock(&conn->recv_mtx);
+    conn_buf_sync(conn);
+
+    ret          = conn_tcp_server_recv(conn, fd, conn->buf, n_byte);
+    conn->offset = 0;
 
     while (ret > 0) {
         zlog_recv_protocol(conn->param.log, conn->buf + conn->offset, ret);
@@ -908,12 +1507,96 @@ int neu_conn_tcp_server_wait_msg(neu_conn_t *conn, int fd, void *context,
         neu_buf_result_t result = fn(context, &pbuf);
         if (result.need > 0) {
             assert(result.need <= conn->buf_size - conn->offset);
-            ret = neu_conn_tcp_server_recv(conn, fd, conn->buf + conn->offset,
-                                           result.need);
+            ret = conn_tcp_server_recv(conn, fd, conn->buf + conn->offset,
+                                       result.need);
         } else {
-            return result.used;
+            ret = result.used;
+            break;
         }
     }
 
+    pthread_mutex_unlock(&conn->recv_mtx);
     return ret;
-}
\ No newline at end of file
+}
+
+static void conn_setsockopt(neu_conn_t *conn, int fd, int level, int name,
+                            const char *opt, int value)
+{
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+        zlog_warn(conn->param.log, "fd: %d, set %s %d error: %s(%d)", fd, opt,
+                  value, strerror(errno), errno);
+    }
+}
+
+static void conn_tune(neu_conn_t *conn, int fd)
+{
+    neu_conn_tune_t *tune = &conn->param.tune;
+    bool             tcp  = conn->param.type != NEU_CONN_UDP;
+
+    if (tcp && tune->nodelay) {
+        conn_setsockopt(conn, fd, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
+    }
+    if (tcp && tune->keepalive_idle > 0) {
+        conn_setsockopt(conn, fd, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+        conn_setsockopt(conn, fd, IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE",
+                        tune->keepalive_idle);
+        if (tune->keepalive_interval > 0) {
+            conn_setsockopt(conn, fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                            "TCP_KEEPINTVL", tune->keepalive_interval);
+        }
+        if (tune->keepalive_count > 0) {
+            conn_setsockopt(conn, fd, IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT",
+                            tune->keepalive_count);
+        }
+    }
+    if (tcp && tune->user_timeout > 0) {
+        conn_setsockopt(conn, fd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                        "TCP_USER_TIMEOUT", tune->user_timeout);
+    }
+    if (tune->rcvbuf > 0) {
+        conn_setsockopt(conn, fd, SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF",
+                        tune->rcvbuf);
+    }
+    if (tune->sndbuf > 0) {
+        conn_setsockopt(conn, fd, SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF",
+                        tune->sndbuf);
+    }
+    if (tune->busy_poll > 0) {
+        // raising it over net.core.busy_read needs CAP_NET_ADMIN
+        conn_setsockopt(conn, fd, SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL",
+                        tune->busy_poll);
+    }
+}
+
+static int conn_getsockopt(int fd, int level, int name)
+{
+    int       value = 0;
+    socklen_t len   = sizeof(value);
+
+    if (getsockopt(fd, level, name, &value, &len) != 0) {
+        return 0;
+    }
+    return value;
+}
+
+static void conn_tune_get(neu_conn_t *conn, int fd)
+{
+    neu_conn_tune_t *tune = &conn->stat.tune;
+
+    memset(tune, 0, sizeof(*tune));
+    tune->rcvbuf    = conn_getsockopt(fd, SOL_SOCKET, SO_RCVBUF);
+    tune->sndbuf    = conn_getsockopt(fd, SOL_SOCKET, SO_SNDBUF);
+    tune->busy_poll = conn_getsockopt(fd, SOL_SOCKET, SO_BUSY_POLL);
+    if (conn->param.type == NEU_CONN_UDP) {
+        return;
+    }
+
+    tune->nodelay      = conn_getsockopt(fd, IPPROTO_TCP, TCP_NODELAY) != 0;
+    tune->user_timeout = conn_getsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT);
+    if (conn_getsockopt(fd, SOL_SOCKET, SO_KEEPALIVE) != 0) {
+        tune->keepalive_idle = conn_getsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE);
+        tune->keepalive_interval =
+            conn_getsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL);
+        tune->keepalive_count = conn_getsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT);
+    }
+}
@@ -16,6 +16,7 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
+#include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -26,6 +27,7 @@
 #include "event/event.h"
 #include "persist/persist.h"
 #include "utils/log.h"
+#include "utils/time.h"
 
 #include "adapter.h"
 #include "adapter/adapter_internal.h"
@@ -46,15 +48,18 @@
 
 static const char *const url = "inproc://neu_manager";
 
-static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data);
+static int  manager_loop(enum neu_event_io_type type, int fd, void *usr_data);
+static void manager_dispatch(void *usr_data, nng_msg *msg);
 inline static void reply(neu_manager_t *manager, neu_reqresp_head_t *header,
                          void *data);
 inline static void forward_msg_dup(neu_manager_t *manager, nng_msg *msg,
                                    nng_pipe pipe);
-inline static void forward_msg(neu_manager_t *manager, nng_msg *msg,
+inline static int  forward_msg(neu_manager_t *manager, nng_msg *msg,
                                const char *ndoe);
 static void start_static_adapter(neu_manager_t *manager, const char *name);
 static int  report_nodes_state(void *usr_data);
+static void startup_check(neu_manager_t *manager);
+static void startup_subscribe(neu_manager_t *manager);
 static void start_single_adapter(neu_manager_t *manager, const char *name,
                                  const char *plugin_name, bool display);
 
@@ -72,6 +77,9 @@ neu_manager_t *neu_manager_create()
         .cb          = report_nodes_state,
     };
 
+    manager->startup.begin = neu_time_ms();
+    nng_mtx_alloc(&manager->startup_mtx);
+
     manager->events            = neu_event_new();
     manager->plugin_manager    = neu_plugin_manager_create();
     manager->node_manager      = neu_node_manager_create();
@@ -89,7 +97,9 @@ neu_manager_t *neu_manager_create()
     nng_socket_set_int(manager->socket, NNG_OPT_RECVBUF, 2048);
     nng_socket_set_int(manager->socket, NNG_OPT_SENDBUF, 2048);
     nng_socket_get_int(manager->socket, NNG_OPT_RECVFD, &param.fd);
-    manager->loop = neu_event_add_io(manager->events, param);
+    manager->lanes = neu_msg_lanes_new(manager->socket, manager->events,
+                                       manager_dispatch, manager);
+    manager->loop  = neu_event_add_io(manager->events, param);
 
     start_static_adapter(manager, DEFAULT_DASHBOARD_PLUGIN_NAME);
     start_static_adapter(manager, DEFAULT_MONITOR_PLUGIN_NAME);
@@ -108,10 +118,12 @@ neu_manager_t *neu_manager_create()
     }
     utarray_free(single_plugins);
 
+    manager->startup.plugins = neu_time_ms();
+
     manager_load_node(manager);
-    while (neu_node_manager_exist_uninit(manager->node_manager)) {
-        usleep(1000 * 100);
-    }
+    nng_mtx_lock(manager->startup_mtx);
+    manager->startup.nodes = neu_time_ms();
+    nng_mtx_unlock(manager->startup_mtx);
 
     manager_load_subscribe(manager);
 
@@ -149,6 +161,8 @@ void neu_manager_destroy(neu_manager_t *manager)
         }
     }
 
+    manager_free_pending_subscribe(manager);
+    nng_mtx_free(manager->startup_mtx);
     neu_sub_msg_manager_destroy(manager->sub_msg_manager);
     neu_persister_destroy(manager->persister);
     neu_subscribe_manager_destroy(manager->subscribe_manager);
@@ -157,6 +171,7 @@ void neu_manager_destroy(neu_manager_t *manager)
 
     nng_close(manager->socket);
     neu_event_del_io(manager->events, manager->loop);
+    neu_msg_lanes_free(manager->lanes);
     neu_event_close(manager->events);
 
     free(manager);
@@ -170,40 +185,48 @@ const char *neu_manager_get_url()
 
 static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
 {
-    neu_manager_t *     manager = (neu_manager_t *) usr_data;
-    int                 rv      = 0;
-    nng_msg *           msg     = NULL;
-    neu_reqresp_head_t *header  = NULL;
+    neu_manager_t *manager = (neu_manager_t *) usr_data;
 
     if (type == NEU_EVENT_IO_CLOSED || type == NEU_EVENT_IO_HUP) {
         nlog_warn("manager socket(%d) recv closed or hup %d.", fd, type);
         return 0;
     }
 
-    rv = nng_recvmsg(manager->socket, &msg, NNG_FLAG_NONBLOCK);
-    if (rv != 0) {
-        nlog_warn("manager recv msg error: %d", rv);
-        return 0;
-    }
+    neu_msg_lanes_run(manager->lanes);
+    return 0;
+}
 
-    header = (neu_reqresp_head_t *) nng_msg_body(msg);
+static void manager_dispatch(void *usr_data, nng_msg *msg)
+{
+    neu_manager_t *     manager = (neu_manager_t *) usr_data;
+    neu_reqresp_head_t *header  = (neu_reqresp_head_t *) nng_msg_body(msg);
 
     nlog_info("manager recv msg from: %s to %s, type: %s", header->sender,
               header->receiver, neu_reqresp_type_string(header->type));
     switch (header->type) {
-    case NEU_REQRESP_TRANS_DATA: {
+    case NEU_REQRESP_TRANS_DATA:
+    case NEU_REQRESP_TRANS_DATA_PACKED: {
+        // both of them start with the driver and group name
         neu_reqresp_trans_data_t *cmd = (neu_reqresp_trans_data_t *) &header[1];
-        UT_array *apps = neu_subscribe_manager_find(manager->subscribe_manager,
-                                                    cmd->driver, cmd->group);
+        neu_subscribe_table_t *   table =
+            neu_subscribe_manager_acquire(manager->subscribe_manager);
+        UT_array *apps =
+            neu_subscribe_table_find(table, cmd->driver, cmd->group);
+        // filtered trans data is addressed to a single app, the full one
+        // goes to every app without a tag filter
+        bool filtered = strlen(header->receiver) > 0;
         if (apps != NULL) {
             utarray_foreach(apps, neu_app_subscribe_t *, app)
             {
+                if (filtered ? strcmp(header->receiver, app->app_name) != 0
+                             : app->filtered) {
+                    continue;
+                }
                 forward_msg_dup(manager, msg, app->pipe);
                 nlog_debug("forward trans data to pipe: %d", app->pipe.id);
             }
-            utarray_free(apps);
-            break;
         }
+        neu_subscribe_manager_release(manager->subscribe_manager, table);
         break;
     }
     case NEU_REQ_UPDATE_LICENSE: {
@@ -232,6 +255,7 @@ static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
         }
 
         nlog_notice("bind node %s to pipe(%d)", init->node, pipe.id);
+        startup_subscribe(manager);
         break;
     }
     case NEU_REQ_ADD_PLUGIN: {
@@ -359,13 +383,19 @@ static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
         neu_req_subscribe_t *cmd   = (neu_req_subscribe_t *) &header[1];
         neu_resp_error_t     error = { 0 };
 
-        error.error =
-            neu_manager_subscribe(manager, cmd->app, cmd->driver, cmd->group);
+        error.error = neu_manager_subscribe(manager, cmd->app, cmd->driver,
+                                            cmd->group, cmd->n_filter,
+                                            cmd->filters);
 
         if (error.error == NEU_ERR_SUCCESS) {
             manager_storage_subscribe(manager, cmd->app, cmd->driver,
-                                      cmd->group);
+                                      cmd->group, cmd->n_filter, cmd->filters);
+        }
+
+        for (int i = 0; i < cmd->n_filter; i++) {
+            free(cmd->filters[i]);
         }
+        free(cmd->filters);
 
         header->type = NEU_RESP_ERROR;
         strcpy(header->receiver, header->sender);
@@ -455,11 +485,24 @@ static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
 
         break;
     }
+    case NEU_REQ_GET_NODE_STAT:
+        if (strcmp(header->receiver, "manager") == 0) {
+            // the manager only reports its own message lanes
+            neu_resp_get_node_stat_t resp = { .type = NEU_NA_TYPE_APP };
+
+            neu_msg_lanes_node_stat(manager->lanes, resp.data);
+            header->type = NEU_RESP_GET_NODE_STAT;
+            neu_msg_exchange(header);
+            reply(manager, header, &resp);
+            break;
+        }
+        // fall through
+    case NEU_REQ_NODE_CAPTURE:
+    case NEU_REQ_GET_NODE_CAPTURE:
     case NEU_REQ_GET_GROUP:
     case NEU_REQ_GET_NODE_SETTING:
     case NEU_REQ_READ_GROUP:
     case NEU_REQ_WRITE_TAG:
-    case NEU_REQ_GET_NODE_STAT:
     case NEU_REQ_GET_NODE_STATE:
     case NEU_REQ_GET_TAG:
     case NEU_REQ_NODE_CTL:
@@ -551,12 +594,39 @@ static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
         break;
     }
 
+    case NEU_REQ_GET_TAG_DICT:
+        // issued by the adapter itself, nobody waits for an error reply
+        if (neu_node_manager_find(manager->node_manager, header->receiver) !=
+            NULL) {
+            forward_msg(manager, msg, header->receiver);
+        }
+        break;
+    case NEU_RESP_GET_TAG_DICT: {
+        neu_resp_get_tag_dict_t *dict = (neu_resp_get_tag_dict_t *) &header[1];
+
+        // the app may be deleted while the dictionary is on its way
+        if (neu_node_manager_find(manager->node_manager, header->receiver) ==
+                NULL ||
+            forward_msg(manager, msg, header->receiver) != 0) {
+            utarray_free(dict->names);
+        }
+        break;
+    }
+    case NEU_RESP_SUBSCRIBE_GROUP: {
+        neu_resp_subscribe_t *resp = (neu_resp_subscribe_t *) &header[1];
+
+        // the app may have unsubscribed in the meantime
+        neu_subscribe_manager_filtered(manager->subscribe_manager,
+                                       resp->driver, resp->app, resp->group);
+        break;
+    }
     case NEU_RESP_ADD_TAG:
     case NEU_RESP_UPDATE_TAG:
     case NEU_RESP_GET_TAG:
     case NEU_RESP_GET_GROUP:
     case NEU_RESP_GET_NODE_SETTING:
     case NEU_RESP_GET_NODE_STAT:
+    case NEU_RESP_GET_NODE_CAPTURE:
     case NEU_RESP_GET_NODE_STATE:
     case NEU_RESP_ERROR:
     case NEU_RESP_READ_GROUP:
@@ -568,7 +638,6 @@ static int manager_loop(enum neu_event_io_type type, int fd, void *usr_data)
     }
 
     nng_msg_free(msg);
-    return 0;
 }
 
 inline static void forward_msg_dup(neu_manager_t *manager, nng_msg *msg,
@@ -585,8 +654,8 @@ inline static void forward_msg_dup(neu_manager_t *manager, nng_msg *msg,
     }
 }
 
-inline static void forward_msg(neu_manager_t *manager, nng_msg *msg,
-                               const char *node)
+inline static int forward_msg(neu_manager_t *manager, nng_msg *msg,
+                              const char *node)
 {
     nng_msg *out_msg;
     nng_pipe pipe = neu_node_manager_get_pipe(manager->node_manager, node);
@@ -595,9 +664,52 @@ inline static void forward_msg(neu_manager_t *manager, nng_msg *msg,
     nng_msg_set_pipe(out_msg, pipe);
     if (nng_sendmsg(manager->socket, out_msg, 0) == 0) {
         nlog_info("forward msg to %s", node);
+        return 0;
     } else {
         nng_msg_free(out_msg);
+        return -1;
+    }
+}
+
+// the persisted subscriptions change the subscribe manager, so they are only
+// applied on the manager thread, each one as soon as its app and driver are
+// bound
+static void startup_subscribe(neu_manager_t *manager)
+{
+    manager_apply_subscribe(manager);
+    startup_check(manager);
+}
+
+static void startup_check(neu_manager_t *manager)
+{
+    neu_manager_startup_t *st = &manager->startup;
+
+    nng_mtx_lock(manager->startup_mtx);
+    if (st->reported || st->nodes == 0) {
+        nng_mtx_unlock(manager->startup_mtx);
+        return;
+    }
+
+    if (st->ready == 0 &&
+        !neu_node_manager_exist_uninit(manager->node_manager)) {
+        st->ready = neu_time_ms();
+    }
+    if (st->subscribed == 0 && manager->pending_subs == NULL) {
+        st->subscribed = neu_time_ms();
+    }
+
+    if (st->ready != 0 && st->subscribed != 0) {
+        uint64_t end = st->ready > st->subscribed ? st->ready : st->subscribed;
+
+        nlog_notice("startup %" PRIu64 " ms, plugins: %" PRIu64
+                    " ms, adapters: %" PRIu64 " ms, nodes ready: %" PRIu64
+                    " ms, subscriptions: %" PRIu64 " ms",
+                    end - st->begin, st->plugins - st->begin,
+                    st->nodes - st->plugins, st->ready - st->nodes,
+                    st->subscribed - st->nodes);
+        st->reported = true;
     }
+    nng_mtx_unlock(manager->startup_mtx);
 }
 
 static void start_static_adapter(neu_manager_t *manager, const char *name)
@@ -669,6 +781,8 @@ static int report_nodes_state(void *usr_data)
     UT_array *     apps    = neu_sub_msg_manager_get(manager->sub_msg_manager,
                                              NEU_SUBSCRIBE_NODES_STATE);
 
+    // the last node may be bound before the subscriptions are loaded
+    startup_subscribe(manager);
     neu_manager_count_tag(manager);
     if (apps == NULL) {
         return 0;
@@ -16,6 +16,8 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
+#include <pthread.h>
+
 #include "utils/log.h"
 
 #include "adapter.h"
@@ -41,14 +43,26 @@ UT_array *neu_manager_get_plugins(neu_manager_t *manager)
     return neu_plugin_manager_get(manager->plugin_manager);
 }
 
-int neu_manager_add_node(neu_manager_t *manager, const char *node_name,
-                         const char *plugin_name, bool start)
+// number of threads creating the adapters at startup
+#define NODE_BOOT_WORKERS 8
+
+typedef struct node_boot {
+    neu_adapter_info_t info;
+    bool               start;
+    neu_adapter_t *    adapter;
+} node_boot_t;
+
+typedef struct node_boot_ctx {
+    node_boot_t *boots;
+    int          n_boot;
+    int          next;
+    nng_mtx *    mtx;
+} node_boot_ctx_t;
+
+static int node_instance(neu_manager_t *manager, const char *node_name,
+                         const char *           plugin_name,
+                         neu_plugin_instance_t *instance)
 {
-    neu_adapter_t *       adapter      = NULL;
-    neu_plugin_instance_t instance     = { 0 };
-    neu_adapter_info_t    adapter_info = {
-        .name = node_name,
-    };
     neu_resp_plugin_info_t info = { 0 };
     int                    ret =
         neu_plugin_manager_find(manager->plugin_manager, plugin_name, &info);
@@ -61,36 +75,139 @@ int neu_manager_add_node(neu_manager_t *manager, const char *node_name,
         return NEU_ERR_LIBRARY_NOT_ALLOW_CREATE_INSTANCE;
     }
 
-    adapter = neu_node_manager_find(manager->node_manager, node_name);
-    if (adapter != NULL) {
+    if (neu_node_manager_find(manager->node_manager, node_name) != NULL) {
         return NEU_ERR_NODE_EXIST;
     }
 
     ret = neu_plugin_manager_create_instance(manager->plugin_manager,
-                                             plugin_name, &instance);
+                                             plugin_name, instance);
     if (ret != 0) {
         return NEU_ERR_LIBRARY_FAILED_TO_OPEN;
     }
-    adapter_info.handle = instance.handle;
-    adapter_info.module = instance.module;
 
-    adapter = neu_adapter_create(&adapter_info);
+    return NEU_ERR_SUCCESS;
+}
+
+static void node_register(neu_manager_t *manager, neu_adapter_t *adapter)
+{
     neu_node_manager_add(manager->node_manager, adapter);
-    neu_adapter_init(adapter, start);
 
-    if (instance.module->type == NEU_NA_TYPE_APP) {
+    if (adapter->module->type == NEU_NA_TYPE_APP) {
         for (int i = 0; i < NEU_APP_SUBSCRIBE_MSG_SIZE; i++) {
-            if (instance.module->sub_msg[i] != 0) {
+            if (adapter->module->sub_msg[i] != 0) {
                 neu_sub_msg_manager_add(manager->sub_msg_manager,
-                                        instance.module->sub_msg[i],
+                                        adapter->module->sub_msg[i],
                                         adapter->name);
             }
         }
     }
+}
+
+static void *node_boot_worker(void *arg)
+{
+    node_boot_ctx_t *ctx = (node_boot_ctx_t *) arg;
+
+    while (true) {
+        nng_mtx_lock(ctx->mtx);
+        int i = ctx->next++;
+        nng_mtx_unlock(ctx->mtx);
+
+        if (i >= ctx->n_boot) {
+            break;
+        }
+
+        // loads the setting, groups and tags of the node from the database
+        ctx->boots[i].adapter = neu_adapter_create(&ctx->boots[i].info);
+    }
+
+    return NULL;
+}
+
+int neu_manager_add_node(neu_manager_t *manager, const char *node_name,
+                         const char *plugin_name, bool start)
+{
+    neu_adapter_t *       adapter      = NULL;
+    neu_plugin_instance_t instance     = { 0 };
+    neu_adapter_info_t    adapter_info = {
+        .name = node_name,
+    };
+    int ret = node_instance(manager, node_name, plugin_name, &instance);
+
+    if (ret != NEU_ERR_SUCCESS) {
+        return ret;
+    }
+    adapter_info.handle = instance.handle;
+    adapter_info.module = instance.module;
+
+    adapter = neu_adapter_create(&adapter_info);
+    node_register(manager, adapter);
+    neu_adapter_init(adapter, start);
 
     return NEU_ERR_SUCCESS;
 }
 
+int neu_manager_add_nodes(neu_manager_t *manager, UT_array *node_infos)
+{
+    node_boot_ctx_t ctx      = { 0 };
+    pthread_t       workers[NODE_BOOT_WORKERS];
+    int             n_worker = 0;
+    int             n_node   = 0;
+
+    ctx.boots = calloc(utarray_len(node_infos) + 1, sizeof(node_boot_t));
+    utarray_foreach(node_infos, neu_persist_node_info_t *, node_info)
+    {
+        neu_plugin_instance_t instance = { 0 };
+        node_boot_t *         boot     = NULL;
+        int ret = node_instance(manager, node_info->name,
+                                node_info->plugin_name, &instance);
+
+        if (ret != NEU_ERR_SUCCESS) {
+            nlog_warn("load adapter fail, name:%s plugin:%s error:%d",
+                      node_info->name, node_info->plugin_name, ret);
+            continue;
+        }
+
+        boot              = &ctx.boots[ctx.n_boot++];
+        boot->info.name   = node_info->name;
+        boot->info.handle = instance.handle;
+        boot->info.module = instance.module;
+        boot->start = (node_info->state == NEU_NODE_RUNNING_STATE_RUNNING);
+    }
+
+    nng_mtx_alloc(&ctx.mtx);
+    for (; n_worker < NODE_BOOT_WORKERS && n_worker < ctx.n_boot;
+         n_worker++) {
+        if (pthread_create(&workers[n_worker], NULL, node_boot_worker, &ctx) !=
+            0) {
+            break;
+        }
+    }
+    // no worker thread, create the adapters on the caller thread
+    if (n_worker == 0) {
+        node_boot_worker(&ctx);
+    }
+    for (int i = 0; i < n_worker; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    nng_mtx_free(ctx.mtx);
+
+    // the adapters are bound to the manager pipe in NEU_REQ_NODE_INIT, so
+    // every node is registered before any of them sends it
+    for (int i = 0; i < ctx.n_boot; i++) {
+        node_register(manager, ctx.boots[i].adapter);
+    }
+    for (int i = 0; i < ctx.n_boot; i++) {
+        neu_adapter_init(ctx.boots[i].adapter, ctx.boots[i].start);
+        nlog_info("load adapter success, name:%s plugin:%s auto start:%d",
+                  ctx.boots[i].info.name, ctx.boots[i].info.module->module_name,
+                  ctx.boots[i].start);
+    }
+
+    n_node = ctx.n_boot;
+    free(ctx.boots);
+    return n_node;
+}
+
 int neu_manager_del_node(neu_manager_t *manager, const char *node_name)
 {
     neu_adapter_t *adapter =
@@ -101,6 +218,9 @@ int neu_manager_del_node(neu_manager_t *manager, const char *node_name)
     }
 
     if (adapter->module->type == NEU_NA_TYPE_APP) {
+        UT_array *groups =
+            neu_subscribe_manager_get(manager->subscribe_manager, node_name);
+
         for (int i = 0; i < NEU_APP_SUBSCRIBE_MSG_SIZE; i++) {
             if (adapter->module->sub_msg[i] != 0) {
                 neu_sub_msg_manager_del(manager->sub_msg_manager,
@@ -108,6 +228,14 @@ int neu_manager_del_node(neu_manager_t *manager, const char *node_name)
                                         adapter->name);
             }
         }
+
+        // the drivers keep a filter entry for every subscribed app
+        utarray_foreach(groups, neu_resp_subscribe_info_t *, info)
+        {
+            neu_manager_unsubscribe(manager, node_name, info->driver,
+                                    info->group);
+        }
+        utarray_free(groups);
     }
 
     neu_adapter_destroy(adapter);
@@ -179,8 +307,26 @@ void neu_manager_count_tag(neu_manager_t *manager)
     utarray_free(drivers);
 }
 
+static void notify_driver(neu_manager_t *manager, neu_reqresp_type_e type,
+                          const char *driver, void *data)
+{
+    neu_reqresp_head_t header = { .type = type };
+    nng_msg *          msg    = NULL;
+
+    strcpy(header.sender, "manager");
+    strcpy(header.receiver, driver);
+
+    msg = neu_msg_gen(&header, data);
+    nng_msg_set_pipe(msg,
+                     neu_node_manager_get_pipe(manager->node_manager, driver));
+    if (nng_sendmsg(manager->socket, msg, 0) != 0) {
+        nng_msg_free(msg);
+    }
+}
+
 int neu_manager_subscribe(neu_manager_t *manager, const char *app,
-                          const char *driver, const char *group)
+                          const char *driver, const char *group,
+                          uint16_t n_filter, char **filters)
 {
     int            ret  = NEU_ERR_SUCCESS;
     nng_pipe       pipe = { 0 };
@@ -203,15 +349,44 @@ int neu_manager_subscribe(neu_manager_t *manager, const char *app,
     }
 
     pipe = neu_node_manager_get_pipe(manager->node_manager, app);
-    return neu_subscribe_manager_sub(manager->subscribe_manager, driver, app,
-                                     group, pipe);
+    ret  = neu_subscribe_manager_sub(manager->subscribe_manager, driver, app,
+                                    group, pipe, n_filter > 0);
+    if (ret == NEU_ERR_SUCCESS) {
+        // the driver owns its copy of the filters
+        neu_req_subscribe_t cmd = { .n_filter = n_filter };
+
+        strcpy(cmd.app, app);
+        strcpy(cmd.driver, driver);
+        strcpy(cmd.group, group);
+        if (n_filter > 0) {
+            cmd.filters = calloc(n_filter, sizeof(char *));
+            for (int i = 0; i < n_filter; i++) {
+                cmd.filters[i] = strdup(filters[i]);
+            }
+        }
+
+        notify_driver(manager, NEU_REQ_SUBSCRIBE_GROUP, driver, &cmd);
+    }
+
+    return ret;
 }
 
 int neu_manager_unsubscribe(neu_manager_t *manager, const char *app,
                             const char *driver, const char *group)
 {
-    return neu_subscribe_manager_unsub(manager->subscribe_manager, driver, app,
-                                       group);
+    int ret = neu_subscribe_manager_unsub(manager->subscribe_manager, driver,
+                                          app, group);
+
+    if (ret == NEU_ERR_SUCCESS) {
+        neu_req_unsubscribe_t cmd = { 0 };
+
+        strcpy(cmd.app, app);
+        strcpy(cmd.driver, driver);
+        strcpy(cmd.group, group);
+        notify_driver(manager, NEU_REQ_UNSUBSCRIBE_GROUP, driver, &cmd);
+    }
+
+    return ret;
 }
 
 UT_array *neu_manager_get_sub_group(neu_manager_t *manager, const char *app)
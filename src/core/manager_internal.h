@@ -26,15 +26,27 @@
 #include "event/event.h"
 #include "persist/persist.h"
 
+#include "msg_lane.h"
 #include "node_manager.h"
 #include "plugin_manager.h"
 #include "sub_msg.h"
 #include "subscribe.h"
 
+// timestamps (ms) of the startup phases
+typedef struct neu_manager_startup {
+    uint64_t begin;
+    uint64_t plugins;    // plugins loaded
+    uint64_t nodes;      // adapters created
+    uint64_t ready;      // every node bound to the manager
+    uint64_t subscribed; // every loaded subscription applied
+    bool     reported;
+} neu_manager_startup_t;
+
 typedef struct neu_manager {
     nng_socket         socket;
     neu_events_t *     events;
     neu_event_io_t *   loop;
+    neu_msg_lanes_t *  lanes;
     neu_event_timer_t *timer;
 
     neu_plugin_manager_t *plugin_manager;
@@ -43,6 +55,13 @@ typedef struct neu_manager {
     neu_sub_msg_mgr_t *   sub_msg_manager;
 
     neu_persister_t *persister;
+
+    // guards the subscriptions waiting for their nodes and the startup
+    // phases, they are updated by both the caller of neu_manager_create
+    // and the manager loop
+    nng_mtx *                   startup_mtx;
+    struct manager_pending_sub *pending_subs;
+    neu_manager_startup_t       startup;
 } neu_manager_t;
 
 int       neu_manager_add_plugin(neu_manager_t *manager, const char *library);
@@ -52,6 +71,9 @@ UT_array *neu_manager_get_plugins(neu_manager_t *manager);
 int       neu_manager_add_node(neu_manager_t *manager, const char *node_name,
                                const char *plugin_name, bool start);
 int       neu_manager_del_node(neu_manager_t *manager, const char *node_name);
+// create the adapters of the persisted nodes concurrently, return the number
+// of nodes added
+int       neu_manager_add_nodes(neu_manager_t *manager, UT_array *node_infos);
 UT_array *neu_manager_get_nodes(neu_manager_t *manager, neu_node_type_e type);
 
 UT_array *neu_manager_get_driver_group(neu_manager_t *manager);
@@ -59,7 +81,8 @@ UT_array *neu_manager_get_driver_group(neu_manager_t *manager);
 void neu_manager_count_tag(neu_manager_t *manager);
 
 int       neu_manager_subscribe(neu_manager_t *manager, const char *app,
-                                const char *driver, const char *group);
+                                const char *driver, const char *group,
+                                uint16_t n_filter, char **filters);
 int       neu_manager_unsubscribe(neu_manager_t *manager, const char *app,
                                   const char *driver, const char *group);
 UT_array *neu_manager_get_sub_group(neu_manager_t *manager, const char *app);
@@ -0,0 +1,274 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/log.h"
+#include "utils/utlist.h"
+
+#include "msg_lane.h"
+
+// messages dispatched in one round, the rest is left for the next round so
+// that the timers on the same event thread are not starved
+#define LANE_ROUND_BUDGET 256
+// the socket is not drained any more when the bulk lane is this deep, the
+// senders are then blocked by the socket buffer
+#define LANE_BULK_MAX 1024
+
+typedef struct lane_msg {
+    nng_msg *msg;
+    uint64_t timestamp;
+
+    struct lane_msg *prev;
+    struct lane_msg *next;
+} lane_msg_t;
+
+typedef struct lane {
+    lane_msg_t *        msgs;
+    neu_msg_lane_stat_t stat;
+} lane_t;
+
+struct neu_msg_lanes {
+    nng_socket           sock;
+    neu_msg_lane_handler handler;
+    void *               usr_data;
+
+    lane_t lanes[NEU_MSG_LANE_MAX];
+
+    // rounds stopped by the budget are resumed by the wakeup pipe
+    neu_events_t *  events;
+    neu_event_io_t *wakeup_io;
+    int             wakeup[2];
+    bool            armed;
+    bool            closed;
+};
+
+static int wakeup_cb(enum neu_event_io_type type, int fd, void *usr_data);
+
+static uint64_t now_us()
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+neu_msg_lanes_t *neu_msg_lanes_new(nng_socket sock, neu_events_t *events,
+                                   neu_msg_lane_handler handler,
+                                   void *               usr_data)
+{
+    neu_msg_lanes_t *    lanes = calloc(1, sizeof(neu_msg_lanes_t));
+    neu_event_io_param_t param = {
+        .usr_data = (void *) lanes,
+        .cb       = wakeup_cb,
+    };
+
+    lanes->sock     = sock;
+    lanes->handler  = handler;
+    lanes->usr_data = usr_data;
+    lanes->events   = events;
+
+    if (pipe(lanes->wakeup) != 0) {
+        nlog_error("msg lanes create wakeup pipe fail");
+        free(lanes);
+        return NULL;
+    }
+    fcntl(lanes->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(lanes->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    param.fd         = lanes->wakeup[0];
+    lanes->wakeup_io = neu_event_add_io(events, param);
+
+    return lanes;
+}
+
+void neu_msg_lanes_free(neu_msg_lanes_t *lanes)
+{
+    neu_msg_lanes_close(lanes);
+
+    close(lanes->wakeup[0]);
+    close(lanes->wakeup[1]);
+    free(lanes);
+}
+
+void neu_msg_lanes_close(neu_msg_lanes_t *lanes)
+{
+    lane_msg_t *lm = NULL, *tmp = NULL;
+
+    if (lanes->closed) {
+        return;
+    }
+
+    lanes->closed = true;
+    neu_event_del_io(lanes->events, lanes->wakeup_io);
+
+    for (int i = 0; i < NEU_MSG_LANE_MAX; i++) {
+        DL_FOREACH_SAFE(lanes->lanes[i].msgs, lm, tmp)
+        {
+            DL_DELETE(lanes->lanes[i].msgs, lm);
+            nng_msg_free(lm->msg);
+            free(lm);
+        }
+        lanes->lanes[i].stat.depth = 0;
+    }
+}
+
+neu_msg_lane_e neu_msg_lane_of(neu_reqresp_type_e type)
+{
+    switch (type) {
+    case NEU_REQRESP_TRANS_DATA:
+    case NEU_REQRESP_TRANS_DATA_PACKED:
+    case NEU_REQRESP_NODES_STATE:
+        return NEU_MSG_LANE_BULK;
+    default:
+        return NEU_MSG_LANE_CTRL;
+    }
+}
+
+void neu_msg_lanes_stat(neu_msg_lanes_t *lanes, neu_msg_lane_e lane,
+                        neu_msg_lane_stat_t *stat)
+{
+    *stat = lanes->lanes[lane].stat;
+}
+
+void neu_msg_lanes_node_stat(neu_msg_lanes_t *lanes,
+                             uint64_t         data[NEU_NODE_STAT_MAX])
+{
+    neu_msg_lane_stat_t *ctrl = &lanes->lanes[NEU_MSG_LANE_CTRL].stat;
+    neu_msg_lane_stat_t *bulk = &lanes->lanes[NEU_MSG_LANE_BULK].stat;
+
+    data[NEU_NODE_STAT_CTRL_DEPTH]       = ctrl->depth;
+    data[NEU_NODE_STAT_CTRL_DEPTH_MAX]   = ctrl->depth_max;
+    data[NEU_NODE_STAT_CTRL_LATENCY]     = ctrl->latency;
+    data[NEU_NODE_STAT_CTRL_LATENCY_MAX] = ctrl->latency_max;
+    data[NEU_NODE_STAT_BULK_DEPTH]       = bulk->depth;
+    data[NEU_NODE_STAT_BULK_DEPTH_MAX]   = bulk->depth_max;
+    data[NEU_NODE_STAT_BULK_LATENCY]     = bulk->latency;
+    data[NEU_NODE_STAT_BULK_LATENCY_MAX] = bulk->latency_max;
+}
+
+static void push(neu_msg_lanes_t *lanes, nng_msg *msg)
+{
+    neu_reqresp_head_t *header = (neu_reqresp_head_t *) nng_msg_body(msg);
+    lane_t *            lane   = &lanes->lanes[neu_msg_lane_of(header->type)];
+    lane_msg_t *        lm     = calloc(1, sizeof(lane_msg_t));
+
+    lm->msg       = msg;
+    lm->timestamp = now_us();
+    DL_APPEND(lane->msgs, lm);
+
+    lane->stat.depth += 1;
+    if (lane->stat.depth > lane->stat.depth_max) {
+        lane->stat.depth_max = lane->stat.depth;
+    }
+}
+
+static nng_msg *pop(neu_msg_lanes_t *lanes, neu_msg_lane_e l)
+{
+    lane_t *    lane    = &lanes->lanes[l];
+    lane_msg_t *lm      = lane->msgs;
+    nng_msg *   msg     = NULL;
+    uint64_t    latency = 0;
+
+    if (lm == NULL) {
+        return NULL;
+    }
+
+    DL_DELETE(lane->msgs, lm);
+    lane->stat.depth -= 1;
+
+    latency = now_us() - lm->timestamp;
+    if (latency > lane->stat.latency_max) {
+        lane->stat.latency_max = latency;
+    }
+    // exponential moving average with alpha = 0.3
+    lane->stat.latency =
+        (uint64_t)(lane->stat.latency * 0.7 + latency * 0.3);
+
+    msg = lm->msg;
+    free(lm);
+    return msg;
+}
+
+static void drain(neu_msg_lanes_t *lanes)
+{
+    nng_msg *msg = NULL;
+
+    while (lanes->lanes[NEU_MSG_LANE_BULK].stat.depth < LANE_BULK_MAX &&
+           nng_recvmsg(lanes->sock, &msg, NNG_FLAG_NONBLOCK) == 0) {
+        push(lanes, msg);
+    }
+}
+
+void neu_msg_lanes_run(neu_msg_lanes_t *lanes)
+{
+    nng_msg *msg = NULL;
+
+    if (lanes->closed) {
+        return;
+    }
+
+    drain(lanes);
+    for (int n = 0; n < LANE_ROUND_BUDGET; n++) {
+        msg = pop(lanes, NEU_MSG_LANE_CTRL);
+        if (msg == NULL) {
+            msg = pop(lanes, NEU_MSG_LANE_BULK);
+        }
+        if (msg == NULL) {
+            break;
+        }
+
+        lanes->handler(lanes->usr_data, msg);
+        if (lanes->closed) {
+            return;
+        }
+
+        // pick up the control messages queued behind the bulk ones
+        drain(lanes);
+    }
+
+    if (!lanes->armed &&
+        (lanes->lanes[NEU_MSG_LANE_CTRL].msgs != NULL ||
+         lanes->lanes[NEU_MSG_LANE_BULK].msgs != NULL)) {
+        if (write(lanes->wakeup[1], "", 1) == 1) {
+            lanes->armed = true;
+        }
+    }
+}
+
+static int wakeup_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    neu_msg_lanes_t *lanes = (neu_msg_lanes_t *) usr_data;
+    char             c     = 0;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    while (read(fd, &c, 1) == 1) {
+    }
+    lanes->armed = false;
+
+    neu_msg_lanes_run(lanes);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#ifndef _NEU_MSG_LANE_H_
+#define _NEU_MSG_LANE_H_
+
+#include <stdint.h>
+
+#include <nng/nng.h>
+
+#include "adapter.h"
+#include "event/event.h"
+
+/**
+ * Priority aware dispatch of the messages received on a pair1 socket.
+ *
+ * Every message received is put into a lane by its type, control requests and
+ * responses are always dispatched before the bulk data (trans data, nodes
+ * state). The socket is drained again after each dispatched bulk message, so
+ * a write request arriving behind hundreds of reports waits for at most one
+ * of them.
+ */
+typedef enum {
+    NEU_MSG_LANE_CTRL,
+    NEU_MSG_LANE_BULK,
+
+    NEU_MSG_LANE_MAX,
+} neu_msg_lane_e;
+
+typedef struct {
+    uint64_t depth;       // number of messages waiting in the lane
+    uint64_t depth_max;   // highest depth seen
+    uint64_t latency;     // average time in the lane (us)
+    uint64_t latency_max; // longest time in the lane (us)
+} neu_msg_lane_stat_t;
+
+typedef struct neu_msg_lanes neu_msg_lanes_t;
+
+// the handler owns the msg
+typedef void (*neu_msg_lane_handler)(void *usr_data, nng_msg *msg);
+
+neu_msg_lanes_t *neu_msg_lanes_new(nng_socket sock, neu_events_t *events,
+                                   neu_msg_lane_handler handler,
+                                   void *               usr_data);
+void             neu_msg_lanes_free(neu_msg_lanes_t *lanes);
+
+/**
+ * Stop dispatching, the queued messages are dropped. It could be called from
+ * the handler, the current round stops after the handler returns.
+ */
+void neu_msg_lanes_close(neu_msg_lanes_t *lanes);
+
+// called when the socket is readable
+void neu_msg_lanes_run(neu_msg_lanes_t *lanes);
+
+neu_msg_lane_e neu_msg_lane_of(neu_reqresp_type_e type);
+
+void neu_msg_lanes_stat(neu_msg_lanes_t *lanes, neu_msg_lane_e lane,
+                        neu_msg_lane_stat_t *stat);
+
+// fill the NEU_NODE_STAT_CTRL_* and NEU_NODE_STAT_BULK_* counters
+void neu_msg_lanes_node_stat(neu_msg_lanes_t *lanes,
+                             uint64_t         data[NEU_NODE_STAT_MAX]);
+
+#endif
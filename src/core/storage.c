@@ -17,9 +17,20 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  **/
 #include "utils/log.h"
+#include "utils/utlist.h"
 
 #include "storage.h"
 
+// a persisted subscription waiting for its app and driver to be ready
+typedef struct manager_pending_sub {
+    char  app[NEU_NODE_NAME_LEN];
+    char  driver[NEU_NODE_NAME_LEN];
+    char  group[NEU_GROUP_NAME_LEN];
+    char *filter;
+
+    struct manager_pending_sub *next;
+} manager_pending_sub_t;
+
 void manager_strorage_plugin(neu_manager_t *manager)
 {
     UT_array *plugin_infos = NULL;
@@ -59,15 +70,69 @@ void manager_storage_del_node(neu_manager_t *manager, const char *node)
     neu_persister_delete_node(manager->persister, node);
 }
 
+// tag filters are persisted as one newline separated text
+static char *filters_join(uint16_t n_filter, char **filters)
+{
+    size_t len    = 0;
+    char * filter = NULL;
+
+    if (n_filter == 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < n_filter; i++) {
+        len += strlen(filters[i]) + 1;
+    }
+
+    filter = calloc(len, sizeof(char));
+    for (int i = 0; i < n_filter; i++) {
+        if (i > 0) {
+            strcat(filter, "\n");
+        }
+        strcat(filter, filters[i]);
+    }
+
+    return filter;
+}
+
+static uint16_t filters_split(char *filter, char ***filters)
+{
+    uint16_t n_filter = 0;
+    char *   save     = NULL;
+
+    *filters = NULL;
+    if (filter == NULL || strlen(filter) == 0) {
+        return 0;
+    }
+
+    n_filter = 1;
+    for (char *c = filter; *c != '\0'; c++) {
+        n_filter += (*c == '\n');
+    }
+
+    *filters = calloc(n_filter, sizeof(char *));
+    n_filter = 0;
+    for (char *tok = strtok_r(filter, "\n", &save); tok != NULL;
+         tok       = strtok_r(NULL, "\n", &save)) {
+        (*filters)[n_filter++] = strdup(tok);
+    }
+
+    return n_filter;
+}
+
 void manager_storage_subscribe(neu_manager_t *manager, const char *app,
-                               const char *driver, const char *group)
+                               const char *driver, const char *group,
+                               uint16_t n_filter, char **filters)
 {
-    int rv = neu_persister_store_subscription(manager->persister, app, driver,
-                                              group);
+    char *filter = filters_join(n_filter, filters);
+    int   rv     = neu_persister_store_subscription(manager->persister, app,
+                                              driver, group, filter);
     if (0 != rv) {
         nlog_error("fail store subscription app:%s driver:%s group:%s", app,
                    driver, group);
     }
+
+    free(filter);
 }
 
 void manager_storage_unsubscribe(neu_manager_t *manager, const char *app,
@@ -107,6 +172,7 @@ int manager_load_node(neu_manager_t *manager)
 {
     UT_array *node_infos = NULL;
     int       rv         = 0;
+    int       n_node     = 0;
 
     rv = neu_persister_load_nodes(manager->persister, &node_infos);
     if (0 != rv) {
@@ -114,15 +180,10 @@ int manager_load_node(neu_manager_t *manager)
         return -1;
     }
 
-    utarray_foreach(node_infos, neu_persist_node_info_t *, node_info)
-    {
-        rv = neu_manager_add_node(
-            manager, node_info->name, node_info->plugin_name,
-            node_info->state == NEU_NODE_RUNNING_STATE_RUNNING);
-        const char *ok_or_err = (0 == rv) ? "success" : "fail";
-        nlog_info("load adapter %s type:%d, name:%s plugin:%s state:%d",
-                  ok_or_err, node_info->type, node_info->name,
-                  node_info->plugin_name, node_info->state);
+    n_node = neu_manager_add_nodes(manager, node_infos);
+    if (n_node != (int) utarray_len(node_infos)) {
+        nlog_warn("load %d of %u adapters", n_node, utarray_len(node_infos));
+        rv = -1;
     }
 
     utarray_free(node_infos);
@@ -134,6 +195,7 @@ int manager_load_subscribe(neu_manager_t *manager)
     UT_array *nodes =
         neu_node_manager_get(manager->node_manager, NEU_NA_TYPE_APP);
 
+    nng_mtx_lock(manager->startup_mtx);
     utarray_foreach(nodes, neu_resp_node_info_t *, node)
     {
         int       rv        = 0;
@@ -143,21 +205,85 @@ int manager_load_subscribe(neu_manager_t *manager)
                                               &sub_infos);
         if (0 != rv) {
             nlog_warn("load %s subscribetion infos error", node->node);
-        } else {
-            utarray_foreach(sub_infos, neu_persist_subscription_info_t *, info)
-            {
-                rv = neu_manager_subscribe(manager, node->node,
-                                           info->driver_name, info->group_name);
-                const char *ok_or_err = (0 == rv) ? "success" : "fail";
-                nlog_info("%s load subscription app:%s driver:%s grp:%s",
-                          ok_or_err, node->node, info->driver_name,
-                          info->group_name);
-            }
+            continue;
+        }
 
-            utarray_free(sub_infos);
+        utarray_foreach(sub_infos, neu_persist_subscription_info_t *, info)
+        {
+            manager_pending_sub_t *sub = calloc(1, sizeof(*sub));
+
+            strncpy(sub->app, node->node, sizeof(sub->app) - 1);
+            strncpy(sub->driver, info->driver_name, sizeof(sub->driver) - 1);
+            strncpy(sub->group, info->group_name, sizeof(sub->group) - 1);
+            if (info->filter != NULL) {
+                sub->filter = strdup(info->filter);
+            }
+            LL_APPEND(manager->pending_subs, sub);
         }
+
+        utarray_free(sub_infos);
     }
+    nng_mtx_unlock(manager->startup_mtx);
 
     utarray_free(nodes);
     return 0;
+}
+
+static bool node_pending(neu_manager_t *manager, const char *node)
+{
+    return neu_node_manager_find(manager->node_manager, node) != NULL &&
+        neu_node_manager_get_pipe(manager->node_manager, node).id == 0;
+}
+
+int manager_apply_subscribe(neu_manager_t *manager)
+{
+    manager_pending_sub_t *sub = NULL, *tmp = NULL;
+    int                    n   = 0;
+
+    // the subscriptions applied in one go are published as one table
+    neu_subscribe_manager_batch_begin(manager->subscribe_manager);
+    nng_mtx_lock(manager->startup_mtx);
+    LL_FOREACH_SAFE(manager->pending_subs, sub, tmp)
+    {
+        // both of the app and the driver must be bound to the manager
+        if (node_pending(manager, sub->app) ||
+            node_pending(manager, sub->driver)) {
+            n += 1;
+            continue;
+        }
+
+        char **  filters  = NULL;
+        uint16_t n_filter = filters_split(sub->filter, &filters);
+        int rv = neu_manager_subscribe(manager, sub->app, sub->driver,
+                                       sub->group, n_filter, filters);
+        for (int i = 0; i < n_filter; i++) {
+            free(filters[i]);
+        }
+        free(filters);
+        const char *ok_or_err = (0 == rv) ? "success" : "fail";
+        nlog_info("%s load subscription app:%s driver:%s grp:%s", ok_or_err,
+                  sub->app, sub->driver, sub->group);
+
+        LL_DELETE(manager->pending_subs, sub);
+        free(sub->filter);
+        free(sub);
+    }
+    nng_mtx_unlock(manager->startup_mtx);
+    neu_subscribe_manager_batch_end(manager->subscribe_manager);
+
+    return n;
+}
+
+void manager_free_pending_subscribe(neu_manager_t *manager)
+{
+    manager_pending_sub_t *sub = NULL, *tmp = NULL;
+
+    nng_mtx_lock(manager->startup_mtx);
+    LL_FOREACH_SAFE(manager->pending_subs, sub, tmp)
+    {
+        LL_DELETE(manager->pending_subs, sub);
+        free(sub->filter);
+        free(sub);
+    }
+    nng_mtx_unlock(manager->startup_mtx);
 }
\ No newline at end of file
@@ -28,12 +28,18 @@ void manager_strorage_plugin(neu_manager_t *manager);
 void manager_storage_del_node(neu_manager_t *manager, const char *node);
 void manager_storage_add_node(neu_manager_t *manager, const char *node);
 void manager_storage_subscribe(neu_manager_t *manager, const char *app,
-                               const char *driver, const char *group);
+                               const char *driver, const char *group,
+                               uint16_t n_filter, char **filters);
 void manager_storage_unsubscribe(neu_manager_t *manager, const char *app,
                                  const char *driver, const char *group);
 
-int manager_load_plugin(neu_manager_t *manager);
-int manager_load_node(neu_manager_t *manager);
-int manager_load_subscribe(neu_manager_t *manager);
+int  manager_load_plugin(neu_manager_t *manager);
+int  manager_load_node(neu_manager_t *manager);
+// only queues the subscriptions, see manager_apply_subscribe
+int  manager_load_subscribe(neu_manager_t *manager);
+// called on the manager thread, return the number of subscriptions still
+// waiting
+int  manager_apply_subscribe(neu_manager_t *manager);
+void manager_free_pending_subscribe(neu_manager_t *manager);
 
 #endif
@@ -37,36 +37,93 @@ typedef struct sub_elem {
     UT_hash_handle hh;
 } sub_elem_t;
 
+typedef struct sub_index {
+    char name[NEU_NODE_NAME_LEN];
+
+    UT_array *elems;
+
+    UT_hash_handle hh;
+} sub_index_t;
+
+struct neu_subscribe_table {
+    uint64_t version;
+    int      ref;
+
+    sub_elem_t * routes;
+    sub_index_t *drivers; // neu_app_subscribe_t
+    sub_index_t *apps;    // neu_resp_subscribe_info_t
+};
+
 static const UT_icd app_sub_icd = { sizeof(neu_app_subscribe_t), NULL, NULL,
                                     NULL };
+static const UT_icd sub_info_icd = { sizeof(neu_resp_subscribe_info_t), NULL,
+                                     NULL, NULL };
 
 struct neu_subscribe_mgr {
+    // only accessed from the manager thread
     sub_elem_t *ss;
+    uint64_t    version;
+    int         batch;
+    bool        dirty;
+
+    nng_mtx *              mtx;
+    neu_subscribe_table_t *table;
 };
 
+static void                   elems_free(sub_elem_t **elems);
+static void                   table_free(neu_subscribe_table_t *table);
+static neu_subscribe_table_t *table_build(sub_elem_t *ss, uint64_t version);
+static void                   publish(neu_subscribe_mgr_t *mgr);
+
 neu_subscribe_mgr_t *neu_subscribe_manager_create()
 {
     neu_subscribe_mgr_t *mgr = calloc(1, sizeof(neu_subscribe_mgr_t));
 
+    nng_mtx_alloc(&mgr->mtx);
+    mgr->table      = table_build(NULL, 0);
+    mgr->table->ref = 1;
+
     return mgr;
 }
 
 void neu_subscribe_manager_destroy(neu_subscribe_mgr_t *mgr)
 {
-    sub_elem_t *el = NULL, *tmp = NULL;
-
-    HASH_ITER(hh, mgr->ss, el, tmp)
-    {
-        HASH_DEL(mgr->ss, el);
-        utarray_free(el->apps);
-        free(el);
-    }
+    elems_free(&mgr->ss);
+    neu_subscribe_manager_release(mgr, mgr->table);
+    nng_mtx_free(mgr->mtx);
 
     free(mgr);
 }
 
-UT_array *neu_subscribe_manager_find(neu_subscribe_mgr_t *mgr,
-                                     const char *driver, const char *group)
+neu_subscribe_table_t *neu_subscribe_manager_acquire(neu_subscribe_mgr_t *mgr)
+{
+    neu_subscribe_table_t *table = NULL;
+
+    nng_mtx_lock(mgr->mtx);
+    table = mgr->table;
+    table->ref += 1;
+    nng_mtx_unlock(mgr->mtx);
+
+    return table;
+}
+
+void neu_subscribe_manager_release(neu_subscribe_mgr_t *  mgr,
+                                   neu_subscribe_table_t *table)
+{
+    int ref = 0;
+
+    nng_mtx_lock(mgr->mtx);
+    table->ref -= 1;
+    ref = table->ref;
+    nng_mtx_unlock(mgr->mtx);
+
+    if (ref == 0) {
+        table_free(table);
+    }
+}
+
+UT_array *neu_subscribe_table_find(neu_subscribe_table_t *table,
+                                   const char *driver, const char *group)
 {
     sub_elem_t *   find = NULL;
     sub_elem_key_t key  = { 0 };
@@ -74,28 +131,40 @@ UT_array *neu_subscribe_manager_find(neu_subscribe_mgr_t *mgr,
     strncpy(key.driver, driver, sizeof(key.driver));
     strncpy(key.group, group, sizeof(key.group));
 
-    HASH_FIND(hh, mgr->ss, &key, sizeof(sub_elem_key_t), find);
+    HASH_FIND(hh, table->routes, &key, sizeof(sub_elem_key_t), find);
 
     if (find) {
-        return utarray_clone(find->apps);
+        return find->apps;
     } else {
         return NULL;
     }
 }
 
+void neu_subscribe_manager_batch_begin(neu_subscribe_mgr_t *mgr)
+{
+    mgr->batch += 1;
+}
+
+void neu_subscribe_manager_batch_end(neu_subscribe_mgr_t *mgr)
+{
+    mgr->batch -= 1;
+    if (mgr->batch == 0 && mgr->dirty) {
+        publish(mgr);
+    }
+}
+
 UT_array *neu_subscribe_manager_find_by_driver(neu_subscribe_mgr_t *mgr,
                                                const char *         driver)
 {
-    sub_elem_t *el = NULL, *tmp = NULL;
-    UT_array *  apps = NULL;
+    sub_index_t *find = NULL;
+    UT_array *   apps = NULL;
 
-    utarray_new(apps, &app_sub_icd);
+    HASH_FIND_STR(mgr->table->drivers, driver, find);
 
-    HASH_ITER(hh, mgr->ss, el, tmp)
-    {
-        if (strcmp(driver, el->key.driver) == 0) {
-            utarray_concat(apps, el->apps);
-        }
+    if (find) {
+        apps = utarray_clone(find->elems);
+    } else {
+        utarray_new(apps, &app_sub_icd);
     }
 
     return apps;
@@ -103,32 +172,23 @@ UT_array *neu_subscribe_manager_find_by_driver(neu_subscribe_mgr_t *mgr,
 
 UT_array *neu_subscribe_manager_get(neu_subscribe_mgr_t *mgr, const char *app)
 {
-    sub_elem_t *el = NULL, *tmp = NULL;
-    UT_array *  groups = NULL;
-    UT_icd      icd = { sizeof(neu_resp_subscribe_info_t), NULL, NULL, NULL };
+    sub_index_t *find   = NULL;
+    UT_array *   groups = NULL;
 
-    utarray_new(groups, &icd);
-    HASH_ITER(hh, mgr->ss, el, tmp)
-    {
-        utarray_foreach(el->apps, neu_app_subscribe_t *, sub_app)
-        {
-            if (strcmp(sub_app->app_name, app) == 0) {
-                neu_resp_subscribe_info_t info = { 0 };
+    HASH_FIND_STR(mgr->table->apps, app, find);
 
-                strncpy(info.driver, el->key.driver, sizeof(info.driver));
-                strncpy(info.app, app, sizeof(info.app));
-                strncpy(info.group, el->key.group, sizeof(info.group));
-
-                utarray_push_back(groups, &info);
-            }
-        }
+    if (find) {
+        groups = utarray_clone(find->elems);
+    } else {
+        utarray_new(groups, &sub_info_icd);
     }
 
     return groups;
 }
 
 int neu_subscribe_manager_sub(neu_subscribe_mgr_t *mgr, const char *driver,
-                              const char *app, const char *group, nng_pipe pipe)
+                              const char *app, const char *group, nng_pipe pipe,
+                              bool has_filter)
 {
     sub_elem_t *        find    = NULL;
     sub_elem_key_t      key     = { 0 };
@@ -137,7 +197,8 @@ int neu_subscribe_manager_sub(neu_subscribe_mgr_t *mgr, const char *driver,
     strncpy(key.driver, driver, sizeof(key.driver));
     strncpy(key.group, group, sizeof(key.group));
     strncpy(app_sub.app_name, app, sizeof(app_sub.app_name));
-    app_sub.pipe = pipe;
+    app_sub.pipe       = pipe;
+    app_sub.has_filter = has_filter;
 
     HASH_FIND(hh, mgr->ss, &key, sizeof(sub_elem_key_t), find);
 
@@ -156,6 +217,7 @@ int neu_subscribe_manager_sub(neu_subscribe_mgr_t *mgr, const char *driver,
     }
 
     utarray_push_back(find->apps, &app_sub);
+    publish(mgr);
     return NEU_ERR_SUCCESS;
 }
 
@@ -175,6 +237,39 @@ int neu_subscribe_manager_unsub(neu_subscribe_mgr_t *mgr, const char *driver,
         {
             if (strcmp(sub->app_name, app) == 0) {
                 utarray_erase(find->apps, utarray_eltidx(find->apps, sub), 1);
+                if (utarray_len(find->apps) == 0) {
+                    HASH_DEL(mgr->ss, find);
+                    utarray_free(find->apps);
+                    free(find);
+                }
+                publish(mgr);
+                return NEU_ERR_SUCCESS;
+            }
+        }
+    }
+
+    return NEU_ERR_GROUP_NOT_SUBSCRIBE;
+}
+
+int neu_subscribe_manager_filtered(neu_subscribe_mgr_t *mgr, const char *driver,
+                                   const char *app, const char *group)
+{
+    sub_elem_t *   find = NULL;
+    sub_elem_key_t key  = { 0 };
+
+    strncpy(key.driver, driver, sizeof(key.driver));
+    strncpy(key.group, group, sizeof(key.group));
+
+    HASH_FIND(hh, mgr->ss, &key, sizeof(sub_elem_key_t), find);
+
+    if (find) {
+        utarray_foreach(find->apps, neu_app_subscribe_t *, sub)
+        {
+            if (strcmp(sub->app_name, app) == 0) {
+                if (sub->has_filter && !sub->filtered) {
+                    sub->filtered = true;
+                    publish(mgr);
+                }
                 return NEU_ERR_SUCCESS;
             }
         }
@@ -187,6 +282,7 @@ void neu_subscribe_manager_remove(neu_subscribe_mgr_t *mgr, const char *driver,
                                   const char *group)
 {
     sub_elem_t *el = NULL, *tmp = NULL;
+    bool        changed = false;
 
     HASH_ITER(hh, mgr->ss, el, tmp)
     {
@@ -195,6 +291,117 @@ void neu_subscribe_manager_remove(neu_subscribe_mgr_t *mgr, const char *driver,
             HASH_DEL(mgr->ss, el);
             utarray_free(el->apps);
             free(el);
+            changed = true;
         }
     }
+
+    if (changed) {
+        publish(mgr);
+    }
+}
+
+static void elems_free(sub_elem_t **elems)
+{
+    sub_elem_t *el = NULL, *tmp = NULL;
+
+    HASH_ITER(hh, *elems, el, tmp)
+    {
+        HASH_DEL(*elems, el);
+        utarray_free(el->apps);
+        free(el);
+    }
+}
+
+static void index_free(sub_index_t **index)
+{
+    sub_index_t *el = NULL, *tmp = NULL;
+
+    HASH_ITER(hh, *index, el, tmp)
+    {
+        HASH_DEL(*index, el);
+        utarray_free(el->elems);
+        free(el);
+    }
+}
+
+static UT_array *index_get(sub_index_t **index, const char *name,
+                           const UT_icd *icd)
+{
+    sub_index_t *find = NULL;
+
+    HASH_FIND_STR(*index, name, find);
+    if (find == NULL) {
+        find = calloc(1, sizeof(sub_index_t));
+        strncpy(find->name, name, sizeof(find->name));
+        utarray_new(find->elems, icd);
+        HASH_ADD_STR(*index, name, find);
+    }
+
+    return find->elems;
+}
+
+static void table_free(neu_subscribe_table_t *table)
+{
+    elems_free(&table->routes);
+    index_free(&table->drivers);
+    index_free(&table->apps);
+    free(table);
+}
+
+static neu_subscribe_table_t *table_build(sub_elem_t *ss, uint64_t version)
+{
+    neu_subscribe_table_t *table = calloc(1, sizeof(neu_subscribe_table_t));
+    sub_elem_t *           el = NULL, *tmp = NULL;
+
+    table->version = version;
+
+    HASH_ITER(hh, ss, el, tmp)
+    {
+        sub_elem_t *route = calloc(1, sizeof(sub_elem_t));
+
+        route->key  = el->key;
+        route->apps = utarray_clone(el->apps);
+        HASH_ADD(hh, table->routes, key, sizeof(sub_elem_key_t), route);
+
+        utarray_concat(index_get(&table->drivers, el->key.driver, &app_sub_icd),
+                       el->apps);
+
+        utarray_foreach(el->apps, neu_app_subscribe_t *, sub_app)
+        {
+            neu_resp_subscribe_info_t info = { 0 };
+
+            strncpy(info.driver, el->key.driver, sizeof(info.driver));
+            strncpy(info.app, sub_app->app_name, sizeof(info.app));
+            strncpy(info.group, el->key.group, sizeof(info.group));
+
+            utarray_push_back(
+                index_get(&table->apps, sub_app->app_name, &sub_info_icd),
+                &info);
+        }
+    }
+
+    return table;
+}
+
+static void publish(neu_subscribe_mgr_t *mgr)
+{
+    neu_subscribe_table_t *table = NULL;
+    neu_subscribe_table_t *old   = NULL;
+
+    if (mgr->batch > 0) {
+        mgr->dirty = true;
+        return;
+    }
+
+    mgr->dirty = false;
+    table      = table_build(mgr->ss, ++mgr->version);
+    table->ref = 1;
+
+    nng_mtx_lock(mgr->mtx);
+    old        = mgr->table;
+    mgr->table = table;
+    nng_mtx_unlock(mgr->mtx);
+
+    nlog_debug("subscribe table version: %" PRIu64, table->version);
+    neu_subscribe_manager_release(mgr, old);
 }
@@ -20,30 +20,61 @@
 #ifndef _NEU_SUBSCRIBE_H_
 #define _NEU_SUBSCRIBE_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <nng/nng.h>
 
 #include "define.h"
 #include "utils/utextend.h"
 
-typedef struct neu_subscribe_mgr neu_subscribe_mgr_t;
+typedef struct neu_subscribe_mgr   neu_subscribe_mgr_t;
+typedef struct neu_subscribe_table neu_subscribe_table_t;
 
 typedef struct neu_app_subscribe {
     char     app_name[NEU_NODE_NAME_LEN];
     nng_pipe pipe;
+    // subscribed with tag filters
+    bool has_filter;
+    // the driver packs the trans data for this app separately
+    bool filtered;
 } neu_app_subscribe_t;
 
 neu_subscribe_mgr_t *neu_subscribe_manager_create();
 void                 neu_subscribe_manager_destroy(neu_subscribe_mgr_t *mgr);
 
-//  neu_app_subscribe_t array
-UT_array *neu_subscribe_manager_find(neu_subscribe_mgr_t *mgr,
-                                     const char *driver, const char *group);
+/**
+ * Every sub/unsub/remove publishes a new immutable table. Readers pin the
+ * current table with acquire and drop it with release, the table is freed
+ * once the last reader is gone.
+ */
+neu_subscribe_table_t *neu_subscribe_manager_acquire(neu_subscribe_mgr_t *mgr);
+void neu_subscribe_manager_release(neu_subscribe_mgr_t *  mgr,
+                                   neu_subscribe_table_t *table);
+//  neu_app_subscribe_t array, owned by the table, must not be modified
+UT_array *neu_subscribe_table_find(neu_subscribe_table_t *table,
+                                   const char *driver, const char *group);
+
+/**
+ * The changes made between batch_begin and batch_end are published as one
+ * table by batch_end, the readers keep the previous table meanwhile.
+ */
+void neu_subscribe_manager_batch_begin(neu_subscribe_mgr_t *mgr);
+void neu_subscribe_manager_batch_end(neu_subscribe_mgr_t *mgr);
+
+//  neu_app_subscribe_t array, caller should free it
 UT_array *neu_subscribe_manager_find_by_driver(neu_subscribe_mgr_t *mgr,
                                                const char *         driver);
+//  neu_resp_subscribe_info_t array, caller should free it
 UT_array *neu_subscribe_manager_get(neu_subscribe_mgr_t *mgr, const char *app);
 int  neu_subscribe_manager_sub(neu_subscribe_mgr_t *mgr, const char *driver,
                                const char *app, const char *group,
-                               nng_pipe pipe);
+                               nng_pipe pipe, bool has_filter);
+// set once the driver confirms it packs the trans data for the app, ignored
+// if the app has subscribed again without filters meanwhile
+int  neu_subscribe_manager_filtered(neu_subscribe_mgr_t *mgr,
+                                    const char *driver, const char *app,
+                                    const char *group);
 int  neu_subscribe_manager_unsub(neu_subscribe_mgr_t *mgr, const char *driver,
                                  const char *app, const char *group);
 void neu_subscribe_manager_remove(neu_subscribe_mgr_t *mgr, const char *driver,
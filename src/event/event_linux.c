@@ -36,6 +36,8 @@
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 
+#include "event_uring.h"
+
 struct neu_event_timer {
     int               fd;
     void *            event_data;
@@ -71,8 +73,23 @@ struct neu_events {
     int       epoll_fd;
     pthread_t thread;
     bool      stop;
+
+    neu_event_stat_t stat;
+    // the timers and ios are handed over to it when not NULL
+    neu_uring_t *uring;
 };
 
+#ifdef NEU_EVENT_URING
+static neu_event_backend_e backend = NEU_EVENT_BACKEND_IO_URING;
+#else
+static neu_event_backend_e backend = NEU_EVENT_BACKEND_EPOLL;
+#endif
+
+void neu_event_set_backend(neu_event_backend_e b)
+{
+    backend = b;
+}
+
 static void *event_loop(void *arg)
 {
     neu_events_t *events   = (neu_events_t *) arg;
@@ -83,6 +100,8 @@ static void *event_loop(void *arg)
         struct event_data *data  = NULL;
 
         int ret = epoll_wait(epoll_fd, &event, 1, 1000);
+        events->stat.n_poll += 1;
+        events->stat.n_syscall += 1;
         if (ret == 0) {
             continue;
         }
@@ -93,6 +112,7 @@ static void *event_loop(void *arg)
         }
 
         data = (struct event_data *) event.data.ptr;
+        events->stat.n_event += 1;
 
         switch (data->type) {
         case TIMER:
@@ -108,6 +128,7 @@ static void *event_loop(void *arg)
                 timerfd_settime(data->fd, 0, &data->ctx.timer->value, NULL);
                 epoll_ctl(epoll_fd, EPOLL_CTL_ADD, data->fd, &event);
                 nng_mtx_unlock(data->ctx.timer->mtx);
+                events->stat.n_syscall += 4;
             }
             break;
         case IO:
@@ -138,6 +159,14 @@ neu_events_t *neu_event_new(void)
 {
     neu_events_t *events = calloc(1, sizeof(struct neu_events));
 
+    if (backend == NEU_EVENT_BACKEND_IO_URING) {
+        events->uring = neu_uring_new();
+        if (events->uring != NULL) {
+            return events;
+        }
+        zlog_warn(neuron, "io_uring not available, fall back to epoll");
+    }
+
     events->epoll_fd = epoll_create(1);
     events->stop     = false;
 
@@ -148,6 +177,12 @@ neu_events_t *neu_event_new(void)
 
 int neu_event_close(neu_events_t *events)
 {
+    if (events->uring != NULL) {
+        neu_uring_free(events->uring);
+        free(events);
+        return 0;
+    }
+
     events->stop = true;
     close(events->epoll_fd);
 
@@ -157,9 +192,22 @@ int neu_event_close(neu_events_t *events)
     return 0;
 }
 
+void neu_event_stat(neu_events_t *events, neu_event_stat_t *stat)
+{
+    if (events->uring != NULL) {
+        neu_uring_stat(events->uring, stat);
+    } else {
+        *stat = events->stat;
+    }
+}
+
 neu_event_timer_t *neu_event_add_timer(neu_events_t *          events,
                                        neu_event_timer_param_t timer)
 {
+    if (events->uring != NULL) {
+        return (neu_event_timer_t *) neu_uring_add_timer(events->uring, timer);
+    }
+
     int               ret      = 0;
     int               timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
     struct itimerspec value    = {
@@ -198,6 +246,11 @@ neu_event_timer_t *neu_event_add_timer(neu_events_t *          events,
 
 int neu_event_del_timer(neu_events_t *events, neu_event_timer_t *timer)
 {
+    if (events->uring != NULL) {
+        neu_uring_del(events->uring, (neu_uring_source_t *) timer);
+        return 0;
+    }
+
     zlog_info(neuron, "del timer: %d from epoll: %d", timer->fd,
               events->epoll_fd);
 
@@ -214,6 +267,10 @@ int neu_event_del_timer(neu_events_t *events, neu_event_timer_t *timer)
 
 neu_event_io_t *neu_event_add_io(neu_events_t *events, neu_event_io_param_t io)
 {
+    if (events->uring != NULL) {
+        return (neu_event_io_t *) neu_uring_add_io(events->uring, io);
+    }
+
     int                ret    = 0;
     neu_event_io_t *   io_ctx = calloc(1, sizeof(neu_event_io_t));
     struct event_data *data   = calloc(1, sizeof(struct event_data));
@@ -240,6 +297,11 @@ neu_event_io_t *neu_event_add_io(neu_events_t *events, neu_event_io_param_t io)
 
 int neu_event_del_io(neu_events_t *events, neu_event_io_t *io)
 {
+    if (events->uring != NULL) {
+        neu_uring_del(events->uring, (neu_uring_source_t *) io);
+        return 0;
+    }
+
     struct event_data *data = (struct event_data *) io->event_data;
     zlog_info(neuron, "del io: %d from epoll: %d", io->fd, events->epoll_fd);
 
@@ -82,6 +82,11 @@ static void *event_loop(void *arg)
     return NULL;
 }
 
+void neu_event_set_backend(neu_event_backend_e backend)
+{
+    (void) backend;
+}
+
 neu_events_t *neu_event_new(void)
 {
     neu_events_t *events = calloc(1, sizeof(neu_events_t));
@@ -110,6 +115,12 @@ int neu_event_close(neu_events_t *events)
     return 0;
 }
 
+void neu_event_stat(neu_events_t *events, neu_event_stat_t *stat)
+{
+    (void) events;
+    memset(stat, 0, sizeof(*stat));
+}
+
 neu_event_timer_t *neu_event_add_timer(neu_events_t *          events,
                                        neu_event_timer_param_t timer)
 {
@@ -0,0 +1,532 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // POLLRDHUP
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nng/nng.h>
+#include <nng/supplemental/util/platform.h>
+
+#include "event/event.h"
+#include "utils/log.h"
+#include "utils/utlist.h"
+
+#if defined(NEU_PLATFORM_LINUX) && defined(NEU_EVENT_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "event_uring.h"
+
+#define URING_ENTRIES 256
+
+struct neu_uring_source {
+    enum {
+        TIMER,
+        IO,
+    } type;
+    union {
+        neu_event_io_callback    io;
+        neu_event_timer_callback timer;
+    } callback;
+
+    void *usr_data;
+    int   fd;
+
+    // timer only, held by the callback, the deletion waits for it
+    struct itimerspec value;
+    uint64_t          ticks;
+    nng_mtx *         mtx;
+
+    // under the uring mtx, the poll or read in flight keeps the source alive,
+    // a source parked after an error is freed by the deletion
+    bool armed;
+    bool parked;
+    bool dead;
+
+    struct neu_uring_source *prev;
+    struct neu_uring_source *next;
+};
+
+struct neu_uring {
+    int fd;
+
+    unsigned *           sq_head;
+    unsigned *           sq_tail;
+    unsigned *           sq_mask;
+    unsigned *           sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned             sq_entries;
+    unsigned             n_pending; // queued, not submitted yet
+
+    unsigned *           cq_head;
+    unsigned *           cq_tail;
+    unsigned *           cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void * sq_ptr;
+    size_t sq_len;
+    void * cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+
+    // the submission queue and the sources
+    nng_mtx *           mtx;
+    neu_uring_source_t *sources;
+
+    pthread_t        thread;
+    bool             stop;
+    neu_event_stat_t stat;
+};
+
+static int uring_enter(neu_uring_t *uring, unsigned to_submit,
+                       unsigned min_complete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, uring->fd, to_submit,
+                         min_complete, flags, NULL, 0);
+}
+
+static bool on_event_thread(neu_uring_t *uring)
+{
+    return pthread_equal(pthread_self(), uring->thread);
+}
+
+// with mtx held, the event thread submits the sqes with its next wait
+static struct io_uring_sqe *uring_sqe(neu_uring_t *uring)
+{
+    unsigned             tail = *uring->sq_tail;
+    struct io_uring_sqe *sqe  = NULL;
+
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >=
+        uring->sq_entries) {
+        uring_enter(uring, uring->n_pending, 0, 0);
+        uring->n_pending = 0;
+        if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >=
+            uring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    sqe = &uring->sqes[tail & *uring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[tail & *uring->sq_mask] = tail & *uring->sq_mask;
+    return sqe;
+}
+
+// with mtx held
+static void uring_commit(neu_uring_t *uring)
+{
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    uring->n_pending += 1;
+
+    if (!on_event_thread(uring)) {
+        uring_enter(uring, uring->n_pending, 0, 0);
+        uring->n_pending = 0;
+    }
+}
+
+// with mtx held
+static void uring_arm(neu_uring_t *uring, neu_uring_source_t *src)
+{
+    struct io_uring_sqe *sqe = uring_sqe(uring);
+
+    if (sqe == NULL) {
+        nlog_error("uring %d submission queue full, fd %d is not watched",
+                   uring->fd, src->fd);
+        return;
+    }
+
+    switch (src->type) {
+    case TIMER:
+        // the read completes when the timer expires
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr   = (uint64_t)(uintptr_t) &src->ticks;
+        sqe->len    = sizeof(src->ticks);
+        sqe->off    = (uint64_t) -1;
+        break;
+    case IO:
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLIN | POLLERR | POLLHUP | POLLRDHUP;
+        break;
+    }
+    sqe->fd        = src->fd;
+    sqe->user_data = (uint64_t)(uintptr_t) src;
+
+    src->armed = true;
+    uring_commit(uring);
+}
+
+// with mtx held
+static void uring_cancel(neu_uring_t *uring, neu_uring_source_t *src)
+{
+    struct io_uring_sqe *sqe = uring_sqe(uring);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = (uint64_t)(uintptr_t) src;
+    sqe->user_data = 0;
+    uring_commit(uring);
+}
+
+static void source_free(neu_uring_source_t *src)
+{
+    if (src->type == TIMER) {
+        nng_mtx_free(src->mtx);
+    }
+    free(src);
+}
+
+static void uring_handle(neu_uring_t *uring, neu_uring_source_t *src,
+                         int res)
+{
+    bool dead = false;
+
+    if (src->type == TIMER) {
+        nng_mtx_lock(src->mtx);
+    }
+
+    nng_mtx_lock(uring->mtx);
+    src->armed = false;
+    dead       = src->dead;
+    nng_mtx_unlock(uring->mtx);
+
+    if (!dead && res >= 0) {
+        uring->stat.n_event += 1;
+
+        switch (src->type) {
+        case TIMER:
+            src->callback.timer(src->usr_data);
+            // the next period starts after the callback
+            timerfd_settime(src->fd, 0, &src->value, NULL);
+            uring->stat.n_syscall += 1;
+            break;
+        case IO:
+            if ((res & POLLHUP) == POLLHUP) {
+                src->callback.io(NEU_EVENT_IO_HUP, src->fd, src->usr_data);
+            } else if ((res & POLLRDHUP) == POLLRDHUP) {
+                src->callback.io(NEU_EVENT_IO_CLOSED, src->fd, src->usr_data);
+            } else if ((res & POLLIN) == POLLIN) {
+                src->callback.io(NEU_EVENT_IO_READ, src->fd, src->usr_data);
+            }
+            break;
+        }
+    }
+
+    nng_mtx_lock(uring->mtx);
+    dead = src->dead;
+    if (dead) {
+        DL_DELETE(uring->sources, src);
+    } else if (res >= 0) {
+        uring_arm(uring, src);
+    } else {
+        // re-arming a bad fd would fail again at once
+        nlog_warn("uring %d fd %d error: %s(%d), not watched any more",
+                  uring->fd, src->fd, strerror(-res), -res);
+        src->parked = true;
+    }
+    nng_mtx_unlock(uring->mtx);
+
+    if (src->type == TIMER) {
+        nng_mtx_unlock(src->mtx);
+    }
+    if (dead) {
+        source_free(src);
+    }
+}
+
+static void *uring_loop(void *arg)
+{
+    neu_uring_t *uring = (neu_uring_t *) arg;
+
+    while (true) {
+        unsigned to_submit = 0;
+        unsigned head      = 0;
+        unsigned tail      = 0;
+        int      ret       = 0;
+
+        nng_mtx_lock(uring->mtx);
+        to_submit        = uring->n_pending;
+        uring->n_pending = 0;
+        nng_mtx_unlock(uring->mtx);
+
+        // submit what the last round queued and wait, in one syscall
+        ret = uring_enter(uring, to_submit, 1, IORING_ENTER_GETEVENTS);
+        uring->stat.n_poll += 1;
+        uring->stat.n_syscall += 1;
+        if (ret == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            nlog_warn("uring %d loop exit, errno: %s(%d)", uring->fd,
+                      strerror(errno), errno);
+            break;
+        }
+        if (uring->stop) {
+            break;
+        }
+
+        head = *uring->cq_head;
+        tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+            neu_uring_source_t * src =
+                (neu_uring_source_t *) (uintptr_t) cqe->user_data;
+            int res = cqe->res;
+
+            __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+            // cancellations and wakeups
+            if (src != NULL) {
+                uring_handle(uring, src, res);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int uring_map(neu_uring_t *uring, struct io_uring_params *p)
+{
+    uring->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    uring->cq_len =
+        p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_len > uring->sq_len) {
+            uring->sq_len = uring->cq_len;
+        }
+        uring->cq_len = 0;
+    }
+
+    uring->sq_ptr = mmap(NULL, uring->sq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring->fd,
+                         IORING_OFF_SQ_RING);
+    if (uring->sq_ptr == MAP_FAILED) {
+        uring->sq_ptr = NULL;
+        return -1;
+    }
+
+    if (uring->cq_len == 0) {
+        uring->cq_ptr = uring->sq_ptr;
+    } else {
+        uring->cq_ptr = mmap(NULL, uring->cq_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, uring->fd,
+                             IORING_OFF_CQ_RING);
+        if (uring->cq_ptr == MAP_FAILED) {
+            uring->cq_ptr = NULL;
+            return -1;
+        }
+    }
+
+    uring->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes =
+        mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        return -1;
+    }
+
+    char *sq = (char *) uring->sq_ptr;
+    char *cq = (char *) uring->cq_ptr;
+
+    uring->sq_head    = (unsigned *) (sq + p->sq_off.head);
+    uring->sq_tail    = (unsigned *) (sq + p->sq_off.tail);
+    uring->sq_mask    = (unsigned *) (sq + p->sq_off.ring_mask);
+    uring->sq_array   = (unsigned *) (sq + p->sq_off.array);
+    uring->sq_entries = p->sq_entries;
+    uring->cq_head    = (unsigned *) (cq + p->cq_off.head);
+    uring->cq_tail    = (unsigned *) (cq + p->cq_off.tail);
+    uring->cq_mask    = (unsigned *) (cq + p->cq_off.ring_mask);
+    uring->cqes       = (struct io_uring_cqe *) (cq + p->cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_unmap(neu_uring_t *uring)
+{
+    if (uring->sqes != NULL) {
+        munmap(uring->sqes, uring->sqes_len);
+    }
+    if (uring->cq_ptr != NULL && uring->cq_ptr != uring->sq_ptr) {
+        munmap(uring->cq_ptr, uring->cq_len);
+    }
+    if (uring->sq_ptr != NULL) {
+        munmap(uring->sq_ptr, uring->sq_len);
+    }
+    close(uring->fd);
+}
+
+neu_uring_t *neu_uring_new(void)
+{
+    neu_uring_t *          uring = calloc(1, sizeof(neu_uring_t));
+    struct io_uring_params p     = { 0 };
+
+    uring->fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (uring->fd < 0) {
+        nlog_warn("io_uring setup fail: %s(%d)", strerror(errno), errno);
+        free(uring);
+        return NULL;
+    }
+
+    // IORING_OP_READ and IORING_OP_ASYNC_CANCEL need linux 5.6
+    if ((p.features & IORING_FEAT_FAST_POLL) == 0 ||
+        uring_map(uring, &p) != 0) {
+        nlog_warn("io_uring %d not supported, features: %x", uring->fd,
+                  p.features);
+        uring_unmap(uring);
+        free(uring);
+        return NULL;
+    }
+
+    nng_mtx_alloc(&uring->mtx);
+    pthread_create(&uring->thread, NULL, uring_loop, uring);
+
+    nlog_info("io_uring %d, entries: %u", uring->fd, uring->sq_entries);
+    return uring;
+}
+
+void neu_uring_free(neu_uring_t *uring)
+{
+    neu_uring_source_t * src = NULL, *tmp = NULL;
+    struct io_uring_sqe *sqe = NULL;
+
+    nng_mtx_lock(uring->mtx);
+    uring->stop = true;
+    sqe         = uring_sqe(uring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_NOP;
+        uring_commit(uring);
+    }
+    nng_mtx_unlock(uring->mtx);
+
+    pthread_join(uring->thread, NULL);
+
+    // the operations in flight are dropped along with the ring
+    uring_unmap(uring);
+    DL_FOREACH_SAFE(uring->sources, src, tmp)
+    {
+        DL_DELETE(uring->sources, src);
+        if (src->type == TIMER && !src->dead) {
+            close(src->fd);
+        }
+        source_free(src);
+    }
+
+    nng_mtx_free(uring->mtx);
+    free(uring);
+}
+
+neu_uring_source_t *neu_uring_add_timer(neu_uring_t *           uring,
+                                        neu_event_timer_param_t timer)
+{
+    neu_uring_source_t *src = calloc(1, sizeof(neu_uring_source_t));
+
+    src->type           = TIMER;
+    src->callback.timer = timer.cb;
+    src->usr_data       = timer.usr_data;
+    src->fd             = timerfd_create(CLOCK_MONOTONIC, 0);
+    src->value          = (struct itimerspec) {
+        .it_value.tv_sec     = timer.second,
+        .it_value.tv_nsec    = timer.millisecond * 1000 * 1000,
+        .it_interval.tv_sec  = timer.second,
+        .it_interval.tv_nsec = timer.millisecond * 1000 * 1000,
+    };
+    nng_mtx_alloc(&src->mtx);
+
+    timerfd_settime(src->fd, 0, &src->value, NULL);
+
+    nng_mtx_lock(uring->mtx);
+    DL_APPEND(uring->sources, src);
+    uring_arm(uring, src);
+    nng_mtx_unlock(uring->mtx);
+
+    nlog_info("add timer, second: %" PRId64 ", millisecond: %" PRId64
+              ", timer: %d in uring %d",
+              timer.second, timer.millisecond, src->fd, uring->fd);
+    return src;
+}
+
+neu_uring_source_t *neu_uring_add_io(neu_uring_t *        uring,
+                                     neu_event_io_param_t io)
+{
+    neu_uring_source_t *src = calloc(1, sizeof(neu_uring_source_t));
+
+    src->type        = IO;
+    src->callback.io = io.cb;
+    src->usr_data    = io.usr_data;
+    src->fd          = io.fd;
+
+    nng_mtx_lock(uring->mtx);
+    DL_APPEND(uring->sources, src);
+    uring_arm(uring, src);
+    nng_mtx_unlock(uring->mtx);
+
+    nlog_info("add io, fd: %d, uring: %d", io.fd, uring->fd);
+    return src;
+}
+
+void neu_uring_del(neu_uring_t *uring, neu_uring_source_t *src)
+{
+    bool free_now = false;
+
+    nlog_info("del %s: %d from uring: %d", src->type == TIMER ? "timer" : "io",
+              src->fd, uring->fd);
+
+    if (src->type == TIMER) {
+        nng_mtx_lock(src->mtx);
+        close(src->fd);
+    }
+
+    nng_mtx_lock(uring->mtx);
+    src->dead = true;
+    if (src->armed) {
+        uring_cancel(uring, src);
+    } else if (src->parked) {
+        DL_DELETE(uring->sources, src);
+        free_now = true;
+    }
+    // otherwise the event thread is handling it and frees it afterwards
+    nng_mtx_unlock(uring->mtx);
+
+    if (src->type == TIMER) {
+        nng_mtx_unlock(src->mtx);
+    }
+    if (free_now) {
+        source_free(src);
+    }
+}
+
+void neu_uring_stat(neu_uring_t *uring, neu_event_stat_t *stat)
+{
+    *stat = uring->stat;
+}
+
+#endif
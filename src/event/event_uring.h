@@ -0,0 +1,94 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#ifndef _NEU_EVENT_URING_H_
+#define _NEU_EVENT_URING_H_
+
+#include "event/event.h"
+
+/**
+ * io_uring backend of the events, built with NEU_EVENT_URING.
+ *
+ * The fds are watched by one shot polls, re-armed after the callback so that
+ * a callback not reading everything is called again as with epoll. The polls
+ * re-armed and the timer reads queued during a round are submitted together
+ * with the next wait, by a single io_uring_enter.
+ */
+typedef struct neu_uring        neu_uring_t;
+typedef struct neu_uring_source neu_uring_source_t;
+
+#ifdef NEU_EVENT_URING
+
+// NULL when io_uring is not supported, the caller falls back to epoll
+neu_uring_t *neu_uring_new(void);
+void         neu_uring_free(neu_uring_t *uring);
+
+neu_uring_source_t *neu_uring_add_timer(neu_uring_t *           uring,
+                                        neu_event_timer_param_t timer);
+neu_uring_source_t *neu_uring_add_io(neu_uring_t *        uring,
+                                     neu_event_io_param_t io);
+
+// the source is freed by the event thread once nothing is in flight
+void neu_uring_del(neu_uring_t *uring, neu_uring_source_t *source);
+
+void neu_uring_stat(neu_uring_t *uring, neu_event_stat_t *stat);
+
+#else
+
+static inline neu_uring_t *neu_uring_new(void)
+{
+    return NULL;
+}
+
+static inline void neu_uring_free(neu_uring_t *uring)
+{
+    (void) uring;
+}
+
+static inline neu_uring_source_t *
+neu_uring_add_timer(neu_uring_t *uring, neu_event_timer_param_t timer)
+{
+    (void) uring;
+    (void) timer;
+    return NULL;
+}
+
+static inline neu_uring_source_t *neu_uring_add_io(neu_uring_t *        uring,
+                                                   neu_event_io_param_t io)
+{
+    (void) uring;
+    (void) io;
+    return NULL;
+}
+
+static inline void neu_uring_del(neu_uring_t *uring, neu_uring_source_t *source)
+{
+    (void) uring;
+    (void) source;
+}
+
+static inline void neu_uring_stat(neu_uring_t *uring, neu_event_stat_t *stat)
+{
+    (void) uring;
+    (void) stat;
+}
+
+#endif
+
+#endif
@@ -18,11 +18,13 @@
  **/
 
 #include <signal.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "core/manager.h"
+#include "event/event.h"
 #include "utils/log.h"
 
 #include "argparse.h"
@@ -62,6 +64,12 @@ static int neuron_run(const neu_cli_args_t *args)
     zlog_notice(neuron, "neuron process, daemon: %d, version: %s (%s %s)",
                 args->daemonized, NEURON_VERSION,
                 NEURON_GIT_REV NEURON_GIT_DIFF, NEURON_BUILD_DATE);
+    if (args->event_backend != NULL) {
+        neu_event_set_backend(0 == strcmp(args->event_backend, "epoll")
+                                  ? NEU_EVENT_BACKEND_EPOLL
+                                  : NEU_EVENT_BACKEND_IO_URING);
+    }
+
     g_manager = neu_manager_create();
     if (g_manager == NULL) {
         nlog_fatal("neuron process failed to create neuron manager, exit!");
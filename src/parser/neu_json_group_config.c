@@ -277,18 +277,25 @@ int neu_json_decode_subscribe_req(char *buf, neu_json_subscribe_req_t **result)
 
     json_obj = neu_json_decode_new(buf);
 
-    neu_json_elem_t req_elems[] = { {
-                                        .name = "app",
-                                        .t    = NEU_JSON_STR,
-                                    },
-                                    {
-                                        .name = "group",
-                                        .t    = NEU_JSON_STR,
-                                    },
-                                    {
-                                        .name = "driver",
-                                        .t    = NEU_JSON_STR,
-                                    } };
+    neu_json_elem_t req_elems[] = {
+        {
+            .name = "app",
+            .t    = NEU_JSON_STR,
+        },
+        {
+            .name = "group",
+            .t    = NEU_JSON_STR,
+        },
+        {
+            .name = "driver",
+            .t    = NEU_JSON_STR,
+        },
+        {
+            .name      = "tags",
+            .t         = NEU_JSON_OBJECT,
+            .attribute = NEU_JSON_ATTRIBUTE_OPTIONAL,
+        },
+    };
     ret = neu_json_decode_by_json(json_obj, NEU_JSON_ELEM_SIZE(req_elems),
                                   req_elems);
     if (ret != 0) {
@@ -299,10 +306,41 @@ int neu_json_decode_subscribe_req(char *buf, neu_json_subscribe_req_t **result)
     req->group  = req_elems[1].v.val_str;
     req->driver = req_elems[2].v.val_str;
 
+    if (req_elems[3].v.val_object != NULL) {
+        req->n_tag = neu_json_decode_array_size_by_json(json_obj, "tags");
+        if (req->n_tag < 0) {
+            goto decode_fail;
+        }
+
+        req->tags = calloc(req->n_tag, sizeof(char *));
+        for (int i = 0; i < req->n_tag; i++) {
+            neu_json_elem_t tag_elems[] = { {
+                .name = NULL,
+                .t    = NEU_JSON_STR,
+            } };
+            ret                         = neu_json_decode_array_by_json(
+                json_obj, "tags", i, NEU_JSON_ELEM_SIZE(tag_elems), tag_elems);
+            if (ret != 0) {
+                goto decode_fail;
+            }
+
+            req->tags[i] = tag_elems[0].v.val_str;
+        }
+    }
+
     *result = req;
     goto decode_exit;
 
 decode_fail:
+    if (req->tags != NULL) {
+        for (int i = 0; i < req->n_tag; i++) {
+            free(req->tags[i]);
+        }
+        free(req->tags);
+    }
+    free(req->app);
+    free(req->group);
+    free(req->driver);
     free(req);
     ret = -1;
 
@@ -318,6 +356,10 @@ void neu_json_decode_subscribe_req_free(neu_json_subscribe_req_t *req)
     free(req->app);
     free(req->driver);
     free(req->group);
+    for (int i = 0; i < req->n_tag; i++) {
+        free(req->tags[i]);
+    }
+    free(req->tags);
 
     free(req);
 }
@@ -92,9 +92,11 @@ typedef struct {
 int neu_json_encode_get_subscribe_resp(void *json_object, void *param);
 
 typedef struct {
-    char *group;
-    char *app;
-    char *driver;
+    char *  group;
+    char *  app;
+    char *  driver;
+    int     n_tag;
+    char ** tags; // optional tag name patterns
 } neu_json_subscribe_req_t;
 
 int neu_json_decode_subscribe_req(char *buf, neu_json_subscribe_req_t **result);
@@ -405,3 +405,61 @@ void neu_json_decode_node_setting_req_free(neu_json_node_setting_req_t *req)
     free(req->node);
     free(req);
 }
+
+int neu_json_decode_node_capture_req(char *                        buf,
+                                     neu_json_node_capture_req_t **result)
+{
+    int                          ret      = 0;
+    void *                       json_obj = NULL;
+    neu_json_node_capture_req_t *req =
+        calloc(1, sizeof(neu_json_node_capture_req_t));
+    if (req == NULL) {
+        return -1;
+    }
+
+    json_obj = neu_json_decode_new(buf);
+
+    neu_json_elem_t req_elems[] = {
+        {
+            .name = "node",
+            .t    = NEU_JSON_STR,
+        },
+        {
+            .name = "enable",
+            .t    = NEU_JSON_BOOL,
+        },
+        {
+            .name      = "size",
+            .t         = NEU_JSON_INT,
+            .attribute = NEU_JSON_ATTRIBUTE_OPTIONAL,
+        },
+    };
+    ret = neu_json_decode_by_json(json_obj, NEU_JSON_ELEM_SIZE(req_elems),
+                                  req_elems);
+    if (ret != 0) {
+        goto decode_fail;
+    }
+
+    req->node   = req_elems[0].v.val_str;
+    req->enable = req_elems[1].v.val_bool;
+    req->size   = req_elems[2].v.val_int;
+
+    *result = req;
+    goto decode_exit;
+
+decode_fail:
+    free(req);
+    ret = -1;
+
+decode_exit:
+    if (json_obj != NULL) {
+        neu_json_decode_free(json_obj);
+    }
+    return ret;
+}
+
+void neu_json_decode_node_capture_req_free(neu_json_node_capture_req_t *req)
+{
+    free(req->node);
+    free(req);
+}
@@ -112,6 +112,16 @@ int  neu_json_decode_node_setting_req(char *                        buf,
                                       neu_json_node_setting_req_t **result);
 void neu_json_decode_node_setting_req_free(neu_json_node_setting_req_t *req);
 
+typedef struct {
+    char *  node;
+    bool    enable;
+    int64_t size;
+} neu_json_node_capture_req_t;
+
+int  neu_json_decode_node_capture_req(char *                        buf,
+                                      neu_json_node_capture_req_t **result);
+void neu_json_decode_node_capture_req_free(neu_json_node_capture_req_t *req);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1078,6 +1078,68 @@ error:
     return NEU_ERR_EINTERNAL;
 }
 
+static UT_icd tag_info_icd = {
+    sizeof(neu_persist_tag_info_t),
+    NULL,
+    NULL,
+    (dtor_f *) neu_persist_tag_info_fini,
+};
+
+int neu_persister_load_driver_tags(neu_persister_t *persister,
+                                   const char *     driver_name,
+                                   UT_array **      tag_infos)
+{
+    sqlite3_stmt *stmt  = NULL;
+    const char *  query = "SELECT group_name, name, address, attribute, "
+                        "precision, type, decimal, description "
+                        "FROM tags WHERE driver_name=? ORDER BY group_name";
+
+    utarray_new(*tag_infos, &tag_info_icd);
+
+    if (SQLITE_OK !=
+        sqlite3_prepare_v2(persister->db, query, -1, &stmt, NULL)) {
+        nlog_error("prepare `%s` fail: %s", query,
+                   sqlite3_errmsg(persister->db));
+        goto error;
+    }
+
+    if (SQLITE_OK != sqlite3_bind_text(stmt, 1, driver_name, -1, NULL)) {
+        nlog_error("bind `%s` with `%s` fail: %s", query, driver_name,
+                   sqlite3_errmsg(persister->db));
+        goto error;
+    }
+
+    int step = sqlite3_step(stmt);
+    while (SQLITE_ROW == step) {
+        neu_persist_tag_info_t info = { 0 };
+
+        info.group_name      = strdup((char *) sqlite3_column_text(stmt, 0));
+        info.tag.name        = strdup((char *) sqlite3_column_text(stmt, 1));
+        info.tag.address     = strdup((char *) sqlite3_column_text(stmt, 2));
+        info.tag.attribute   = sqlite3_column_int(stmt, 3);
+        info.tag.precision   = sqlite3_column_int64(stmt, 4);
+        info.tag.type        = sqlite3_column_int(stmt, 5);
+        info.tag.decimal     = sqlite3_column_double(stmt, 6);
+        info.tag.description = strdup((char *) sqlite3_column_text(stmt, 7));
+        utarray_push_back(*tag_infos, &info);
+
+        step = sqlite3_step(stmt);
+    }
+
+    if (SQLITE_DONE != step) {
+        nlog_warn("query `%s` fail: %s", query, sqlite3_errmsg(persister->db));
+        // do not set return code, return partial or empty result
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+
+error:
+    utarray_free(*tag_infos);
+    *tag_infos = NULL;
+    return NEU_ERR_EINTERNAL;
+}
+
 int neu_persister_update_tag(neu_persister_t *persister,
                              const char *driver_name, const char *group_name,
                              const neu_datatag_t *tag)
@@ -1104,13 +1166,13 @@ int neu_persister_delete_tag(neu_persister_t *persister,
 int neu_persister_store_subscription(neu_persister_t *persister,
                                      const char *     app_name,
                                      const char *     driver_name,
-                                     const char *     group_name)
+                                     const char *     group_name,
+                                     const char *     filter)
 {
-    return execute_sql(
-        persister->db,
-        "INSERT INTO subscriptions (app_name, driver_name, group_name) "
-        "VALUES (%Q, %Q, %Q)",
-        app_name, driver_name, group_name);
+    return execute_sql(persister->db,
+                       "INSERT INTO subscriptions (app_name, driver_name, "
+                       "group_name, filter) VALUES (%Q, %Q, %Q, %Q)",
+                       app_name, driver_name, group_name, filter);
 }
 
 static UT_icd subscription_info_icd = {
@@ -1126,7 +1188,8 @@ int neu_persister_load_subscriptions(neu_persister_t *persister,
 {
     sqlite3_stmt *stmt = NULL;
     const char *  query =
-        "SELECT driver_name, group_name FROM subscriptions WHERE app_name=?";
+        "SELECT driver_name, group_name, filter FROM subscriptions WHERE "
+        "app_name=?";
 
     utarray_new(*subscription_infos, &subscription_info_icd);
 
@@ -1156,9 +1219,15 @@ int neu_persister_load_subscriptions(neu_persister_t *persister,
             break;
         }
 
+        char *filter = NULL;
+        if (SQLITE_NULL != sqlite3_column_type(stmt, 2)) {
+            filter = strdup((char *) sqlite3_column_text(stmt, 2));
+        }
+
         neu_persist_subscription_info_t info = {
             .driver_name = driver_name,
             .group_name  = group_name,
+            .filter      = filter,
         };
         utarray_push_back(*subscription_infos, &info);
 
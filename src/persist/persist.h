@@ -44,8 +44,14 @@ typedef struct {
 typedef struct {
     char *driver_name;
     char *group_name;
+    char *filter; // newline separated tag name patterns, may be NULL
 } neu_persist_subscription_info_t;
 
+typedef struct {
+    char *        group_name;
+    neu_datatag_t tag;
+} neu_persist_tag_info_t;
+
 typedef struct {
     char *name;
     char *hash;
@@ -72,6 +78,15 @@ neu_persist_subscription_info_fini(neu_persist_subscription_info_t *info)
 {
     free(info->driver_name);
     free(info->group_name);
+    free(info->filter);
+}
+
+static inline void neu_persist_tag_info_fini(neu_persist_tag_info_t *info)
+{
+    free(info->group_name);
+    free(info->tag.name);
+    free(info->tag.address);
+    free(info->tag.description);
 }
 
 static inline void neu_persist_user_info_fini(neu_persist_user_info_t *info)
@@ -188,6 +203,19 @@ int neu_persister_store_tags(neu_persister_t *persister,
 int neu_persister_load_tags(neu_persister_t *persister, const char *driver_name,
                             const char *group_name, UT_array **tag_infos);
 
+/**
+ * Load the tags of every group of a driver in one query.
+ * @param persister                 persiter object.
+ * @param driver_name               name of the driver who owns the tags
+ * @param[out] tag_infos            used to return pointer to heap allocated
+ *                                  vector of neu_persist_tag_info_t, ordered
+ *                                  by group
+ * @return 0 on success, non-zero otherwise
+ */
+int neu_persister_load_driver_tags(neu_persister_t *persister,
+                                   const char *     driver_name,
+                                   UT_array **      tag_infos);
+
 /**
  * Update node tags.
  * @param persister                 persiter object.
@@ -218,12 +246,15 @@ int neu_persister_delete_tag(neu_persister_t *persister,
  * @param app_name                  name of the app node
  * @param driver_name               name of the driver node
  * @param group_name                name of the group
+ * @param filter                    newline separated tag name patterns,
+ *                                  NULL to subscribe all tags
  * @return 0 on success, non-zero otherwise
  */
 int neu_persister_store_subscription(neu_persister_t *persister,
                                      const char *     app_name,
                                      const char *     driver_name,
-                                     const char *     group_name);
+                                     const char *     group_name,
+                                     const char *     filter);
 
 /**
  * Load adapter subscriptions.
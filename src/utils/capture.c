@@ -0,0 +1,287 @@
+/**
+ * NEURON IIoT System for Industry 4.0
+ * Copyright (C) 2020-2022 EMQ Technologies Co., Ltd All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ **/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "utils/capture.h"
+
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_SHB_LEN 28
+#define PCAPNG_IDB_LEN 20
+// block header, interface, timestamp, lengths, epb_flags and end of options
+#define PCAPNG_EPB_LEN 44
+#define PCAPNG_OPT_EPB_FLAGS 2
+
+#define PAD4(n) (((n) + 3) & ~(size_t) 3)
+
+typedef struct {
+    uint64_t timestamp; // us since epoch
+    uint32_t len;
+    uint32_t orig_len;
+    uint32_t dir;
+} record_t;
+
+struct neu_capture {
+    pthread_mutex_t mtx;
+
+    uint8_t *ring;
+    size_t   size;
+    size_t   head;
+    size_t   tail;
+    size_t   used;
+
+    size_t   n_frame;
+    uint64_t n_drop;
+};
+
+static void ring_write(neu_capture_t *capture, const void *src, size_t n)
+{
+    size_t first = capture->size - capture->head;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(capture->ring + capture->head, src, first);
+    memcpy(capture->ring, (const uint8_t *) src + first, n - first);
+    capture->head = (capture->head + n) % capture->size;
+    capture->used += n;
+}
+
+static void ring_read(neu_capture_t *capture, size_t off, void *dst, size_t n)
+{
+    size_t first = capture->size - off;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(dst, capture->ring + off, first);
+    memcpy((uint8_t *) dst + first, capture->ring, n - first);
+}
+
+static void ring_evict(neu_capture_t *capture)
+{
+    record_t record = { 0 };
+
+    ring_read(capture, capture->tail, &record, sizeof(record));
+    capture->tail =
+        (capture->tail + sizeof(record) + record.len) % capture->size;
+    capture->used -= sizeof(record) + record.len;
+    capture->n_frame -= 1;
+    capture->n_drop += 1;
+}
+
+static size_t clamp_size(size_t size)
+{
+    if (size < NEU_CAPTURE_SIZE_MIN) {
+        return NEU_CAPTURE_SIZE_MIN;
+    }
+    if (size > NEU_CAPTURE_SIZE_MAX) {
+        return NEU_CAPTURE_SIZE_MAX;
+    }
+    return size;
+}
+
+neu_capture_t *neu_capture_new(size_t size)
+{
+    neu_capture_t *capture = calloc(1, sizeof(neu_capture_t));
+
+    if (capture == NULL) {
+        return NULL;
+    }
+
+    capture->size = clamp_size(size);
+    capture->ring = calloc(capture->size, 1);
+    if (capture->ring == NULL) {
+        free(capture);
+        return NULL;
+    }
+    pthread_mutex_init(&capture->mtx, NULL);
+
+    return capture;
+}
+
+void neu_capture_free(neu_capture_t *capture)
+{
+    pthread_mutex_destroy(&capture->mtx);
+    free(capture->ring);
+    free(capture);
+}
+
+int neu_capture_reset(neu_capture_t *capture, size_t size)
+{
+    int rv = 0;
+
+    size = clamp_size(size);
+    pthread_mutex_lock(&capture->mtx);
+    if (size != capture->size) {
+        uint8_t *ring = calloc(size, 1);
+
+        if (ring != NULL) {
+            free(capture->ring);
+            capture->ring = ring;
+            capture->size = size;
+        } else {
+            rv = -1;
+        }
+    }
+    capture->head    = 0;
+    capture->tail    = 0;
+    capture->used    = 0;
+    capture->n_frame = 0;
+    capture->n_drop  = 0;
+    pthread_mutex_unlock(&capture->mtx);
+
+    return rv;
+}
+
+void neu_capture_add(neu_capture_t *capture, neu_capture_dir_e dir,
+                     const uint8_t *bytes, size_t n_byte)
+{
+    struct timeval tv     = { 0 };
+    record_t       record = {
+        .len      = n_byte > NEU_CAPTURE_SNAPLEN ? NEU_CAPTURE_SNAPLEN
+                                                 : (uint32_t) n_byte,
+        .orig_len = (uint32_t) n_byte,
+        .dir      = dir,
+    };
+
+    gettimeofday(&tv, NULL);
+    record.timestamp = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+    pthread_mutex_lock(&capture->mtx);
+    if (sizeof(record) + record.len > capture->size) {
+        capture->n_drop += 1;
+    } else {
+        while (capture->used + sizeof(record) + record.len > capture->size) {
+            ring_evict(capture);
+        }
+        ring_write(capture, &record, sizeof(record));
+        ring_write(capture, bytes, record.len);
+        capture->n_frame += 1;
+    }
+    pthread_mutex_unlock(&capture->mtx);
+}
+
+void neu_capture_used(neu_capture_t *capture, size_t *n_frame,
+                      uint64_t *n_drop)
+{
+    pthread_mutex_lock(&capture->mtx);
+    *n_frame = capture->n_frame;
+    *n_drop  = capture->n_drop;
+    pthread_mutex_unlock(&capture->mtx);
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+// the blocks are written in host byte order, readers detect it from the
+// byte order magic of the section header
+static uint8_t *put_header(uint8_t *p)
+{
+    p = put32(p, PCAPNG_SHB);
+    p = put32(p, PCAPNG_SHB_LEN);
+    p = put32(p, PCAPNG_BYTE_ORDER);
+    p = put16(p, 1);
+    p = put16(p, 0);
+    // unspecified section length
+    p = put32(p, UINT32_MAX);
+    p = put32(p, UINT32_MAX);
+    p = put32(p, PCAPNG_SHB_LEN);
+
+    p = put32(p, PCAPNG_IDB);
+    p = put32(p, PCAPNG_IDB_LEN);
+    p = put16(p, NEU_CAPTURE_LINKTYPE);
+    p = put16(p, 0);
+    p = put32(p, NEU_CAPTURE_SNAPLEN);
+    p = put32(p, PCAPNG_IDB_LEN);
+
+    return p;
+}
+
+int neu_capture_dump(neu_capture_t *capture, uint8_t **data, size_t *len)
+{
+    uint8_t *p   = NULL;
+    size_t   off = 0;
+
+    pthread_mutex_lock(&capture->mtx);
+
+    *len = PCAPNG_SHB_LEN + PCAPNG_IDB_LEN;
+    off  = capture->tail;
+    for (size_t i = 0; i < capture->n_frame; i++) {
+        record_t record = { 0 };
+
+        ring_read(capture, off, &record, sizeof(record));
+        *len += PCAPNG_EPB_LEN + PAD4(record.len);
+        off = (off + sizeof(record) + record.len) % capture->size;
+    }
+
+    *data = calloc(*len, 1);
+    if (*data == NULL) {
+        pthread_mutex_unlock(&capture->mtx);
+        return -1;
+    }
+
+    p   = put_header(*data);
+    off = capture->tail;
+    for (size_t i = 0; i < capture->n_frame; i++) {
+        record_t record    = { 0 };
+        uint32_t block_len = 0;
+
+        ring_read(capture, off, &record, sizeof(record));
+        off       = (off + sizeof(record)) % capture->size;
+        block_len = PCAPNG_EPB_LEN + PAD4(record.len);
+
+        p = put32(p, PCAPNG_EPB);
+        p = put32(p, block_len);
+        p = put32(p, 0);
+        p = put32(p, (uint32_t)(record.timestamp >> 32));
+        p = put32(p, (uint32_t) record.timestamp);
+        p = put32(p, record.len);
+        p = put32(p, record.orig_len);
+        ring_read(capture, off, p, record.len);
+        p += PAD4(record.len);
+        off = (off + record.len) % capture->size;
+
+        // epb_flags, the direction is in the two low bits
+        p = put16(p, PCAPNG_OPT_EPB_FLAGS);
+        p = put16(p, 4);
+        p = put32(p, record.dir);
+        p = put32(p, 0);
+        p = put32(p, block_len);
+    }
+
+    pthread_mutex_unlock(&capture->mtx);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#include <neuron.h>
+
+zlog_category_t *neuron = NULL;
+
+struct frame {
+    uint32_t             flags;
+    uint32_t             orig_len;
+    std::vector<uint8_t> bytes;
+};
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v = 0;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// walks the enhanced packet blocks after the section and interface headers
+static std::vector<frame> dump(neu_capture_t *capture)
+{
+    std::vector<frame> frames;
+    uint8_t *          data = NULL;
+    size_t             len  = 0;
+
+    EXPECT_EQ(0, neu_capture_dump(capture, &data, &len));
+    EXPECT_EQ(0x0A0D0D0Au, get32(data));
+    EXPECT_EQ(0x1A2B3C4Du, get32(data + 8));
+    EXPECT_EQ(1u, get32(data + 28));
+    EXPECT_EQ((uint32_t) NEU_CAPTURE_LINKTYPE, get32(data + 36) & 0xffff);
+
+    for (size_t off = 48; off < len; off += get32(data + off + 4)) {
+        const uint8_t *block = data + off;
+        uint32_t       n     = get32(block + 20);
+        frame          f;
+
+        EXPECT_EQ(6u, get32(block));
+        EXPECT_EQ(get32(block + 4), get32(block + get32(block + 4) - 4));
+        f.orig_len = get32(block + 24);
+        f.bytes.assign(block + 28, block + 28 + n);
+        f.flags = get32(block + 28 + ((n + 3) & ~3u) + 4);
+        frames.push_back(f);
+    }
+
+    free(data);
+    return frames;
+}
+
+TEST(CaptureTest, direction)
+{
+    neu_capture_t *capture = neu_capture_new(NEU_CAPTURE_SIZE_MIN);
+    uint8_t        req[]   = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01 };
+    uint8_t        res[]   = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x05 };
+
+    neu_capture_add(capture, NEU_CAPTURE_SEND, req, sizeof(req));
+    neu_capture_add(capture, NEU_CAPTURE_RECV, res, sizeof(res));
+
+    std::vector<frame> frames = dump(capture);
+    ASSERT_EQ(2u, frames.size());
+    EXPECT_EQ((uint32_t) NEU_CAPTURE_SEND, frames[0].flags);
+    EXPECT_EQ(std::vector<uint8_t>(req, req + sizeof(req)), frames[0].bytes);
+    EXPECT_EQ((uint32_t) NEU_CAPTURE_RECV, frames[1].flags);
+    EXPECT_EQ(std::vector<uint8_t>(res, res + sizeof(res)), frames[1].bytes);
+
+    neu_capture_free(capture);
+}
+
+// the oldest frames are overwritten once the ring wraps
+TEST(CaptureTest, overwrite)
+{
+    neu_capture_t *capture = neu_capture_new(NEU_CAPTURE_SIZE_MIN);
+    uint8_t        buf[100];
+    size_t         n_frame = 0;
+    uint64_t       n_drop  = 0;
+
+    for (int i = 0; i < 200; i++) {
+        memset(buf, i, sizeof(buf));
+        neu_capture_add(capture, NEU_CAPTURE_SEND, buf, sizeof(buf));
+    }
+
+    std::vector<frame> frames = dump(capture);
+    neu_capture_used(capture, &n_frame, &n_drop);
+    ASSERT_FALSE(frames.empty());
+    EXPECT_EQ(frames.size(), n_frame);
+    EXPECT_EQ(200u, n_frame + n_drop);
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(200 - frames.size() + i, frames[i].bytes[0]);
+        EXPECT_EQ(frames[i].bytes[0], frames[i].bytes[sizeof(buf) - 1]);
+    }
+
+    EXPECT_EQ(0, neu_capture_reset(capture, NEU_CAPTURE_SIZE_MIN * 2));
+    EXPECT_TRUE(dump(capture).empty());
+
+    neu_capture_free(capture);
+}
+
+TEST(CaptureTest, oversize)
+{
+    neu_capture_t *      capture = neu_capture_new(NEU_CAPTURE_SIZE_MIN);
+    std::vector<uint8_t> big(NEU_CAPTURE_SIZE_MIN, 0xaa);
+    uint8_t              small[] = { 0x01 };
+    size_t               n_frame = 0;
+    uint64_t             n_drop  = 0;
+
+    neu_capture_add(capture, NEU_CAPTURE_RECV, small, sizeof(small));
+    neu_capture_add(capture, NEU_CAPTURE_RECV, big.data(), big.size());
+    neu_capture_used(capture, &n_frame, &n_drop);
+    EXPECT_EQ(1u, n_frame);
+    EXPECT_EQ(1u, n_drop);
+
+    neu_capture_free(capture);
+}
+
+int main(int argc, char **argv)
+{
+    zlog_init("./config/dev.conf");
+    neuron = zlog_get_category("neuron");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
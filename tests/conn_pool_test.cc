@@ -0,0 +1,302 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <neuron.h>
+
+zlog_category_t *neuron = NULL;
+
+// a frame is a 2 bytes tag, a length byte and the payload
+static int frame_size(const uint8_t *buf, size_t len)
+{
+    return len < 3 ? 0 : 3 + buf[2];
+}
+
+static uint16_t frame_tag(const uint8_t *buf, size_t len)
+{
+    (void) len;
+    return (uint16_t) buf[0] << 8 | buf[1];
+}
+
+static const neu_conn_framing_t framing = {
+    .frame_size = frame_size,
+    .frame_tag  = frame_tag,
+};
+
+// echoes the frames, in the order they are received, unless muted
+struct echo_server {
+    int                   fd       = -1;
+    uint16_t              port     = 0;
+    int                   n_accept = 0;
+    bool                  stop     = false;
+    bool                  mute     = false;
+    std::vector<uint16_t> tags;
+    std::mutex            mtx;
+    std::thread           thread;
+
+    void start()
+    {
+        struct sockaddr_in addr = {};
+        socklen_t          len  = sizeof(addr);
+
+        fd                   = socket(AF_INET, SOCK_STREAM, 0);
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(0, bind(fd, (struct sockaddr *) &addr, sizeof(addr)));
+        ASSERT_EQ(0, listen(fd, 8));
+        getsockname(fd, (struct sockaddr *) &addr, &len);
+        port   = ntohs(addr.sin_port);
+        thread = std::thread([this] { run(); });
+    }
+
+    void run()
+    {
+        std::vector<struct pollfd> fds = { { fd, POLLIN, 0 } };
+        uint8_t                    buf[1024];
+
+        while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+            if (poll(fds.data(), fds.size(), 10) <= 0) {
+                continue;
+            }
+            if (fds[0].revents & POLLIN) {
+                fds.push_back({ accept(fd, NULL, NULL), POLLIN, 0 });
+                std::lock_guard<std::mutex> lock(mtx);
+                n_accept += 1;
+            }
+            for (size_t i = 1; i < fds.size(); i++) {
+                ssize_t n = 0;
+
+                if (!(fds[i].revents & POLLIN) ||
+                    (n = recv(fds[i].fd, buf, sizeof(buf), 0)) <= 0) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mtx);
+                for (ssize_t off = 0; off < n;
+                     off += frame_size(buf + off, 3)) {
+                    tags.push_back(frame_tag(buf + off, 2));
+                }
+                if (!mute) {
+                    EXPECT_EQ(n, send(fds[i].fd, buf, n, MSG_NOSIGNAL));
+                }
+            }
+        }
+
+        for (auto &p : fds) {
+            close(p.fd);
+        }
+    }
+
+    void close_all()
+    {
+        __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+        thread.join();
+    }
+};
+
+struct member {
+    neu_conn_t *conn     = NULL;
+    uint16_t    base     = 0;
+    uint16_t    mask     = 0;
+    int         n_recv   = 0;
+    bool        misroute = false;
+};
+
+static void connected(void *data, int fd)
+{
+    (void) data;
+    (void) fd;
+}
+
+static neu_conn_t *join(echo_server &server, member &m, bool shared,
+                        uint16_t sessions, uint16_t window)
+{
+    neu_conn_param_t param = {};
+
+    param.log                             = neuron;
+    param.type                            = NEU_CONN_TCP_CLIENT;
+    param.params.tcp_client.ip            = (char *) "127.0.0.1";
+    param.params.tcp_client.port          = server.port;
+    param.params.tcp_client.pool.shared   = shared;
+    param.params.tcp_client.pool.sessions = sessions;
+    param.params.tcp_client.pool.window   = window;
+    param.params.tcp_client.pool.timeout  = 2000;
+    param.params.tcp_client.pool.framing  = &framing;
+
+    m.conn = neu_conn_new(&param, &m, connected, connected);
+    m.base = neu_conn_tag_base(m.conn, &m.mask);
+    return m.conn;
+}
+
+static void send_frame(member &m, uint16_t n)
+{
+    uint16_t tag      = m.base | (n & m.mask);
+    uint8_t  frame[4] = { (uint8_t)(tag >> 8), (uint8_t) tag, 1, 0x5a };
+
+    EXPECT_EQ(4, neu_conn_send(m.conn, frame, sizeof(frame)));
+}
+
+static void recv_frames(member &m)
+{
+    uint8_t buf[256] = { 0 };
+    ssize_t n        = neu_conn_recv(m.conn, buf, sizeof(buf));
+
+    for (ssize_t off = 0; off < n; off += frame_size(buf + off, 3)) {
+        if ((frame_tag(buf + off, 2) & ~m.mask) != m.base) {
+            m.misroute = true;
+        }
+        m.n_recv += 1;
+    }
+}
+
+static void wait_recv(std::vector<member *> members, int n)
+{
+    for (int i = 0; i < 300; i++) {
+        bool done = true;
+
+        for (auto m : members) {
+            recv_frames(*m);
+            done = done && m->n_recv >= n;
+        }
+        if (done) {
+            return;
+        }
+        usleep(10 * 1000);
+    }
+}
+
+TEST(ConnPoolTest, shared_session)
+{
+    echo_server server;
+    member      a, b;
+
+    server.start();
+    join(server, a, true, 1, 4);
+    join(server, b, true, 1, 4);
+    EXPECT_NE(a.base, b.base);
+    EXPECT_EQ(NEU_CONN_TAG_MASK, a.mask);
+
+    for (uint16_t i = 0; i < 3; i++) {
+        send_frame(a, i);
+        send_frame(b, i);
+    }
+    wait_recv({ &a, &b }, 3);
+
+    EXPECT_EQ(3, a.n_recv);
+    EXPECT_EQ(3, b.n_recv);
+    EXPECT_FALSE(a.misroute);
+    EXPECT_FALSE(b.misroute);
+    EXPECT_EQ(1, server.n_accept);
+
+    neu_conn_destory(a.conn);
+    neu_conn_destory(b.conn);
+    server.close_all();
+}
+
+TEST(ConnPoolTest, parallel_sessions)
+{
+    echo_server server;
+    member      a;
+
+    server.start();
+    join(server, a, false, 2, 4);
+    EXPECT_EQ(0, a.base);
+
+    for (uint16_t i = 0; i < 4; i++) {
+        send_frame(a, i);
+    }
+    wait_recv({ &a }, 4);
+
+    EXPECT_EQ(4, a.n_recv);
+    EXPECT_EQ(2, server.n_accept);
+
+    // both of the sessions are counted
+    neu_conn_stat_t stat = {};
+    neu_conn_stat(a.conn, &stat);
+    EXPECT_EQ(2u, stat.connect_attempts);
+    EXPECT_EQ(0u, stat.connect_failures);
+
+    neu_conn_destory(a.conn);
+    server.close_all();
+}
+
+// one request in flight, the members are served in turn
+TEST(ConnPoolTest, fair_turns)
+{
+    echo_server server;
+    member      a, b;
+    size_t      pos = 0;
+
+    server.start();
+    join(server, a, true, 1, 1);
+    join(server, b, true, 1, 1);
+
+    for (uint16_t i = 0; i < 8; i++) {
+        send_frame(a, i);
+    }
+    send_frame(b, 0);
+    wait_recv({ &a }, 8);
+    wait_recv({ &b }, 1);
+
+    EXPECT_EQ(8, a.n_recv);
+    EXPECT_EQ(1, b.n_recv);
+    server.mtx.lock();
+    EXPECT_EQ(9u, server.tags.size());
+    while (pos < server.tags.size() && server.tags[pos] != b.base) {
+        pos++;
+    }
+    server.mtx.unlock();
+    EXPECT_LE(pos, 1u);
+
+    neu_conn_destory(a.conn);
+    neu_conn_destory(b.conn);
+    server.close_all();
+}
+
+// a member backed up by a slow device is refused, the others go on
+TEST(ConnPoolTest, queue_full)
+{
+    echo_server server;
+    member      a, b;
+    uint8_t     frame[4] = { 0, 0, 1, 0x5a };
+    int         n        = 0;
+
+    server.mute = true;
+    server.start();
+    join(server, a, true, 1, 1);
+    join(server, b, true, 1, 1);
+
+    for (; n < 256; n++) {
+        uint16_t tag = a.base | (n & a.mask);
+
+        frame[0] = (uint8_t)(tag >> 8);
+        frame[1] = (uint8_t) tag;
+        if (neu_conn_send(a.conn, frame, sizeof(frame)) < 0) {
+            EXPECT_EQ(EAGAIN, errno);
+            break;
+        }
+    }
+    EXPECT_GE(n, 64);
+    EXPECT_LT(n, 256);
+
+    send_frame(b, 0);
+
+    neu_conn_destory(a.conn);
+    neu_conn_destory(b.conn);
+    server.close_all();
+}
+
+int main(int argc, char **argv)
+{
+    zlog_init("./config/dev.conf");
+    neuron = zlog_get_category("neuron");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+
+#include <inttypes.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <neuron.h>
+
+zlog_category_t *neuron = NULL;
+
+struct io_ctx {
+    int n_read;
+    int n_call;
+    // the first call leaves the byte unread
+    bool lazy;
+};
+
+static int timer_cb(void *usr_data)
+{
+    __atomic_fetch_add((int *) usr_data, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int io_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    struct io_ctx *ctx = (struct io_ctx *) usr_data;
+    char           c   = 0;
+
+    if (type != NEU_EVENT_IO_READ) {
+        return 0;
+    }
+
+    if (__atomic_fetch_add(&ctx->n_call, 1, __ATOMIC_RELAXED) == 0 &&
+        ctx->lazy) {
+        return 0;
+    }
+
+    if (read(fd, &c, 1) == 1) {
+        __atomic_fetch_add(&ctx->n_read, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+static int load(int *v)
+{
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+static void test_timer(neu_event_backend_e backend)
+{
+    int                     n      = 0;
+    neu_events_t *          events = NULL;
+    neu_event_timer_t *     timer  = NULL;
+    neu_event_timer_param_t param  = {
+        .second      = 0,
+        .millisecond = 50,
+        .usr_data    = &n,
+        .cb          = timer_cb,
+    };
+
+    neu_event_set_backend(backend);
+    events = neu_event_new();
+    timer  = neu_event_add_timer(events, param);
+
+    usleep(280 * 1000);
+    neu_event_del_timer(events, timer);
+    EXPECT_GE(load(&n), 3);
+    EXPECT_LE(load(&n), 6);
+
+    n = 0;
+    usleep(120 * 1000);
+    EXPECT_EQ(0, load(&n));
+
+    neu_event_close(events);
+}
+
+static void test_io(neu_event_backend_e backend, bool lazy)
+{
+    int                  fds[2] = { 0 };
+    struct io_ctx        ctx    = { 0, 0, lazy };
+    neu_events_t *       events = NULL;
+    neu_event_io_t *     io     = NULL;
+    neu_event_io_param_t param  = { 0 };
+
+    ASSERT_EQ(0, pipe(fds));
+    param.fd       = fds[0];
+    param.usr_data = &ctx;
+    param.cb       = io_cb;
+
+    neu_event_set_backend(backend);
+    events = neu_event_new();
+    io     = neu_event_add_io(events, param);
+
+    EXPECT_EQ(1, write(fds[1], "a", 1));
+    usleep(50 * 1000);
+    EXPECT_EQ(1, load(&ctx.n_read));
+    EXPECT_EQ(lazy ? 2 : 1, load(&ctx.n_call));
+
+    EXPECT_EQ(1, write(fds[1], "b", 1));
+    usleep(50 * 1000);
+    EXPECT_EQ(2, load(&ctx.n_read));
+
+    neu_event_del_io(events, io);
+    EXPECT_EQ(1, write(fds[1], "c", 1));
+    usleep(50 * 1000);
+    EXPECT_EQ(2, load(&ctx.n_read));
+
+    neu_event_close(events);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(EventTest, epoll_timer)
+{
+    test_timer(NEU_EVENT_BACKEND_EPOLL);
+}
+
+TEST(EventTest, epoll_io)
+{
+    test_io(NEU_EVENT_BACKEND_EPOLL, false);
+    test_io(NEU_EVENT_BACKEND_EPOLL, true);
+}
+
+// falls back to epoll when io_uring is not built or not supported
+TEST(EventTest, io_uring_timer)
+{
+    test_timer(NEU_EVENT_BACKEND_IO_URING);
+}
+
+TEST(EventTest, io_uring_io)
+{
+    test_io(NEU_EVENT_BACKEND_IO_URING, false);
+    test_io(NEU_EVENT_BACKEND_IO_URING, true);
+}
+
+#define BENCH_REQUESTS 10000
+#define BENCH_TIMERS 16
+
+static int echo_cb(enum neu_event_io_type type, int fd, void *usr_data)
+{
+    char buf[16] = { 0 };
+
+    (void) usr_data;
+    if (type == NEU_EVENT_IO_READ && read(fd, buf, sizeof(buf)) > 0) {
+        EXPECT_EQ(1, write(fd, buf, 1));
+    }
+    return 0;
+}
+
+static uint64_t cpu_us()
+{
+    struct rusage ru = { 0 };
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t) ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec +
+        (uint64_t) ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+}
+
+static void bench(neu_event_backend_e backend, const char *name)
+{
+    int                     fds[2]               = { 0 };
+    int                     n_timer              = 0;
+    neu_events_t *          events               = NULL;
+    neu_event_io_t *        io                   = NULL;
+    neu_event_timer_t *     timers[BENCH_TIMERS] = { 0 };
+    neu_event_stat_t        stat                 = { 0 };
+    neu_event_io_param_t    io_param             = { 0 };
+    neu_event_timer_param_t timer_param          = {
+        .second      = 0,
+        .millisecond = 10,
+        .usr_data    = &n_timer,
+        .cb          = timer_cb,
+    };
+    uint64_t cpu = 0;
+    char     c   = 0;
+
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    io_param.fd = fds[1];
+    io_param.cb = echo_cb;
+
+    neu_event_set_backend(backend);
+    events = neu_event_new();
+    io     = neu_event_add_io(events, io_param);
+    // the group timers of a busy driver
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        timers[i] = neu_event_add_timer(events, timer_param);
+    }
+
+    cpu = cpu_us();
+    for (int i = 0; i < BENCH_REQUESTS; i++) {
+        ASSERT_EQ(1, write(fds[0], "r", 1));
+        ASSERT_EQ(1, read(fds[0], &c, 1));
+    }
+    cpu = cpu_us() - cpu;
+    neu_event_stat(events, &stat);
+
+    printf("%-8s cpu per 10k requests: %" PRIu64 " us, polls: %" PRIu64
+           ", syscalls per poll: %.2f, events per poll: %.2f, timers: %d\n",
+           name, cpu * 10000 / BENCH_REQUESTS, stat.n_poll,
+           (double) stat.n_syscall / stat.n_poll,
+           (double) stat.n_event / stat.n_poll, load(&n_timer));
+
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        neu_event_del_timer(events, timers[i]);
+    }
+    neu_event_del_io(events, io);
+    neu_event_close(events);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// ./event_test --gtest_also_run_disabled_tests --gtest_filter=*bench*
+TEST(EventTest, DISABLED_bench)
+{
+    bench(NEU_EVENT_BACKEND_EPOLL, "epoll");
+    bench(NEU_EVENT_BACKEND_IO_URING, "io_uring");
+}
+
+int main(int argc, char **argv)
+{
+    zlog_init("./config/dev.conf");
+    neuron = zlog_get_category("neuron");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtest/gtest.h>
+
+#include "modbus.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+static uint64_t now_ns()
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TEST(ModbusDecodeTest, Registers)
+{
+    uint8_t  bytes[250] = { 0 };
+    uint16_t regs[125]  = { 0 };
+
+    for (int i = 0; i < 250; i++) {
+        bytes[i] = (uint8_t) i;
+    }
+
+    for (uint16_t n = 0; n <= 125; n++) {
+        memset(regs, 0, sizeof(regs));
+        modbus_registers_decode(bytes, n, regs);
+
+        for (uint16_t i = 0; i < n; i++) {
+            uint16_t v = 0;
+
+            memcpy(&v, bytes + i * 2, sizeof(v));
+            EXPECT_EQ(ntohs(v), regs[i]);
+        }
+        for (uint16_t i = n; i < 125; i++) {
+            EXPECT_EQ(0, regs[i]);
+        }
+    }
+}
+
+// the scalar path decoded each register of a response on its own
+TEST(ModbusDecodeTest, DISABLED_Bench)
+{
+    uint8_t           bytes[250] = { 0 };
+    uint16_t          regs[125]  = { 0 };
+    volatile uint16_t sink       = 0;
+    int               loop       = 200000;
+    uint64_t          start      = 0;
+    uint64_t          scalar     = 0;
+    uint64_t          batch      = 0;
+
+    for (int i = 0; i < 250; i++) {
+        bytes[i] = (uint8_t) rand();
+    }
+
+    start = now_ns();
+    for (int l = 0; l < loop; l++) {
+        for (uint16_t i = 0; i < 125; i++) {
+            uint16_t v = 0;
+
+            memcpy(&v, bytes + i * 2, sizeof(v));
+            regs[i] = ntohs(v);
+        }
+        sink = sink + regs[l % 125];
+    }
+    scalar = now_ns() - start;
+
+    start = now_ns();
+    for (int l = 0; l < loop; l++) {
+        modbus_registers_decode(bytes, 125, regs);
+        sink = sink + regs[l % 125];
+    }
+    batch = now_ns() - start;
+
+    printf("125 registers, scalar: %.1f ns, batch: %.1f ns\n",
+           (double) scalar / loop, (double) batch / loop);
+}
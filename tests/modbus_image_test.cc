@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "modbus_image.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+static UT_icd info_icd = { sizeof(neu_resp_get_sub_driver_tags_info_t), NULL,
+                           NULL, NULL };
+static UT_icd tag_icd  = { sizeof(neu_datatag_t), NULL, NULL, NULL };
+
+static void info_add(UT_array *infos, const char *group, const char **names,
+                     const neu_type_e *types, int n)
+{
+    neu_resp_get_sub_driver_tags_info_t info = { 0 };
+
+    strcpy(info.driver, "driver");
+    strcpy(info.group, group);
+    utarray_new(info.tags, &tag_icd);
+    for (int i = 0; i < n; i++) {
+        neu_datatag_t tag = { 0 };
+
+        tag.name = (char *) names[i];
+        tag.type = types[i];
+        utarray_push_back(info.tags, &tag);
+    }
+    utarray_push_back(infos, &info);
+}
+
+static void infos_free(UT_array *infos)
+{
+    utarray_foreach(infos, neu_resp_get_sub_driver_tags_info_t *, info)
+    {
+        utarray_free(info->tags);
+    }
+    utarray_free(infos);
+}
+
+static neu_reqresp_trans_data_t *trans_new(const char *group, int n)
+{
+    neu_reqresp_trans_data_t *data = (neu_reqresp_trans_data_t *) calloc(
+        1, sizeof(neu_reqresp_trans_data_t) + n * sizeof(neu_resp_tag_value_t));
+
+    strcpy(data->driver, "driver");
+    strcpy(data->group, group);
+    data->n_tag = n;
+    return data;
+}
+
+TEST(ModbusImageTest, Registers)
+{
+    const char *     names[] = { "u16", "f32", "i8", "s" };
+    const neu_type_e types[] = { NEU_TYPE_UINT16, NEU_TYPE_FLOAT,
+                                 NEU_TYPE_INT8, NEU_TYPE_STRING };
+    modbus_image_t * image   = modbus_image_new();
+    UT_array *       infos   = NULL;
+    modbus_area_e    area    = MODBUS_AREA_COIL;
+    uint8_t          bytes[MODBUS_MAX_PDU] = { 0 };
+    uint8_t expect[] = { 0x3f, 0x80, 0x00, 0x00, 0xff, 0xfe, 0x12, 0x34 };
+
+    utarray_new(infos, &info_icd);
+    info_add(infos, "g", names, types, 4);
+    modbus_image_layout(image, infos);
+
+    // sorted by name
+    EXPECT_EQ(0, modbus_image_address(image, "driver", "g", "f32", &area));
+    EXPECT_EQ(MODBUS_AREA_HOLD_REGISTER, area);
+    EXPECT_EQ(2, modbus_image_address(image, "driver", "g", "i8", &area));
+    EXPECT_EQ(3, modbus_image_address(image, "driver", "g", "u16", &area));
+    EXPECT_EQ(-1, modbus_image_address(image, "driver", "g", "s", &area));
+
+    neu_reqresp_trans_data_t *data = trans_new("g", 4);
+    strcpy(data->tags[0].tag, "u16");
+    data->tags[0].value.type      = NEU_TYPE_UINT16;
+    data->tags[0].value.value.u16 = 0x1234;
+    strcpy(data->tags[1].tag, "f32");
+    data->tags[1].value.type      = NEU_TYPE_FLOAT;
+    data->tags[1].value.value.f32 = 1.0;
+    strcpy(data->tags[2].tag, "i8");
+    data->tags[2].value.type     = NEU_TYPE_INT8;
+    data->tags[2].value.value.i8 = -2;
+    // the string is not mapped, no new layout is needed for it
+    strcpy(data->tags[3].tag, "s");
+    data->tags[3].value.type = NEU_TYPE_STRING;
+    EXPECT_EQ(0, modbus_image_update(image, data));
+
+    EXPECT_EQ(8,
+              modbus_image_read(image, MODBUS_READ_HOLD_REG, 0, 4, bytes));
+    EXPECT_EQ(0, memcmp(expect, bytes, sizeof(expect)));
+    EXPECT_EQ(2,
+              modbus_image_read(image, MODBUS_READ_INPUT_REG, 3, 1, bytes));
+    EXPECT_EQ(0, memcmp(&expect[6], bytes, 2));
+
+    EXPECT_EQ(-MODBUS_EXCEPTION_ILLEGAL_ADDRESS,
+              modbus_image_read(image, MODBUS_READ_HOLD_REG, 3, 2, bytes));
+    EXPECT_EQ(-MODBUS_EXCEPTION_ILLEGAL_VALUE,
+              modbus_image_read(image, MODBUS_READ_HOLD_REG, 0, 0, bytes));
+    EXPECT_EQ(-MODBUS_EXCEPTION_ILLEGAL_FUNCTION,
+              modbus_image_read(image, MODBUS_WRITE_S_HOLD_REG, 0, 1, bytes));
+
+    // an error keeps the last value
+    data->tags[0].value.type = NEU_TYPE_ERROR;
+    EXPECT_EQ(0, modbus_image_update(image, data));
+    EXPECT_EQ(2, modbus_image_read(image, MODBUS_READ_HOLD_REG, 3, 1, bytes));
+    EXPECT_EQ(0x12, bytes[0]);
+
+    free(data);
+    infos_free(infos);
+    modbus_image_free(image);
+}
+
+TEST(ModbusImageTest, Coils)
+{
+    const char *names[10] = { "b0", "b1", "b2", "b3", "b4",
+                              "b5", "b6", "b7", "b8", "b9" };
+    neu_type_e       types[10];
+    modbus_image_t * image                 = modbus_image_new();
+    UT_array *       infos                 = NULL;
+    uint8_t          bytes[MODBUS_MAX_PDU] = { 0 };
+    neu_reqresp_trans_data_t *data         = trans_new("g", 10);
+
+    for (int i = 0; i < 10; i++) {
+        types[i] = NEU_TYPE_BOOL;
+        strcpy(data->tags[i].tag, names[i]);
+        data->tags[i].value.type          = NEU_TYPE_BOOL;
+        data->tags[i].value.value.boolean = i % 3 == 0;
+    }
+
+    utarray_new(infos, &info_icd);
+    info_add(infos, "g", names, types, 10);
+    modbus_image_layout(image, infos);
+    EXPECT_EQ(0, modbus_image_update(image, data));
+
+    // 1001 0010 01
+    EXPECT_EQ(2, modbus_image_read(image, MODBUS_READ_COIL, 0, 10, bytes));
+    EXPECT_EQ(0x49, bytes[0]);
+    EXPECT_EQ(0x02, bytes[1]);
+    EXPECT_EQ(1, modbus_image_read(image, MODBUS_READ_INPUT, 3, 7, bytes));
+    EXPECT_EQ(0x49, bytes[0]);
+    EXPECT_EQ(-MODBUS_EXCEPTION_ILLEGAL_ADDRESS,
+              modbus_image_read(image, MODBUS_READ_COIL, 5, 6, bytes));
+
+    free(data);
+    infos_free(infos);
+    modbus_image_free(image);
+}
+
+TEST(ModbusImageTest, LayoutStable)
+{
+    const char *     a[]     = { "a0", "a1" };
+    const char *     b[]     = { "b0" };
+    const neu_type_e types[] = { NEU_TYPE_UINT32, NEU_TYPE_UINT32 };
+    modbus_image_t * image   = modbus_image_new();
+    UT_array *       infos   = NULL;
+    modbus_area_e    area    = MODBUS_AREA_COIL;
+
+    utarray_new(infos, &info_icd);
+    info_add(infos, "a", a, types, 2);
+    modbus_image_layout(image, infos);
+    infos_free(infos);
+
+    // a1 deleted, group b subscribed, b0 takes the space of a1
+    utarray_new(infos, &info_icd);
+    info_add(infos, "b", b, types, 1);
+    info_add(infos, "a", a, types, 1);
+    modbus_image_layout(image, infos);
+
+    EXPECT_EQ(0, modbus_image_address(image, "driver", "a", "a0", &area));
+    EXPECT_EQ(-1, modbus_image_address(image, "driver", "a", "a1", &area));
+    EXPECT_EQ(2, modbus_image_address(image, "driver", "b", "b0", &area));
+
+    neu_reqresp_trans_data_t *data = trans_new("c", 1);
+    strcpy(data->tags[0].tag, "c0");
+    data->tags[0].value.type = NEU_TYPE_UINT32;
+    EXPECT_EQ(-1, modbus_image_update(image, data));
+
+    free(data);
+    infos_free(infos);
+    modbus_image_free(image);
+}
+
+// the addresses do not depend on the order the groups are subscribed in
+TEST(ModbusImageTest, LayoutSorted)
+{
+    const char *     a[]     = { "a1", "a0" };
+    const char *     b[]     = { "b0" };
+    const neu_type_e types[] = { NEU_TYPE_UINT16, NEU_TYPE_UINT16 };
+    modbus_area_e    area    = MODBUS_AREA_COIL;
+
+    for (int order = 0; order < 2; order++) {
+        modbus_image_t *image      = modbus_image_new();
+        UT_array *      infos      = NULL;
+        uint32_t        n_register = 0;
+        uint32_t        n_bit      = 0;
+
+        utarray_new(infos, &info_icd);
+        if (order == 0) {
+            info_add(infos, "a", a, types, 2);
+            info_add(infos, "b", b, types, 1);
+        } else {
+            info_add(infos, "b", b, types, 1);
+            info_add(infos, "a", a, types, 2);
+        }
+        modbus_image_layout(image, infos);
+
+        EXPECT_EQ(0, modbus_image_address(image, "driver", "a", "a0", &area));
+        EXPECT_EQ(1, modbus_image_address(image, "driver", "a", "a1", &area));
+        EXPECT_EQ(2, modbus_image_address(image, "driver", "b", "b0", &area));
+        modbus_image_size(image, &n_register, &n_bit);
+        EXPECT_EQ(3u, n_register);
+
+        infos_free(infos);
+        modbus_image_free(image);
+    }
+}
+
+// the freed space is reused, and the image shrinks when its end is freed
+TEST(ModbusImageTest, LayoutReuse)
+{
+    const char *     names[]    = { "t0", "t1", "t2" };
+    const neu_type_e wide[]     = { NEU_TYPE_UINT16, NEU_TYPE_UINT64,
+                                    NEU_TYPE_UINT16 };
+    const neu_type_e small[]    = { NEU_TYPE_UINT16, NEU_TYPE_UINT32,
+                                    NEU_TYPE_UINT16 };
+    const char *     tail[]     = { "t0" };
+    modbus_image_t * image      = modbus_image_new();
+    UT_array *       infos      = NULL;
+    modbus_area_e    area       = MODBUS_AREA_COIL;
+    uint32_t         n_register = 0;
+    uint32_t         n_bit      = 0;
+
+    utarray_new(infos, &info_icd);
+    info_add(infos, "g", names, wide, 3);
+    modbus_image_layout(image, infos);
+    infos_free(infos);
+    EXPECT_EQ(5, modbus_image_address(image, "driver", "g", "t2", &area));
+
+    // t1 retyped, it fits in its own space
+    for (int i = 0; i < 100; i++) {
+        utarray_new(infos, &info_icd);
+        info_add(infos, "g", names, i % 2 == 0 ? small : wide, 3);
+        modbus_image_layout(image, infos);
+        infos_free(infos);
+    }
+    EXPECT_EQ(1, modbus_image_address(image, "driver", "g", "t1", &area));
+    EXPECT_EQ(5, modbus_image_address(image, "driver", "g", "t2", &area));
+    modbus_image_size(image, &n_register, &n_bit);
+    EXPECT_EQ(6u, n_register);
+
+    utarray_new(infos, &info_icd);
+    info_add(infos, "g", tail, wide, 1);
+    modbus_image_layout(image, infos);
+    infos_free(infos);
+    modbus_image_size(image, &n_register, &n_bit);
+    EXPECT_EQ(1u, n_register);
+
+    modbus_image_free(image);
+}
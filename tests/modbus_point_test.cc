@@ -0,0 +1,138 @@
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "modbus_point.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+static modbus_point_t *point_new(UT_array *points, uint16_t address,
+                                 uint16_t n_register)
+{
+    modbus_point_t *p = (modbus_point_t *) calloc(1, sizeof(modbus_point_t));
+
+    p->slave_id      = 1;
+    p->area          = MODBUS_AREA_HOLD_REGISTER;
+    p->start_address = address;
+    p->n_register    = n_register;
+    p->type          = NEU_TYPE_UINT16;
+
+    utarray_push_back(points, &p);
+    return p;
+}
+
+static void points_free(UT_array *points)
+{
+    utarray_foreach(points, modbus_point_t **, p) { free(*p); }
+    utarray_free(points);
+}
+
+TEST(ModbusPointTest, SortContiguous)
+{
+    UT_array *              points = NULL;
+    modbus_read_cmd_sort_t *sort   = NULL;
+    modbus_read_limit_t     limit  = { 125, 2000, 0, NULL };
+
+    utarray_new(points, &ut_ptr_icd);
+    point_new(points, 2, 1);
+    point_new(points, 0, 1);
+    point_new(points, 1, 1);
+    point_new(points, 4, 1);
+
+    sort = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(2, sort->n_cmd);
+    EXPECT_EQ(0, sort->cmd[0].start_address);
+    EXPECT_EQ(3, sort->cmd[0].n_register);
+    EXPECT_EQ(4, sort->cmd[1].start_address);
+    EXPECT_EQ(1, sort->cmd[1].n_register);
+
+    modbus_tag_sort_free(sort);
+    points_free(points);
+}
+
+TEST(ModbusPointTest, SortGap)
+{
+    UT_array *              points = NULL;
+    modbus_read_cmd_sort_t *sort   = NULL;
+    modbus_read_limit_t     limit  = { 125, 2000, 3, NULL };
+
+    utarray_new(points, &ut_ptr_icd);
+    point_new(points, 0, 2);
+    point_new(points, 5, 1);
+    point_new(points, 10, 1);
+
+    sort = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(2, sort->n_cmd);
+    EXPECT_EQ(0, sort->cmd[0].start_address);
+    EXPECT_EQ(6, sort->cmd[0].n_register);
+    EXPECT_EQ(2, utarray_len(sort->cmd[0].tags));
+    EXPECT_EQ(10, sort->cmd[1].start_address);
+
+    modbus_tag_sort_free(sort);
+    points_free(points);
+}
+
+TEST(ModbusPointTest, SortMaxRegister)
+{
+    UT_array *              points = NULL;
+    modbus_read_cmd_sort_t *sort   = NULL;
+    modbus_read_limit_t     limit  = { 125, 2000, 0, NULL };
+
+    utarray_new(points, &ut_ptr_icd);
+    for (uint16_t i = 0; i < 200; i++) {
+        point_new(points, i, 1);
+    }
+
+    sort = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(2, sort->n_cmd);
+    EXPECT_EQ(125, sort->cmd[0].n_register);
+    EXPECT_EQ(125, sort->cmd[1].start_address);
+    EXPECT_EQ(75, sort->cmd[1].n_register);
+
+    modbus_tag_sort_free(sort);
+    points_free(points);
+}
+
+TEST(ModbusPointTest, SortHole)
+{
+    UT_array *              points = NULL;
+    UT_array *              holes  = NULL;
+    modbus_read_cmd_sort_t *sort   = NULL;
+    UT_icd                  icd = { sizeof(modbus_hole_t), NULL, NULL, NULL };
+    modbus_read_limit_t     limit = { 125, 2000, 10, NULL };
+    modbus_hole_t           gap   = { 1, MODBUS_AREA_HOLD_REGISTER, 2, 4 };
+    modbus_hole_t           split = { 1, MODBUS_AREA_HOLD_REGISTER, 5, 5 };
+
+    utarray_new(points, &ut_ptr_icd);
+    utarray_new(holes, &icd);
+    point_new(points, 0, 2);
+    point_new(points, 4, 1);
+    point_new(points, 5, 1);
+
+    limit.holes = holes;
+    sort        = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(1, sort->n_cmd);
+    modbus_tag_sort_free(sort);
+
+    // no read across the refused addresses
+    utarray_push_back(holes, &gap);
+    sort = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(2, sort->n_cmd);
+    EXPECT_EQ(0, sort->cmd[0].start_address);
+    EXPECT_EQ(2, sort->cmd[0].n_register);
+    EXPECT_EQ(4, sort->cmd[1].start_address);
+    EXPECT_EQ(2, sort->cmd[1].n_register);
+    modbus_tag_sort_free(sort);
+
+    // split at 5
+    utarray_push_back(holes, &split);
+    sort = modbus_tag_sort(points, &limit);
+    EXPECT_EQ(3, sort->n_cmd);
+    EXPECT_EQ(5, sort->cmd[2].start_address);
+    modbus_tag_sort_free(sort);
+
+    utarray_free(holes);
+    points_free(points);
+}
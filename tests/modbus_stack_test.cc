@@ -0,0 +1,156 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "modbus_stack.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+struct stack_result {
+    int      n_value;
+    int      n_write;
+    uint16_t seq;
+    uint8_t  slave_id;
+    uint16_t n_byte;
+    bool     exception;
+};
+
+static int send_fn(void *ctx, uint16_t n_byte, uint8_t *bytes)
+{
+    (void) ctx;
+    (void) bytes;
+    return n_byte;
+}
+
+static int value_fn(void *ctx, uint16_t seq, uint8_t slave_id, uint16_t n_byte,
+                    uint8_t *bytes)
+{
+    stack_result *result = (stack_result *) ctx;
+
+    result->n_value += 1;
+    result->seq       = seq;
+    result->slave_id  = slave_id;
+    result->n_byte    = n_byte;
+    result->exception = bytes == NULL;
+    return 0;
+}
+
+static int write_fn(void *ctx, uint16_t seq, int error)
+{
+    stack_result *result = (stack_result *) ctx;
+
+    (void) error;
+    result->n_write += 1;
+    result->seq = seq;
+    return 0;
+}
+
+// the pdu of an rtu frame, the crc is appended
+static int recv_rtu(modbus_stack_t *stack, std::vector<uint8_t> pdu)
+{
+    neu_protocol_unpack_buf_t pbuf = { 0 };
+    uint16_t                  crc  = modbus_crc16(pdu.data(), pdu.size());
+
+    pdu.push_back(crc & 0xff);
+    pdu.push_back(crc >> 8);
+    neu_protocol_unpack_buf_init(&pbuf, pdu.data(), pdu.size());
+    return modbus_stack_recv(stack, &pbuf);
+}
+
+static modbus_stack_t *rtu_stack(stack_result *result)
+{
+    return modbus_stack_create(result, MODBUS_PROTOCOL_RTU, send_fn, value_fn,
+                               write_fn);
+}
+
+TEST(ModbusStackTest, RtuRead)
+{
+    stack_result    result = {};
+    modbus_stack_t *stack  = rtu_stack(&result);
+    uint16_t        size   = 0;
+    uint16_t        seq    = 0;
+
+    modbus_stack_read(stack, 1, MODBUS_AREA_HOLD_REGISTER, 0, 2, &size, &seq);
+    EXPECT_LT(0, recv_rtu(stack, { 1, 0x03, 4, 0, 1, 0, 2 }));
+    EXPECT_EQ(1, result.n_value);
+    EXPECT_EQ(seq, result.seq);
+    EXPECT_EQ(1, result.slave_id);
+    EXPECT_EQ(4, result.n_byte);
+
+    // answered already
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x03, 4, 0, 1, 0, 2 }));
+    EXPECT_EQ(1, result.n_value);
+
+    modbus_stack_destroy(stack);
+}
+
+// the late answer of an expired request is not taken for the next one
+TEST(ModbusStackTest, RtuLateResponse)
+{
+    stack_result    result = {};
+    modbus_stack_t *stack  = rtu_stack(&result);
+    uint16_t        size   = 0;
+    uint16_t        seq    = 0;
+
+    modbus_stack_read(stack, 1, MODBUS_AREA_HOLD_REGISTER, 0, 2, &size, &seq);
+    modbus_stack_read(stack, 1, MODBUS_AREA_HOLD_REGISTER, 10, 3, &size, &seq);
+
+    // byte count, slave id and function code of the other requests
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x03, 4, 0, 1, 0, 2 }));
+    EXPECT_EQ(-1, recv_rtu(stack, { 2, 0x03, 6, 0, 1, 0, 2, 0, 3 }));
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x04, 6, 0, 1, 0, 2, 0, 3 }));
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x84, 2 }));
+    EXPECT_EQ(0, result.n_value);
+
+    EXPECT_LT(0, recv_rtu(stack, { 1, 0x03, 6, 0, 1, 0, 2, 0, 3 }));
+    EXPECT_EQ(1, result.n_value);
+    EXPECT_EQ(seq, result.seq);
+    EXPECT_EQ(6, result.n_byte);
+
+    modbus_stack_destroy(stack);
+}
+
+TEST(ModbusStackTest, RtuException)
+{
+    stack_result    result = {};
+    modbus_stack_t *stack  = rtu_stack(&result);
+    uint16_t        size   = 0;
+    uint16_t        seq    = 0;
+
+    modbus_stack_read(stack, 3, MODBUS_AREA_COIL, 0, 9, &size, &seq);
+    EXPECT_LT(0, recv_rtu(stack, { 3, 0x81, 2 }));
+    EXPECT_EQ(1, result.n_value);
+    EXPECT_TRUE(result.exception);
+    EXPECT_EQ(2, result.n_byte);
+    EXPECT_EQ(seq, result.seq);
+
+    modbus_stack_destroy(stack);
+}
+
+TEST(ModbusStackTest, RtuWrite)
+{
+    stack_result    result  = {};
+    modbus_stack_t *stack   = rtu_stack(&result);
+    uint16_t        size    = 0;
+    uint16_t        seq     = 0;
+    uint8_t         on      = 1;
+    uint8_t         regs[4] = { 0, 1, 0, 2 };
+
+    modbus_stack_write(stack, 1, MODBUS_AREA_COIL, 10, 1, &on, 1, &size, &seq);
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x05, 0, 10, 0, 0 }));
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x05, 0, 11, 0xff, 0 }));
+    EXPECT_LT(0, recv_rtu(stack, { 1, 0x05, 0, 10, 0xff, 0 }));
+    EXPECT_EQ(1, result.n_write);
+    EXPECT_EQ(seq, result.seq);
+
+    modbus_stack_write(stack, 1, MODBUS_AREA_HOLD_REGISTER, 20, 2, regs,
+                       sizeof(regs), &size, &seq);
+    EXPECT_EQ(-1, recv_rtu(stack, { 1, 0x10, 0, 20, 0, 1 }));
+    EXPECT_LT(0, recv_rtu(stack, { 1, 0x10, 0, 20, 0, 2 }));
+    EXPECT_EQ(2, result.n_write);
+    EXPECT_EQ(seq, result.seq);
+
+    modbus_stack_destroy(stack);
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "modbus_req.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+static modbus_work_t *write_work(modbus_area_e area, uint16_t start,
+                                 uint16_t n, const uint8_t *bytes)
+{
+    modbus_work_t *work = (modbus_work_t *) calloc(1, sizeof(modbus_work_t));
+
+    work->type                = MODBUS_WORK_WRITE;
+    work->area                = area;
+    work->point.area          = area;
+    work->point.start_address = start;
+    work->point.n_register    = n;
+    if (area == MODBUS_AREA_COIL) {
+        work->n_byte = 1;
+    } else {
+        work->n_byte = n * 2;
+    }
+    memcpy(work->value.bytes, bytes, work->n_byte);
+
+    return work;
+}
+
+static int n_merged(modbus_work_t *work)
+{
+    modbus_work_t *merged = NULL;
+    int            n      = 0;
+
+    DL_COUNT(work->merged, merged, n);
+    return n;
+}
+
+static void free_work(modbus_work_t *work)
+{
+    modbus_work_t *merged = NULL, *tmp = NULL;
+
+    DL_FOREACH_SAFE(work->merged, merged, tmp)
+    {
+        DL_DELETE(work->merged, merged);
+        free(merged);
+    }
+    free(work->batch);
+    free(work);
+}
+
+TEST(ModbusWorkTest, RegisterAdjacent)
+{
+    const uint8_t  v1[]   = { 1, 2, 3, 4 };
+    const uint8_t  v2[]   = { 5, 6 };
+    const uint8_t  want[] = { 1, 2, 3, 4, 5, 6 };
+    modbus_work_t *work   = write_work(MODBUS_AREA_HOLD_REGISTER, 10, 2, v1);
+    modbus_work_t *next   = write_work(MODBUS_AREA_HOLD_REGISTER, 12, 1, v2);
+
+    EXPECT_TRUE(modbus_work_merge(work, next));
+    EXPECT_EQ(10, work->point.start_address);
+    EXPECT_EQ(3, work->point.n_register);
+    EXPECT_EQ(6, work->n_byte);
+    EXPECT_EQ(0, memcmp(want, work->batch, sizeof(want)));
+    EXPECT_EQ(1, n_merged(work));
+
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, RegisterOverlap)
+{
+    const uint8_t  v1[]   = { 1, 2, 3, 4 };
+    const uint8_t  v2[]   = { 7, 8, 9, 10 };
+    const uint8_t  v3[]   = { 11, 12 };
+    const uint8_t  want[] = { 1, 2, 11, 12, 9, 10 };
+    modbus_work_t *work   = write_work(MODBUS_AREA_HOLD_REGISTER, 10, 2, v1);
+
+    // the later value wins
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 11, 2, v2)));
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 11, 1, v3)));
+    EXPECT_EQ(10, work->point.start_address);
+    EXPECT_EQ(3, work->point.n_register);
+    EXPECT_EQ(6, work->n_byte);
+    EXPECT_EQ(0, memcmp(want, work->batch, sizeof(want)));
+    EXPECT_EQ(2, n_merged(work));
+
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, RegisterPrepend)
+{
+    const uint8_t  v1[]   = { 1, 2, 3, 4 };
+    const uint8_t  v2[]   = { 5, 6, 7, 8 };
+    const uint8_t  v3[]   = { 9, 10 };
+    const uint8_t  want[] = { 9, 10, 5, 6, 7, 8, 1, 2, 3, 4 };
+    modbus_work_t *work   = write_work(MODBUS_AREA_HOLD_REGISTER, 10, 2, v1);
+
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 8, 2, v2)));
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 7, 1, v3)));
+    EXPECT_EQ(7, work->point.start_address);
+    EXPECT_EQ(5, work->point.n_register);
+    EXPECT_EQ(10, work->n_byte);
+    EXPECT_EQ(0, memcmp(want, work->batch, sizeof(want)));
+
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, RegisterMax)
+{
+    uint8_t        v[NEU_VALUE_SIZE] = { 0 };
+    modbus_work_t *work = write_work(MODBUS_AREA_HOLD_REGISTER, 100, 60, v);
+    modbus_work_t *next = NULL;
+
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 160, 60, v)));
+    EXPECT_EQ(120, work->point.n_register);
+
+    // 124 registers
+    next = write_work(MODBUS_AREA_HOLD_REGISTER, 220, 4, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+    next = write_work(MODBUS_AREA_HOLD_REGISTER, 96, 4, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    EXPECT_TRUE(modbus_work_merge(
+        work, write_work(MODBUS_AREA_HOLD_REGISTER, 220, 3, v)));
+    EXPECT_EQ(MODBUS_MAX_WRITE_REGISTER, work->point.n_register);
+    EXPECT_EQ(MODBUS_MAX_WRITE_REGISTER * 2, work->n_byte);
+
+    next = write_work(MODBUS_AREA_HOLD_REGISTER, 99, 1, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, RegisterNotMerged)
+{
+    const uint8_t  v[]  = { 1, 2, 3, 4 };
+    modbus_work_t *work = write_work(MODBUS_AREA_HOLD_REGISTER, 10, 2, v);
+    modbus_work_t *next = NULL;
+
+    // a gap between the addresses
+    next = write_work(MODBUS_AREA_HOLD_REGISTER, 13, 1, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    // a single byte of a register
+    next         = write_work(MODBUS_AREA_HOLD_REGISTER, 12, 1, v);
+    next->n_byte = 1;
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    next = write_work(MODBUS_AREA_COIL, 12, 1, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    work->type = MODBUS_WORK_READ;
+    next       = write_work(MODBUS_AREA_HOLD_REGISTER, 12, 1, v);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    EXPECT_EQ(NULL, work->batch);
+    EXPECT_EQ(10, work->point.start_address);
+    EXPECT_EQ(2, work->point.n_register);
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, Coil)
+{
+    const uint8_t  on     = 0xff;
+    const uint8_t  off    = 0;
+    const uint8_t  want[] = { 1, 0, 1, 0 };
+    modbus_work_t *work   = write_work(MODBUS_AREA_COIL, 5, 1, &on);
+
+    // adjacent, prepended and overlapping
+    EXPECT_TRUE(
+        modbus_work_merge(work, write_work(MODBUS_AREA_COIL, 6, 1, &on)));
+    EXPECT_TRUE(
+        modbus_work_merge(work, write_work(MODBUS_AREA_COIL, 4, 1, &off)));
+    EXPECT_TRUE(
+        modbus_work_merge(work, write_work(MODBUS_AREA_COIL, 3, 1, &on)));
+    EXPECT_TRUE(
+        modbus_work_merge(work, write_work(MODBUS_AREA_COIL, 6, 1, &off)));
+    EXPECT_EQ(3, work->point.start_address);
+    EXPECT_EQ(4, work->point.n_register);
+    EXPECT_EQ(0, memcmp(want, work->batch, sizeof(want)));
+    EXPECT_EQ(4, n_merged(work));
+
+    free_work(work);
+}
+
+TEST(ModbusWorkTest, CoilMax)
+{
+    const uint8_t  on   = 1;
+    modbus_work_t *work = write_work(MODBUS_AREA_COIL, 0, 1, &on);
+    modbus_work_t *next = NULL;
+
+    for (uint16_t i = 1; i < MODBUS_MAX_WRITE_BIT; i++) {
+        ASSERT_TRUE(
+            modbus_work_merge(work, write_work(MODBUS_AREA_COIL, i, 1, &on)));
+    }
+    EXPECT_EQ(MODBUS_MAX_WRITE_BIT, work->point.n_register);
+
+    next = write_work(MODBUS_AREA_COIL, MODBUS_MAX_WRITE_BIT, 1, &on);
+    EXPECT_FALSE(modbus_work_merge(work, next));
+    free(next);
+
+    for (int i = 0; i < MODBUS_MAX_WRITE_BIT; i++) {
+        ASSERT_EQ(1, work->batch[i]);
+    }
+
+    free_work(work);
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "adapter.h"
+
+#include "utils/log.h"
+
+zlog_category_t *neuron = NULL;
+
+static neu_dvalue_t dvalue(neu_type_e type)
+{
+    neu_dvalue_t value = { .type = type };
+
+    switch (type) {
+    case NEU_TYPE_INT8:
+        value.value.i8 = -12;
+        break;
+    case NEU_TYPE_UINT8:
+        value.value.u8 = 0xfe;
+        break;
+    case NEU_TYPE_INT16:
+        value.value.i16 = -1234;
+        break;
+    case NEU_TYPE_UINT16:
+        value.value.u16 = 0xfedc;
+        break;
+    case NEU_TYPE_INT32:
+    case NEU_TYPE_ERROR:
+        value.value.i32 = -123456;
+        break;
+    case NEU_TYPE_UINT32:
+        value.value.u32 = 0xfedcba98;
+        break;
+    case NEU_TYPE_INT64:
+        value.value.i64 = -1234567890123;
+        break;
+    case NEU_TYPE_UINT64:
+        value.value.u64 = 0xfedcba9876543210;
+        break;
+    case NEU_TYPE_FLOAT:
+        value.value.f32 = 1.25;
+        value.precision = 2;
+        break;
+    case NEU_TYPE_DOUBLE:
+        value.value.d64 = -3.125;
+        value.precision = 3;
+        break;
+    case NEU_TYPE_BIT:
+        value.value.u8 = 1;
+        break;
+    case NEU_TYPE_BOOL:
+        value.value.boolean = true;
+        break;
+    case NEU_TYPE_STRING:
+        strcpy(value.value.str, "hello");
+        break;
+    case NEU_TYPE_BYTES:
+        for (int i = 0; i < NEU_VALUE_SIZE; i++) {
+            value.value.bytes[i] = i;
+        }
+        break;
+    }
+
+    return value;
+}
+
+static void expect_dvalue(neu_dvalue_t *expect, neu_dvalue_t *value)
+{
+    EXPECT_EQ(expect->type, value->type);
+    EXPECT_EQ(expect->precision, value->precision);
+
+    switch (expect->type) {
+    case NEU_TYPE_STRING:
+        EXPECT_STREQ(expect->value.str, value->value.str);
+        break;
+    case NEU_TYPE_BYTES:
+        EXPECT_EQ(0,
+                  memcmp(expect->value.bytes, value->value.bytes,
+                         NEU_VALUE_SIZE));
+        break;
+    case NEU_TYPE_INT64:
+    case NEU_TYPE_UINT64:
+    case NEU_TYPE_DOUBLE:
+        EXPECT_EQ(expect->value.u64, value->value.u64);
+        break;
+    case NEU_TYPE_INT32:
+    case NEU_TYPE_UINT32:
+    case NEU_TYPE_FLOAT:
+    case NEU_TYPE_ERROR:
+        EXPECT_EQ(expect->value.u32, value->value.u32);
+        break;
+    case NEU_TYPE_INT16:
+    case NEU_TYPE_UINT16:
+        EXPECT_EQ(expect->value.u16, value->value.u16);
+        break;
+    default:
+        EXPECT_EQ(expect->value.u8, value->value.u8);
+        break;
+    }
+}
+
+TEST(TransDataTest, RoundTrip)
+{
+    for (int type = NEU_TYPE_INT8; type <= NEU_TYPE_ERROR; type++) {
+        for (int with_ts = 0; with_ts < 2; with_ts++) {
+            SCOPED_TRACE(neu_type_string((neu_type_e) type));
+            neu_dvalue_t expect    = dvalue((neu_type_e) type);
+            neu_dvalue_t value     = { .type = NEU_TYPE_INT8 };
+            int64_t      ts        = 1650000000123;
+            int64_t      timestamp = -1;
+            uint16_t     slot      = 0;
+            uint8_t      buf[256]  = { 0 };
+
+            int n = neu_trans_data_pack(NULL, 0, 513, &expect,
+                                        with_ts ? &ts : NULL);
+            ASSERT_GT(n, 0);
+            EXPECT_EQ(n,
+                      neu_trans_data_pack(buf, n, 513, &expect,
+                                          with_ts ? &ts : NULL));
+            EXPECT_EQ(-1,
+                      neu_trans_data_pack(buf, n - 1, 513, &expect,
+                                          with_ts ? &ts : NULL));
+
+            EXPECT_EQ(n, neu_trans_data_unpack(buf, n, &slot, &value,
+                                               &timestamp));
+            EXPECT_EQ(513, slot);
+            EXPECT_EQ(with_ts ? ts : 0, timestamp);
+            expect_dvalue(&expect, &value);
+        }
+    }
+}
+
+TEST(TransDataTest, StringSize)
+{
+    neu_dvalue_t value = { .type = NEU_TYPE_STRING };
+    neu_dvalue_t out   = { .type = NEU_TYPE_INT8 };
+    uint16_t     slot  = 0;
+    int64_t      ts    = 0;
+    uint8_t      buf[256];
+
+    EXPECT_EQ(2 + 1 + 1, neu_trans_data_pack(NULL, 0, 0, &value, NULL));
+
+    memset(value.value.str, 'a', NEU_VALUE_SIZE);
+    int n = neu_trans_data_pack(buf, sizeof(buf), 0, &value, NULL);
+    EXPECT_EQ(2 + 1 + 1 + NEU_VALUE_SIZE - 1, n);
+    EXPECT_EQ(n, neu_trans_data_unpack(buf, n, &slot, &out, &ts));
+    EXPECT_EQ(NEU_VALUE_SIZE - 1, (int) strlen(out.value.str));
+}
+
+TEST(TransDataTest, Truncated)
+{
+    for (int type = NEU_TYPE_INT8; type <= NEU_TYPE_ERROR; type++) {
+        SCOPED_TRACE(neu_type_string((neu_type_e) type));
+        neu_dvalue_t expect    = dvalue((neu_type_e) type);
+        neu_dvalue_t value     = { .type = NEU_TYPE_INT8 };
+        int64_t      ts        = 1650000000123;
+        int64_t      timestamp = 0;
+        uint16_t     slot      = 0;
+        uint8_t      buf[256]  = { 0 };
+
+        int n = neu_trans_data_pack(buf, sizeof(buf), 1, &expect, &ts);
+        ASSERT_GT(n, 0);
+        for (int i = 0; i < n; i++) {
+            EXPECT_EQ(-1,
+                      neu_trans_data_unpack(buf, i, &slot, &value,
+                                            &timestamp));
+        }
+    }
+}
+
+TEST(TransDataTest, Corrupt)
+{
+    neu_dvalue_t value     = dvalue(NEU_TYPE_STRING);
+    int64_t      timestamp = 0;
+    uint16_t     slot      = 0;
+    uint8_t      buf[512]  = { 0 };
+
+    int n = neu_trans_data_pack(buf, sizeof(buf), 1, &value, NULL);
+    ASSERT_GT(n, 0);
+
+    // unknown type
+    buf[2] = 0x7f;
+    EXPECT_EQ(-1,
+              neu_trans_data_unpack(buf, sizeof(buf), &slot, &value,
+                                    &timestamp));
+    buf[2] = 0;
+    EXPECT_EQ(-1,
+              neu_trans_data_unpack(buf, sizeof(buf), &slot, &value,
+                                    &timestamp));
+
+    // string longer than the value can hold
+    buf[2] = NEU_TYPE_STRING;
+    buf[3] = NEU_VALUE_SIZE;
+    EXPECT_EQ(-1,
+              neu_trans_data_unpack(buf, sizeof(buf), &slot, &value,
+                                    &timestamp));
+    buf[3] = 0xff;
+    EXPECT_EQ(-1,
+              neu_trans_data_unpack(buf, sizeof(buf), &slot, &value,
+                                    &timestamp));
+
+    // value not packable
+    value.type = (neu_type_e) 0;
+    EXPECT_EQ(-1, neu_trans_data_pack(NULL, 0, 1, &value, NULL));
+}
+
+static neu_reqresp_trans_data_packed_t *pack(neu_dvalue_t *values,
+                                             uint16_t *slots, int n)
+{
+    neu_reqresp_trans_data_packed_t *packed =
+        (neu_reqresp_trans_data_packed_t *) calloc(
+            1, sizeof(neu_reqresp_trans_data_packed_t) + 1024);
+
+    strcpy(packed->driver, "modbus");
+    strcpy(packed->group, "grp");
+    for (int i = 0; i < n; i++) {
+        int ret = neu_trans_data_pack(packed->data + packed->size,
+                                      1024 - packed->size, slots[i],
+                                      &values[i], NULL);
+        EXPECT_GT(ret, 0);
+        packed->size += ret;
+        packed->n_tag += 1;
+    }
+
+    return packed;
+}
+
+static neu_reqresp_trans_data_t *trans_data(int n)
+{
+    return (neu_reqresp_trans_data_t *) calloc(
+        1, sizeof(neu_reqresp_trans_data_t) + n * sizeof(neu_resp_tag_value_t));
+}
+
+TEST(TransDataTest, Decode)
+{
+    UT_array *   names     = NULL;
+    const char * tags[]    = { "tag0", "tag1", "tag2" };
+    neu_dvalue_t values[3] = { dvalue(NEU_TYPE_INT16), dvalue(NEU_TYPE_STRING),
+                               dvalue(NEU_TYPE_DOUBLE) };
+    uint16_t     slots[3]  = { 2, 0, 1 };
+
+    utarray_new(names, &ut_str_icd);
+    for (int i = 0; i < 3; i++) {
+        utarray_push_back(names, &tags[i]);
+    }
+
+    neu_reqresp_trans_data_packed_t *packed = pack(values, slots, 3);
+    neu_reqresp_trans_data_t *       data   = trans_data(3);
+
+    EXPECT_EQ(0, neu_trans_data_decode(packed, names, data));
+    EXPECT_STREQ("modbus", data->driver);
+    EXPECT_STREQ("grp", data->group);
+    EXPECT_EQ(3, data->n_tag);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_STREQ(tags[slots[i]], data->tags[i].tag);
+        expect_dvalue(&values[i], &data->tags[i].value);
+    }
+
+    // truncated
+    packed->size -= 1;
+    EXPECT_EQ(-1, neu_trans_data_decode(packed, names, data));
+    EXPECT_EQ(2, data->n_tag);
+
+    free(packed);
+    free(data);
+    utarray_free(names);
+}
+
+TEST(TransDataTest, DecodeBadSlot)
+{
+    UT_array *   names    = NULL;
+    const char * tag      = "tag0";
+    neu_dvalue_t values[] = { dvalue(NEU_TYPE_INT32), dvalue(NEU_TYPE_BOOL) };
+    uint16_t     slots[]  = { 0, 1 };
+
+    utarray_new(names, &ut_str_icd);
+    utarray_push_back(names, &tag);
+
+    neu_reqresp_trans_data_packed_t *packed = pack(values, slots, 2);
+    neu_reqresp_trans_data_t *       data   = trans_data(2);
+
+    EXPECT_EQ(-1, neu_trans_data_decode(packed, names, data));
+    EXPECT_EQ(1, data->n_tag);
+    EXPECT_STREQ("tag0", data->tags[0].tag);
+
+    free(packed);
+    free(data);
+    utarray_free(names);
+}